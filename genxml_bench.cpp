@@ -0,0 +1,323 @@
+// genxml-bench: repeatable benchmarks of the load, save, lookup and per-frame
+// UI build hot paths. The UI is driven through a null ImGui backend: frames are
+// built and finalized but never rasterized, so no window or GPU is needed.
+//
+// usage: genxml-bench [--iterations N] [--label NAME] [--json out.json]
+//                     [--synthetic SCALE] [--require-alloc-free] file.xml...
+//
+// --synthetic generates a document with genxml-gen's default shape times
+// SCALE from a fixed seed, so runs on different machines see the same input.
+//
+// In a GENXML_COUNTING_ALLOCATOR build every benchmark also reports its heap
+// allocations per iteration, ImGui's included. --require-alloc-free fails the
+// run when a steady-state UI frame (ui_frame_*) allocates at all.
+#include "imgui.h"
+#include "xml_alloc_counter.h"
+#include "xml_frame_arena.h"
+#include "xml_generator.h"
+#include "xml_hash.h"
+#include "xml_parser.h"
+#include "xml_saver.h"
+#include "xml_types.h"
+#include "xml_viewer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct BenchResult {
+  std::string name;
+  std::string input;
+  size_t iterations;
+  double medianSeconds;
+  double minSeconds;
+  // Work done by one iteration, used for the throughput columns.
+  uint64_t bytes;
+  uint64_t elements;
+  // Mean heap allocations of one iteration, only counted in a
+  // GENXML_COUNTING_ALLOCATOR build.
+  double allocations;
+};
+
+template <typename Func>
+static BenchResult RunBench(const std::string &name, const std::string &input,
+                            size_t iterations, uint64_t bytes,
+                            uint64_t elements, Func &&func) {
+  using Clock = std::chrono::steady_clock;
+  func(); // warm up caches and allocator pools
+  std::vector<double> samples;
+  samples.reserve(iterations);
+  XMLAllocStats allocBefore = GetAllocStats();
+  for (size_t i = 0; i < iterations; ++i) {
+    auto begin = Clock::now();
+    func();
+    auto end = Clock::now();
+    samples.push_back(std::chrono::duration<double>(end - begin).count());
+  }
+  XMLAllocStats allocs = AllocStatsDelta(allocBefore, GetAllocStats());
+  std::sort(samples.begin(), samples.end());
+  return BenchResult{name,
+                     input,
+                     iterations,
+                     samples[samples.size() / 2],
+                     samples.front(),
+                     bytes,
+                     elements,
+                     static_cast<double>(allocs.allocations) / iterations};
+}
+
+static uint64_t CountElements(const XMLDocData &doc) {
+  uint64_t count = 0;
+  for (const auto &enumData : doc.enumerates) {
+    count += 1 + enumData.values.size();
+  }
+  for (const auto &structData : doc.structures) {
+    count += 1;
+    for (const auto &field : structData.fields) {
+      count += 1 + (field.choices ? field.choices->size() : 0);
+    }
+  }
+  return count;
+}
+
+static void InitHeadlessImGui() {
+  if (IsAllocCounterEnabled())
+    ImGui::SetAllocatorFunctions(CountedMalloc, CountedFree);
+  ImGui::CreateContext();
+  ImGuiIO &io = ImGui::GetIO();
+  io.IniFilename = nullptr;
+  io.LogFilename = nullptr;
+  io.DisplaySize = ImVec2(1920.0f, 1080.0f);
+  io.DeltaTime = 1.0f / 60.0f;
+  // The null backend never uploads the atlas, it only has to be built.
+  unsigned char *pixels = nullptr;
+  int width = 0, height = 0;
+  io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+}
+
+static void RenderHeadlessFrame(XMLViewer &viewer) {
+  GetFrameArena().Reset();
+  ImGui::NewFrame();
+  viewer.Render();
+  ImGui::Render();
+}
+
+static void BenchFile(const std::string &file, size_t iterations,
+                      std::vector<BenchResult> &results) {
+  XMLParserContext context(file);
+  if (!context.init()) {
+    std::fprintf(stderr, "Skip '%s': failed to load.\n", file.c_str());
+    return;
+  }
+  const XMLDocData &doc = context.GetDoc();
+  const uint64_t fileBytes = std::filesystem::file_size(file);
+  const uint64_t elements = CountElements(doc);
+
+  results.push_back(RunBench("load", file, iterations, fileBytes, elements,
+                             [&file]() {
+                               XMLParserContext ctx(file);
+                               ctx.init();
+                             }));
+  // Time to first frame in the editor: header scan only.
+  results.push_back(RunBench("load_lazy", file, iterations, fileBytes, elements,
+                             [&file]() {
+                               XMLParserContext ctx(file);
+                               ctx.init(XMLLoadMode::Lazy);
+                             }));
+
+  XMLDocData scratch = doc;
+  results.push_back(RunBench("rehash", file, iterations, 0, elements,
+                             [&scratch]() { RehashDoc(scratch); }));
+
+  const std::string savePath =
+      (std::filesystem::temp_directory_path() / "genxml-bench-save.xml")
+          .string();
+  SaveToFile(doc, savePath.c_str());
+  const uint64_t savedBytes = std::filesystem::file_size(savePath);
+  results.push_back(RunBench("save", file, iterations, savedBytes, elements,
+                             [&doc, &savePath]() {
+                               SaveToFile(doc, savePath.c_str());
+                             }));
+  std::filesystem::remove(savePath);
+
+  // Resolve every struct by name, the way type references are looked up.
+  volatile size_t sink = 0;
+  results.push_back(RunBench(
+      "lookup_struct_by_name", file, iterations, 0, doc.structures.size(),
+      [&doc, &sink]() {
+        for (const auto &wanted : doc.structures) {
+          for (size_t i = 0; i < doc.structures.size(); ++i) {
+            if (doc.structures[i].name == wanted.name) {
+              sink = sink + i;
+              break;
+            }
+          }
+        }
+      }));
+
+  XMLViewer viewer(file);
+  if (!viewer.WaitForLoading()) {
+    std::fprintf(stderr, "Skip UI benchmarks of '%s'.\n", file.c_str());
+    return;
+  }
+  // The viewer loads lazily in the background; commit every body up front so
+  // no commit work or allocation lands in the measured frames.
+  viewer.EnsureAllLoaded();
+  // A few frames for windows to settle and the caches to fill, the
+  // measured frames are the steady state.
+  constexpr int kWarmUpFrames = 4;
+  for (int i = 0; i < kWarmUpFrames; ++i)
+    RenderHeadlessFrame(viewer);
+  results.push_back(RunBench("ui_frame_collapsed", file, iterations, 0,
+                             elements,
+                             [&viewer]() { RenderHeadlessFrame(viewer); }));
+  viewer.SetExpandAll(true);
+  for (int i = 0; i < kWarmUpFrames; ++i)
+    RenderHeadlessFrame(viewer);
+  results.push_back(RunBench("ui_frame_expanded", file, iterations, 0,
+                             elements,
+                             [&viewer]() { RenderHeadlessFrame(viewer); }));
+}
+
+static void PrintTable(const std::vector<BenchResult> &results) {
+  std::printf("%-24s %12s %12s %12s %14s %12s  %s\n", "benchmark",
+              "median(ms)", "min(ms)", "MB/s", "elements/s", "allocs/iter",
+              "input");
+  for (const auto &r : results) {
+    double mbps = r.bytes ? r.bytes / r.medianSeconds / 1e6 : 0.0;
+    double eps = r.elements ? r.elements / r.medianSeconds : 0.0;
+    char allocs[32] = "-";
+    if (IsAllocCounterEnabled())
+      std::snprintf(allocs, sizeof(allocs), "%.1f", r.allocations);
+    std::printf("%-24s %12.3f %12.3f %12.2f %14.0f %12s  %s\n",
+                r.name.c_str(), r.medianSeconds * 1e3, r.minSeconds * 1e3,
+                mbps, eps, allocs, r.input.c_str());
+  }
+}
+
+static std::string JsonEscape(const std::string &str) {
+  std::string out;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+static bool WriteJson(const std::vector<BenchResult> &results,
+                      const std::string &label, const char *path) {
+  FILE *fp = std::fopen(path, "w");
+  if (!fp) {
+    std::fprintf(stderr, "Error: open '%s' failed.\n", path);
+    return false;
+  }
+  std::fprintf(fp, "{\n  \"label\": \"%s\",\n  \"results\": [\n",
+               JsonEscape(label).c_str());
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult &r = results[i];
+    char allocs[32] = "null";
+    if (IsAllocCounterEnabled())
+      std::snprintf(allocs, sizeof(allocs), "%.3f", r.allocations);
+    std::fprintf(fp,
+                 "    {\"name\": \"%s\", \"input\": \"%s\", "
+                 "\"iterations\": %zu, \"median_ns\": %.0f, \"min_ns\": %.0f, "
+                 "\"bytes\": %llu, \"elements\": %llu, "
+                 "\"mb_per_s\": %.3f, \"elements_per_s\": %.0f, "
+                 "\"allocations_per_iteration\": %s}%s\n",
+                 JsonEscape(r.name).c_str(), JsonEscape(r.input).c_str(),
+                 r.iterations, r.medianSeconds * 1e9, r.minSeconds * 1e9,
+                 (unsigned long long)r.bytes, (unsigned long long)r.elements,
+                 r.bytes ? r.bytes / r.medianSeconds / 1e6 : 0.0,
+                 r.elements ? r.elements / r.medianSeconds : 0.0,
+                 allocs, i + 1 == results.size() ? "" : ",");
+  }
+  std::fprintf(fp, "  ]\n}\n");
+  std::fclose(fp);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  size_t iterations = 10;
+  std::string label;
+  const char *jsonPath = nullptr;
+  bool isAllocFreeRequired = false;
+  std::vector<std::string> files;
+  std::vector<std::string> generatedFiles;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--iterations") && i + 1 < argc) {
+      iterations = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--label") && i + 1 < argc) {
+      label = argv[++i];
+    } else if (!std::strcmp(argv[i], "--json") && i + 1 < argc) {
+      jsonPath = argv[++i];
+    } else if (!std::strcmp(argv[i], "--require-alloc-free")) {
+      isAllocFreeRequired = true;
+    } else if (!std::strcmp(argv[i], "--synthetic") && i + 1 < argc) {
+      uint32_t scale = std::max(1, std::atoi(argv[++i]));
+      XMLGeneratorOptions options;
+      options.structCount *= scale;
+      options.enumCount *= scale;
+      std::string path = (std::filesystem::temp_directory_path() /
+                          ("genxml-bench-synthetic-x" +
+                           std::to_string(scale) + ".xml"))
+                             .string();
+      if (!GenerateSyntheticDoc(options, path.c_str())) {
+        return 1;
+      }
+      files.push_back(path);
+      generatedFiles.push_back(path);
+    } else {
+      files.emplace_back(argv[i]);
+    }
+  }
+  if (isAllocFreeRequired && !IsAllocCounterEnabled()) {
+    std::fprintf(stderr, "Error: --require-alloc-free needs a build with "
+                         "-DGENXML_COUNTING_ALLOCATOR=ON.\n");
+    return 1;
+  }
+  if (files.empty()) {
+    std::fprintf(stderr, "usage: %s [--iterations N] [--label NAME] "
+                         "[--json out.json] [--synthetic SCALE] "
+                         "[--require-alloc-free] file.xml...\n",
+                 argv[0]);
+    return 1;
+  }
+
+  InitHeadlessImGui();
+  std::vector<BenchResult> results;
+  for (const auto &file : files) {
+    BenchFile(file, iterations, results);
+  }
+  ImGui::DestroyContext();
+  for (const auto &path : generatedFiles) {
+    std::filesystem::remove(path);
+  }
+
+  PrintTable(results);
+  if (jsonPath && !WriteJson(results, label, jsonPath)) {
+    return 1;
+  }
+  bool isAllocFree = true;
+  for (const auto &r : results) {
+    if (isAllocFreeRequired && r.name.rfind("ui_frame_", 0) == 0 &&
+        r.allocations > 0.0) {
+      std::fprintf(stderr, "%s allocates %.1f times per frame on '%s'.\n",
+                   r.name.c_str(), r.allocations, r.input.c_str());
+      isAllocFree = false;
+    }
+  }
+  return results.empty() || !isAllocFree ? 1 : 0;
+}
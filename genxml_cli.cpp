@@ -0,0 +1,387 @@
+// genxml-cli: headless access to genxml documents.
+//
+// usage: genxml-cli <command> [args...]
+//   query <file.xml> <query>    run a query (see xml_query.h) and print hits
+//   mem [--compact] <file.xml>  print heap usage of the loaded document
+//   decode <file.xml> <struct> <dword>...
+//                               decode raw dwords as the named struct
+//   mmio <file.xml> [<dump>]    decode "address value" lines of an MMIO dump
+//                               (stdin by default) by register address
+//   search [-i] [-r] <file.xml> <text>
+//                               search names and info text
+//   export [-f xml|json|binary] [-j N] <out-dir> <file.xml>...
+//                               convert documents, in parallel
+#include "xml_alloc_counter.h"
+#include "xml_decoder.h"
+#include "xml_exporter.h"
+#include "xml_memstats.h"
+#include "xml_parser.h"
+#include "xml_query.h"
+#include "xml_search.h"
+#include "xml_types.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+static bool LoadDocument(XMLParserContext &context) {
+  bool loaded = context.init();
+  PrintDiagnostics(context.GetDiagnostics(), context.filename.c_str(),
+                   stderr);
+  if (!loaded) {
+    std::fprintf(stderr, "Error: load '%s' failed.\n",
+                 context.filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+static int QueryCommand(int argc, char **argv) {
+  if (argc != 2) {
+    std::fprintf(stderr, "usage: genxml-cli query <file.xml> <query>\n");
+    return 1;
+  }
+  XMLParserContext context(argv[0]);
+  if (!LoadDocument(context))
+    return 1;
+
+  XMLQuery query;
+  std::string error;
+  if (!query.Compile(argv[1], error)) {
+    std::fprintf(stderr, "Error: %s\n", error.c_str());
+    return 1;
+  }
+  std::vector<XMLQueryHit> hits;
+  const XMLDocData &doc = context.GetDoc();
+  query.Evaluate(doc, context.GetIndex(), hits);
+  for (const auto &hit : hits) {
+    char detail[128];
+    QueryHitDetail(doc, hit, detail, sizeof(detail));
+    const std::string &parent = QueryHitParentName(doc, hit);
+    std::printf("%s\t%s%s%s\t%s\n", QueryKindName(hit.kind),
+                parent.c_str(), parent.empty() ? "" : "::",
+                QueryHitName(doc, hit).c_str(), detail);
+  }
+  std::fprintf(stderr, "%zu result(s)\n", hits.size());
+  return 0;
+}
+
+static int MemCommand(int argc, char **argv) {
+  bool compact = argc == 2 && !std::strcmp(argv[0], "--compact");
+  if (argc != 1 && !compact) {
+    std::fprintf(stderr, "usage: genxml-cli mem [--compact] <file.xml>\n");
+    return 1;
+  }
+  XMLParserContext context(argv[argc - 1]);
+  if (!LoadDocument(context))
+    return 1;
+  if (compact)
+    context.Compact();
+
+  XMLMemReport report;
+  context.BuildMemoryReport(report);
+  std::printf("%-10s %14s %12s %12s\n", "category", "bytes", "allocations",
+              "objects");
+  auto printBucket = [](const char *name, const XMLMemBucket &bucket) {
+    std::printf("%-10s %14llu %12llu %12llu\n", name,
+                static_cast<unsigned long long>(bucket.bytes),
+                static_cast<unsigned long long>(bucket.allocations),
+                static_cast<unsigned long long>(bucket.objects));
+  };
+  for (size_t c = 0; c < static_cast<size_t>(XMLMemCategory::Count); ++c) {
+    printBucket(MemCategoryName(static_cast<XMLMemCategory>(c)),
+                report.buckets[c]);
+  }
+  printBucket("total", report.Total());
+  if (IsAllocCounterEnabled()) {
+    std::printf("load: %llu allocations, %llu bytes allocated, %llu frees\n",
+                static_cast<unsigned long long>(report.loadAllocs.allocations),
+                static_cast<unsigned long long>(
+                    report.loadAllocs.bytesAllocated),
+                static_cast<unsigned long long>(report.loadAllocs.frees));
+  }
+  return 0;
+}
+
+// One "name<TAB>text" line per field, grouped fields as "name[repeat]".
+static void PrintDecodedFields(const XMLStructData &structData,
+                               const std::vector<XMLDecodedField> &fields,
+                               const char *indent) {
+  for (const auto &field : fields) {
+    const XMLFieldData &fieldData = structData.fields[field.fieldIndex];
+    if (fieldData.group == XMLGroupData::kNoGroup) {
+      std::printf("%s%s\t%s\n", indent, fieldData.name.c_str(),
+                  field.text.c_str());
+    } else {
+      std::printf("%s%s[%u]\t%s\n", indent, fieldData.name.c_str(),
+                  field.repeat, field.text.c_str());
+    }
+  }
+}
+
+static int DecodeCommand(int argc, char **argv) {
+  if (argc < 3) {
+    std::fprintf(stderr,
+                 "usage: genxml-cli decode <file.xml> <struct> <dword>...\n");
+    return 1;
+  }
+  XMLParserContext context(argv[0]);
+  if (!LoadDocument(context))
+    return 1;
+
+  const XMLDocData &doc = context.GetDoc();
+  uint32_t structIndex = 0;
+  while (structIndex < doc.structures.size() &&
+         doc.structures[structIndex].name != argv[1])
+    ++structIndex;
+  if (structIndex == doc.structures.size()) {
+    std::fprintf(stderr, "Error: no struct named '%s'.\n", argv[1]);
+    return 1;
+  }
+  std::vector<uint32_t> dwords;
+  for (int i = 2; i < argc; ++i) {
+    dwords.push_back(static_cast<uint32_t>(std::strtoul(argv[i], nullptr, 0)));
+  }
+
+  XMLDecoder decoder(doc, context.GetTypeGraph());
+  std::vector<XMLDecodedField> fields;
+  decoder.DecodeStruct(structIndex, dwords.data(), dwords.size(), fields);
+  PrintDecodedFields(doc.structures[structIndex], fields, "");
+  return 0;
+}
+
+static int MmioCommand(int argc, char **argv) {
+  if (argc < 1 || argc > 2) {
+    std::fprintf(stderr, "usage: genxml-cli mmio <file.xml> [<dump>]\n");
+    return 1;
+  }
+  FILE *in = argc == 2 ? std::fopen(argv[1], "r") : stdin;
+  if (!in) {
+    std::fprintf(stderr, "Error: open '%s' failed.\n", argv[1]);
+    return 1;
+  }
+  // Dword values by address; registers are decoded in the order the dump
+  // first touches them.
+  std::map<uint64_t, uint32_t> values;
+  std::vector<uint64_t> order;
+  char line[256];
+  while (std::fgets(line, sizeof(line), in)) {
+    char *end = nullptr;
+    uint64_t address = std::strtoull(line, &end, 0);
+    if (end == line)
+      continue;
+    char *valueEnd = nullptr;
+    uint64_t value = std::strtoull(end, &valueEnd, 0);
+    if (valueEnd == end)
+      continue;
+    if (values.emplace(address, static_cast<uint32_t>(value)).second)
+      order.push_back(address);
+  }
+  if (in != stdin)
+    std::fclose(in);
+
+  XMLParserContext context(argv[0]);
+  if (!LoadDocument(context))
+    return 1;
+  const XMLDocData &doc = context.GetDoc();
+  XMLDecoder decoder(doc, context.GetTypeGraph());
+  std::vector<bool> isDecoded(doc.structures.size());
+  std::vector<uint32_t> dwords;
+  std::vector<XMLDecodedField> fields;
+  size_t unknown = 0;
+  for (uint64_t address : order) {
+    uint32_t structIndex;
+    if (!context.GetIndex().FindRegister(doc, address, structIndex)) {
+      std::printf("0x%llx\t0x%08x\t(no register)\n",
+                  static_cast<unsigned long long>(address), values[address]);
+      ++unknown;
+      continue;
+    }
+    if (isDecoded[structIndex])
+      continue;
+    isDecoded[structIndex] = true;
+    // Dwords of a multi-dword register the dump lacks read as zero.
+    const XMLStructData &reg = doc.structures[structIndex];
+    uint64_t base = *reg.address;
+    dwords.assign(std::max(reg.length, 1u), 0);
+    for (uint32_t d = 0; d < dwords.size(); ++d) {
+      auto it = values.find(base + uint64_t(d) * 4);
+      if (it != values.end())
+        dwords[d] = it->second;
+    }
+    std::printf("%s (0x%llx)\n", reg.name.c_str(),
+                static_cast<unsigned long long>(base));
+    decoder.DecodeStruct(structIndex, dwords.data(), dwords.size(), fields);
+    PrintDecodedFields(reg, fields, "\t");
+  }
+  if (unknown)
+    std::fprintf(stderr, "%zu address(es) match no register\n", unknown);
+  return 0;
+}
+
+static int SearchCommand(int argc, char **argv) {
+  XMLSearchOptions options;
+  options.caseSensitive = true;
+  for (; argc > 2 && argv[0][0] == '-'; --argc, ++argv) {
+    if (!std::strcmp(argv[0], "-i")) {
+      options.caseSensitive = false;
+    } else if (!std::strcmp(argv[0], "-r")) {
+      options.regex = true;
+    } else {
+      break;
+    }
+  }
+  if (argc != 2) {
+    std::fprintf(stderr,
+                 "usage: genxml-cli search [-i] [-r] <file.xml> <text>\n");
+    return 1;
+  }
+  XMLParserContext context(argv[0]);
+  if (!LoadDocument(context))
+    return 1;
+
+  const XMLDocData &doc = context.GetDoc();
+  auto corpus = std::make_shared<XMLSearchCorpus>();
+  corpus->Build(doc);
+  XMLTextSearch search;
+  std::string error;
+  if (!search.Start(corpus, argv[1], options, error)) {
+    std::fprintf(stderr, "Error: %s\n", error.c_str());
+    return 1;
+  }
+  std::vector<XMLSearchHit> hits;
+  while (search.Poll(hits)) {
+    std::this_thread::yield();
+  }
+  for (const auto &hit : hits) {
+    const XMLSearchCorpus::Entry &entry = corpus->Entries()[hit.entry];
+    const std::string &parent = QueryHitParentName(doc, entry.target);
+    std::string_view text = corpus->Text(entry);
+    std::printf("%s\t%s%s%s\t%.*s\n", QueryKindName(entry.target.kind),
+                parent.c_str(), parent.empty() ? "" : "::",
+                QueryHitName(doc, entry.target).c_str(),
+                static_cast<int>(text.size()), text.data());
+  }
+  std::fprintf(stderr, "%zu hit(s)\n", hits.size());
+  return 0;
+}
+
+static int ExportCommand(int argc, char **argv) {
+  XMLExportFormat format = XMLExportFormat::Json;
+  unsigned threadCount = 0;
+  for (; argc > 2 && argv[0][0] == '-'; argc -= 2, argv += 2) {
+    if (!std::strcmp(argv[0], "-f") && ParseExportFormat(argv[1], format)) {
+      continue;
+    } else if (!std::strcmp(argv[0], "-j")) {
+      threadCount = static_cast<unsigned>(std::strtoul(argv[1], nullptr, 0));
+    } else {
+      argc = 0;
+      break;
+    }
+  }
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: genxml-cli export [-f xml|json|binary] [-j N] "
+                         "<out-dir> <file.xml>...\n");
+    return 1;
+  }
+  std::filesystem::path outDir(argv[0]);
+  std::vector<std::unique_ptr<XMLParserContext>> contexts;
+  std::vector<std::string> outFiles;
+  std::map<std::string, const char *> inputOf;
+  for (int i = 1; i < argc; ++i) {
+    std::filesystem::path file =
+        outDir / std::filesystem::path(argv[i]).filename().replace_extension(
+                     ExportFormatExtension(format));
+    auto inserted = inputOf.emplace(file.string(), argv[i]);
+    if (!inserted.second) {
+      std::fprintf(stderr, "%s and %s would both write %s\n",
+                   inserted.first->second, argv[i], file.string().c_str());
+      return 1;
+    }
+    contexts.push_back(std::make_unique<XMLParserContext>(argv[i]));
+    outFiles.push_back(file.string());
+  }
+
+  // Load on up to threadCount threads, like ExportDocs below.
+  if (threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  threadCount = std::min<unsigned>(threadCount, contexts.size());
+  std::vector<uint8_t> loaded(contexts.size(), 0);
+  std::atomic<size_t> next{0};
+  auto load = [&contexts, &loaded, &next]() {
+    for (size_t i; (i = next.fetch_add(1)) < contexts.size();)
+      loaded[i] = LoadDocument(*contexts[i]);
+  };
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < threadCount; ++t)
+    threads.emplace_back(load);
+  load();
+  for (auto &thread : threads)
+    thread.join();
+
+  std::vector<XMLExportJob> jobs;
+  bool ok = true;
+  for (size_t i = 0; i < contexts.size(); ++i) {
+    if (!loaded[i]) {
+      ok = false;
+      continue;
+    }
+    jobs.push_back({&contexts[i]->GetDoc(), format, outFiles[i]});
+  }
+  ok &= ExportDocs(jobs, threadCount);
+  for (const auto &job : jobs) {
+    std::fprintf(stderr, "%s %s\n", job.ok ? "wrote" : "FAILED",
+                 job.file.c_str());
+  }
+  return ok ? 0 : 1;
+}
+
+struct CliCommand {
+  const char *name;
+  const char *help;
+  int (*run)(int argc, char **argv);
+};
+
+static const CliCommand kCommands[] = {
+    {"query", "<file.xml> <query>  run a query and print the hits",
+     QueryCommand},
+    {"mem", "[--compact] <file.xml>  print heap usage by category",
+     MemCommand},
+    {"decode", "<file.xml> <struct> <dword>...  decode raw dwords",
+     DecodeCommand},
+    {"mmio", "<file.xml> [<dump>]  decode an MMIO dump by register address",
+     MmioCommand},
+    {"search", "[-i] [-r] <file.xml> <text>  search names and info text",
+     SearchCommand},
+    {"export",
+     "[-f xml|json|binary] [-j N] <out-dir> <file.xml>...  convert documents",
+     ExportCommand},
+};
+
+static void PrintUsage() {
+  std::fprintf(stderr, "usage: genxml-cli <command> [args...]\n");
+  for (const auto &command : kCommands) {
+    std::fprintf(stderr, "  %s %s\n", command.name, command.help);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    PrintUsage();
+    return 1;
+  }
+  for (const auto &command : kCommands) {
+    if (!std::strcmp(argv[1], command.name)) {
+      return command.run(argc - 2, argv + 2);
+    }
+  }
+  PrintUsage();
+  return 1;
+}
@@ -0,0 +1,525 @@
+// genxml-daemon: keeps genxml definitions loaded and serves lookup and decode
+// batches over a Unix domain socket, see xml_decode_protocol.h.
+//
+// usage: genxml-daemon [--threads N] <socket-path> <file.xml>...
+//
+// The definitions are reloaded when one of the files changes on disk;
+// requests in flight finish against the definitions they started with.
+#include "xml_decode_protocol.h"
+#include "xml_decoder.h"
+#include "xml_parser.h"
+#include "xml_types.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static volatile std::sig_atomic_t gStop = 0;
+
+static void OnStopSignal(int) { gStop = 1; }
+
+// One immutable snapshot of the loaded documents.
+struct Definitions {
+  struct Location {
+    uint32_t document;
+    uint32_t structIndex;
+  };
+  uint32_t generation = 0;
+  std::vector<std::unique_ptr<XMLParserContext>> documents;
+  // First definition of a name wins, in command line order.
+  std::unordered_map<std::string, Location> structsByName;
+};
+
+static std::shared_ptr<const Definitions>
+LoadDefinitions(const std::vector<std::string> &files, uint32_t generation) {
+  auto definitions = std::make_shared<Definitions>();
+  definitions->generation = generation;
+  for (const std::string &file : files) {
+    auto context = std::make_unique<XMLParserContext>(file);
+    if (!context->init()) {
+      PrintDiagnostics(context->GetDiagnostics(), file.c_str(), stderr);
+      std::fprintf(stderr, "Error: load '%s' failed.\n", file.c_str());
+      return nullptr;
+    }
+    uint32_t document = static_cast<uint32_t>(definitions->documents.size());
+    const XMLDocData &doc = context->GetDoc();
+    for (uint32_t s = 0; s < doc.structures.size(); ++s) {
+      definitions->structsByName.emplace(doc.structures[s].name,
+                                         Definitions::Location{document, s});
+    }
+    definitions->documents.emplace_back(std::move(context));
+  }
+  return definitions;
+}
+
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t threads) {
+    for (size_t i = 0; i < threads; ++i)
+      workers.emplace_back([this]() { Run(); });
+  }
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      isStopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+      worker.join();
+  }
+  void Submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+  }
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool isStopping = false;
+
+  void Run() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return isStopping || !tasks.empty(); });
+        if (tasks.empty())
+          return;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      task();
+    }
+  }
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Time a client gets to send a whole request frame or to take a whole reply.
+// The socket timeouts only bound single reads and writes, a client trickling
+// a byte at a time would pass them forever.
+constexpr std::chrono::seconds kFrameTimeout(5);
+
+// Wait until 'fd' is ready for 'events', false once 'deadline' passed.
+static bool WaitReady(int fd, short events, Clock::time_point deadline) {
+  for (;;) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - Clock::now());
+    if (left.count() <= 0)
+      return false;
+    pollfd entry{fd, events, 0};
+    int ready = poll(&entry, 1, static_cast<int>(left.count()));
+    if (ready < 0 && errno == EINTR)
+      continue;
+    return ready > 0;
+  }
+}
+
+static bool ReadFull(int fd, void *data, size_t size,
+                     Clock::time_point deadline) {
+  uint8_t *bytes = static_cast<uint8_t *>(data);
+  while (size > 0) {
+    if (!WaitReady(fd, POLLIN, deadline))
+      return false;
+    ssize_t n = read(fd, bytes, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    bytes += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static bool WriteFull(int fd, const void *data, size_t size,
+                      Clock::time_point deadline) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  while (size > 0) {
+    if (!WaitReady(fd, POLLOUT, deadline))
+      return false;
+    ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    bytes += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static void WriteError(XMLWireWriter &out, const char *message) {
+  out.Raw(message, std::strlen(message));
+}
+
+static XMLDecodeStatus HandleLookup(const Definitions &definitions,
+                                    XMLWireReader &in, XMLWireWriter &out) {
+  std::string_view name = in.Bytes(in.Remaining());
+  auto it = definitions.structsByName.find(std::string(name));
+  if (it == definitions.structsByName.end()) {
+    WriteError(out, "no such struct");
+    return XMLDecodeStatus::NotFound;
+  }
+  const Definitions::Location &location = it->second;
+  const XMLStructData &structData =
+      definitions.documents[location.document]->GetDoc().structures
+          [location.structIndex];
+  out.U32(definitions.generation);
+  out.U32(location.document);
+  out.U32(location.structIndex);
+  out.U32(structData.length);
+  out.U32(static_cast<uint32_t>(structData.fields.size()));
+  return XMLDecodeStatus::Ok;
+}
+
+static XMLDecodeStatus HandleDecode(const Definitions &definitions,
+                                    XMLWireReader &in, XMLWireWriter &out) {
+  uint32_t generation = in.U32();
+  uint32_t document = in.U32();
+  uint32_t structIndex = in.U32();
+  uint32_t dwordCount = in.U32();
+  std::string_view raw = in.Bytes(size_t(dwordCount) * sizeof(uint32_t));
+  if (!in.Ok()) {
+    WriteError(out, "truncated decode request");
+    return XMLDecodeStatus::BadRequest;
+  }
+  if (generation != definitions.generation) {
+    WriteError(out, "definitions were reloaded");
+    return XMLDecodeStatus::Stale;
+  }
+  if (document >= definitions.documents.size() ||
+      structIndex >=
+          definitions.documents[document]->GetDoc().structures.size()) {
+    WriteError(out, "no such struct");
+    return XMLDecodeStatus::NotFound;
+  }
+
+  // The payload is not necessarily aligned.
+  thread_local std::vector<uint32_t> dwords;
+  thread_local std::vector<XMLDecodedField> fields;
+  dwords.resize(dwordCount);
+  if (dwordCount)
+    std::memcpy(dwords.data(), raw.data(), raw.size());
+
+  const XMLParserContext &context = *definitions.documents[document];
+  XMLDecoder decoder(context.GetDoc(), context.GetTypeGraph());
+  decoder.DecodeStruct(structIndex, dwords.data(), dwords.size(), fields);
+
+  const auto &fieldData = context.GetDoc().structures[structIndex].fields;
+  out.U32(static_cast<uint32_t>(fields.size()));
+  for (const XMLDecodedField &field : fields) {
+    const std::string &name = fieldData[field.fieldIndex].name;
+    uint16_t nameSize =
+        static_cast<uint16_t>(std::min<size_t>(name.size(), UINT16_MAX));
+    uint16_t textSize =
+        static_cast<uint16_t>(std::min<size_t>(field.text.size(), UINT16_MAX));
+    out.U32(field.fieldIndex);
+    out.U64(field.raw);
+    out.U16(nameSize);
+    out.U16(textSize);
+    out.Raw(name.data(), nameSize);
+    out.Raw(field.text.data(), textSize);
+  }
+  return XMLDecodeStatus::Ok;
+}
+
+// Answer every item of one request frame.
+static void HandleBatch(const Definitions &definitions, uint32_t itemCount,
+                        XMLWireReader &in, XMLWireWriter &out) {
+  for (uint32_t i = 0; i < itemCount; ++i) {
+    uint8_t op = in.U8();
+    in.Bytes(3);
+    uint32_t size = in.U32();
+    std::string_view payload = in.Bytes(size);
+
+    out.U8(op);
+    size_t statusOffset = out.buffer.size();
+    out.U8(0);
+    out.U16(0);
+    size_t sizeOffset = out.Placeholder32();
+    size_t payloadStart = out.buffer.size();
+
+    XMLDecodeStatus status = XMLDecodeStatus::BadRequest;
+    XMLWireReader item(reinterpret_cast<const uint8_t *>(payload.data()),
+                       payload.size());
+    if (!in.Ok()) {
+      WriteError(out, "truncated frame");
+    } else if (op == static_cast<uint8_t>(XMLDecodeOp::Lookup)) {
+      status = HandleLookup(definitions, item, out);
+    } else if (op == static_cast<uint8_t>(XMLDecodeOp::Decode)) {
+      status = HandleDecode(definitions, item, out);
+    } else {
+      WriteError(out, "unknown op");
+    }
+    out.buffer[statusOffset] = static_cast<uint8_t>(status);
+    out.Patch32(sizeOffset,
+                static_cast<uint32_t>(out.buffer.size() - payloadStart));
+  }
+}
+
+class DecodeServer {
+public:
+  DecodeServer(std::vector<std::string> files, size_t threads)
+      : files(std::move(files)),
+        pool(std::make_unique<ThreadPool>(threads)) {}
+  ~DecodeServer();
+
+  bool Start(const std::string &socketPath);
+  void Run();
+
+private:
+  std::vector<std::string> files;
+  std::vector<std::filesystem::file_time_type> fileTimes;
+  std::shared_ptr<const Definitions> definitions;
+  std::string path;
+  int listenFd = -1;
+  int wakePipe[2] = {-1, -1};
+  // Connections waiting for their next request, main thread only.
+  std::vector<int> idle;
+  // Connections handed back by workers after answering a frame.
+  std::mutex returnedMutex;
+  std::vector<int> returned;
+  // A reload is running on the pool.
+  std::atomic<bool> isReloading{false};
+  std::unique_ptr<ThreadPool> pool;
+
+  std::vector<std::filesystem::file_time_type> FileTimes() const;
+  void CheckReload();
+  void Reload();
+  void Serve(int fd);
+};
+
+DecodeServer::~DecodeServer() {
+  // Finish the frames in flight before closing what workers write to.
+  pool.reset();
+  for (int fd : idle)
+    close(fd);
+  for (int fd : returned)
+    close(fd);
+  if (listenFd >= 0) {
+    close(listenFd);
+    unlink(path.c_str());
+  }
+  if (wakePipe[0] >= 0) {
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+  }
+}
+
+std::vector<std::filesystem::file_time_type> DecodeServer::FileTimes() const {
+  std::vector<std::filesystem::file_time_type> times;
+  for (const std::string &file : files) {
+    std::error_code error;
+    times.push_back(std::filesystem::last_write_time(file, error));
+  }
+  return times;
+}
+
+bool DecodeServer::Start(const std::string &socketPath) {
+  fileTimes = FileTimes();
+  definitions = LoadDefinitions(files, 0);
+  if (!definitions)
+    return false;
+
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path)) {
+    std::fprintf(stderr, "Error: socket path too long.\n");
+    return false;
+  }
+  std::strcpy(address.sun_path, socketPath.c_str());
+  unlink(socketPath.c_str());
+  listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0 ||
+      bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) ||
+      listen(listenFd, SOMAXCONN) || pipe(wakePipe)) {
+    std::fprintf(stderr, "Error: listen on '%s': %s\n", socketPath.c_str(),
+                 std::strerror(errno));
+    return false;
+  }
+  path = socketPath;
+  return true;
+}
+
+// Main thread: only compares file times, the reload itself runs on the pool
+// so that connections keep being served meanwhile.
+void DecodeServer::CheckReload() {
+  if (isReloading)
+    return;
+  auto times = FileTimes();
+  if (times == fileTimes)
+    return;
+  // Remember the new times even on failure: a file still being written
+  // changes again when it is complete.
+  fileTimes = times;
+  isReloading = true;
+  pool->Submit([this]() { Reload(); });
+}
+
+void DecodeServer::Reload() {
+  auto current = std::atomic_load(&definitions);
+  auto reloaded = LoadDefinitions(files, current->generation + 1);
+  if (!reloaded) {
+    std::fprintf(stderr, "Reload failed, keep generation %u.\n",
+                 current->generation);
+  } else {
+    std::atomic_store(&definitions, reloaded);
+    std::fprintf(stderr, "Reloaded definitions, generation %u.\n",
+                 reloaded->generation);
+  }
+  isReloading = false;
+}
+
+// Worker side: answer one frame, then give the connection back to poll().
+void DecodeServer::Serve(int fd) {
+  XMLDecodeFrameHeader header;
+  std::vector<uint8_t> body;
+  Clock::time_point deadline = Clock::now() + kFrameTimeout;
+  // Every item takes at least its 8 byte header, which bounds the reply.
+  bool ok = ReadFull(fd, &header, sizeof(header), deadline) &&
+            header.magic == kDecodeRequestMagic &&
+            header.bodySize <= kDecodeMaxFrameBytes &&
+            header.itemCount <= header.bodySize / 8;
+  if (ok) {
+    body.resize(header.bodySize);
+    ok = ReadFull(fd, body.data(), body.size(), deadline);
+  }
+  if (ok) {
+    auto snapshot = std::atomic_load(&definitions);
+    XMLWireReader in(body.data(), body.size());
+    XMLWireWriter out;
+    out.U32(kDecodeResponseMagic);
+    out.U32(header.itemCount);
+    size_t bodySizeOffset = out.Placeholder32();
+    HandleBatch(*snapshot, header.itemCount, in, out);
+    out.Patch32(bodySizeOffset, static_cast<uint32_t>(out.buffer.size() -
+                                                      sizeof(header)));
+    ok = WriteFull(fd, out.buffer.data(), out.buffer.size(),
+                   Clock::now() + kFrameTimeout);
+  }
+  if (!ok) {
+    close(fd);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(returnedMutex);
+    returned.push_back(fd);
+  }
+  char wake = 1;
+  ssize_t ignored = write(wakePipe[1], &wake, 1);
+  (void)ignored;
+}
+
+void DecodeServer::Run() {
+  Clock::time_point lastReloadCheck = Clock::now();
+  std::vector<pollfd> fds;
+  while (!gStop) {
+    fds.clear();
+    fds.push_back({listenFd, POLLIN, 0});
+    fds.push_back({wakePipe[0], POLLIN, 0});
+    for (int fd : idle)
+      fds.push_back({fd, POLLIN, 0});
+    int ready = poll(fds.data(), fds.size(), 1000);
+    if (ready < 0 && errno != EINTR) {
+      std::perror("poll");
+      return;
+    }
+
+    if (Clock::now() - lastReloadCheck >= std::chrono::seconds(1)) {
+      CheckReload();
+      lastReloadCheck = Clock::now();
+    }
+    if (ready <= 0)
+      continue;
+
+    std::vector<int> stillIdle;
+    for (size_t i = 2; i < fds.size(); ++i) {
+      if (fds[i].revents & POLLIN) {
+        int fd = fds[i].fd;
+        pool->Submit([this, fd]() { Serve(fd); });
+      } else if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+        close(fds[i].fd);
+      } else {
+        stillIdle.push_back(fds[i].fd);
+      }
+    }
+    idle.swap(stillIdle);
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listenFd, nullptr, nullptr);
+      if (fd >= 0) {
+        // A client stalling mid-frame, or no longer reading its replies,
+        // must not hold a worker forever.
+        timeval timeout{5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        idle.push_back(fd);
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      char drain[64];
+      ssize_t ignored = read(wakePipe[0], drain, sizeof(drain));
+      (void)ignored;
+      std::lock_guard<std::mutex> lock(returnedMutex);
+      idle.insert(idle.end(), returned.begin(), returned.end());
+      returned.clear();
+    }
+  }
+}
+
+static void PrintUsage() {
+  std::fprintf(stderr,
+               "usage: genxml-daemon [--threads N] <socket-path> <file.xml>...\n");
+}
+
+int main(int argc, char **argv) {
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  int arg = 1;
+  if (arg + 1 < argc && !std::strcmp(argv[arg], "--threads")) {
+    threads = std::max(1l, std::strtol(argv[arg + 1], nullptr, 10));
+    arg += 2;
+  }
+  if (argc - arg < 2) {
+    PrintUsage();
+    return 1;
+  }
+  std::string socketPath = argv[arg++];
+  std::vector<std::string> files(argv + arg, argv + argc);
+
+  std::signal(SIGINT, OnStopSignal);
+  std::signal(SIGTERM, OnStopSignal);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  DecodeServer server(files, threads);
+  if (!server.Start(socketPath))
+    return 1;
+  std::fprintf(stderr, "Serving %zu document(s) on %s with %zu thread(s).\n",
+               files.size(), socketPath.c_str(), threads);
+  server.Run();
+  return 0;
+}
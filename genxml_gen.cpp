@@ -0,0 +1,69 @@
+// genxml-gen: write a synthetic genxml document for scale and stress tests.
+//
+// usage: genxml-gen [options] -o out.xml
+//   --seed N             PRNG seed, same seed gives the same document (1)
+//   --structs N          number of 'struct's (1000)
+//   --fields N           fields per struct (16)
+//   --enums N            number of 'enum's (200)
+//   --values N           values per enum (8)
+//   --choice-density P   probability a field has a choice list (0.2)
+//   --choice-values N    values per choice list (4)
+//   --info-length N      average 'info' length, 0 for none (32)
+//   --enum-types P       probability a field is typed as an enum (0.15)
+#include "xml_generator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void PrintUsage(const char *argv0) {
+  std::fprintf(stderr,
+               "usage: %s [--seed N] [--structs N] [--fields N] [--enums N] "
+               "[--values N]\n"
+               "          [--choice-density P] [--choice-values N] "
+               "[--info-length N]\n"
+               "          [--enum-types P] -o out.xml\n",
+               argv0);
+}
+
+int main(int argc, char **argv) {
+  XMLGeneratorOptions options;
+  const char *outFile = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!value) {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    if (!std::strcmp(arg, "-o")) {
+      outFile = value;
+    } else if (!std::strcmp(arg, "--seed")) {
+      options.seed = std::strtoull(value, nullptr, 0);
+    } else if (!std::strcmp(arg, "--structs")) {
+      options.structCount = std::strtoul(value, nullptr, 0);
+    } else if (!std::strcmp(arg, "--fields")) {
+      options.fieldsPerStruct = std::strtoul(value, nullptr, 0);
+    } else if (!std::strcmp(arg, "--enums")) {
+      options.enumCount = std::strtoul(value, nullptr, 0);
+    } else if (!std::strcmp(arg, "--values")) {
+      options.valuesPerEnum = std::strtoul(value, nullptr, 0);
+    } else if (!std::strcmp(arg, "--choice-density")) {
+      options.choiceDensity = std::strtod(value, nullptr);
+    } else if (!std::strcmp(arg, "--choice-values")) {
+      options.valuesPerChoice = std::strtoul(value, nullptr, 0);
+    } else if (!std::strcmp(arg, "--info-length")) {
+      options.infoLength = std::strtoul(value, nullptr, 0);
+    } else if (!std::strcmp(arg, "--enum-types")) {
+      options.enumTypeDensity = std::strtod(value, nullptr);
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    ++i;
+  }
+  if (!outFile) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  return GenerateSyntheticDoc(options, outFile) ? 0 : 1;
+}
@@ -4,12 +4,15 @@
 #include "imgui_impl_opengl3.h"
 #include "imgui_internal.h"
 #include "imgui_stdlib.h"
-#include "xml_parser.h"
-#include "xml_saver.h"
-#include "xml_types.h"
+#include "xml_alloc_counter.h"
+#include "xml_frame_arena.h"
+#include "xml_workspace.h"
 #include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <future>
 #include <memory>
 #include <queue>
@@ -21,8 +24,6 @@
 #endif
 #include <GLFW/glfw3.h> // Will drag system OpenGL headers
 
-constexpr size_t MAX_PATH_SIZE = 4096;
-
 // [Win32] Our example includes a copy of glfw3.lib pre-compiled with VS2010 to
 // maximize ease of testing and compatibility with old VS compilers. To link
 // with VS2010-era libraries, VS2015+ requires linking with
@@ -88,6 +89,8 @@ bool MainUI::Init() {
 
   // Setup Dear ImGui context
   IMGUI_CHECKVERSION();
+  if (IsAllocCounterEnabled())
+    ImGui::SetAllocatorFunctions(CountedMalloc, CountedFree);
   ImGui::CreateContext();
   ImGuiIO &io = ImGui::GetIO();
   (void)io;
@@ -138,7 +141,95 @@ bool MainUI::Init() {
   return true;
 }
 
+bool MainUI::InitHeadless(float width, float height) {
+  IMGUI_CHECKVERSION();
+  // ImGui's own heap traffic is part of the frame's allocation count.
+  if (IsAllocCounterEnabled())
+    ImGui::SetAllocatorFunctions(CountedMalloc, CountedFree);
+  ImGui::CreateContext();
+  ImGuiIO &io = ImGui::GetIO();
+  // No imgui.ini either way, so every replay starts from the same layout.
+  io.IniFilename = nullptr;
+  io.LogFilename = nullptr;
+  io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
+  io.DisplaySize = ImVec2(width, height);
+  io.DeltaTime = 1.0f / 60.0f;
+  ImGui::StyleColorsDark();
+  // The null renderer never uploads the atlas, it only has to be built.
+  unsigned char *pixels = nullptr;
+  int atlasWidth = 0, atlasHeight = 0;
+  io.Fonts->GetTexDataAsRGBA32(&pixels, &atlasWidth, &atlasHeight);
+  isHeadless = true;
+  return true;
+}
+
+void MainUI::SetScriptHandler(ScriptHandlerType &&handler) {
+  scriptHandler = std::move(handler);
+}
+
+void MainUI::StartRecording(const std::string &path) {
+  recordingPath = path;
+  isRecording = true;
+}
+
+void MainUI::RenderHeadlessFrame(UIReplayReport &report) {
+  using Clock = std::chrono::steady_clock;
+  XMLAllocStats allocBefore = GetAllocStats();
+  auto begin = Clock::now();
+  GetFrameArena().Reset();
+  ImGui::NewFrame();
+  for (const auto &func : imguiRenderingFuncs) {
+    func();
+  }
+  ImGui::Render();
+  auto end = Clock::now();
+  XMLAllocStats allocs = AllocStatsDelta(allocBefore, GetAllocStats());
+  UIFrameSample sample;
+  sample.seconds = std::chrono::duration<double>(end - begin).count();
+  sample.allocations = allocs.allocations;
+  sample.bytesAllocated = allocs.bytesAllocated;
+  report.frames.push_back(sample);
+}
+
+bool MainUI::Replay(const UIScript &script, UIReplayReport &report,
+                    std::string &error) {
+  report.isAllocCounted = IsAllocCounterEnabled();
+  UIScriptCommand wait{UIScriptOp::Wait};
+  for (const UIScriptCommand &command : script.commands) {
+    if (IsUIInputOp(command.op)) {
+      ApplyUIInput(command);
+      continue;
+    }
+    if (command.op != UIScriptOp::Frame) {
+      if (!scriptHandler || !scriptHandler(command)) {
+        error = "line " + std::to_string(command.line) + ": command failed";
+        return false;
+      }
+      continue;
+    }
+    for (uint32_t i = 0; i < command.value; ++i) {
+      // Loading is not what is measured, settle it outside of the frame.
+      if (scriptHandler && !scriptHandler(wait)) {
+        error = "line " + std::to_string(command.line) +
+                ": a document failed to load";
+        return false;
+      }
+      RenderHeadlessFrame(report);
+    }
+  }
+  return true;
+}
+
 void MainUI::Deinit() {
+  if (isHeadless) {
+    ImGui::DestroyContext();
+    return;
+  }
+  // Init() failed before the ImGui context existed.
+  if (!ImGui::GetCurrentContext()) {
+    glfwTerminate();
+    return;
+  }
   // Cleanup
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
@@ -176,8 +267,11 @@ void MainUI::Render() {
     }
 
     // Start the Dear ImGui frame
+    GetFrameArena().Reset();
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
+    if (isRecording)
+      recorder.Capture();
     ImGui::NewFrame();
 
     // IMGUI Rendering Commands
@@ -199,246 +293,142 @@ void MainUI::Render() {
 #ifdef __EMSCRIPTEN__
   EMSCRIPTEN_MAINLOOP_END;
 #endif
+  if (isRecording && !SaveUIScript(recorder.GetScript(), recordingPath))
+    fprintf(stderr, "Error: saving the recording failed.\n");
 }
 
 void MainUI::AppendRenderFunction(RenderFuncType &&func) {
   imguiRenderingFuncs.emplace_back(func);
 }
 
-XMLViewer::XMLViewer() {
-  filename.reserve(MAX_PATH_SIZE);
-  filename = "../gen4.xml";
-  OnFileLoading();
-}
-
-static int PathInputChangeCallback(ImGuiInputTextCallbackData *data) {
-  *(bool *)(data->UserData) = false;
-  return 1;
-}
-
-static void XMLValueDataDrawWidget(const XMLValueData &valueData) {
-  ImGui::Text("%llu\t%s %s", valueData.value, valueData.name.c_str(),
-              (valueData.info ? valueData.info->c_str() : ""));
+static bool RunScriptCommand(XMLWorkspace &workspace,
+                             const UIScriptCommand &command) {
+  switch (command.op) {
+  case UIScriptOp::Open:
+    workspace.Open(command.file);
+    return true;
+  case UIScriptOp::Wait:
+    return workspace.WaitForLoading();
+  case UIScriptOp::Expand:
+    workspace.SetExpandAll(command.value != 0);
+    return true;
+  case UIScriptOp::Save:
+    return workspace.SaveActive(command.file);
+  default:
+    return false;
+  }
 }
 
-static void XMLVecValueDataTable(const std::vector<XMLValueData> &vecValueData,
-                                 const char *strTableName) {
-  if (ImGui::BeginTable(strTableName, 3,
-                        ImGuiTableFlags_Resizable |
-                            ImGuiTableFlags_SizingFixedFit)) {
-    ImGui::TableSetupColumn("Name", 0);
-    ImGui::TableSetupColumn("Value", 0);
-    ImGui::TableSetupColumn("Info", 0);
-    ImGui::TableHeadersRow();
-    for (const auto &valueData : vecValueData) {
-      ImGui::TableNextRow();
-      ImGui::TableNextColumn();
-      ImGui::Text("%s", valueData.name.c_str());
-      ImGui::TableNextColumn();
-      ImGui::Text("%llu", valueData.value);
-      ImGui::TableNextColumn();
-      ImGui::Text("%s", valueData.info ? valueData.info->c_str() : "NA");
-    }
-    ImGui::EndTable();
+struct ReplayBudget {
+  double maxP99Ms = 0.0;       // 0 = unchecked
+  long long maxP99Allocs = -1; // -1 = unchecked
+};
+
+// Replay 'scriptPath' headless and report the frame times, returns the exit
+// code: 1 when the script failed or a budget was exceeded.
+static int RunReplay(MainUI &mainUI, const char *scriptPath,
+                     const std::string &label, const char *jsonPath,
+                     const ReplayBudget &budget) {
+  UIScript script;
+  std::string error;
+  if (!LoadUIScript(scriptPath, script, error)) {
+    fprintf(stderr, "Error: %s: %s\n", scriptPath, error.c_str());
+    return 1;
+  }
+  mainUI.InitHeadless(1280.0f, 720.0f);
+  UIReplayReport report;
+  if (!mainUI.Replay(script, report, error)) {
+    fprintf(stderr, "Error: %s: %s\n", scriptPath, error.c_str());
+    return 1;
+  }
+  PrintUIReplaySummary(report, stdout);
+  if (jsonPath && !WriteUIReplayJson(report, label, scriptPath, jsonPath))
+    return 1;
+
+  UIReplaySummary summary = SummarizeUIReplay(report);
+  int exitCode = 0;
+  if (budget.maxP99Ms > 0.0 && summary.p99Seconds * 1e3 > budget.maxP99Ms) {
+    fprintf(stderr, "Budget exceeded: p99 frame %.3f ms > %.3f ms\n",
+            summary.p99Seconds * 1e3, budget.maxP99Ms);
+    exitCode = 1;
   }
+  if (budget.maxP99Allocs >= 0 && report.isAllocCounted &&
+      summary.p99Allocations > (unsigned long long)budget.maxP99Allocs) {
+    fprintf(stderr, "Budget exceeded: p99 frame allocations %llu > %lld\n",
+            (unsigned long long)summary.p99Allocations, budget.maxP99Allocs);
+    exitCode = 1;
+  }
+  return exitCode;
 }
 
-void XMLViewer::Render() {
-  if (!isFileOpened) {
-    ImGui::Text("No file opened.");
-    if (ImGui::Button("Open")) {
-      isShowFileDialog = true;
-      ImGui::OpenPopup("File Selector");
-    }
-
-    if (isShowFileDialog) {
-      ImGui::BeginPopupModal("File Selector", NULL,
-                             ImGuiWindowFlags_AlwaysAutoResize);
-      if (isFileLoading) {
-        if (filename.empty()) {
-          ImGui::Text("Unknow error");
-        }
-        ImGui::Text("Loading file of %s ...", filename.c_str());
-      } else {
-        ImGui::InputText(
-            "Please input the absolute path of the target xml file", &filename,
-            ImGuiInputTextFlags_CallbackEdit, &PathInputChangeCallback,
-            &isShowFileLoadError);
-        if (ImGui::Button("Load")) {
-          OnFileLoading();
-        }
-        if (isShowFileLoadError) {
-          ImGui::Text("Load '%s' failed.", filename.c_str());
-        }
-      }
-      ImGui::EndPopup();
-    }
-  } else {
-    ImGui::Text("Opened file %s", filename.c_str());
-    const XMLDocData &docData = xmlParserContext->parsedDoc;
-    if (ImGui::TreeNode("enum(s)")) {
-      for (const auto &enumData : docData.enumerates) {
-        if (ImGui::TreeNode(enumData.name.c_str())) {
-          XMLVecValueDataTable(enumData.values, "Values");
-          ImGui::TreePop();
-        }
-      }
-      ImGui::TreePop();
-    }
-    if (ImGui::TreeNode("struct(s)")) {
-      for (const auto &structData : docData.structures) {
-        if (ImGui::TreeNode(structData.name.c_str())) {
-          for (const auto &fields : structData.fields) {
-            if (!fields.choices) {
-              ImGui::BulletText("%s", fields.name.c_str());
-            } else {
-              if (ImGui::TreeNode(fields.name.c_str())) {
-                XMLVecValueDataTable(fields.choices.value(), "Choices");
-                ImGui::TreePop();
-              }
-            }
-          }
-          ImGui::TreePop();
-        }
-      }
-      ImGui::TreePop();
-    }
-
-    if (ImGui::Button("Close")) {
-      OnFileClose();
-    }
-
-    if (ImGui::Button("Save")) {
-      if (toSaveFilename.empty() && !filename.empty()) {
-        toSaveFilename = filename;
-      }
-      toSaveFilename.reserve(FILENAME_MAX);
-      savingMsg.clear();
-      ImGui::OpenPopup("Save");
-    }
-    if (ImGui::BeginPopupModal("Save", NULL,
-                               ImGuiWindowFlags_AlwaysAutoResize)) {
-
-      if (!savingResult) {
-        ImGui::InputText("File", toSaveFilename.data(),
-                         toSaveFilename.capacity());
-        if (ImGui::Button("Save")) {
-          OnFileSave();
-        }
-      } else {
-        if (savingResult->valid()) {
-          savingMsg += (savingResult.get() ? " Sucess" : " Fail");
-          savingResult.reset();
-        }
-      }
-      if (!savingMsg.empty()) {
-        ImGui::Text("%s.", savingMsg.c_str());
-      }
-      // no begin save or finished save
-      if (!savingResult || savingResult->valid()) {
-        if (ImGui::Button("Cancel")) {
-          savingResult.reset();
-          ImGui::CloseCurrentPopup();
-        }
-      }
-      ImGui::EndPopup();
-    }
-    if (ImGui::Button("Add enum")) {
-      if (!xmlEditEnumUI) {
-        xmlEditEnumUI = std::make_unique<XMLEditEnumUI>();
-      }
-      ImGui::OpenPopup("Edit enum" );
-    }
-    if (ImGui::BeginPopupModal("Edit enum")) {
-
-      xmlEditEnumUI->Render();
-      ImGui::NewLine();
-      if (ModalOKButton()) {
-        xmlParserContext->parsedDoc.enumerates.emplace_back(
-          xmlEditEnumUI->currentEditing
-        );
-        xmlEditEnumUI.reset();
-        ImGui::CloseCurrentPopup();
-      }
-      ImGui::SameLine();
-
-      if (ModalCancelButton()) {
-        ImGui::CloseCurrentPopup();
-      }
-      ImGui::EndPopup();
+// Main code
+//
+// usage: genxml-editor [file.xml...]
+//        genxml-editor --record script.txt [file.xml...]
+//        genxml-editor --replay script.txt [--json out.json] [--label NAME]
+//                      [--max-p99-ms MS] [--max-p99-allocs N] [file.xml...]
+//
+// --replay is the test mode: no window is opened, see main_ui_script.h.
+int main(int argc, char **argv) {
+  const char *recordPath = nullptr;
+  const char *replayPath = nullptr;
+  const char *jsonPath = nullptr;
+  std::string label = "replay";
+  ReplayBudget budget;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--record") && i + 1 < argc) {
+      recordPath = argv[++i];
+    } else if (!std::strcmp(argv[i], "--replay") && i + 1 < argc) {
+      replayPath = argv[++i];
+    } else if (!std::strcmp(argv[i], "--json") && i + 1 < argc) {
+      jsonPath = argv[++i];
+    } else if (!std::strcmp(argv[i], "--label") && i + 1 < argc) {
+      label = argv[++i];
+    } else if (!std::strcmp(argv[i], "--max-p99-ms") && i + 1 < argc) {
+      budget.maxP99Ms = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--max-p99-allocs") && i + 1 < argc) {
+      budget.maxP99Allocs = std::atoll(argv[++i]);
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr,
+              "usage: %s [--record script | --replay script [--json out.json]"
+              " [--label NAME] [--max-p99-ms MS] [--max-p99-allocs N]]"
+              " [file.xml...]\n",
+              argv[0]);
+      return 1;
+    } else {
+      files.emplace_back(argv[i]);
     }
+  }
+  if (files.empty() && !replayPath)
+    files.emplace_back("../gen4.xml");
 
-    if (ImGui::Button("Add Struct")) {
-      if (!xmlEditStructUI) xmlEditStructUI = std::make_unique<XMLEditStructUI>();
-      ImGui::OpenPopup("Edit Struct");
-    }
-    if (ImGui::BeginPopupModal("Edit Struct")) {
-      xmlEditStructUI->Render();
-      if (ModalOKButton()) {
-        xmlParserContext->parsedDoc.structures.emplace_back(xmlEditStructUI->currentEditing);
-        xmlEditStructUI.reset();
-        ImGui::CloseCurrentPopup();
-      }
-      ImGui::SameLine();
-      if (ModalCancelButton()) {
-        ImGui::CloseCurrentPopup();
-      }
-      ImGui::EndPopup();
+  MainUI mainUI{};
+  XMLWorkspace workspace;
+  mainUI.SetScriptHandler([&workspace](const UIScriptCommand &command) {
+    return RunScriptCommand(workspace, command);
+  });
+  mainUI.AppendRenderFunction([&workspace]() { workspace.Render(); });
+  for (const std::string &file : files) {
+    workspace.Open(file);
+    if (recordPath) {
+      UIScriptCommand open{UIScriptOp::Open};
+      open.file = file;
+      mainUI.GetRecorder().Append(open);
     }
-
   }
-}
 
-void XMLViewer::OnFileLoading() {
-  isFileLoading = true;
-  isShowFileLoadError = false;
-  if (loadingResult)
-    loadingResult->wait();
-  auto newLoadingResult = std::make_unique<std::future<bool>>(
-      std::async(std::launch::async, [this]() {
-        auto parserContextPtr =
-            std::make_unique<XMLParserContext>(this->filename);
-        bool parseResult = parserContextPtr->init();
-        if (parseResult) {
-          this->xmlParserContext.swap(parserContextPtr);
-          isFileOpened = true;
-          isShowFileDialog = false;
-        } else {
-          isShowFileLoadError = true;
-        }
-
-        isFileLoading = false;
-        return parseResult;
-      }));
-  loadingResult.swap(newLoadingResult);
-}
+  if (replayPath)
+    return RunReplay(mainUI, replayPath, label, jsonPath, budget);
 
-void XMLViewer::OnFileClose() {
-  if (isFileLoading) {
-    loadingResult->wait();
+  if (!mainUI.Init()) {
+    fprintf(stderr, "Error: creating the window failed.\n");
+    return 1;
+  }
+  if (recordPath) {
+    mainUI.GetRecorder().Append(UIScriptCommand{UIScriptOp::Wait});
+    mainUI.StartRecording(recordPath);
   }
-  xmlParserContext.reset();
-  isFileLoading = false;
-  isFileOpened = false;
-}
-
-void XMLViewer::OnFileSave() {
-  savingResult = std::make_unique<std::future<bool>>(std::async([this]() {
-    savingMsg = "Saving ...";
-    bool saveResult = SaveToFile(xmlParserContext->parsedDoc, toSaveFilename.c_str());
-    return saveResult;
-  }));
-}
-
-// Main code
-int main(int, char **) {
-  MainUI mainUI{};
-  mainUI.Init();
-
-  XMLViewer viewer;
-
-  mainUI.AppendRenderFunction([&viewer]() { viewer.Render(); });
-
   mainUI.Render();
 
   return 0;
@@ -5,15 +5,13 @@
 #include <memory>
 #include <vector>
 #include <string>
-#include <future>
-#include "xml_parser.h"
-#include "xml_types.h"
-#include "xml_ui.h"
+#include "main_ui_script.h"
 typedef struct GLFWwindow GLFWwindow;
 
 class MainUI
 {
 using RenderFuncType = std::function<void()>;
+using ScriptHandlerType = std::function<bool(const UIScriptCommand&)>;
 public:
 	MainUI() : window(nullptr) {}
 	~MainUI() {
@@ -24,37 +22,31 @@ public:
 	bool Init();
 	void Render();
 
+	// Test mode: no window and a null renderer, frames are built and
+	// finalized but never drawn, so it runs on machines without a display.
+	bool InitHeadless(float width, float height);
+	// Replay 'script' (see main_ui_script.h) and time every frame. The
+	// application commands go to the script handler, which is also asked to
+	// "wait" before every frame. False with 'error' set when one failed.
+	bool Replay(const UIScript& script, UIReplayReport& report,
+	            std::string& error);
+	void SetScriptHandler(ScriptHandlerType&& handler);
+	// Record the input of the interactive session, written to 'path' when
+	// the window closes.
+	void StartRecording(const std::string& path);
+	UIScriptRecorder& GetRecorder() { return recorder; }
+
 	void AppendRenderFunction(RenderFuncType&& func);
 private:
 	GLFWwindow *window;
 	std::vector<RenderFuncType> imguiRenderingFuncs;
+	ScriptHandlerType scriptHandler;
+	UIScriptRecorder recorder;
+	std::string recordingPath;
+	bool isHeadless = false;
+	bool isRecording = false;
+	void RenderHeadlessFrame(UIReplayReport& report);
 	void Deinit();
 };
 
-class XMLViewer
-{
-public:
-	XMLViewer();
-	~XMLViewer() = default;
-	void Render();
-private:
-	std::string filename;
-	std::string toSaveFilename;
-	std::string loadingErrorMsg;
-	std::string savingMsg;
-	bool isFileOpened = false;
-	bool isShowFileDialog = false;
-	bool isShowFileLoadError = false;
-	bool isFileLoading = false;
-
-	void OnFileLoading();
-	void OnFileClose();
-	void OnFileSave();
-	std::unique_ptr<std::future<bool>> loadingResult;
-	std::unique_ptr<std::future<bool>> savingResult;
-	std::unique_ptr<XMLParserContext> xmlParserContext;
-	std::unique_ptr<XMLEditEnumUI> xmlEditEnumUI;
-	std::unique_ptr<XMLEditStructUI> xmlEditStructUI;
-};
-
 #endif
\ No newline at end of file
@@ -0,0 +1,462 @@
+#include "main_ui_script.h"
+#include "imgui.h"
+#include "imgui_internal.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+struct UIScriptOpName {
+  UIScriptOp op;
+  const char *name;
+};
+
+// Key events are written as "key <name> down|up", not by op name.
+static const UIScriptOpName kOpNames[] = {
+    {UIScriptOp::Size, "size"},     {UIScriptOp::Mouse, "mouse"},
+    {UIScriptOp::MouseDown, "down"}, {UIScriptOp::MouseUp, "up"},
+    {UIScriptOp::Wheel, "wheel"},   {UIScriptOp::Char, "char"},
+    {UIScriptOp::Focus, "focus"},   {UIScriptOp::Frame, "frame"},
+    {UIScriptOp::Open, "open"},     {UIScriptOp::Wait, "wait"},
+    {UIScriptOp::Expand, "expand"}, {UIScriptOp::Save, "save"},
+};
+
+static const char *OpName(UIScriptOp op) {
+  for (const UIScriptOpName &entry : kOpNames) {
+    if (entry.op == op)
+      return entry.name;
+  }
+  return "key";
+}
+
+static bool FindKey(const std::string &name, ImGuiKey &key) {
+  for (int k = ImGuiKey_NamedKey_BEGIN; k < ImGuiKey_NamedKey_END; ++k) {
+    if (name == ImGui::GetKeyName(static_cast<ImGuiKey>(k))) {
+      key = static_cast<ImGuiKey>(k);
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool ParseFloat(const std::string &str, float &out) {
+  char *end = nullptr;
+  out = std::strtof(str.c_str(), &end);
+  return !str.empty() && *end == '\0';
+}
+
+static bool ParseCount(const std::string &str, uint32_t &out) {
+  char *end = nullptr;
+  unsigned long value = std::strtoul(str.c_str(), &end, 0);
+  if (str.empty() || *end != '\0' || value > UINT32_MAX)
+    return false;
+  out = static_cast<uint32_t>(value);
+  return true;
+}
+
+// The rest of the line after the command word, for file names with spaces.
+static std::string RestOfLine(const std::string &line, const std::string &word) {
+  size_t begin = line.find(word) + word.size();
+  begin = line.find_first_not_of(" \t", begin);
+  if (begin == std::string::npos)
+    return std::string();
+  size_t end = line.find_last_not_of(" \t\r");
+  return line.substr(begin, end + 1 - begin);
+}
+
+static bool ParseLine(const std::string &line, UIScriptCommand &command,
+                      std::string &error) {
+  std::istringstream stream(line);
+  std::string word;
+  stream >> word;
+  std::vector<std::string> args;
+  for (std::string arg; stream >> arg;)
+    args.push_back(arg);
+
+  auto expectArgs = [&](size_t count) {
+    if (args.size() == count)
+      return true;
+    error = "'" + word + "' takes " + std::to_string(count) + " argument(s)";
+    return false;
+  };
+
+  if (word == "key") {
+    if (!expectArgs(2))
+      return false;
+    ImGuiKey key = ImGuiKey_None;
+    if (!FindKey(args[0], key)) {
+      error = "unknown key '" + args[0] + "'";
+      return false;
+    }
+    if (args[1] != "down" && args[1] != "up") {
+      error = "key state must be down or up";
+      return false;
+    }
+    command.op = args[1] == "down" ? UIScriptOp::KeyDown : UIScriptOp::KeyUp;
+    command.value = static_cast<uint32_t>(key);
+    return true;
+  }
+
+  const UIScriptOpName *entry = nullptr;
+  for (const UIScriptOpName &candidate : kOpNames) {
+    if (word == candidate.name)
+      entry = &candidate;
+  }
+  if (!entry) {
+    error = "unknown command '" + word + "'";
+    return false;
+  }
+  command.op = entry->op;
+  switch (command.op) {
+  case UIScriptOp::Size:
+  case UIScriptOp::Mouse:
+  case UIScriptOp::Wheel:
+    if (!expectArgs(2))
+      return false;
+    if (!ParseFloat(args[0], command.x) || !ParseFloat(args[1], command.y)) {
+      error = "bad coordinate";
+      return false;
+    }
+    return true;
+  case UIScriptOp::MouseDown:
+  case UIScriptOp::MouseUp:
+    if (!expectArgs(1))
+      return false;
+    if (!ParseCount(args[0], command.value) ||
+        command.value >= ImGuiMouseButton_COUNT) {
+      error = "bad mouse button '" + args[0] + "'";
+      return false;
+    }
+    return true;
+  case UIScriptOp::Char:
+  case UIScriptOp::Focus:
+    if (!expectArgs(1))
+      return false;
+    if (!ParseCount(args[0], command.value)) {
+      error = "bad number '" + args[0] + "'";
+      return false;
+    }
+    return true;
+  case UIScriptOp::Frame:
+    command.value = 1;
+    if (args.size() > 1 ||
+        (args.size() == 1 && !ParseCount(args[0], command.value)) ||
+        command.value == 0) {
+      error = "frame takes an optional count above 0";
+      return false;
+    }
+    return true;
+  case UIScriptOp::Open:
+  case UIScriptOp::Save:
+    command.file = RestOfLine(line, word);
+    if (command.file.empty()) {
+      error = "'" + word + "' needs a file";
+      return false;
+    }
+    return true;
+  case UIScriptOp::Wait:
+    return expectArgs(0);
+  case UIScriptOp::Expand:
+    if (!expectArgs(1))
+      return false;
+    if (args[0] != "on" && args[0] != "off") {
+      error = "expand takes on or off";
+      return false;
+    }
+    command.value = args[0] == "on";
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool ParseUIScript(const std::string &text, UIScript &out,
+                   std::string &error) {
+  std::istringstream stream(text);
+  std::string line;
+  uint32_t lineNumber = 0;
+  while (std::getline(stream, line)) {
+    ++lineNumber;
+    size_t first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#')
+      continue;
+    UIScriptCommand command;
+    command.line = lineNumber;
+    std::string lineError;
+    if (!ParseLine(line, command, lineError)) {
+      error = "line " + std::to_string(lineNumber) + ": " + lineError;
+      return false;
+    }
+    out.commands.push_back(std::move(command));
+  }
+  return true;
+}
+
+bool LoadUIScript(const std::string &path, UIScript &out, std::string &error) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    error = "cannot open '" + path + "'";
+    return false;
+  }
+  std::stringstream text;
+  text << in.rdbuf();
+  return ParseUIScript(text.str(), out, error);
+}
+
+bool SaveUIScript(const UIScript &script, const std::string &path) {
+  FILE *fp = std::fopen(path.c_str(), "w");
+  if (!fp) {
+    std::fprintf(stderr, "Error: open '%s' failed.\n", path.c_str());
+    return false;
+  }
+  std::fprintf(fp, "# genxml-editor input script, see main_ui_script.h\n");
+  for (const UIScriptCommand &command : script.commands) {
+    const char *name = OpName(command.op);
+    switch (command.op) {
+    case UIScriptOp::Size:
+    case UIScriptOp::Mouse:
+    case UIScriptOp::Wheel:
+      std::fprintf(fp, "%s %g %g\n", name, command.x, command.y);
+      break;
+    case UIScriptOp::KeyDown:
+    case UIScriptOp::KeyUp:
+      std::fprintf(fp, "key %s %s\n",
+                   ImGui::GetKeyName(static_cast<ImGuiKey>(command.value)),
+                   command.op == UIScriptOp::KeyDown ? "down" : "up");
+      break;
+    case UIScriptOp::Frame:
+      if (command.value == 1)
+        std::fprintf(fp, "frame\n");
+      else
+        std::fprintf(fp, "frame %u\n", command.value);
+      break;
+    case UIScriptOp::Open:
+    case UIScriptOp::Save:
+      std::fprintf(fp, "%s %s\n", name, command.file.c_str());
+      break;
+    case UIScriptOp::Wait:
+      std::fprintf(fp, "wait\n");
+      break;
+    case UIScriptOp::Expand:
+      std::fprintf(fp, "expand %s\n", command.value ? "on" : "off");
+      break;
+    default:
+      std::fprintf(fp, "%s %u\n", name, command.value);
+      break;
+    }
+  }
+  bool isOk = !std::ferror(fp);
+  isOk = std::fclose(fp) == 0 && isOk;
+  return isOk;
+}
+
+bool IsUIInputOp(UIScriptOp op) { return op < UIScriptOp::Frame; }
+
+void ApplyUIInput(const UIScriptCommand &command) {
+  ImGuiIO &io = ImGui::GetIO();
+  switch (command.op) {
+  case UIScriptOp::Size:
+    io.DisplaySize = ImVec2(command.x, command.y);
+    break;
+  case UIScriptOp::Mouse:
+    io.AddMousePosEvent(command.x, command.y);
+    break;
+  case UIScriptOp::MouseDown:
+  case UIScriptOp::MouseUp:
+    io.AddMouseButtonEvent(static_cast<int>(command.value),
+                           command.op == UIScriptOp::MouseDown);
+    break;
+  case UIScriptOp::Wheel:
+    io.AddMouseWheelEvent(command.x, command.y);
+    break;
+  case UIScriptOp::KeyDown:
+  case UIScriptOp::KeyUp:
+    io.AddKeyEvent(static_cast<ImGuiKey>(command.value),
+                   command.op == UIScriptOp::KeyDown);
+    break;
+  case UIScriptOp::Char:
+    io.AddInputCharacter(command.value);
+    break;
+  case UIScriptOp::Focus:
+    io.AddFocusEvent(command.value != 0);
+    break;
+  default:
+    break;
+  }
+}
+
+void UIScriptRecorder::Capture() {
+  const ImGuiIO &io = ImGui::GetIO();
+  const size_t mark = script.commands.size();
+  if (io.DisplaySize.x != displayWidth || io.DisplaySize.y != displayHeight) {
+    displayWidth = io.DisplaySize.x;
+    displayHeight = io.DisplaySize.y;
+    UIScriptCommand command{UIScriptOp::Size};
+    command.x = displayWidth;
+    command.y = displayHeight;
+    script.commands.push_back(command);
+  }
+
+  // Events trickled over to a later frame stay queued, the id keeps them
+  // from being recorded twice.
+  const ImGuiContext &g = *ImGui::GetCurrentContext();
+  for (const ImGuiInputEvent &event : g.InputEventsQueue) {
+    if (event.EventId <= lastEventId)
+      continue;
+    lastEventId = event.EventId;
+    UIScriptCommand command{UIScriptOp::Frame};
+    switch (event.Type) {
+    case ImGuiInputEventType_MousePos:
+      command.op = UIScriptOp::Mouse;
+      command.x = event.MousePos.PosX;
+      command.y = event.MousePos.PosY;
+      break;
+    case ImGuiInputEventType_MouseWheel:
+      command.op = UIScriptOp::Wheel;
+      command.x = event.MouseWheel.WheelX;
+      command.y = event.MouseWheel.WheelY;
+      break;
+    case ImGuiInputEventType_MouseButton:
+      command.op = event.MouseButton.Down ? UIScriptOp::MouseDown
+                                          : UIScriptOp::MouseUp;
+      command.value = static_cast<uint32_t>(event.MouseButton.Button);
+      break;
+    case ImGuiInputEventType_Key:
+      command.op = event.Key.Down ? UIScriptOp::KeyDown : UIScriptOp::KeyUp;
+      command.value = static_cast<uint32_t>(event.Key.Key);
+      break;
+    case ImGuiInputEventType_Text:
+      command.op = UIScriptOp::Char;
+      command.value = event.Text.Char;
+      break;
+    case ImGuiInputEventType_Focus:
+      command.op = UIScriptOp::Focus;
+      command.value = event.AppFocused.Focused ? 1 : 0;
+      break;
+    default:
+      continue;
+    }
+    script.commands.push_back(command);
+  }
+
+  // Idle frames collapse into one "frame <count>" line.
+  if (script.commands.size() == mark && !script.commands.empty() &&
+      script.commands.back().op == UIScriptOp::Frame) {
+    ++script.commands.back().value;
+    return;
+  }
+  UIScriptCommand frame{UIScriptOp::Frame};
+  frame.value = 1;
+  script.commands.push_back(frame);
+}
+
+template <typename T>
+static T Percentile(const std::vector<T> &sorted, double fraction) {
+  if (sorted.empty())
+    return T();
+  size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+  return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+UIReplaySummary SummarizeUIReplay(const UIReplayReport &report) {
+  UIReplaySummary summary;
+  summary.frames = report.frames.size();
+  if (report.frames.empty())
+    return summary;
+  std::vector<double> seconds;
+  std::vector<uint64_t> allocations;
+  seconds.reserve(report.frames.size());
+  allocations.reserve(report.frames.size());
+  double totalSeconds = 0.0;
+  for (const UIFrameSample &frame : report.frames) {
+    seconds.push_back(frame.seconds);
+    allocations.push_back(frame.allocations);
+    totalSeconds += frame.seconds;
+    summary.totalAllocations += frame.allocations;
+    summary.totalBytesAllocated += frame.bytesAllocated;
+  }
+  std::sort(seconds.begin(), seconds.end());
+  std::sort(allocations.begin(), allocations.end());
+  summary.meanSeconds = totalSeconds / seconds.size();
+  summary.p50Seconds = Percentile(seconds, 0.50);
+  summary.p90Seconds = Percentile(seconds, 0.90);
+  summary.p99Seconds = Percentile(seconds, 0.99);
+  summary.maxSeconds = seconds.back();
+  summary.p50Allocations = Percentile(allocations, 0.50);
+  summary.p99Allocations = Percentile(allocations, 0.99);
+  summary.maxAllocations = allocations.back();
+  return summary;
+}
+
+void PrintUIReplaySummary(const UIReplayReport &report, std::FILE *out) {
+  UIReplaySummary s = SummarizeUIReplay(report);
+  std::fprintf(out, "%zu frame(s)\n", s.frames);
+  std::fprintf(out,
+               "cpu ms        p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f  "
+               "mean %8.3f\n",
+               s.p50Seconds * 1e3, s.p90Seconds * 1e3, s.p99Seconds * 1e3,
+               s.maxSeconds * 1e3, s.meanSeconds * 1e3);
+  if (!report.isAllocCounted) {
+    std::fprintf(out, "allocations   not counted, configure with "
+                      "-DGENXML_COUNTING_ALLOCATOR=ON\n");
+    return;
+  }
+  std::fprintf(out,
+               "allocations   p50 %8llu  p99 %8llu  max %8llu  total %llu "
+               "(%llu bytes)\n",
+               (unsigned long long)s.p50Allocations,
+               (unsigned long long)s.p99Allocations,
+               (unsigned long long)s.maxAllocations,
+               (unsigned long long)s.totalAllocations,
+               (unsigned long long)s.totalBytesAllocated);
+}
+
+static std::string JsonEscape(const std::string &str) {
+  std::string out;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+bool WriteUIReplayJson(const UIReplayReport &report, const std::string &label,
+                       const std::string &script, const char *path) {
+  FILE *fp = std::fopen(path, "w");
+  if (!fp) {
+    std::fprintf(stderr, "Error: open '%s' failed.\n", path);
+    return false;
+  }
+  UIReplaySummary s = SummarizeUIReplay(report);
+  std::fprintf(fp, "{\n  \"label\": \"%s\",\n  \"script\": \"%s\",\n",
+               JsonEscape(label).c_str(), JsonEscape(script).c_str());
+  std::fprintf(fp,
+               "  \"frames\": %zu,\n"
+               "  \"cpu_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, "
+               "\"max\": %.0f, \"mean\": %.0f},\n",
+               s.frames, s.p50Seconds * 1e9, s.p90Seconds * 1e9,
+               s.p99Seconds * 1e9, s.maxSeconds * 1e9, s.meanSeconds * 1e9);
+  std::fprintf(fp, "  \"alloc_counted\": %s,\n",
+               report.isAllocCounted ? "true" : "false");
+  std::fprintf(fp,
+               "  \"allocations\": {\"p50\": %llu, \"p99\": %llu, "
+               "\"max\": %llu, \"total\": %llu, \"bytes\": %llu}\n}\n",
+               (unsigned long long)s.p50Allocations,
+               (unsigned long long)s.p99Allocations,
+               (unsigned long long)s.maxAllocations,
+               (unsigned long long)s.totalAllocations,
+               (unsigned long long)s.totalBytesAllocated);
+  bool isOk = !std::ferror(fp);
+  isOk = std::fclose(fp) == 0 && isOk;
+  return isOk;
+}
@@ -0,0 +1,126 @@
+#ifndef __MAIN_UI_SCRIPT_H__
+#define __MAIN_UI_SCRIPT_H__
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Input script of the editor's test mode: a recorded (or hand written) UI
+// session that MainUI replays against a null renderer, one command per line.
+//
+//   size <w> <h>            display size from the next frame on
+//   mouse <x> <y>           mouse moved
+//   down <b> | up <b>       mouse button, 0 left, 1 right, 2 middle
+//   wheel <dx> <dy>         scroll, in wheel steps
+//   key <name> down|up      ImGui key name: "Enter", "Z", "LeftCtrl", "ModCtrl"
+//   char <codepoint>        text input
+//   focus 0|1               application focus
+//   frame [count]           render 'count' frames (default 1), the input
+//                           queued since the last frame goes to the first
+//
+// and application commands, run between frames:
+//
+//   open <file>             open a tab
+//   wait                    block until every tab finished loading
+//   expand on|off           force every tree node open
+//   save <file>             save the selected tab as XML
+//
+// Blank lines and lines starting with '#' are ignored. Replay blocks on
+// pending loads before every frame, so a recorded session sees the same
+// documents however slow the disk is.
+enum class UIScriptOp : uint8_t {
+	Size,
+	Mouse,
+	MouseDown,
+	MouseUp,
+	Wheel,
+	KeyDown,
+	KeyUp,
+	Char,
+	Focus,
+	Frame,
+	Open,
+	Wait,
+	Expand,
+	Save,
+};
+
+struct UIScriptCommand {
+	UIScriptCommand() = default;
+	explicit UIScriptCommand(UIScriptOp op) : op(op) {}
+
+	UIScriptOp op = UIScriptOp::Frame;
+	float x = 0.0f;
+	float y = 0.0f;
+	// Button, key, codepoint, frame count, focus or expand flag.
+	uint32_t value = 0;
+	std::string file;
+	uint32_t line = 0;
+};
+
+struct UIScript {
+	std::vector<UIScriptCommand> commands;
+};
+
+// Returns false and fills 'error' with the offending line on a bad script.
+bool ParseUIScript(const std::string& text, UIScript& out, std::string& error);
+bool LoadUIScript(const std::string& path, UIScript& out, std::string& error);
+bool SaveUIScript(const UIScript& script, const std::string& path);
+
+// Input commands go to the ImGui input queue, the others are for the app.
+bool IsUIInputOp(UIScriptOp op);
+// Queue an input command on the current ImGui context.
+void ApplyUIInput(const UIScriptCommand& command);
+
+// Turns the input a platform backend queued for the current frame into script
+// commands. Capture() must run after the backend's NewFrame and before
+// ImGui::NewFrame(), while the frame's events are still queued.
+class UIScriptRecorder
+{
+public:
+	void Capture();
+	void Append(const UIScriptCommand& command) { script.commands.push_back(command); }
+	const UIScript& GetScript() const { return script; }
+private:
+	UIScript script;
+	uint32_t lastEventId = 0;
+	float displayWidth = 0.0f;
+	float displayHeight = 0.0f;
+};
+
+// CPU time and heap traffic of one replayed frame, from ImGui::NewFrame()
+// through ImGui::Render().
+struct UIFrameSample {
+	double seconds = 0.0;
+	uint64_t allocations = 0;
+	uint64_t bytesAllocated = 0;
+};
+
+struct UIReplayReport {
+	std::vector<UIFrameSample> frames;
+	// False unless built with GENXML_COUNTING_ALLOCATOR, the allocation
+	// columns are all 0 then.
+	bool isAllocCounted = false;
+};
+
+struct UIReplaySummary {
+	size_t frames = 0;
+	double meanSeconds = 0.0;
+	double p50Seconds = 0.0;
+	double p90Seconds = 0.0;
+	double p99Seconds = 0.0;
+	double maxSeconds = 0.0;
+	uint64_t p50Allocations = 0;
+	uint64_t p99Allocations = 0;
+	uint64_t maxAllocations = 0;
+	uint64_t totalAllocations = 0;
+	uint64_t totalBytesAllocated = 0;
+};
+
+// Nearest rank percentiles over the replayed frames.
+UIReplaySummary SummarizeUIReplay(const UIReplayReport& report);
+void PrintUIReplaySummary(const UIReplayReport& report, std::FILE* out);
+bool WriteUIReplayJson(const UIReplayReport& report, const std::string& label,
+                       const std::string& script, const char* path);
+
+#endif
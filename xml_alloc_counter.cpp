@@ -0,0 +1,72 @@
+#include "xml_alloc_counter.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef GENXML_COUNTING_ALLOCATOR
+
+static std::atomic<uint64_t> gAllocations{0};
+static std::atomic<uint64_t> gFrees{0};
+static std::atomic<uint64_t> gBytesAllocated{0};
+static std::atomic<uint64_t> gLiveBytes{0};
+
+// Every block carries its size in a header so frees can be accounted; the
+// header keeps the default new alignment.
+static constexpr size_t kHeaderSize = alignof(std::max_align_t);
+
+void *operator new(std::size_t size) {
+  void *block = std::malloc(size + kHeaderSize);
+  if (!block)
+    throw std::bad_alloc();
+  *static_cast<std::size_t *>(block) = size;
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  gBytesAllocated.fetch_add(size, std::memory_order_relaxed);
+  gLiveBytes.fetch_add(size, std::memory_order_relaxed);
+  return static_cast<char *>(block) + kHeaderSize;
+}
+
+void operator delete(void *ptr) noexcept {
+  if (!ptr)
+    return;
+  void *block = static_cast<char *>(ptr) - kHeaderSize;
+  gFrees.fetch_add(1, std::memory_order_relaxed);
+  gLiveBytes.fetch_sub(*static_cast<std::size_t *>(block),
+                       std::memory_order_relaxed);
+  std::free(block);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept { operator delete(ptr); }
+
+bool IsAllocCounterEnabled() { return true; }
+
+XMLAllocStats GetAllocStats() {
+  XMLAllocStats stats;
+  stats.allocations = gAllocations.load(std::memory_order_relaxed);
+  stats.frees = gFrees.load(std::memory_order_relaxed);
+  stats.bytesAllocated = gBytesAllocated.load(std::memory_order_relaxed);
+  stats.liveBytes = gLiveBytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+#else
+
+bool IsAllocCounterEnabled() { return false; }
+
+XMLAllocStats GetAllocStats() { return XMLAllocStats(); }
+
+#endif
+
+void *CountedMalloc(size_t size, void *) { return ::operator new(size); }
+
+void CountedFree(void *ptr, void *) { ::operator delete(ptr); }
+
+XMLAllocStats AllocStatsDelta(const XMLAllocStats &before,
+                              const XMLAllocStats &after) {
+  XMLAllocStats delta;
+  delta.allocations = after.allocations - before.allocations;
+  delta.frees = after.frees - before.frees;
+  delta.bytesAllocated = after.bytesAllocated - before.bytesAllocated;
+  delta.liveBytes = after.liveBytes - before.liveBytes;
+  return delta;
+}
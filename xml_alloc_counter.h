@@ -0,0 +1,29 @@
+#ifndef __XML_ALLOC_COUNTER_H__
+#define __XML_ALLOC_COUNTER_H__
+
+#include <cstddef>
+#include <cstdint>
+
+// Process wide heap counters. They are only live when the build replaces the
+// global operator new/delete (CMake option GENXML_COUNTING_ALLOCATOR);
+// otherwise every counter stays 0 and IsAllocCounterEnabled() is false.
+struct XMLAllocStats {
+  uint64_t allocations = 0;
+  uint64_t frees = 0;
+  uint64_t bytesAllocated = 0;
+  uint64_t liveBytes = 0;
+};
+
+bool IsAllocCounterEnabled();
+XMLAllocStats GetAllocStats();
+
+// 'after' minus 'before', liveBytes may wrap when memory was released.
+XMLAllocStats AllocStatsDelta(const XMLAllocStats &before,
+                              const XMLAllocStats &after);
+
+// malloc/free going through operator new/delete, so that libraries with
+// their own allocator hooks (ImGui::SetAllocatorFunctions) are counted too.
+void *CountedMalloc(size_t size, void *userData);
+void CountedFree(void *ptr, void *userData);
+
+#endif
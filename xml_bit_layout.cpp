@@ -0,0 +1,217 @@
+#include "xml_bit_layout.h"
+#include <algorithm>
+
+static unsigned CountTrailingZeros(uint64_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return index;
+#else
+  return __builtin_ctzll(mask);
+#endif
+}
+
+static uint32_t AlignUp(uint32_t bit, uint32_t align) {
+  return (bit + align - 1) & ~(align - 1);
+}
+
+// Bits [begin, end) of a 64 bit word at 'base'.
+static uint64_t RangeMask(uint32_t base, uint32_t begin, uint32_t end) {
+  uint32_t lo = begin > base ? begin - base : 0;
+  uint32_t hi = end - base >= 64 ? 64 : end - base;
+  uint64_t mask = hi == 64 ? ~0ull : (1ull << hi) - 1;
+  return mask & (~0ull << lo);
+}
+
+uint32_t LayoutAlignment(XMLLayoutAlign rule, uint32_t width) {
+  switch (rule) {
+  case XMLLayoutAlign::Byte:
+    return 8;
+  case XMLLayoutAlign::Natural:
+    if (width == 8 || width == 16 || width == 32 || width == 64)
+      return width;
+    return 1;
+  default:
+    return 1;
+  }
+}
+
+// The first used bit in [begin, end), kNone when all are free.
+uint32_t XMLBitLayoutSolver::FirstUsed(uint32_t begin, uint32_t end) const {
+  uint32_t words = static_cast<uint32_t>(used.size());
+  for (uint32_t w = begin / 64; w < words && w * 64 < end; ++w) {
+    uint64_t hits = used[w] & RangeMask(w * 64, begin, end);
+    if (hits)
+      return w * 64 + CountTrailingZeros(hits);
+  }
+  return kNone;
+}
+
+// The first free bit at or after 'from'; bits past the bitset are free.
+uint32_t XMLBitLayoutSolver::FirstFree(uint32_t from) const {
+  uint32_t words = static_cast<uint32_t>(used.size());
+  for (uint32_t w = from / 64; w < words; ++w) {
+    uint64_t free = ~used[w] & RangeMask(w * 64, from, w * 64 + 64);
+    if (free)
+      return w * 64 + CountTrailingZeros(free);
+  }
+  return std::max(from, words * 64);
+}
+
+void XMLBitLayoutSolver::Mark(uint32_t start, uint32_t width) {
+  uint32_t end = start + width;
+  if (used.size() * 64 < end)
+    used.resize((end + 63) / 64, 0);
+  for (uint32_t w = start / 64; w * 64 < end; ++w) {
+    used[w] |= RangeMask(w * 64, start, end);
+  }
+}
+
+// Lowest start at or after 'from' where the field fits, kNone if none does
+// within options.maxBits.
+uint32_t XMLBitLayoutSolver::FirstFit(const XMLLayoutField &field,
+                                      const XMLLayoutOptions &options,
+                                      uint32_t from) const {
+  uint32_t align =
+      std::max(field.align, LayoutAlignment(options.align, field.width));
+  bool isWide = field.width > 32;
+  if (options.goal == XMLLayoutGoal::Dwords && isWide)
+    align = std::max(align, 32u);
+  uint32_t start = AlignUp(from, align);
+  for (;;) {
+    if (options.maxBits != 0 &&
+        (start > options.maxBits || options.maxBits - start < field.width))
+      return kNone;
+    if (options.goal == XMLLayoutGoal::Dwords && !isWide &&
+        start % 32 + field.width > 32) {
+      start = AlignUp(AlignUp(start + 1, 32), align);
+      continue;
+    }
+    uint32_t busy = FirstUsed(start, start + field.width);
+    if (busy == kNone)
+      return start;
+    start = AlignUp(FirstFree(busy), align);
+  }
+}
+
+bool XMLBitLayoutSolver::Fail(XMLLayoutError reason, uint32_t field) {
+  error = reason;
+  failedField = field;
+  return false;
+}
+
+bool XMLBitLayoutSolver::Solve(std::vector<XMLLayoutField> &fields,
+                               const XMLLayoutOptions &options) {
+  std::fill(used.begin(), used.end(), 0);
+  error = XMLLayoutError::None;
+  failedField = kNone;
+  uint32_t end = 0;
+  order.clear();
+  for (uint32_t i = 0; i < fields.size(); ++i) {
+    const XMLLayoutField &field = fields[i];
+    if (field.width == 0)
+      continue;
+    if (!field.isPinned) {
+      order.push_back(i);
+      continue;
+    }
+    if (options.maxBits != 0 && (field.start > options.maxBits ||
+                                 options.maxBits - field.start < field.width))
+      return Fail(XMLLayoutError::NoRoom, i);
+    if (FirstUsed(field.start, field.start + field.width) != kNone)
+      return Fail(XMLLayoutError::PinnedOverlap, i);
+    Mark(field.start, field.width);
+    end = std::max(end, field.start + field.width);
+  }
+  if (!options.keepOrder) {
+    // Widest first, the most aligned first among equals.
+    std::stable_sort(order.begin(), order.end(),
+                     [&fields](uint32_t a, uint32_t b) {
+                       if (fields[a].width != fields[b].width)
+                         return fields[a].width > fields[b].width;
+                       return fields[a].align > fields[b].align;
+                     });
+  }
+
+  // Placed into the bitset first and written back once all fit.
+  placed.clear();
+  uint32_t from = 0;
+  for (uint32_t i : order) {
+    uint32_t start = FirstFit(fields[i], options, from);
+    if (start == kNone)
+      return Fail(XMLLayoutError::NoRoom, i);
+    Mark(start, fields[i].width);
+    placed.push_back(start);
+    end = std::max(end, start + fields[i].width);
+    if (options.keepOrder)
+      from = start + fields[i].width;
+  }
+  for (size_t k = 0; k < order.size(); ++k) {
+    fields[order[k]].start = placed[k];
+  }
+  lengthBits = end;
+  return true;
+}
+
+bool XMLBitLayoutSolver::SolveStruct(XMLStructData &data,
+                                     const std::vector<uint8_t> &pinned,
+                                     const XMLLayoutOptions &options) {
+  structFields.clear();
+  structFieldIndex.clear();
+  for (const XMLGroupData &group : data.groups) {
+    if (group.parent != XMLGroupData::kNoGroup)
+      continue;
+    structFields.push_back(
+        XMLLayoutField{GroupWidth(data, group), 1, true, group.start});
+    structFieldIndex.push_back(kNone);
+  }
+  for (uint32_t f = 0; f < data.fields.size(); ++f) {
+    const XMLFieldData &field = data.fields[f];
+    if (field.group != XMLGroupData::kNoGroup)
+      continue;
+    bool isPinned = f < pinned.size() && pinned[f];
+    structFields.push_back(
+        XMLLayoutField{FieldWidth(field), 1, isPinned, field.start});
+    structFieldIndex.push_back(f);
+  }
+  if (!Solve(structFields, options)) {
+    // Report the struct's field index; kNone when a group is in the way.
+    failedField = structFieldIndex[failedField];
+    return false;
+  }
+  for (size_t k = 0; k < structFields.size(); ++k) {
+    if (structFieldIndex[k] == kNone)
+      continue;
+    XMLFieldData &field = data.fields[structFieldIndex[k]];
+    field.start = structFields[k].start;
+    field.end = field.start + structFields[k].width - 1;
+  }
+  if (options.maxBits == 0)
+    data.length = LengthDwords();
+  return true;
+}
+
+bool XMLBitLayoutSolver::PlaceField(const XMLStructData &data,
+                                    uint32_t skipField, XMLFieldData &field,
+                                    const XMLLayoutOptions &options) {
+  std::fill(used.begin(), used.end(), 0);
+  error = XMLLayoutError::None;
+  failedField = kNone;
+  // Existing overlaps (aliased fields) are the document's business here.
+  for (const XMLGroupData &group : data.groups) {
+    if (group.parent == XMLGroupData::kNoGroup)
+      Mark(group.start, GroupWidth(data, group));
+  }
+  for (uint32_t f = 0; f < data.fields.size(); ++f) {
+    const XMLFieldData &other = data.fields[f];
+    if (f != skipField && other.group == XMLGroupData::kNoGroup)
+      Mark(other.start, FieldWidth(other));
+  }
+  XMLLayoutField item{FieldWidth(field), 1, false, 0};
+  uint32_t start = FirstFit(item, options, 0);
+  if (start == kNone)
+    return Fail(XMLLayoutError::NoRoom, skipField);
+  field.start = start;
+  field.end = start + item.width - 1;
+  return true;
+}
@@ -0,0 +1,115 @@
+#ifndef __XML_BIT_LAYOUT_H__
+#define __XML_BIT_LAYOUT_H__
+
+#include "xml_types.h"
+#include <cstdint>
+#include <vector>
+
+// Automatic bit allocation for struct fields.
+//
+// Given the width of every field, an alignment rule and the fields whose
+// position is fixed (pinned), the solver assigns a start bit to every other
+// field. Occupied bits are tracked in a bitset, so finding the first free run
+// for a field skips 64 bits per step; solving a struct of a few hundred
+// fields takes microseconds and the editor re-solves on every change.
+//
+// Placement is first fit. With 'keepOrder' off the widest fields go first,
+// which packs well but is not guaranteed minimal when pinned fields leave
+// holes of awkward sizes.
+
+enum class XMLLayoutGoal : uint8_t {
+  // Smallest length; fields may cross dword boundaries.
+  Compact,
+  // No field narrower than a dword crosses a dword boundary, wider fields
+  // start on one.
+  Dwords,
+};
+
+enum class XMLLayoutAlign : uint8_t {
+  None,
+  // Every field starts on a byte boundary.
+  Byte,
+  // Fields of 8, 16, 32 or 64 bits start on a multiple of their width.
+  Natural,
+};
+
+// Start alignment in bits of a field of 'width' bits under 'rule'.
+uint32_t LayoutAlignment(XMLLayoutAlign rule, uint32_t width);
+
+struct XMLLayoutField {
+  uint32_t width = 1;
+  // Power of two; the start is a multiple of it.
+  uint32_t align = 1;
+  bool isPinned = false;
+  // The pinned position, or the one assigned by the solver.
+  uint32_t start = 0;
+};
+
+struct XMLLayoutOptions {
+  XMLLayoutGoal goal = XMLLayoutGoal::Compact;
+  XMLLayoutAlign align = XMLLayoutAlign::None;
+  // Place the free fields in list order, each after the previous one,
+  // instead of widest first.
+  bool keepOrder = false;
+  // Bits available, 0 for no limit.
+  uint32_t maxBits = 0;
+};
+
+enum class XMLLayoutError : uint8_t {
+  None,
+  // A pinned field overlaps another pinned field or a group.
+  PinnedOverlap,
+  // A field does not fit in 'maxBits'.
+  NoRoom,
+};
+
+class XMLBitLayoutSolver {
+public:
+  // Assign 'start' to every unpinned field. On failure the fields keep
+  // their positions and Error()/FailedField() say why.
+  bool Solve(std::vector<XMLLayoutField> &fields,
+             const XMLLayoutOptions &options);
+
+  // Lay out the struct's top level fields. Fields inside groups keep their
+  // positions and the groups count as pinned. 'pinned' is parallel to
+  // data.fields, missing entries are unpinned. The length is set to the
+  // dwords used unless options.maxBits limits it.
+  bool SolveStruct(XMLStructData &data, const std::vector<uint8_t> &pinned,
+                   const XMLLayoutOptions &options);
+
+  // Move 'field' to the first free bits among the other top level fields
+  // and groups of 'data'; 'skipField' is the index of 'field' itself when it
+  // is already in the struct (UINT32_MAX otherwise). Fields that already
+  // overlap are left alone.
+  bool PlaceField(const XMLStructData &data, uint32_t skipField,
+                  XMLFieldData &field, const XMLLayoutOptions &options);
+
+  // Bits and dwords used by the last successful Solve() or SolveStruct().
+  uint32_t LengthBits() const { return lengthBits; }
+  uint32_t LengthDwords() const { return (lengthBits + 31) / 32; }
+  XMLLayoutError Error() const { return error; }
+  // Index of the field the last solve failed on.
+  uint32_t FailedField() const { return failedField; }
+
+private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  // Scratch kept between solves, so re-solving does not allocate.
+  std::vector<uint64_t> used;
+  std::vector<uint32_t> order;
+  std::vector<uint32_t> placed; // start of order[k]
+  std::vector<XMLLayoutField> structFields;
+  std::vector<uint32_t> structFieldIndex;
+  uint32_t lengthBits = 0;
+  XMLLayoutError error = XMLLayoutError::None;
+  uint32_t failedField = kNone;
+
+  uint32_t FirstUsed(uint32_t begin, uint32_t end) const;
+  uint32_t FirstFree(uint32_t from) const;
+  void Mark(uint32_t start, uint32_t width);
+  uint32_t FirstFit(const XMLLayoutField &field,
+                    const XMLLayoutOptions &options, uint32_t from) const;
+  bool Fail(XMLLayoutError reason, uint32_t field);
+};
+
+#endif
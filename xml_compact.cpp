@@ -0,0 +1,197 @@
+#include "xml_compact.h"
+#include <unordered_map>
+
+static XMLSymbol InternOptional(XMLSymbolTable &symbols,
+                                const std::optional<std::string> &str) {
+  return str ? symbols.Intern(*str) : kNoSymbol;
+}
+
+static std::optional<std::string> ExpandOptional(const XMLSymbolTable &symbols,
+                                                 XMLSymbol symbol) {
+  if (symbol == kNoSymbol)
+    return std::nullopt;
+  return symbols.Str(symbol);
+}
+
+static void CompactBase(XMLSymbolTable &symbols, const XMLBaseData &data,
+                        XMLCompactBase &out) {
+  out.name = symbols.Intern(data.name);
+  out.prefix = InternOptional(symbols, data.prefix);
+  out.info = InternOptional(symbols, data.info);
+  out.contentHash = data.contentHash;
+}
+
+static void ExpandBase(const XMLSymbolTable &symbols,
+                       const XMLCompactBase &data, XMLBaseData &out) {
+  out.name = symbols.Str(data.name);
+  out.prefix = ExpandOptional(symbols, data.prefix);
+  out.info = ExpandOptional(symbols, data.info);
+  out.contentHash = data.contentHash;
+}
+
+static void CompactValues(const std::vector<XMLValueData> &values,
+                          XMLCompactDoc &out) {
+  for (const XMLValueData &value : values) {
+    XMLCompactValue compact;
+    CompactBase(out.symbols, value, compact);
+    compact.value = value.value;
+    out.values.push_back(compact);
+  }
+}
+
+static void ExpandValues(const XMLCompactDoc &doc, uint32_t first,
+                         uint32_t count, std::vector<XMLValueData> &out) {
+  out.resize(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    const XMLCompactValue &value = doc.values[first + i];
+    ExpandBase(doc.symbols, value, out[i]);
+    out[i].value = value.value;
+  }
+}
+
+void CompactDoc(const XMLDocData &doc, XMLCompactDoc &out) {
+  out = XMLCompactDoc();
+  CompactBase(out.symbols, doc, out);
+
+  // Fields sharing a value table share its range of values, placed the
+  // first time the table is met.
+  constexpr uint32_t kUnplaced = ~0u;
+  std::unordered_map<const XMLValueTable *, uint32_t> tableRanges;
+  size_t fieldCount = 0, valueCount = 0, groupCount = 0;
+  for (const XMLStructData &structData : doc.structures) {
+    fieldCount += structData.fields.size();
+    groupCount += structData.groups.size();
+    for (const XMLFieldData &field : structData.fields) {
+      if (field.choices &&
+          tableRanges.emplace(field.choices.Table(), kUnplaced).second)
+        valueCount += field.choices->size();
+    }
+  }
+  for (const XMLEnumData &enumData : doc.enumerates) {
+    valueCount += enumData.values.size();
+  }
+  out.structures.reserve(doc.structures.size());
+  out.enumerates.reserve(doc.enumerates.size());
+  out.fields.reserve(fieldCount);
+  out.values.reserve(valueCount);
+  out.groups.reserve(groupCount);
+
+  for (const XMLStructData &structData : doc.structures) {
+    XMLCompactStruct compact;
+    CompactBase(out.symbols, structData, compact);
+    compact.length = structData.length;
+    compact.kind = structData.kind;
+    compact.hasAddress = structData.address.has_value();
+    compact.address = structData.address.value_or(0);
+    compact.hasBias = structData.bias.has_value();
+    compact.bias = structData.bias.value_or(0);
+    compact.engine = InternOptional(out.symbols, structData.engine);
+    compact.firstGroup = static_cast<uint32_t>(out.groups.size());
+    compact.groupCount = static_cast<uint32_t>(structData.groups.size());
+    out.groups.insert(out.groups.end(), structData.groups.begin(),
+                      structData.groups.end());
+    compact.firstField = static_cast<uint32_t>(out.fields.size());
+    compact.fieldCount = static_cast<uint32_t>(structData.fields.size());
+    for (const XMLFieldData &field : structData.fields) {
+      XMLCompactField compactField;
+      CompactBase(out.symbols, field, compactField);
+      compactField.start = field.start;
+      compactField.end = field.end;
+      compactField.type = out.symbols.Intern(field.type);
+      compactField.hasDefaultValue = field.defaultValue.has_value();
+      compactField.defaultValue = field.defaultValue.value_or(0);
+      compactField.group = field.group;
+      out.fields.push_back(compactField);
+    }
+    out.structures.push_back(compact);
+  }
+  // Choices go after all fields so each struct's fields stay contiguous.
+  for (size_t s = 0; s < doc.structures.size(); ++s) {
+    const auto &fields = doc.structures[s].fields;
+    for (size_t f = 0; f < fields.size(); ++f) {
+      if (!fields[f].choices)
+        continue;
+      XMLCompactField &compactField =
+          out.fields[out.structures[s].firstField + f];
+      compactField.hasChoices = true;
+      compactField.choiceCount =
+          static_cast<uint32_t>(fields[f].choices->size());
+      uint32_t &first = tableRanges[fields[f].choices.Table()];
+      if (first == kUnplaced) {
+        first = static_cast<uint32_t>(out.values.size());
+        CompactValues(*fields[f].choices, out);
+      }
+      compactField.firstChoice = first;
+    }
+  }
+  for (const XMLEnumData &enumData : doc.enumerates) {
+    XMLCompactEnum compact;
+    CompactBase(out.symbols, enumData, compact);
+    compact.firstValue = static_cast<uint32_t>(out.values.size());
+    compact.valueCount = static_cast<uint32_t>(enumData.values.size());
+    CompactValues(enumData.values, out);
+    out.enumerates.push_back(compact);
+  }
+}
+
+void ExpandDoc(const XMLCompactDoc &doc, XMLDocData &out) {
+  out = XMLDocData();
+  ExpandBase(doc.symbols, doc, out);
+
+  // One table per choice range, shared like before compacting. Empty
+  // ranges can start where another one does, so the count is in the key.
+  std::unordered_map<uint64_t, XMLChoices> tables;
+  out.structures.resize(doc.structures.size());
+  for (size_t s = 0; s < doc.structures.size(); ++s) {
+    const XMLCompactStruct &compact = doc.structures[s];
+    XMLStructData &structData = out.structures[s];
+    ExpandBase(doc.symbols, compact, structData);
+    structData.length = compact.length;
+    structData.kind = compact.kind;
+    if (compact.hasAddress)
+      structData.address = compact.address;
+    if (compact.hasBias)
+      structData.bias = compact.bias;
+    structData.engine = ExpandOptional(doc.symbols, compact.engine);
+    structData.groups.assign(doc.groups.begin() + compact.firstGroup,
+                             doc.groups.begin() + compact.firstGroup +
+                                 compact.groupCount);
+    structData.fields.resize(compact.fieldCount);
+    for (uint32_t f = 0; f < compact.fieldCount; ++f) {
+      const XMLCompactField &compactField = doc.fields[compact.firstField + f];
+      XMLFieldData &field = structData.fields[f];
+      ExpandBase(doc.symbols, compactField, field);
+      field.start = compactField.start;
+      field.end = compactField.end;
+      field.type = doc.symbols.Str(compactField.type);
+      field.group = compactField.group;
+      if (compactField.hasDefaultValue)
+        field.defaultValue = compactField.defaultValue;
+      if (compactField.hasChoices) {
+        XMLChoices &table =
+            tables[(uint64_t(compactField.firstChoice) << 32) |
+                   compactField.choiceCount];
+        if (!table)
+          ExpandValues(doc, compactField.firstChoice, compactField.choiceCount,
+                       table.emplace());
+        field.choices = table;
+      }
+    }
+  }
+  out.enumerates.resize(doc.enumerates.size());
+  for (size_t e = 0; e < doc.enumerates.size(); ++e) {
+    const XMLCompactEnum &compact = doc.enumerates[e];
+    ExpandBase(doc.symbols, compact, out.enumerates[e]);
+    ExpandValues(doc, compact.firstValue, compact.valueCount,
+                 out.enumerates[e].values);
+  }
+}
+
+size_t XMLCompactDoc::MemoryBytes() const {
+  return symbols.MemoryBytes() +
+         structures.capacity() * sizeof(XMLCompactStruct) +
+         enumerates.capacity() * sizeof(XMLCompactEnum) +
+         fields.capacity() * sizeof(XMLCompactField) +
+         values.capacity() * sizeof(XMLCompactValue) +
+         groups.capacity() * sizeof(XMLGroupData);
+}
@@ -0,0 +1,87 @@
+#ifndef __XML_COMPACT_H__
+#define __XML_COMPACT_H__
+
+#include "xml_symbols.h"
+#include "xml_types.h"
+#include <cstdint>
+#include <vector>
+
+// Symbol id form of XMLDocData. Names, prefixes, infos and type names are
+// interned in one document symbol table, absent optionals are kNoSymbol and
+// children live in flat per-kind arrays addressed by (first, count), so a
+// field record is a few dozen bytes instead of several std::strings.
+// Content hashes are carried over unchanged.
+//
+// This is a storage form only. Lookups, the indexes, hashing and edits all
+// work on XMLDocData, whose names and types stay std::string because the
+// editor widgets bind to them. A document is compacted while it is parked
+// (see XMLParserContext::Compact) and expanded before anything reads it, so
+// the memory saving applies to parked documents and the cheaper symbol
+// compares apply only to code reading an XMLCompactDoc directly.
+
+struct XMLCompactBase {
+  XMLSymbol name = kNoSymbol;
+  XMLSymbol prefix = kNoSymbol;
+  XMLSymbol info = kNoSymbol;
+  uint64_t contentHash = 0;
+};
+
+struct XMLCompactValue : public XMLCompactBase {
+  uint64_t value = 0;
+};
+
+struct XMLCompactField : public XMLCompactBase {
+  uint32_t start = 0;
+  uint32_t end = 0;
+  XMLSymbol type = kNoSymbol;
+  bool hasDefaultValue = false;
+  bool hasChoices = false;
+  uint64_t defaultValue = 0;
+  // Range in XMLCompactDoc::values.
+  uint32_t firstChoice = 0;
+  uint32_t choiceCount = 0;
+  uint32_t group = XMLGroupData::kNoGroup;
+};
+
+struct XMLCompactEnum : public XMLCompactBase {
+  // Range in XMLCompactDoc::values.
+  uint32_t firstValue = 0;
+  uint32_t valueCount = 0;
+};
+
+struct XMLCompactStruct : public XMLCompactBase {
+  uint32_t length = 0;
+  XMLStructKind kind = XMLStructKind::Struct;
+  bool hasAddress = false;
+  bool hasBias = false;
+  uint32_t bias = 0;
+  uint64_t address = 0;
+  XMLSymbol engine = kNoSymbol;
+  // Range in XMLCompactDoc::fields.
+  uint32_t firstField = 0;
+  uint32_t fieldCount = 0;
+  // Range in XMLCompactDoc::groups; parent indices stay struct relative.
+  uint32_t firstGroup = 0;
+  uint32_t groupCount = 0;
+};
+
+struct XMLCompactDoc : public XMLCompactBase {
+  XMLSymbolTable symbols;
+  std::vector<XMLCompactStruct> structures;
+  std::vector<XMLCompactEnum> enumerates;
+  std::vector<XMLCompactField> fields;
+  std::vector<XMLCompactValue> values;
+  std::vector<XMLGroupData> groups;
+
+  const char *Name(const XMLCompactBase &data) const {
+    return symbols.CStr(data.name);
+  }
+  size_t MemoryBytes() const;
+};
+
+void CompactDoc(const XMLDocData &doc, XMLCompactDoc &out);
+// Rebuild the string model; the result is equal to the compacted input,
+// hashes included.
+void ExpandDoc(const XMLCompactDoc &doc, XMLDocData &out);
+
+#endif
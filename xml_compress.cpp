@@ -0,0 +1,508 @@
+#include "xml_compress.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef GENXML_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef GENXML_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr size_t kChunkBytes = size_t(1) << 20;
+// Chunks the reading thread may be ahead of the decompressor.
+constexpr size_t kMaxQueuedChunks = 4;
+// Output is produced in steps of this many bytes.
+constexpr size_t kOutputStep = size_t(256) << 10;
+
+// Compressed chunks handed from the reading thread to the decompressor.
+class ChunkQueue {
+public:
+  // Blocks while the queue is full. False once the consumer gave up.
+  bool Push(std::vector<char> chunk) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() {
+      return chunks.size() < kMaxQueuedChunks || isCancelled;
+    });
+    if (isCancelled)
+      return false;
+    chunks.push_back(std::move(chunk));
+    changed.notify_all();
+    return true;
+  }
+
+  // No more chunks; 'failed' after a read error.
+  void Close(bool failed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    isClosed = true;
+    isFailed = failed;
+    changed.notify_all();
+  }
+
+  // Blocks until a chunk is there. False at the end of the file.
+  bool Pop(std::vector<char> &chunk) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return !chunks.empty() || isClosed; });
+    if (chunks.empty())
+      return false;
+    chunk = std::move(chunks.front());
+    chunks.pop_front();
+    changed.notify_all();
+    return true;
+  }
+
+  // Stop the reader, the rest of the file is not needed.
+  void Cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    isCancelled = true;
+    chunks.clear();
+    changed.notify_all();
+  }
+
+  bool IsFailed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return isFailed;
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<char>> chunks;
+  bool isClosed = false;
+  bool isFailed = false;
+  bool isCancelled = false;
+};
+
+// Streaming decompressor, fed one chunk at a time.
+class Inflater {
+public:
+  virtual ~Inflater() = default;
+  // Decompress 'size' bytes and append the result to 'out'.
+  virtual bool Feed(const char *data, size_t size, std::string &out,
+                    std::string &error) = 0;
+  // Whether the input ended on the end of a stream.
+  virtual bool Finish(std::string &error) = 0;
+};
+
+// Room for one more output step at the end of 'out'; returns its offset.
+size_t GrowOutput(std::string &out) {
+  size_t offset = out.size();
+  if (out.capacity() < offset + kOutputStep)
+    out.reserve(std::max(out.capacity() * 2, offset + kOutputStep));
+  out.resize(offset + kOutputStep);
+  return offset;
+}
+
+#ifdef GENXML_HAVE_ZLIB
+class GzipInflater : public Inflater {
+public:
+  GzipInflater() {
+    std::memset(&stream, 0, sizeof(stream));
+    // 32: accept both gzip and zlib headers.
+    isValid = inflateInit2(&stream, 15 + 32) == Z_OK;
+  }
+  ~GzipInflater() override {
+    if (isValid)
+      inflateEnd(&stream);
+  }
+
+  bool Feed(const char *data, size_t size, std::string &out,
+            std::string &error) override {
+    if (!isValid) {
+      error = "cannot initialize zlib";
+      return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    while (stream.avail_in > 0 || isOutputFull) {
+      if (isEnded) {
+        // Concatenated members, as `cat a.gz b.gz` produces.
+        if (inflateReset(&stream) != Z_OK) {
+          error = "corrupt gzip stream";
+          return false;
+        }
+        isEnded = false;
+      }
+      size_t offset = GrowOutput(out);
+      stream.next_out = reinterpret_cast<Bytef *>(&out[offset]);
+      stream.avail_out = static_cast<uInt>(kOutputStep);
+      int result = inflate(&stream, Z_NO_FLUSH);
+      isOutputFull = stream.avail_out == 0;
+      out.resize(offset + kOutputStep - stream.avail_out);
+      if (result == Z_STREAM_END) {
+        isEnded = true;
+        // Reset for a following member only once its bytes are here;
+        // resetting on no input would make Finish() see a truncated stream.
+        if (stream.avail_in == 0) {
+          isOutputFull = false;
+          break;
+        }
+      } else if (result == Z_BUF_ERROR && !isOutputFull) {
+        break; // needs the next chunk
+      } else if (result != Z_OK && result != Z_BUF_ERROR) {
+        error = stream.msg ? stream.msg : "corrupt gzip stream";
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Finish(std::string &error) override {
+    if (!isEnded)
+      error = "truncated gzip stream";
+    return isEnded;
+  }
+
+private:
+  z_stream stream;
+  bool isValid = false;
+  bool isEnded = false;
+  bool isOutputFull = false;
+};
+#endif
+
+#ifdef GENXML_HAVE_ZSTD
+class ZstdInflater : public Inflater {
+public:
+  ~ZstdInflater() override { ZSTD_freeDStream(stream); }
+
+  bool Feed(const char *data, size_t size, std::string &out,
+            std::string &error) override {
+    if (!stream) {
+      error = "cannot initialize zstd";
+      return false;
+    }
+    ZSTD_inBuffer input = {data, size, 0};
+    bool isOutputFull = false;
+    while (input.pos < input.size || isOutputFull) {
+      size_t offset = GrowOutput(out);
+      ZSTD_outBuffer output = {&out[offset], kOutputStep, 0};
+      size_t result = ZSTD_decompressStream(stream, &output, &input);
+      out.resize(offset + output.pos);
+      if (ZSTD_isError(result)) {
+        error = ZSTD_getErrorName(result);
+        return false;
+      }
+      // 0 once a frame is complete and flushed.
+      pending = result;
+      isOutputFull = output.pos == output.size;
+    }
+    return true;
+  }
+
+  bool Finish(std::string &error) override {
+    if (pending != 0)
+      error = "truncated zstd stream";
+    return pending == 0;
+  }
+
+private:
+  ZSTD_DStream *stream = ZSTD_createDStream();
+  size_t pending = 0;
+};
+#endif
+
+std::unique_ptr<Inflater> MakeInflater(XMLCompression compression) {
+  switch (compression) {
+#ifdef GENXML_HAVE_ZLIB
+  case XMLCompression::Gzip:
+    return std::make_unique<GzipInflater>();
+#endif
+#ifdef GENXML_HAVE_ZSTD
+  case XMLCompression::Zstd:
+    return std::make_unique<ZstdInflater>();
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+XMLCompression SniffCompression(const unsigned char *magic, size_t size) {
+  if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+    return XMLCompression::Gzip;
+  if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+      magic[3] == 0xfd)
+    return XMLCompression::Zstd;
+  return XMLCompression::None;
+}
+
+// The decompressed size, when the format records it, to size the output in
+// one allocation. Only a hint: gzip keeps it modulo 4GB.
+size_t DecompressedSizeHint(FILE *file, XMLCompression compression,
+                            size_t fileBytes) {
+  unsigned char header[18] = {};
+  size_t headerBytes = 0;
+  if (compression == XMLCompression::Gzip && fileBytes >= 18 &&
+      std::fseek(file, -4, SEEK_END) == 0 &&
+      std::fread(header, 1, 4, file) == 4) {
+    headerBytes = 4;
+  }
+#ifdef GENXML_HAVE_ZSTD
+  if (compression == XMLCompression::Zstd && std::fseek(file, 0, SEEK_SET) == 0)
+    headerBytes = std::fread(header, 1, sizeof(header), file);
+#endif
+  std::fseek(file, 0, SEEK_SET);
+  if (compression == XMLCompression::Gzip && headerBytes == 4) {
+    return static_cast<size_t>(header[0]) | static_cast<size_t>(header[1]) << 8 |
+           static_cast<size_t>(header[2]) << 16 |
+           static_cast<size_t>(header[3]) << 24;
+  }
+#ifdef GENXML_HAVE_ZSTD
+  if (compression == XMLCompression::Zstd) {
+    unsigned long long size = ZSTD_getFrameContentSize(header, headerBytes);
+    if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR)
+      return static_cast<size_t>(size);
+  }
+#endif
+  return 0;
+}
+
+bool ReadPlainFile(FILE *file, size_t fileBytes, std::string &out) {
+  out.resize(fileBytes);
+  return std::fread(&out[0], 1, fileBytes, file) == fileBytes;
+}
+
+bool ReadCompressedFile(FILE *file, XMLCompression compression,
+                        size_t fileBytes, std::string &out,
+                        std::string &error) {
+  std::unique_ptr<Inflater> inflater = MakeInflater(compression);
+  // An implausible hint (a corrupt trailer) is not worth a huge allocation.
+  size_t hint = DecompressedSizeHint(file, compression, fileBytes);
+  if (hint <= fileBytes * 64)
+    out.reserve(hint);
+
+  ChunkQueue queue;
+  std::thread reader([file, &queue]() {
+    bool failed = false;
+    for (;;) {
+      std::vector<char> chunk(kChunkBytes);
+      size_t read = std::fread(chunk.data(), 1, chunk.size(), file);
+      if (read == 0) {
+        failed = std::ferror(file) != 0;
+        break;
+      }
+      chunk.resize(read);
+      if (!queue.Push(std::move(chunk)))
+        break;
+    }
+    queue.Close(failed);
+  });
+
+  bool ok = true;
+  std::vector<char> chunk;
+  while (ok && queue.Pop(chunk)) {
+    ok = inflater->Feed(chunk.data(), chunk.size(), out, error);
+  }
+  if (!ok)
+    queue.Cancel();
+  reader.join();
+  if (ok && queue.IsFailed()) {
+    error = "cannot read the file";
+    ok = false;
+  }
+  return ok && inflater->Finish(error);
+}
+
+#ifdef GENXML_HAVE_ZLIB
+bool WriteGzip(FILE *file, const char *data, size_t size, std::string &error) {
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+  // 16: gzip header and trailer instead of zlib's.
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    error = "cannot initialize zlib";
+    return false;
+  }
+  std::vector<char> buffer(kOutputStep);
+  bool ok = true;
+  int result = Z_OK;
+  while (ok && result != Z_STREAM_END) {
+    // avail_in is 32 bits wide, feed large documents in pieces.
+    if (stream.avail_in == 0 && size > 0) {
+      size_t piece = std::min(size, kChunkBytes);
+      stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+      stream.avail_in = static_cast<uInt>(piece);
+      data += piece;
+      size -= piece;
+    }
+    stream.next_out = reinterpret_cast<Bytef *>(buffer.data());
+    stream.avail_out = static_cast<uInt>(buffer.size());
+    result = deflate(&stream, size == 0 ? Z_FINISH : Z_NO_FLUSH);
+    size_t produced = buffer.size() - stream.avail_out;
+    if (result == Z_STREAM_ERROR) {
+      error = "gzip compression failed";
+      ok = false;
+    } else if (std::fwrite(buffer.data(), 1, produced, file) != produced) {
+      error = "cannot write the file";
+      ok = false;
+    }
+  }
+  deflateEnd(&stream);
+  return ok;
+}
+#endif
+
+#ifdef GENXML_HAVE_ZSTD
+bool WriteZstd(FILE *file, const char *data, size_t size, std::string &error) {
+  ZSTD_CCtx *context = ZSTD_createCCtx();
+  if (!context) {
+    error = "cannot initialize zstd";
+    return false;
+  }
+  // Lets a reader size its output buffer in one go.
+  ZSTD_CCtx_setPledgedSrcSize(context, size);
+  std::vector<char> buffer(kOutputStep);
+  ZSTD_inBuffer input = {data, size, 0};
+  bool ok = true;
+  size_t remaining = 1;
+  while (ok && remaining != 0) {
+    ZSTD_outBuffer output = {buffer.data(), buffer.size(), 0};
+    remaining = ZSTD_compressStream2(context, &output, &input, ZSTD_e_end);
+    if (ZSTD_isError(remaining)) {
+      error = ZSTD_getErrorName(remaining);
+      ok = false;
+    } else if (std::fwrite(buffer.data(), 1, output.pos, file) != output.pos) {
+      error = "cannot write the file";
+      ok = false;
+    }
+  }
+  ZSTD_freeCCtx(context);
+  return ok;
+}
+#endif
+
+bool EndsWith(const std::string &str, const char *suffix) {
+  size_t length = std::strlen(suffix);
+  return str.size() >= length &&
+         str.compare(str.size() - length, length, suffix) == 0;
+}
+
+} // namespace
+
+XMLCompression CompressionOfPath(const std::string &path) {
+  if (EndsWith(path, ".gz"))
+    return XMLCompression::Gzip;
+  if (EndsWith(path, ".zst"))
+    return XMLCompression::Zstd;
+  return XMLCompression::None;
+}
+
+const char *CompressionName(XMLCompression compression) {
+  switch (compression) {
+  case XMLCompression::Gzip:
+    return "gzip";
+  case XMLCompression::Zstd:
+    return "zstd";
+  default:
+    return "none";
+  }
+}
+
+bool IsCompressionSupported(XMLCompression compression) {
+  switch (compression) {
+  case XMLCompression::None:
+    return true;
+  case XMLCompression::Gzip:
+#ifdef GENXML_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+  case XMLCompression::Zstd:
+#ifdef GENXML_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+bool ReadSourceFile(const std::string &path, std::string &out,
+                    std::string &error) {
+  out.clear();
+  FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    error = "cannot read the file";
+    return false;
+  }
+  long end = -1;
+  if (std::fseek(file, 0, SEEK_END) == 0)
+    end = std::ftell(file);
+  unsigned char magic[4] = {};
+  size_t magicBytes = 0;
+  if (end >= 0 && std::fseek(file, 0, SEEK_SET) == 0) {
+    magicBytes = std::fread(magic, 1, sizeof(magic), file);
+    std::fseek(file, 0, SEEK_SET);
+  }
+  if (end < 0 || std::ferror(file)) {
+    std::fclose(file);
+    error = "cannot read the file";
+    return false;
+  }
+
+  size_t fileBytes = static_cast<size_t>(end);
+  XMLCompression compression = SniffCompression(magic, magicBytes);
+  bool ok = false;
+  if (compression == XMLCompression::None) {
+    ok = ReadPlainFile(file, fileBytes, out);
+    if (!ok)
+      error = "cannot read the file";
+  } else if (!IsCompressionSupported(compression)) {
+    error = std::string("built without ") + CompressionName(compression) +
+            " support";
+  } else {
+    ok = ReadCompressedFile(file, compression, fileBytes, out, error);
+  }
+  std::fclose(file);
+  if (!ok)
+    out.clear();
+  return ok;
+}
+
+bool WriteCompressedFile(const std::string &path, XMLCompression compression,
+                         const char *data, size_t size, std::string &error) {
+  if (!IsCompressionSupported(compression)) {
+    error = std::string("built without ") + CompressionName(compression) +
+            " support";
+    return false;
+  }
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    error = "cannot open the file for writing";
+    return false;
+  }
+  bool ok = false;
+  switch (compression) {
+  case XMLCompression::None:
+    ok = std::fwrite(data, 1, size, file) == size;
+    if (!ok)
+      error = "cannot write the file";
+    break;
+#ifdef GENXML_HAVE_ZLIB
+  case XMLCompression::Gzip:
+    ok = WriteGzip(file, data, size, error);
+    break;
+#endif
+#ifdef GENXML_HAVE_ZSTD
+  case XMLCompression::Zstd:
+    ok = WriteZstd(file, data, size, error);
+    break;
+#endif
+  default:
+    break;
+  }
+  if (std::fclose(file) != 0 && ok) {
+    error = "cannot write the file";
+    ok = false;
+  }
+  return ok;
+}
@@ -0,0 +1,31 @@
+#ifndef __XML_COMPRESS_H__
+#define __XML_COMPRESS_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Compressed genxml files (.xml.gz, .xml.zst).
+//
+// Reading streams the file in fixed size chunks: a second thread reads the
+// compressed bytes while the calling thread decompresses the chunks it
+// already has, so a slow disk or network share and the decompressor run in
+// parallel. gzip needs zlib and zstd needs libzstd at build time; without
+// them those files fail to open with an error saying so.
+
+enum class XMLCompression : uint8_t { None, Gzip, Zstd };
+
+// By file name suffix: ".gz" or ".zst".
+XMLCompression CompressionOfPath(const std::string &path);
+const char *CompressionName(XMLCompression compression);
+bool IsCompressionSupported(XMLCompression compression);
+
+// The whole file as text. Compressed files are recognized by their magic
+// bytes, whatever their name.
+bool ReadSourceFile(const std::string &path, std::string &out,
+                    std::string &error);
+// Write 'size' bytes of 'data' compressed with 'compression'.
+bool WriteCompressedFile(const std::string &path, XMLCompression compression,
+                         const char *data, size_t size, std::string &error);
+
+#endif
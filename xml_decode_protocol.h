@@ -0,0 +1,117 @@
+#ifndef __XML_DECODE_PROTOCOL_H__
+#define __XML_DECODE_PROTOCOL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+// Wire format of genxml-daemon. The socket is local, so integers are in host
+// byte order; strings are length prefixed and not NUL terminated.
+//
+//   frame    := u32 magic, u32 itemCount, u32 bodySize, body[bodySize]
+//   request  := u8 op, u8[3] 0, u32 size, payload[size]
+//   response := u8 op, u8 status, u16 0, u32 size, payload[size]
+//
+// Every request frame is a batch answered by one response frame with the
+// same number of items, in order.
+//
+//   Lookup   payload: name bytes
+//            reply:   u32 generation, u32 document, u32 struct,
+//                     u32 length (dwords), u32 fieldCount
+//   Decode   payload: u32 generation, u32 document, u32 struct,
+//                     u32 dwordCount, u32 dwords[dwordCount]
+//            reply:   u32 fieldCount, fieldCount * (u32 fieldIndex, u64 raw,
+//                     u16 nameSize, u16 textSize, name, text)
+//            A field inside a <group> is reported once per repetition, in
+//            the order of the dwords.
+//   Error replies carry a message instead.
+//
+// 'generation' changes whenever the daemon reloads its definitions; a decode
+// naming an older generation is answered with Stale, and the client repeats
+// the lookup since struct indices may have moved.
+
+constexpr uint32_t kDecodeRequestMagic = 0x51445847;  // "GXDQ"
+constexpr uint32_t kDecodeResponseMagic = 0x52445847; // "GXDR"
+constexpr uint32_t kDecodeMaxFrameBytes = 64u << 20;
+
+enum class XMLDecodeOp : uint8_t { Lookup = 1, Decode = 2 };
+
+enum class XMLDecodeStatus : uint8_t {
+  Ok = 0,
+  NotFound = 1,
+  Stale = 2,
+  BadRequest = 3,
+};
+
+struct XMLDecodeFrameHeader {
+  uint32_t magic;
+  uint32_t itemCount;
+  uint32_t bodySize;
+};
+
+class XMLWireWriter {
+public:
+  std::vector<uint8_t> buffer;
+
+  void U8(uint8_t v) { Raw(&v, sizeof(v)); }
+  void U16(uint16_t v) { Raw(&v, sizeof(v)); }
+  void U32(uint32_t v) { Raw(&v, sizeof(v)); }
+  void U64(uint64_t v) { Raw(&v, sizeof(v)); }
+  void Raw(const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+  }
+  // Reserve a u32 to be filled in later, e.g. a size.
+  size_t Placeholder32() {
+    U32(0);
+    return buffer.size() - sizeof(uint32_t);
+  }
+  void Patch32(size_t offset, uint32_t v) {
+    std::memcpy(buffer.data() + offset, &v, sizeof(v));
+  }
+};
+
+// Bounds checked reads; after the first short read everything fails.
+class XMLWireReader {
+public:
+  XMLWireReader(const uint8_t *data, size_t size)
+      : cursor(data), end(data + size) {}
+
+  bool Ok() const { return ok; }
+  size_t Remaining() const { return end - cursor; }
+
+  uint8_t U8() { return Read<uint8_t>(); }
+  uint16_t U16() { return Read<uint16_t>(); }
+  uint32_t U32() { return Read<uint32_t>(); }
+  uint64_t U64() { return Read<uint64_t>(); }
+  std::string_view Bytes(size_t size) {
+    if (!Take(size))
+      return std::string_view();
+    return std::string_view(reinterpret_cast<const char *>(cursor - size),
+                            size);
+  }
+
+private:
+  const uint8_t *cursor;
+  const uint8_t *end;
+  bool ok = true;
+
+  bool Take(size_t size) {
+    if (!ok || static_cast<size_t>(end - cursor) < size) {
+      ok = false;
+      return false;
+    }
+    cursor += size;
+    return true;
+  }
+  template <typename T> T Read() {
+    T v = 0;
+    if (Take(sizeof(T)))
+      std::memcpy(&v, cursor - sizeof(T), sizeof(T));
+    return v;
+  }
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "xml_decoder.h"
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+bool ExtractBits(const uint32_t *dwords, size_t dwordCount, uint32_t start,
+                 uint32_t end, uint64_t &out) {
+  if (end < start || end / 32 >= dwordCount)
+    return false;
+  // At most 64 bits are kept, so read up to three dwords.
+  uint32_t width = end - start + 1;
+  if (width > 64)
+    width = 64;
+  uint32_t first = start / 32;
+  uint32_t shift = start % 32;
+  uint64_t value = dwords[first] >> shift;
+  uint32_t have = 32 - shift;
+  for (uint32_t d = first + 1; have < width && d < dwordCount; ++d) {
+    value |= static_cast<uint64_t>(dwords[d]) << have;
+    have += 32;
+  }
+  out = width == 64 ? value : value & ((uint64_t(1) << width) - 1);
+  return true;
+}
+
+static int64_t SignExtend(uint64_t value, uint32_t width) {
+  if (width == 0 || width >= 64)
+    return static_cast<int64_t>(value);
+  uint64_t sign = uint64_t(1) << (width - 1);
+  return static_cast<int64_t>((value ^ sign) - sign);
+}
+
+static const XMLValueData *FindValue(const std::vector<XMLValueData> &values,
+                                     uint64_t raw) {
+  for (const XMLValueData &value : values) {
+    if (value.value == raw)
+      return &value;
+  }
+  return nullptr;
+}
+
+static void AppendNamedValue(const XMLValueData *value, uint64_t raw,
+                             std::string &out) {
+  char buf[64];
+  if (value) {
+    out += value->name;
+    std::snprintf(buf, sizeof(buf), " (%" PRIu64 ")", raw);
+  } else {
+    std::snprintf(buf, sizeof(buf), "%" PRIu64 " (unknown)", raw);
+  }
+  out += buf;
+}
+
+void XMLDecoder::FormatField(uint32_t structIndex, uint32_t fieldIndex,
+                             uint64_t raw, std::string &out) const {
+  const XMLFieldData &field = doc.structures[structIndex].fields[fieldIndex];
+  const XMLTypeRef &ref = typeGraph.FieldType(structIndex, fieldIndex);
+  uint32_t width = field.end - field.start + 1;
+  char buf[64];
+  out.clear();
+
+  if (field.choices) {
+    // Fields with the same choices share one sorted index.
+    AppendNamedValue(field.choices.Find(raw), raw, out);
+    return;
+  }
+  switch (ref.kind) {
+  case XMLTypeKind::Enum:
+    AppendNamedValue(FindValue(doc.enumerates[ref.index].values, raw), raw,
+                     out);
+    return;
+  case XMLTypeKind::Struct:
+    std::snprintf(buf, sizeof(buf), "0x%" PRIx64, raw);
+    out = doc.structures[ref.index].name;
+    out += " ";
+    out += buf;
+    return;
+  case XMLTypeKind::Unresolved:
+    std::snprintf(buf, sizeof(buf), "%" PRIu64, raw);
+    break;
+  case XMLTypeKind::Builtin:
+    switch (ref.builtin) {
+    case XMLBuiltinType::Int:
+      std::snprintf(buf, sizeof(buf), "%" PRId64, SignExtend(raw, width));
+      break;
+    case XMLBuiltinType::Bool:
+      std::snprintf(buf, sizeof(buf), "%s", raw ? "true" : "false");
+      break;
+    case XMLBuiltinType::Float:
+      if (width == 32) {
+        float f;
+        uint32_t bits = static_cast<uint32_t>(raw);
+        std::memcpy(&f, &bits, sizeof(f));
+        std::snprintf(buf, sizeof(buf), "%g", f);
+      } else {
+        std::snprintf(buf, sizeof(buf), "0x%" PRIx64, raw);
+      }
+      break;
+    case XMLBuiltinType::Address:
+    case XMLBuiltinType::Offset:
+      std::snprintf(buf, sizeof(buf), "0x%08" PRIx64, raw);
+      break;
+    case XMLBuiltinType::UFixed:
+    case XMLBuiltinType::SFixed: {
+      // "u4.8": the fraction width follows the dot.
+      long fraction = std::strtol(field.type.c_str() + field.type.find('.') + 1,
+                                  nullptr, 10);
+      double value = ref.builtin == XMLBuiltinType::SFixed
+                         ? static_cast<double>(SignExtend(raw, width))
+                         : static_cast<double>(raw);
+      std::snprintf(buf, sizeof(buf), "%g",
+                    std::ldexp(value, -static_cast<int>(fraction)));
+      break;
+    }
+    default:
+      std::snprintf(buf, sizeof(buf), "%" PRIu64, raw);
+      break;
+    }
+    break;
+  }
+  out = buf;
+}
+
+// Whether 'group' is 'scope' or nested in it; kNoGroup is the struct scope.
+static bool GroupIsIn(const std::vector<XMLGroupData> &groups, uint32_t group,
+                      uint32_t scope) {
+  for (; group < groups.size(); group = groups[group].parent) {
+    if (group == scope)
+      return true;
+  }
+  return scope == XMLGroupData::kNoGroup;
+}
+
+// Decode fields [first, last), which all lie in 'group', with the group's
+// current repetition starting at bit 'base'. Nested groups are runs of
+// fields, expanded one repetition at a time.
+void XMLDecoder::DecodeGroup(uint32_t structIndex, uint32_t group,
+                             uint32_t base, uint32_t repeat, uint32_t first,
+                             uint32_t last, const uint32_t *dwords,
+                             size_t dwordCount,
+                             std::vector<XMLDecodedField> &out) const {
+  const XMLStructData &structData = doc.structures[structIndex];
+  const auto &fields = structData.fields;
+  const auto &groups = structData.groups;
+  uint64_t bitCount = uint64_t(dwordCount) * 32;
+  for (uint32_t f = first; f < last;) {
+    uint32_t child = fields[f].group;
+    if (child >= groups.size() || child == group) {
+      uint64_t start = uint64_t(base) + fields[f].start;
+      uint64_t end = uint64_t(base) + fields[f].end;
+      uint64_t raw;
+      if (end < bitCount &&
+          ExtractBits(dwords, dwordCount, static_cast<uint32_t>(start),
+                      static_cast<uint32_t>(end), raw)) {
+        out.push_back(XMLDecodedField{f, static_cast<uint32_t>(start), repeat,
+                                      raw, std::string()});
+        FormatField(structIndex, f, raw, out.back().text);
+      }
+      ++f;
+      continue;
+    }
+    // The outermost group below 'group' holding this field, and its run.
+    while (groups[child].parent != group &&
+           groups[child].parent < groups.size())
+      child = groups[child].parent;
+    uint32_t runEnd = f + 1;
+    while (runEnd < last && GroupIsIn(groups, fields[runEnd].group, child))
+      ++runEnd;
+    const XMLGroupData &repeated = groups[child];
+    // A zero size cannot advance, so it is a single repetition.
+    uint32_t count = repeated.size == 0 ? 1 : repeated.count;
+    for (uint32_t i = 0; count == 0 || i < count; ++i) {
+      uint64_t groupBase =
+          uint64_t(base) + repeated.start + uint64_t(i) * repeated.size;
+      if (groupBase >= bitCount)
+        break;
+      DecodeGroup(structIndex, child, static_cast<uint32_t>(groupBase), i, f,
+                  runEnd, dwords, dwordCount, out);
+    }
+    f = runEnd;
+  }
+}
+
+bool XMLDecoder::DecodeStruct(uint32_t structIndex, const uint32_t *dwords,
+                              size_t dwordCount,
+                              std::vector<XMLDecodedField> &out) const {
+  if (structIndex >= doc.structures.size())
+    return false;
+  const auto &fields = doc.structures[structIndex].fields;
+  out.clear();
+  out.reserve(fields.size());
+  DecodeGroup(structIndex, XMLGroupData::kNoGroup, 0, 0, 0,
+              static_cast<uint32_t>(fields.size()), dwords, dwordCount, out);
+  return true;
+}
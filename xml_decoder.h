@@ -0,0 +1,57 @@
+#ifndef __XML_DECODER_H__
+#define __XML_DECODER_H__
+
+#include "xml_typegraph.h"
+#include "xml_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct XMLDecodedField {
+  uint32_t fieldIndex;
+  // First bit of this instance of the field in the dword stream.
+  uint32_t start;
+  // Repetition of the field's innermost group, 0 outside of groups.
+  uint32_t repeat;
+  // Bits [start, end] of the field; only the low 64 bits of wider fields.
+  uint64_t raw;
+  std::string text;
+};
+
+// Bits [start, end] (inclusive, counted from bit 0 of dword 0) of a
+// little-endian dword stream. Returns false when the range is outside
+// 'dwordCount' dwords or inverted.
+bool ExtractBits(const uint32_t *dwords, size_t dwordCount, uint32_t start,
+                 uint32_t end, uint64_t &out);
+
+// Decodes raw struct dwords against a loaded document, rendering every field
+// according to its resolved type: enum and choice names, signed and fixed
+// point numbers, floats, addresses. Holds references only, so it is cheap to
+// create per request; the document must be fully loaded.
+class XMLDecoder {
+public:
+  XMLDecoder(const XMLDocData &doc, const XMLTypeGraph &typeGraph)
+      : doc(doc), typeGraph(typeGraph) {}
+
+  // Fields lying outside 'dwordCount' dwords are skipped. A field inside a
+  // group yields one entry per repetition, the fields of one repetition
+  // together; groups of count 0 repeat while they start inside the dwords.
+  // Returns false for an unknown struct index.
+  bool DecodeStruct(uint32_t structIndex, const uint32_t *dwords,
+                    size_t dwordCount,
+                    std::vector<XMLDecodedField> &out) const;
+  void FormatField(uint32_t structIndex, uint32_t fieldIndex, uint64_t raw,
+                   std::string &out) const;
+
+private:
+  const XMLDocData &doc;
+  const XMLTypeGraph &typeGraph;
+
+  void DecodeGroup(uint32_t structIndex, uint32_t group, uint32_t base,
+                   uint32_t repeat, uint32_t first, uint32_t last,
+                   const uint32_t *dwords, size_t dwordCount,
+                   std::vector<XMLDecodedField> &out) const;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "xml_diagnostics.h"
+#include <algorithm>
+#include <cstdio>
+
+void XMLDiagnostics::Report(XMLDiagSeverity severity, XMLDiagElement element,
+                            XMLDiagCode code, uint32_t line,
+                            const char *arg) {
+  XMLDiagnostic diagnostic;
+  diagnostic.arg = arg;
+  diagnostic.line = line ? line + lineBase : 0;
+  diagnostic.textOffset = 0;
+  diagnostic.textSize = 0;
+  diagnostic.code = code;
+  diagnostic.severity = severity;
+  diagnostic.element = element;
+  records.push_back(diagnostic);
+}
+
+void XMLDiagnostics::ReportText(XMLDiagSeverity severity,
+                                XMLDiagElement element, uint32_t line,
+                                std::string_view message) {
+  Report(severity, element, XMLDiagCode::Text, line);
+  records.back().textOffset = static_cast<uint32_t>(text.size());
+  records.back().textSize = static_cast<uint32_t>(message.size());
+  text.append(message);
+}
+
+void XMLDiagnostics::Append(const XMLDiagnostics &other) {
+  uint32_t textBase = static_cast<uint32_t>(text.size());
+  for (XMLDiagnostic diagnostic : other.records) {
+    diagnostic.textOffset += textBase;
+    records.push_back(diagnostic);
+  }
+  text.append(other.text);
+}
+
+void XMLDiagnostics::Clear() {
+  records.clear();
+  text.clear();
+  lineBase = 0;
+}
+
+size_t XMLDiagnostics::Count(XMLDiagSeverity severity) const {
+  return std::count_if(records.begin(), records.end(),
+                       [severity](const XMLDiagnostic &diagnostic) {
+                         return diagnostic.severity == severity;
+                       });
+}
+
+int XMLDiagnostics::Format(const XMLDiagnostic &diagnostic, char *out,
+                           size_t size) const {
+  const char *element = DiagElementName(diagnostic.element);
+  switch (diagnostic.code) {
+  case XMLDiagCode::BadAttribute:
+    return std::snprintf(out, size, "%s: missing or malformed attribute '%s'",
+                         element, diagnostic.arg ? diagnostic.arg : "?");
+  case XMLDiagCode::NoRootElement:
+    return std::snprintf(out, size, "no <genxml> root element");
+  case XMLDiagCode::NoValues:
+    return std::snprintf(out, size, "%s has no values", element);
+  case XMLDiagCode::NoFields:
+    return std::snprintf(out, size, "%s has no fields", element);
+  case XMLDiagCode::InvalidDefinition:
+    return std::snprintf(out, size, "invalid %s definition dropped", element);
+  case XMLDiagCode::BodyNotLoaded:
+    return std::snprintf(out, size, "%s body failed to load, kept its header",
+                         element);
+  case XMLDiagCode::MalformedJournalRecord:
+    return std::snprintf(out, size, "malformed journal record (%s) skipped",
+                         element);
+  case XMLDiagCode::Text:
+    return std::snprintf(out, size, "%.*s",
+                         static_cast<int>(diagnostic.textSize),
+                         text.data() + diagnostic.textOffset);
+  }
+  return std::snprintf(out, size, "?");
+}
+
+const char *DiagSeverityName(XMLDiagSeverity severity) {
+  switch (severity) {
+  case XMLDiagSeverity::Note:
+    return "note";
+  case XMLDiagSeverity::Warning:
+    return "warning";
+  case XMLDiagSeverity::Error:
+    return "error";
+  }
+  return "?";
+}
+
+const char *DiagElementName(XMLDiagElement element) {
+  switch (element) {
+  case XMLDiagElement::Document:
+    return "document";
+  case XMLDiagElement::Enum:
+    return "enum";
+  case XMLDiagElement::Struct:
+    return "struct";
+  case XMLDiagElement::Field:
+    return "field";
+  case XMLDiagElement::Value:
+    return "value";
+  case XMLDiagElement::Instruction:
+    return "instruction";
+  case XMLDiagElement::Register:
+    return "register";
+  case XMLDiagElement::Group:
+    return "group";
+  }
+  return "?";
+}
+
+void PrintDiagnostics(const XMLDiagnostics &diagnostics, const char *file,
+                      FILE *out) {
+  for (const auto &diagnostic : diagnostics.Records()) {
+    char message[512];
+    diagnostics.Format(diagnostic, message, sizeof(message));
+    if (diagnostic.line) {
+      std::fprintf(out, "%s:%u: %s: %s\n", file, diagnostic.line,
+                   DiagSeverityName(diagnostic.severity), message);
+    } else {
+      std::fprintf(out, "%s: %s: %s\n", file,
+                   DiagSeverityName(diagnostic.severity), message);
+    }
+  }
+}
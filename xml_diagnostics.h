@@ -0,0 +1,86 @@
+#ifndef __XML_DIAGNOSTICS_H__
+#define __XML_DIAGNOSTICS_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class XMLDiagSeverity : uint8_t { Note, Warning, Error };
+
+enum class XMLDiagElement : uint8_t {
+  Document,
+  Enum,
+  Struct,
+  Field,
+  Value,
+  Instruction,
+  Register,
+  Group,
+};
+
+enum class XMLDiagCode : uint8_t {
+  // 'arg' names the attribute.
+  BadAttribute,
+  NoRootElement,
+  NoValues,
+  NoFields,
+  // A child failed, the whole definition was dropped.
+  InvalidDefinition,
+  // A lazily loaded body failed, the definition keeps only its header.
+  BodyNotLoaded,
+  MalformedJournalRecord,
+  // The message is the record's text, e.g. from tinyxml2 or the scanner.
+  Text,
+};
+
+// One diagnostic. 'arg' must point to static storage, e.g. an attribute name
+// literal; free text lives in the owning XMLDiagnostics.
+struct XMLDiagnostic {
+  const char *arg;
+  uint32_t line; // 0 when unknown
+  uint32_t textOffset;
+  uint32_t textSize;
+  XMLDiagCode code;
+  XMLDiagSeverity severity;
+  XMLDiagElement element;
+};
+
+// Collects parser diagnostics as compact records. Reporting never formats
+// or prints anything; messages are built on demand by Format().
+class XMLDiagnostics {
+public:
+  void Report(XMLDiagSeverity severity, XMLDiagElement element,
+              XMLDiagCode code, uint32_t line, const char *arg = nullptr);
+  void ReportText(XMLDiagSeverity severity, XMLDiagElement element,
+                  uint32_t line, std::string_view message);
+  // Take over another sink's records, e.g. one filled on a worker thread.
+  void Append(const XMLDiagnostics &other);
+  void Clear();
+
+  // Added to the line of every later report, for fragments of a larger file.
+  void SetLineBase(uint32_t base) { lineBase = base; }
+
+  const std::vector<XMLDiagnostic> &Records() const { return records; }
+  size_t Count(XMLDiagSeverity severity) const;
+  bool HasErrors() const { return Count(XMLDiagSeverity::Error) > 0; }
+
+  // Writes the message (without severity and line) into 'out'; returns its
+  // untruncated length like snprintf.
+  int Format(const XMLDiagnostic &diagnostic, char *out, size_t size) const;
+
+private:
+  std::vector<XMLDiagnostic> records;
+  std::string text;
+  uint32_t lineBase = 0;
+};
+
+const char *DiagSeverityName(XMLDiagSeverity severity);
+const char *DiagElementName(XMLDiagElement element);
+// One "file:line: severity: message" line per record.
+void PrintDiagnostics(const XMLDiagnostics &diagnostics, const char *file,
+                      FILE *out);
+
+#endif
@@ -0,0 +1,315 @@
+#include "xml_edit.h"
+#include "xml_hash.h"
+#include <algorithm>
+
+XMLChange XMLChange::Inverse() const {
+  XMLChange inverse = *this;
+  std::swap(inverse.before, inverse.after);
+  if (op == XMLEditOp::Insert)
+    inverse.op = XMLEditOp::Remove;
+  else if (op == XMLEditOp::Remove)
+    inverse.op = XMLEditOp::Insert;
+  return inverse;
+}
+
+XMLChangeSet XMLChangeSet::Inverse() const {
+  XMLChangeSet inverse;
+  inverse.label = label;
+  inverse.changes.reserve(changes.size());
+  for (auto it = changes.rbegin(); it != changes.rend(); ++it)
+    inverse.changes.push_back(it->Inverse());
+  return inverse;
+}
+
+static XMLHeaderData MakeHeader(const XMLBaseData &data, uint32_t length) {
+  XMLHeaderData header;
+  static_cast<XMLBaseData &>(header) = data;
+  header.length = length;
+  return header;
+}
+
+XMLHeaderData StructHeader(const XMLStructData &data) {
+  return MakeHeader(data, data.length);
+}
+
+XMLHeaderData EnumHeader(const XMLEnumData &data) {
+  return MakeHeader(data, 0);
+}
+
+static XMLChange MakeChange(XMLEditTarget target, XMLEditOp op,
+                            uint32_t parent, uint32_t child) {
+  XMLChange change;
+  change.target = target;
+  change.op = op;
+  change.parent = parent;
+  change.child = child;
+  return change;
+}
+
+XMLChange SetStructHeaderChange(const XMLDocData &doc, uint32_t structIndex,
+                                XMLHeaderData header) {
+  XMLChange change = MakeChange(XMLEditTarget::Struct, XMLEditOp::Set,
+                                structIndex, XMLQueryHit::kNoChild);
+  change.before = StructHeader(doc.structures[structIndex]);
+  change.after = std::move(header);
+  return change;
+}
+
+XMLChange SetEnumHeaderChange(const XMLDocData &doc, uint32_t enumIndex,
+                              XMLHeaderData header) {
+  XMLChange change = MakeChange(XMLEditTarget::Enum, XMLEditOp::Set,
+                                enumIndex, XMLQueryHit::kNoChild);
+  change.before = EnumHeader(doc.enumerates[enumIndex]);
+  change.after = std::move(header);
+  return change;
+}
+
+XMLChange SetFieldChange(const XMLDocData &doc, uint32_t structIndex,
+                         uint32_t fieldIndex, XMLFieldData field) {
+  XMLChange change = MakeChange(XMLEditTarget::Field, XMLEditOp::Set,
+                                structIndex, fieldIndex);
+  change.before = doc.structures[structIndex].fields[fieldIndex];
+  RehashField(field);
+  change.after = std::move(field);
+  return change;
+}
+
+XMLChange InsertFieldChange(uint32_t structIndex, uint32_t fieldIndex,
+                            XMLFieldData field) {
+  XMLChange change = MakeChange(XMLEditTarget::Field, XMLEditOp::Insert,
+                                structIndex, fieldIndex);
+  RehashField(field);
+  change.after = std::move(field);
+  return change;
+}
+
+XMLChange RemoveFieldChange(const XMLDocData &doc, uint32_t structIndex,
+                            uint32_t fieldIndex) {
+  XMLChange change = MakeChange(XMLEditTarget::Field, XMLEditOp::Remove,
+                                structIndex, fieldIndex);
+  change.before = doc.structures[structIndex].fields[fieldIndex];
+  return change;
+}
+
+XMLChange SetValueChange(const XMLDocData &doc, uint32_t enumIndex,
+                         uint32_t valueIndex, XMLValueData value) {
+  XMLChange change = MakeChange(XMLEditTarget::Value, XMLEditOp::Set,
+                                enumIndex, valueIndex);
+  change.before = doc.enumerates[enumIndex].values[valueIndex];
+  RehashValue(value);
+  change.after = std::move(value);
+  return change;
+}
+
+XMLChange InsertValueChange(uint32_t enumIndex, uint32_t valueIndex,
+                            XMLValueData value) {
+  XMLChange change = MakeChange(XMLEditTarget::Value, XMLEditOp::Insert,
+                                enumIndex, valueIndex);
+  RehashValue(value);
+  change.after = std::move(value);
+  return change;
+}
+
+XMLChange RemoveValueChange(const XMLDocData &doc, uint32_t enumIndex,
+                            uint32_t valueIndex) {
+  XMLChange change = MakeChange(XMLEditTarget::Value, XMLEditOp::Remove,
+                                enumIndex, valueIndex);
+  change.before = doc.enumerates[enumIndex].values[valueIndex];
+  return change;
+}
+
+// Move the hash terms of children [from, size) by 'shift' slots, ahead of an
+// insertion or removal.
+template <typename Child>
+static void ShiftChildHashes(uint64_t &parentHash, XMLHashSlot slot,
+                             const std::vector<Child> &children, size_t from,
+                             int shift) {
+  for (size_t i = from; i < children.size(); ++i) {
+    RemoveChildHash(parentHash, slot, i, children[i].contentHash);
+    AddChildHash(parentHash, slot, i + shift, children[i].contentHash);
+  }
+}
+
+// Set/Insert/Remove one child of 'parent', keeping the parent's hash and
+// the document hash consistent. Returns false if the change does not fit,
+// or would remove the last child: genxml does not load empty bodies.
+template <typename Child, typename Parent>
+static bool ApplyChildChange(uint64_t &docHash, XMLHashSlot parentSlot,
+                             uint32_t parentIndex, Parent &parent,
+                             std::vector<Child> &children,
+                             XMLHashSlot childSlot, const XMLChange &change,
+                             uint64_t (*rehash)(Child &)) {
+  size_t child = change.child;
+  uint64_t oldParentHash = parent.contentHash;
+  switch (change.op) {
+  case XMLEditOp::Set: {
+    const Child *before = std::get_if<Child>(&change.before);
+    const Child *after = std::get_if<Child>(&change.after);
+    if (!before || !after || child >= children.size() ||
+        children[child].contentHash != before->contentHash)
+      return false;
+    children[child] = *after;
+    UpdateChildHash(parent.contentHash, childSlot, child, before->contentHash,
+                    rehash(children[child]));
+    break;
+  }
+  case XMLEditOp::Insert: {
+    const Child *after = std::get_if<Child>(&change.after);
+    if (!after || child > children.size())
+      return false;
+    ShiftChildHashes(parent.contentHash, childSlot, children, child, 1);
+    children.insert(children.begin() + child, *after);
+    AddChildHash(parent.contentHash, childSlot, child,
+                 rehash(children[child]));
+    break;
+  }
+  case XMLEditOp::Remove: {
+    const Child *before = std::get_if<Child>(&change.before);
+    if (!before || child >= children.size() || children.size() == 1 ||
+        children[child].contentHash != before->contentHash)
+      return false;
+    RemoveChildHash(parent.contentHash, childSlot, child,
+                    children[child].contentHash);
+    ShiftChildHashes(parent.contentHash, childSlot, children, child + 1, -1);
+    children.erase(children.begin() + child);
+    break;
+  }
+  }
+  UpdateChildHash(docHash, parentSlot, parentIndex, oldParentHash,
+                  parent.contentHash);
+  return true;
+}
+
+// Headers of the edited node must hash like the live one; that is the
+// check that a change still matches the document.
+template <typename Parent>
+static bool HeaderMatches(const Parent &parent, const XMLHeaderData &header) {
+  return parent.name == header.name && parent.prefix == header.prefix &&
+         parent.info == header.info;
+}
+
+static bool ApplyStructHeader(XMLDocData &doc, XMLDocIndex *index,
+                              XMLTypeGraph *typeGraph,
+                              const XMLChange &change) {
+  const auto *before = std::get_if<XMLHeaderData>(&change.before);
+  const auto *after = std::get_if<XMLHeaderData>(&change.after);
+  if (change.op != XMLEditOp::Set || !before || !after ||
+      change.parent >= doc.structures.size())
+    return false;
+  XMLStructData &structData = doc.structures[change.parent];
+  if (!HeaderMatches(structData, *before) ||
+      structData.length != before->length)
+    return false;
+  uint64_t oldHash = structData.contentHash;
+  uint64_t oldHeader = StructHeaderHash(structData);
+  static_cast<XMLBaseData &>(structData) = *after;
+  structData.length = after->length;
+  structData.contentHash = oldHash - oldHeader + StructHeaderHash(structData);
+  UpdateChildHash(doc.contentHash, XMLHashSlot::Struct, change.parent,
+                  oldHash, structData.contentHash);
+  if (index)
+    index->UpdateStructLength(change.parent, before->length, after->length);
+  // Renames re-resolve every type name; rare enough for a full rebuild.
+  if (typeGraph && before->name != after->name)
+    typeGraph->Build(doc);
+  return true;
+}
+
+static bool ApplyEnumHeader(XMLDocData &doc, XMLTypeGraph *typeGraph,
+                            const XMLChange &change) {
+  const auto *before = std::get_if<XMLHeaderData>(&change.before);
+  const auto *after = std::get_if<XMLHeaderData>(&change.after);
+  if (change.op != XMLEditOp::Set || !before || !after ||
+      change.parent >= doc.enumerates.size())
+    return false;
+  XMLEnumData &enumData = doc.enumerates[change.parent];
+  if (!HeaderMatches(enumData, *before))
+    return false;
+  uint64_t oldHash = enumData.contentHash;
+  uint64_t oldHeader = EnumHeaderHash(enumData);
+  static_cast<XMLBaseData &>(enumData) = *after;
+  enumData.contentHash = oldHash - oldHeader + EnumHeaderHash(enumData);
+  UpdateChildHash(doc.contentHash, XMLHashSlot::Enum, change.parent, oldHash,
+                  enumData.contentHash);
+  if (typeGraph && before->name != after->name)
+    typeGraph->Build(doc);
+  return true;
+}
+
+bool ApplyChange(XMLDocData &doc, XMLDocIndex *index, XMLTypeGraph *typeGraph,
+                 const XMLChange &change) {
+  switch (change.target) {
+  case XMLEditTarget::Struct:
+    return ApplyStructHeader(doc, index, typeGraph, change);
+  case XMLEditTarget::Enum:
+    return ApplyEnumHeader(doc, typeGraph, change);
+  case XMLEditTarget::Field: {
+    if (change.parent >= doc.structures.size())
+      return false;
+    XMLStructData &structData = doc.structures[change.parent];
+    if (!ApplyChildChange(doc.contentHash, XMLHashSlot::Struct, change.parent,
+                          structData, structData.fields, XMLHashSlot::Field,
+                          change, &RehashField))
+      return false;
+    if (change.op == XMLEditOp::Set) {
+      const auto &before = std::get<XMLFieldData>(change.before);
+      if (index)
+        index->UpdateField(doc, XMLFieldRef{change.parent, change.child},
+                           before);
+      if (typeGraph && before.type != structData.fields[change.child].type)
+        typeGraph->UpdateField(doc, change.parent, change.child);
+    } else {
+      // Every following field moved, re-key the whole struct.
+      if (index) {
+        index->RemoveStruct(change.parent);
+        index->AddStruct(doc, change.parent);
+      }
+      if (typeGraph)
+        typeGraph->UpdateStructFields(doc, change.parent);
+    }
+    return true;
+  }
+  case XMLEditTarget::Value: {
+    if (change.parent >= doc.enumerates.size())
+      return false;
+    XMLEnumData &enumData = doc.enumerates[change.parent];
+    if (!ApplyChildChange(doc.contentHash, XMLHashSlot::Enum, change.parent,
+                          enumData, enumData.values, XMLHashSlot::Value,
+                          change, &RehashValue))
+      return false;
+    if (!index)
+      return true;
+    if (change.op == XMLEditOp::Set) {
+      index->UpdateValue(doc, change.parent, change.child,
+                         std::get<XMLValueData>(change.before).value);
+    } else {
+      index->RemoveEnum(change.parent);
+      index->AddEnum(doc, change.parent);
+    }
+    return true;
+  }
+  }
+  return false;
+}
+
+void XMLEditHistory::Push(XMLChangeSet changes) {
+  redoStack.clear();
+  if (undoStack.size() == kMaxUndoSets)
+    undoStack.erase(undoStack.begin());
+  undoStack.push_back(std::move(changes));
+}
+
+void XMLEditHistory::OnUndone() {
+  redoStack.push_back(std::move(undoStack.back()));
+  undoStack.pop_back();
+}
+
+void XMLEditHistory::OnRedone() {
+  undoStack.push_back(std::move(redoStack.back()));
+  redoStack.pop_back();
+}
+
+void XMLEditHistory::Clear() {
+  undoStack.clear();
+  redoStack.clear();
+}
@@ -0,0 +1,103 @@
+#ifndef __XML_EDIT_H__
+#define __XML_EDIT_H__
+
+#include "xml_query.h"
+#include "xml_typegraph.h"
+#include "xml_types.h"
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <vector>
+
+// In-place edits of a live document.
+//
+// An edit is described by change records at the granularity of one struct or
+// enum header, one field or one enum value. Applying a record touches just
+// that node: its hash is folded into the struct/enum and document hashes in
+// O(1) (inserts and removals re-slot the following siblings' hashes), and the
+// query index and type graph are patched for that node only. Records carry
+// their before and after state, so the inverse of a change set is its undo.
+
+// Everything of a struct or enum except its children. 'length' is unused
+// for enums.
+struct XMLHeaderData : public XMLBaseData {
+  uint32_t length = 0;
+};
+
+enum class XMLEditTarget : uint8_t { Struct, Enum, Field, Value };
+
+// Struct and Enum headers can only be Set.
+enum class XMLEditOp : uint8_t { Set, Insert, Remove };
+
+using XMLEditNode = std::variant<XMLHeaderData, XMLFieldData, XMLValueData>;
+
+struct XMLChange {
+  XMLEditTarget target;
+  XMLEditOp op;
+  uint32_t parent; // struct index for Struct/Field, enum index otherwise
+  uint32_t child;  // field or value index, unused for headers
+  // 'before' is unused for an Insert and 'after' for a Remove.
+  XMLEditNode before;
+  XMLEditNode after;
+
+  XMLChange Inverse() const;
+};
+
+// One user action; applied, undone and redone as a whole.
+struct XMLChangeSet {
+  std::string label;
+  std::vector<XMLChange> changes;
+
+  XMLChangeSet Inverse() const;
+};
+
+// Change constructors. The 'before' state is read from 'doc', so the record
+// is only valid against the document it was made for; the 'after' state is
+// hashed here so the inverse change can be checked like any other.
+XMLHeaderData StructHeader(const XMLStructData &data);
+XMLHeaderData EnumHeader(const XMLEnumData &data);
+XMLChange SetStructHeaderChange(const XMLDocData &doc, uint32_t structIndex,
+                                XMLHeaderData header);
+XMLChange SetEnumHeaderChange(const XMLDocData &doc, uint32_t enumIndex,
+                              XMLHeaderData header);
+XMLChange SetFieldChange(const XMLDocData &doc, uint32_t structIndex,
+                         uint32_t fieldIndex, XMLFieldData field);
+XMLChange InsertFieldChange(uint32_t structIndex, uint32_t fieldIndex,
+                            XMLFieldData field);
+XMLChange RemoveFieldChange(const XMLDocData &doc, uint32_t structIndex,
+                            uint32_t fieldIndex);
+XMLChange SetValueChange(const XMLDocData &doc, uint32_t enumIndex,
+                         uint32_t valueIndex, XMLValueData value);
+XMLChange InsertValueChange(uint32_t enumIndex, uint32_t valueIndex,
+                            XMLValueData value);
+XMLChange RemoveValueChange(const XMLDocData &doc, uint32_t enumIndex,
+                            uint32_t valueIndex);
+
+// Apply one change to 'doc' and patch the hashes, 'index' and 'typeGraph'.
+// Either may be null when the caller rebuilds it afterwards. Returns false,
+// leaving everything untouched, when the change does not match the
+// document: an index out of range or a 'before' state whose hash differs
+// from the live node.
+bool ApplyChange(XMLDocData &doc, XMLDocIndex *index, XMLTypeGraph *typeGraph,
+                 const XMLChange &change);
+
+// Undo/redo stacks of applied change sets.
+class XMLEditHistory {
+public:
+  void Push(XMLChangeSet changes);
+  bool CanUndo() const { return !undoStack.empty(); }
+  bool CanRedo() const { return !redoStack.empty(); }
+  const XMLChangeSet &NextUndo() const { return undoStack.back(); }
+  const XMLChangeSet &NextRedo() const { return redoStack.back(); }
+  // Move the top set to the other stack once it was (un)applied.
+  void OnUndone();
+  void OnRedone();
+  void Clear();
+
+private:
+  static constexpr size_t kMaxUndoSets = 256;
+  std::vector<XMLChangeSet> undoStack;
+  std::vector<XMLChangeSet> redoStack;
+};
+
+#endif
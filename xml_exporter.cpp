@@ -0,0 +1,377 @@
+#include "xml_exporter.h"
+#include "xml_saver.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <thread>
+
+// Output buffer flushed with plain fwrite; on files opened here the FILE's
+// own buffer is turned off so every byte is copied once.
+class ExportStream {
+public:
+  explicit ExportStream(FILE *out) : out(out) {}
+  ~ExportStream() { Flush(); }
+
+  void Put(char c) {
+    if (used == sizeof(buffer))
+      Flush();
+    buffer[used++] = c;
+  }
+  void Write(const void *data, size_t size) {
+    if (size > sizeof(buffer) - used) {
+      Flush();
+      if (size > sizeof(buffer)) {
+        isOk &= std::fwrite(data, 1, size, out) == size;
+        return;
+      }
+    }
+    std::memcpy(buffer + used, data, size);
+    used += size;
+  }
+  void Write(std::string_view text) { Write(text.data(), text.size()); }
+  template <typename T> void Number(T value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    Write(digits, result.ptr - digits);
+  }
+  template <typename T> void Le(T value) {
+    uint8_t bytes[sizeof(T)];
+    for (size_t i = 0; i < sizeof(T); ++i)
+      bytes[i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i));
+    Write(bytes, sizeof(T));
+  }
+  bool Flush() {
+    if (used) {
+      isOk &= std::fwrite(buffer, 1, used, out) == used;
+      used = 0;
+    }
+    return isOk;
+  }
+
+private:
+  FILE *out;
+  size_t used = 0;
+  bool isOk = true;
+  char buffer[1 << 16];
+};
+
+static void JsonString(ExportStream &stream, std::string_view text) {
+  static const char kHex[] = "0123456789abcdef";
+  stream.Put('"');
+  size_t run = 0; // start of the pending run of plain characters
+  for (size_t i = 0; i < text.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    stream.Write(text.data() + run, i - run);
+    run = i + 1;
+    switch (c) {
+    case '"':
+      stream.Write("\\\"");
+      break;
+    case '\\':
+      stream.Write("\\\\");
+      break;
+    case '\n':
+      stream.Write("\\n");
+      break;
+    case '\t':
+      stream.Write("\\t");
+      break;
+    case '\r':
+      stream.Write("\\r");
+      break;
+    default: {
+      char escape[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 15]};
+      stream.Write(escape, sizeof(escape));
+      break;
+    }
+    }
+  }
+  stream.Write(text.data() + run, text.size() - run);
+  stream.Put('"');
+}
+
+// Integers beyond 2^53 are not exact as JSON (double) numbers in most
+// readers, so those are written as decimal strings.
+static void JsonUint64(ExportStream &stream, uint64_t value) {
+  constexpr uint64_t kMaxExact = uint64_t(1) << 53;
+  if (value <= kMaxExact) {
+    stream.Number(value);
+    return;
+  }
+  stream.Put('"');
+  stream.Number(value);
+  stream.Put('"');
+}
+
+static void JsonBase(ExportStream &stream, const XMLBaseData &data) {
+  stream.Write("\"name\":");
+  JsonString(stream, data.name);
+  if (data.prefix) {
+    stream.Write(",\"prefix\":");
+    JsonString(stream, *data.prefix);
+  }
+  if (data.info) {
+    stream.Write(",\"info\":");
+    JsonString(stream, *data.info);
+  }
+}
+
+static void JsonValues(ExportStream &stream,
+                       const std::vector<XMLValueData> &values) {
+  stream.Put('[');
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i)
+      stream.Put(',');
+    stream.Put('{');
+    JsonBase(stream, values[i]);
+    stream.Write(",\"value\":");
+    JsonUint64(stream, values[i].value);
+    stream.Put('}');
+  }
+  stream.Put(']');
+}
+
+static void JsonDoc(ExportStream &stream, const XMLDocData &doc) {
+  stream.Put('{');
+  JsonBase(stream, doc);
+  stream.Write(",\n\"enums\":[");
+  for (size_t e = 0; e < doc.enumerates.size(); ++e) {
+    const auto &enumData = doc.enumerates[e];
+    stream.Write(e ? ",\n{" : "\n{");
+    JsonBase(stream, enumData);
+    stream.Write(",\"values\":");
+    JsonValues(stream, enumData.values);
+    stream.Put('}');
+  }
+  stream.Write("],\n\"structs\":[");
+  for (size_t s = 0; s < doc.structures.size(); ++s) {
+    const auto &structData = doc.structures[s];
+    stream.Write(s ? ",\n{" : "\n{");
+    JsonBase(stream, structData);
+    stream.Write(",\"length\":");
+    stream.Number(structData.length);
+    stream.Write(",\"kind\":");
+    JsonString(stream, StructKindName(structData.kind));
+    if (structData.address) {
+      stream.Write(",\"address\":");
+      JsonUint64(stream, *structData.address);
+    }
+    if (structData.bias) {
+      stream.Write(",\"bias\":");
+      stream.Number(*structData.bias);
+    }
+    if (structData.engine) {
+      stream.Write(",\"engine\":");
+      JsonString(stream, *structData.engine);
+    }
+    if (!structData.groups.empty()) {
+      stream.Write(",\"groups\":[");
+      for (size_t g = 0; g < structData.groups.size(); ++g) {
+        const auto &group = structData.groups[g];
+        stream.Write(g ? ",{\"start\":" : "{\"start\":");
+        stream.Number(group.start);
+        stream.Write(",\"size\":");
+        stream.Number(group.size);
+        stream.Write(",\"count\":");
+        stream.Number(group.count);
+        if (group.parent != XMLGroupData::kNoGroup) {
+          stream.Write(",\"parent\":");
+          stream.Number(group.parent);
+        }
+        stream.Put('}');
+      }
+      stream.Put(']');
+    }
+    stream.Write(",\"fields\":[");
+    for (size_t f = 0; f < structData.fields.size(); ++f) {
+      const auto &field = structData.fields[f];
+      stream.Write(f ? ",{" : "{");
+      JsonBase(stream, field);
+      stream.Write(",\"start\":");
+      stream.Number(field.start);
+      stream.Write(",\"end\":");
+      stream.Number(field.end);
+      stream.Write(",\"type\":");
+      JsonString(stream, field.type);
+      if (field.defaultValue) {
+        stream.Write(",\"default\":");
+        JsonUint64(stream, *field.defaultValue);
+      }
+      if (field.choices) {
+        stream.Write(",\"choices\":");
+        JsonValues(stream, *field.choices);
+      }
+      if (field.group != XMLGroupData::kNoGroup) {
+        stream.Write(",\"group\":");
+        stream.Number(field.group);
+      }
+      stream.Put('}');
+    }
+    stream.Write("]}");
+  }
+  stream.Write("]}\n");
+}
+
+static void BinaryString(ExportStream &stream, std::string_view text) {
+  stream.Le(static_cast<uint32_t>(text.size()));
+  stream.Write(text);
+}
+
+static void BinaryBase(ExportStream &stream, const XMLBaseData &data) {
+  BinaryString(stream, data.name);
+  stream.Le(static_cast<uint8_t>((data.prefix ? 1 : 0) | (data.info ? 2 : 0)));
+  if (data.prefix)
+    BinaryString(stream, *data.prefix);
+  if (data.info)
+    BinaryString(stream, *data.info);
+}
+
+static void BinaryValues(ExportStream &stream,
+                         const std::vector<XMLValueData> &values) {
+  stream.Le(static_cast<uint32_t>(values.size()));
+  for (const auto &value : values) {
+    BinaryBase(stream, value);
+    stream.Le(value.value);
+  }
+}
+
+static void BinaryDoc(ExportStream &stream, const XMLDocData &doc) {
+  stream.Le(kBinarySchemaMagic);
+  stream.Le(kBinarySchemaVersion);
+  BinaryBase(stream, doc);
+  stream.Le(static_cast<uint32_t>(doc.enumerates.size()));
+  for (const auto &enumData : doc.enumerates) {
+    BinaryBase(stream, enumData);
+    BinaryValues(stream, enumData.values);
+  }
+  stream.Le(static_cast<uint32_t>(doc.structures.size()));
+  for (const auto &structData : doc.structures) {
+    BinaryBase(stream, structData);
+    stream.Le(structData.length);
+    stream.Le(static_cast<uint8_t>(structData.kind));
+    stream.Le(static_cast<uint8_t>((structData.address ? 1 : 0) |
+                                   (structData.bias ? 2 : 0) |
+                                   (structData.engine ? 4 : 0)));
+    if (structData.address)
+      stream.Le(*structData.address);
+    if (structData.bias)
+      stream.Le(*structData.bias);
+    if (structData.engine)
+      BinaryString(stream, *structData.engine);
+    stream.Le(static_cast<uint32_t>(structData.groups.size()));
+    for (const auto &group : structData.groups) {
+      stream.Le(group.start);
+      stream.Le(group.size);
+      stream.Le(group.count);
+      stream.Le(group.parent);
+    }
+    stream.Le(static_cast<uint32_t>(structData.fields.size()));
+    for (const auto &field : structData.fields) {
+      BinaryBase(stream, field);
+      stream.Le(field.start);
+      stream.Le(field.end);
+      BinaryString(stream, field.type);
+      stream.Le(static_cast<uint8_t>((field.defaultValue ? 1 : 0) |
+                                     (field.choices ? 2 : 0)));
+      if (field.defaultValue)
+        stream.Le(*field.defaultValue);
+      if (field.choices)
+        BinaryValues(stream, *field.choices);
+      stream.Le(field.group);
+    }
+  }
+}
+
+const char *ExportFormatName(XMLExportFormat format) {
+  switch (format) {
+  case XMLExportFormat::Xml:
+    return "xml";
+  case XMLExportFormat::Json:
+    return "json";
+  case XMLExportFormat::Binary:
+    return "binary";
+  }
+  return "?";
+}
+
+bool ParseExportFormat(const char *name, XMLExportFormat &format) {
+  for (auto candidate : {XMLExportFormat::Xml, XMLExportFormat::Json,
+                         XMLExportFormat::Binary}) {
+    if (!std::strcmp(name, ExportFormatName(candidate))) {
+      format = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *ExportFormatExtension(XMLExportFormat format) {
+  switch (format) {
+  case XMLExportFormat::Xml:
+    return ".xml";
+  case XMLExportFormat::Json:
+    return ".json";
+  case XMLExportFormat::Binary:
+    return ".gxs";
+  }
+  return "";
+}
+
+bool ExportDoc(const XMLDocData &doc, XMLExportFormat format, FILE *out) {
+  ExportStream stream(out);
+  switch (format) {
+  case XMLExportFormat::Json:
+    JsonDoc(stream, doc);
+    break;
+  case XMLExportFormat::Binary:
+    BinaryDoc(stream, doc);
+    break;
+  case XMLExportFormat::Xml:
+    std::cerr << "Error: XML export needs a file name." << std::endl;
+    return false;
+  }
+  return stream.Flush();
+}
+
+bool ExportDoc(const XMLDocData &doc, XMLExportFormat format,
+               const char *file) {
+  if (format == XMLExportFormat::Xml)
+    return SaveToFile(doc, file);
+  FILE *out = std::fopen(file, "wb");
+  if (!out) {
+    std::cerr << "Error: Open '" << file << "' failed." << std::endl;
+    return false;
+  }
+  std::setvbuf(out, nullptr, _IONBF, 0);
+  bool ok = ExportDoc(doc, format, out);
+  ok &= std::fclose(out) == 0;
+  if (!ok)
+    std::cerr << "Error: Export to '" << file << "' failed." << std::endl;
+  return ok;
+}
+
+bool ExportDocs(std::vector<XMLExportJob> &jobs, unsigned threadCount) {
+  if (threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  threadCount = std::min<unsigned>(threadCount, jobs.size());
+  std::atomic<size_t> next{0};
+  auto work = [&jobs, &next]() {
+    for (size_t i; (i = next.fetch_add(1)) < jobs.size();) {
+      XMLExportJob &job = jobs[i];
+      job.ok = ExportDoc(*job.doc, job.format, job.file.c_str());
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < threadCount; ++t)
+    threads.emplace_back(work);
+  work();
+  for (auto &thread : threads)
+    thread.join();
+  return std::all_of(jobs.begin(), jobs.end(),
+                     [](const XMLExportJob &job) { return job.ok; });
+}
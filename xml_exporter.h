@@ -0,0 +1,57 @@
+#ifndef __XML_EXPORTER_H__
+#define __XML_EXPORTER_H__
+
+#include "xml_types.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Exporters writing XMLDocData straight into a buffered file, without an
+// intermediate DOM and without allocating per node.
+//
+// Json:   {"name": .., "prefix": .., "info": .., "enums": [..], "structs":
+//         [..]}, absent optional attributes are left out. Structs carry their
+//         "kind" and, when grouped, "groups": [{"start", "size", "count",
+//         "parent"}] with fields naming their "group" index. Values,
+//         defaults and addresses above 2^53 are decimal strings, since JSON
+//         readers using doubles cannot hold them exactly.
+// Binary: the "GXS1" schema, all integers little endian:
+//   schema := u32 magic, u32 version, base, u32 n, enum[n], u32 n, struct[n]
+//   base   := str name, u8 flags (1 prefix, 2 info), [str prefix], [str info]
+//   str    := u32 size, bytes[size]
+//   enum   := base, u32 n, value[n]
+//   value  := base, u64 value
+//   struct := base, u32 length, u8 kind (0 struct, 1 instruction, 2 register),
+//             u8 flags (1 address, 2 bias, 4 engine), [u64 address],
+//             [u32 bias], [str engine], u32 n, group[n], u32 n, field[n]
+//   group  := u32 start, u32 size, u32 count, u32 parent (~0 for none)
+//   field  := base, u32 start, u32 end, str type,
+//             u8 flags (1 default, 2 choices), [u64 default], [u32 n, value[n]],
+//             u32 group (~0 for none)
+enum class XMLExportFormat { Xml, Json, Binary };
+
+constexpr uint32_t kBinarySchemaMagic = 0x31535847; // "GXS1"
+constexpr uint32_t kBinarySchemaVersion = 2;
+
+const char *ExportFormatName(XMLExportFormat format);
+bool ParseExportFormat(const char *name, XMLExportFormat &format);
+// Conventional extension including the dot, e.g. ".json".
+const char *ExportFormatExtension(XMLExportFormat format);
+
+// Xml goes through SaveToFile. A caller's 'out' keeps its buffering.
+bool ExportDoc(const XMLDocData &doc, XMLExportFormat format,
+               const char *file);
+bool ExportDoc(const XMLDocData &doc, XMLExportFormat format, FILE *out);
+
+struct XMLExportJob {
+  const XMLDocData *doc;
+  XMLExportFormat format;
+  std::string file;
+  bool ok = false;
+};
+
+// Run the jobs on up to 'threadCount' threads (0: one per core). Returns
+// whether all of them succeeded; each job's 'ok' tells which did.
+bool ExportDocs(std::vector<XMLExportJob> &jobs, unsigned threadCount = 0);
+
+#endif
@@ -0,0 +1,79 @@
+#include "xml_frame_arena.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+XMLFrameArena::XMLFrameArena(size_t blockBytes) { AddBlock(blockBytes); }
+
+void XMLFrameArena::AddBlock(size_t minBytes) {
+  size_t size = blocks.empty() ? minBytes
+                               : std::max(minBytes, blocks.back().size * 2);
+  blocks.push_back(Block{std::unique_ptr<char[]>(new char[size]), size});
+  used = 0;
+}
+
+void XMLFrameArena::Reset() {
+  if (blocks.size() > 1) {
+    // Last frame needed more than one block, make the next one fit in one.
+    size_t total = Capacity();
+    blocks.clear();
+    AddBlock(total);
+  }
+  used = 0;
+  spilledBytes = 0;
+}
+
+void *XMLFrameArena::Allocate(size_t bytes, size_t align) {
+  Block &block = blocks.back();
+  uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+  size_t offset = ((base + used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+  if (offset + bytes > block.size) {
+    spilledBytes += used;
+    AddBlock(bytes + align);
+    return Allocate(bytes, align);
+  }
+  used = offset + bytes;
+  return block.data.get() + offset;
+}
+
+void *XMLFrameArena::ZeroedAllocate(size_t bytes, size_t align) {
+  void *memory = Allocate(bytes, align);
+  std::memset(memory, 0, bytes);
+  return memory;
+}
+
+const char *XMLFrameArena::Format(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  va_list retry;
+  va_copy(retry, args);
+  // Format straight into the free tail of the block, the common case.
+  Block &block = blocks.back();
+  size_t room = block.size - used;
+  int length = std::vsnprintf(block.data.get() + used, room, fmt, args);
+  va_end(args);
+  if (length < 0) {
+    va_end(retry);
+    return "";
+  }
+  // Byte aligned, so a text that fit is claimed where it was written.
+  char *text = static_cast<char *>(Allocate(length + 1, 1));
+  if (static_cast<size_t>(length) >= room)
+    std::vsnprintf(text, length + 1, fmt, retry);
+  va_end(retry);
+  return text;
+}
+
+size_t XMLFrameArena::Capacity() const {
+  size_t total = 0;
+  for (const Block &block : blocks) {
+    total += block.size;
+  }
+  return total;
+}
+
+XMLFrameArena &GetFrameArena() {
+  static XMLFrameArena arena;
+  return arena;
+}
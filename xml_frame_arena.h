@@ -0,0 +1,58 @@
+#ifndef __XML_FRAME_ARENA_H__
+#define __XML_FRAME_ARENA_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for UI data that only lives until the end of the frame:
+// formatted labels and scratch arrays. Allocating bumps a pointer and Reset()
+// at the start of the next frame releases everything at once. A frame that
+// outgrows the current block spills into extra blocks; Reset() folds them
+// into one block of the combined size, so after the first frames of a
+// session the arena stops touching the heap.
+//
+// Not thread safe, it belongs to the UI thread.
+class XMLFrameArena {
+public:
+  explicit XMLFrameArena(size_t blockBytes = size_t(64) << 10);
+  XMLFrameArena(const XMLFrameArena &) = delete;
+  XMLFrameArena &operator=(const XMLFrameArena &) = delete;
+
+  void Reset();
+  void *Allocate(size_t bytes, size_t align = alignof(std::max_align_t));
+  // Zeroed array of trivially destructible elements, nothing is destroyed.
+  template <typename T> T *AllocateArray(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "arena memory is released without destructors");
+    return static_cast<T *>(ZeroedAllocate(count * sizeof(T), alignof(T)));
+  }
+  // printf into the arena, the text is valid until Reset().
+  const char *Format(const char *fmt, ...)
+#if defined(__GNUC__) || defined(__clang__)
+      __attribute__((format(printf, 2, 3)))
+#endif
+      ;
+
+  size_t BytesUsed() const { return spilledBytes + used; }
+  size_t Capacity() const;
+
+private:
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+  std::vector<Block> blocks;
+  size_t used = 0;         // in the last block
+  size_t spilledBytes = 0; // handed out from earlier blocks this frame
+
+  void *ZeroedAllocate(size_t bytes, size_t align);
+  void AddBlock(size_t minBytes);
+};
+
+// The arena of the UI thread, reset by the frame loop (MainUI, genxml-bench).
+XMLFrameArena &GetFrameArena();
+
+#endif
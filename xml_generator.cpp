@@ -0,0 +1,197 @@
+#include "xml_generator.h"
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <vector>
+
+// splitmix64. Unlike the <random> distributions its output is specified
+// exactly, so documents are identical across standard libraries.
+class GeneratorRng {
+public:
+  explicit GeneratorRng(uint64_t seed) : state(seed) {}
+
+  uint64_t Next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  // Uniform in [lo, hi]
+  uint32_t Range(uint32_t lo, uint32_t hi) {
+    return lo + static_cast<uint32_t>(Next() % (uint64_t(hi) - lo + 1));
+  }
+
+  bool Chance(double probability) {
+    return (Next() >> 11) * (1.0 / 9007199254740992.0) < probability;
+  }
+
+private:
+  uint64_t state;
+};
+
+static const char *const kWords[] = {
+    "surface", "tile",    "mode",   "address", "state",  "pointer", "base",
+    "enable",  "format",  "depth",  "stencil", "vertex", "buffer",  "size",
+    "offset",  "command", "pitch",  "cache",   "render", "sampler", "media",
+    "pipe",    "control", "flush",  "index",   "count",  "length",  "width",
+};
+static constexpr size_t kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+// 'bool' is reserved for single-bit fields.
+static const char *const kBuiltinTypes[] = {"uint", "uint",    "uint",
+                                            "int",  "address", "offset",
+                                            "float"};
+static constexpr size_t kBuiltinTypeCount =
+    sizeof(kBuiltinTypes) / sizeof(kBuiltinTypes[0]);
+
+struct GeneratedField {
+  uint32_t start;
+  uint32_t end;
+  std::string type;
+  std::optional<uint32_t> defaultValue;
+};
+
+class SyntheticDocWriter {
+public:
+  SyntheticDocWriter(const XMLGeneratorOptions &options, FILE *out)
+      : options(options), out(out), rng(options.seed) {}
+
+  bool Write() {
+    std::fputs("<?xml version=\"1.0\" ?>\n", out);
+    std::fprintf(out, "<genxml name=\"SYNTH\" info=\"seed %llu\">\n",
+                 (unsigned long long)options.seed);
+    for (uint32_t i = 0; i < options.enumCount; ++i) {
+      WriteEnum(i);
+    }
+    for (uint32_t i = 0; i < options.structCount; ++i) {
+      WriteStruct(i);
+    }
+    std::fputs("</genxml>\n", out);
+    return !std::ferror(out);
+  }
+
+private:
+  const XMLGeneratorOptions &options;
+  FILE *out;
+  GeneratorRng rng;
+  std::string info;
+  std::vector<GeneratedField> fields;
+
+  void WriteInfo() {
+    if (options.infoLength == 0)
+      return;
+    uint32_t target = rng.Range(options.infoLength / 2,
+                                options.infoLength + options.infoLength / 2);
+    info.clear();
+    while (info.size() < target) {
+      if (!info.empty())
+        info += ' ';
+      info += kWords[rng.Next() % kWordCount];
+    }
+    std::fprintf(out, " info=\"%s\"", info.c_str());
+  }
+
+  // 'maxValue' of 0 means unbounded.
+  void WriteValues(const char *indent, const char *prefix, uint32_t count,
+                   uint64_t maxValue) {
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      std::fprintf(out, "%s<value name=\"%s_%u\" value=\"%llu\"", indent,
+                   prefix, i, (unsigned long long)value);
+      WriteInfo();
+      std::fputs("/>\n", out);
+      value += rng.Range(1, 3);
+      if (maxValue && value > maxValue)
+        value = maxValue;
+    }
+  }
+
+  void WriteEnum(uint32_t index) {
+    char prefix[32];
+    std::snprintf(prefix, sizeof(prefix), "SE%u", index);
+    std::fprintf(out, "  <enum name=\"SYNTH_ENUM_%u\" prefix=\"%s\"", index,
+                 prefix);
+    WriteInfo();
+    std::fputs(">\n", out);
+    WriteValues("    ", prefix, std::max(1u, options.valuesPerEnum), 0);
+    std::fputs("  </enum>\n", out);
+  }
+
+  // Fields are laid out back to back; 'length' depends on the layout, so
+  // plan all of them before the struct header is written.
+  uint32_t PlanFields() {
+    fields.clear();
+    uint32_t bit = 0;
+    const uint32_t fieldCount = std::max(1u, options.fieldsPerStruct);
+    for (uint32_t f = 0; f < fieldCount; ++f) {
+      GeneratedField field;
+      uint32_t width = rng.Chance(0.25) ? 32 : rng.Range(1, 16);
+      field.start = bit;
+      field.end = bit + width - 1;
+      bit = field.end + 1;
+      field.type = width == 1 ? "bool"
+                              : kBuiltinTypes[rng.Next() % kBuiltinTypeCount];
+      if (options.enumCount && rng.Chance(options.enumTypeDensity)) {
+        field.type = "SYNTH_ENUM_" +
+                     std::to_string(rng.Range(0, options.enumCount - 1));
+      }
+      if (rng.Chance(0.1)) {
+        field.defaultValue = rng.Range(0, width >= 8 ? 255 : (1u << width) - 1);
+      }
+      fields.push_back(std::move(field));
+    }
+    return (bit + 31) / 32;
+  }
+
+  void WriteStruct(uint32_t index) {
+    uint32_t length = PlanFields();
+    std::fprintf(out, "  <struct name=\"SYNTH_STRUCT_%u\" length=\"%u\"", index,
+                 length);
+    WriteInfo();
+    std::fputs(">\n", out);
+    for (size_t f = 0; f < fields.size(); ++f) {
+      const GeneratedField &field = fields[f];
+      std::fprintf(out,
+                   "    <field name=\"Field %zu\" start=\"%u\" end=\"%u\" "
+                   "type=\"%s\"",
+                   f, field.start, field.end, field.type.c_str());
+      if (field.defaultValue) {
+        std::fprintf(out, " default=\"%u\"", field.defaultValue.value());
+      }
+      WriteInfo();
+      uint32_t width = field.end - field.start + 1;
+      if (width > 1 && rng.Chance(options.choiceDensity)) {
+        std::fputs(">\n", out);
+        char prefix[48];
+        std::snprintf(prefix, sizeof(prefix), "S%uF%zu", index, f);
+        uint64_t maxValue = width >= 32 ? 0 : (1ull << width) - 1;
+        WriteValues("      ", prefix, std::max(1u, options.valuesPerChoice),
+                    maxValue);
+        std::fputs("    </field>\n", out);
+      } else {
+        std::fputs("/>\n", out);
+      }
+    }
+    std::fputs("  </struct>\n", out);
+  }
+};
+
+bool GenerateSyntheticDoc(const XMLGeneratorOptions &options, FILE *out) {
+  SyntheticDocWriter writer(options, out);
+  return writer.Write();
+}
+
+bool GenerateSyntheticDoc(const XMLGeneratorOptions &options,
+                          const char *file) {
+  FILE *fp = std::fopen(file, "w");
+  if (!fp) {
+    std::fprintf(stderr, "Error: open '%s' failed.\n", file);
+    return false;
+  }
+  // Large documents are written in long sequential runs.
+  std::setvbuf(fp, nullptr, _IOFBF, 1 << 20);
+  bool result = GenerateSyntheticDoc(options, fp);
+  result = (std::fclose(fp) == 0) && result;
+  return result;
+}
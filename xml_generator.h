@@ -0,0 +1,29 @@
+#ifndef __XML_GENERATOR_H__
+#define __XML_GENERATOR_H__
+
+#include <cstdint>
+#include <cstdio>
+
+// Shape of a synthetic genxml document. The same options and seed always
+// produce byte-identical output, so benchmark inputs are reproducible.
+struct XMLGeneratorOptions {
+  uint64_t seed = 1;
+  uint32_t structCount = 1000;
+  uint32_t fieldsPerStruct = 16;
+  uint32_t enumCount = 200;
+  uint32_t valuesPerEnum = 8;
+  // Probability in [0, 1] that a field carries an inline 'value' choice list.
+  double choiceDensity = 0.2;
+  uint32_t valuesPerChoice = 4;
+  // Average length of the 'info' attribute; 0 disables info strings.
+  uint32_t infoLength = 32;
+  // Probability in [0, 1] that a field is typed as a generated enum.
+  double enumTypeDensity = 0.15;
+};
+
+// Write a document in the schema DoParseXMLDocData accepts.
+bool GenerateSyntheticDoc(const XMLGeneratorOptions &options, FILE *out);
+bool GenerateSyntheticDoc(const XMLGeneratorOptions &options,
+                          const char *file);
+
+#endif
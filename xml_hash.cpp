@@ -0,0 +1,152 @@
+#include "xml_hash.h"
+#include <string>
+
+static inline uint64_t Mix64(uint64_t x) {
+  // splitmix64 finalizer
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+class HashBuilder {
+public:
+  explicit HashBuilder(uint64_t seed) : state(Mix64(seed)) {}
+
+  HashBuilder &Add(uint64_t v) {
+    state = Mix64(state ^ v) + 0x9e3779b97f4a7c15ull;
+    return *this;
+  }
+
+  HashBuilder &Add(const std::string &str) {
+    // FNV-1a over the bytes, then folded in with the length so that
+    // ("ab", "c") and ("a", "bc") differ.
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : str) {
+      h ^= c;
+      h *= 0x100000001b3ull;
+    }
+    return Add(h).Add(str.size());
+  }
+
+  HashBuilder &Add(const std::optional<std::string> &str) {
+    if (!str)
+      return Add(0ull);
+    return Add(1ull).Add(str.value());
+  }
+
+  uint64_t Get() const { return Mix64(state); }
+
+private:
+  uint64_t state;
+};
+
+static uint64_t ChildTerm(XMLHashSlot slot, size_t index, uint64_t childHash) {
+  return Mix64(childHash ^ Mix64(static_cast<uint64_t>(slot) + index));
+}
+
+void AddChildHash(uint64_t &parentHash, XMLHashSlot slot, size_t index,
+                  uint64_t childHash) {
+  parentHash += ChildTerm(slot, index, childHash);
+}
+
+void RemoveChildHash(uint64_t &parentHash, XMLHashSlot slot, size_t index,
+                     uint64_t childHash) {
+  parentHash -= ChildTerm(slot, index, childHash);
+}
+
+void UpdateChildHash(uint64_t &parentHash, XMLHashSlot slot, size_t index,
+                     uint64_t oldChildHash, uint64_t newChildHash) {
+  RemoveChildHash(parentHash, slot, index, oldChildHash);
+  AddChildHash(parentHash, slot, index, newChildHash);
+}
+
+static HashBuilder BaseHash(XMLHashSlot slot, const XMLBaseData &data) {
+  HashBuilder builder(static_cast<uint64_t>(slot));
+  builder.Add(data.name).Add(data.prefix).Add(data.info);
+  return builder;
+}
+
+static uint64_t ValueHash(const XMLValueData &data) {
+  return BaseHash(XMLHashSlot::Value, data).Add(data.value).Get();
+}
+
+uint64_t RehashValue(XMLValueData &data) {
+  data.contentHash = ValueHash(data);
+  return data.contentHash;
+}
+
+uint64_t ValuesHash(const std::vector<XMLValueData> &values) {
+  uint64_t hash = 0;
+  for (size_t i = 0; i < values.size(); ++i) {
+    AddChildHash(hash, XMLHashSlot::Value, i, ValueHash(values[i]));
+  }
+  return hash;
+}
+
+uint64_t RehashField(XMLFieldData &data) {
+  HashBuilder builder = BaseHash(XMLHashSlot::Field, data);
+  builder.Add(data.start).Add(data.end).Add(data.type);
+  builder.Add(data.defaultValue.has_value() ? 1ull : 0ull)
+      .Add(data.defaultValue.value_or(0));
+  builder.Add(data.choices.has_value() ? 1ull : 0ull).Add(data.group);
+  uint64_t hash = builder.Get();
+  // Interned tables carry their sum, shared ones are left untouched.
+  if (const XMLValueTable *table = data.choices.Table())
+    hash += table->isInterned ? table->valuesHash : ValuesHash(table->values);
+  data.contentHash = hash;
+  return hash;
+}
+
+uint64_t StructHeaderHash(const XMLStructData &data) {
+  HashBuilder builder = BaseHash(XMLHashSlot::Struct, data);
+  builder.Add(data.length).Add(static_cast<uint64_t>(data.kind));
+  builder.Add(data.address.has_value() ? 1ull : 0ull)
+      .Add(data.address.value_or(0));
+  builder.Add(data.bias.has_value() ? 1ull : 0ull).Add(data.bias.value_or(0));
+  builder.Add(data.engine);
+  // Groups are part of the layout but have no identity of their own, so
+  // they are hashed with the header rather than as children.
+  builder.Add(data.groups.size());
+  for (const XMLGroupData &group : data.groups) {
+    builder.Add(group.start).Add(group.size).Add(group.count).Add(group.parent);
+  }
+  return builder.Get();
+}
+
+uint64_t EnumHeaderHash(const XMLEnumData &data) {
+  return BaseHash(XMLHashSlot::Enum, data).Get();
+}
+
+uint64_t RehashEnum(XMLEnumData &data) {
+  uint64_t hash = EnumHeaderHash(data);
+  for (size_t i = 0; i < data.values.size(); ++i) {
+    AddChildHash(hash, XMLHashSlot::Value, i, RehashValue(data.values[i]));
+  }
+  data.contentHash = hash;
+  return hash;
+}
+
+uint64_t RehashStruct(XMLStructData &data) {
+  uint64_t hash = StructHeaderHash(data);
+  for (size_t i = 0; i < data.fields.size(); ++i) {
+    AddChildHash(hash, XMLHashSlot::Field, i, RehashField(data.fields[i]));
+  }
+  data.contentHash = hash;
+  return hash;
+}
+
+uint64_t RehashDoc(XMLDocData &data) {
+  uint64_t hash = BaseHash(XMLHashSlot::Struct, data).Add(~0ull).Get();
+  for (size_t i = 0; i < data.enumerates.size(); ++i) {
+    AddChildHash(hash, XMLHashSlot::Enum, i, RehashEnum(data.enumerates[i]));
+  }
+  for (size_t i = 0; i < data.structures.size(); ++i) {
+    AddChildHash(hash, XMLHashSlot::Struct, i,
+                 RehashStruct(data.structures[i]));
+  }
+  data.contentHash = hash;
+  return hash;
+}
@@ -0,0 +1,49 @@
+#ifndef __XML_HASH_H__
+#define __XML_HASH_H__
+
+#include "xml_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Merkle content hashes.
+//
+// Every node keeps the hash of its own attributes plus one salted term per
+// child, summed. A changed child can therefore be folded into its parent (and
+// from there into the document) in O(1) with UpdateChildHash, and an unchanged
+// subtree never has to be walked again. Comparing two nodes, or asking whether
+// a document differs from what was saved, is a single integer compare.
+
+enum class XMLHashSlot : uint64_t {
+  Value = 0x51ed270b27b4b0c1ull,
+  Field = 0x2d358dccaa6c78a5ull,
+  Enum = 0x8bb84b93962eacc9ull,
+  Struct = 0x4b33a62ed433d4a3ull,
+};
+
+// Recompute a node's hash from scratch, including all of its children.
+uint64_t RehashValue(XMLValueData &data);
+uint64_t RehashField(XMLFieldData &data);
+uint64_t RehashEnum(XMLEnumData &data);
+uint64_t RehashStruct(XMLStructData &data);
+uint64_t RehashDoc(XMLDocData &data);
+
+// Sum of the child terms a list of values adds to its field's hash. Pure:
+// value tables can be shared and are not written to.
+uint64_t ValuesHash(const std::vector<XMLValueData> &values);
+
+// Hash of a struct's or enum's own attributes, i.e. its hash without the
+// child terms. Lets a header edit be folded in without touching children.
+uint64_t StructHeaderHash(const XMLStructData &data);
+uint64_t EnumHeaderHash(const XMLEnumData &data);
+
+// O(1) incremental maintenance of a parent hash. 'index' is the child's
+// position inside its parent's container.
+void AddChildHash(uint64_t &parentHash, XMLHashSlot slot, size_t index,
+                  uint64_t childHash);
+void RemoveChildHash(uint64_t &parentHash, XMLHashSlot slot, size_t index,
+                     uint64_t childHash);
+void UpdateChildHash(uint64_t &parentHash, XMLHashSlot slot, size_t index,
+                     uint64_t oldChildHash, uint64_t newChildHash);
+
+#endif
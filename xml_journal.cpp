@@ -0,0 +1,507 @@
+#include "xml_journal.h"
+#include "xml_decode_protocol.h"
+#include "xml_hash.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+constexpr uint32_t kJournalMagic = 0x314a5847; // "GXJ1"
+// 2: struct kinds and groups.
+constexpr uint32_t kJournalVersion = 2;
+constexpr size_t kJournalHeaderBytes = 24;
+constexpr size_t kJournalRecordHeaderBytes = 8;
+// How long the flusher collects appends before one fsync covers them all.
+constexpr auto kJournalSyncDelay = std::chrono::milliseconds(50);
+
+static uint32_t JournalChecksum(const uint8_t *data, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// fsync only, records are fflush'ed to the OS as they are appended.
+static void SyncFile(std::FILE *file) {
+#ifdef _WIN32
+  _commit(_fileno(file));
+#else
+  fsync(fileno(file));
+#endif
+}
+
+// Identity of the saved document a journal applies to.
+static bool StatDocument(const std::string &docFile, uint64_t &size,
+                         int64_t &time) {
+  std::error_code error;
+  size = std::filesystem::file_size(docFile, error);
+  if (error)
+    return false;
+  auto writeTime = std::filesystem::last_write_time(docFile, error);
+  if (error)
+    return false;
+  time = static_cast<int64_t>(writeTime.time_since_epoch().count());
+  return true;
+}
+
+static void WriteString(XMLWireWriter &writer, const std::string &value) {
+  writer.U32(static_cast<uint32_t>(value.size()));
+  writer.Raw(value.data(), value.size());
+}
+
+static void WriteOptional(XMLWireWriter &writer,
+                          const std::optional<std::string> &value) {
+  writer.U8(value ? 1 : 0);
+  if (value)
+    WriteString(writer, *value);
+}
+
+static void WriteBase(XMLWireWriter &writer, const XMLBaseData &data) {
+  WriteString(writer, data.name);
+  WriteOptional(writer, data.prefix);
+  WriteOptional(writer, data.info);
+}
+
+static void WriteValues(XMLWireWriter &writer,
+                        const std::vector<XMLValueData> &values) {
+  writer.U32(static_cast<uint32_t>(values.size()));
+  for (const auto &value : values) {
+    WriteBase(writer, value);
+    writer.U64(value.value);
+  }
+}
+
+static bool ReadString(XMLWireReader &reader, std::string &value) {
+  uint32_t size = reader.U32();
+  value = reader.Bytes(size);
+  return reader.Ok();
+}
+
+static bool ReadOptional(XMLWireReader &reader,
+                         std::optional<std::string> &value) {
+  if (!reader.U8()) {
+    value.reset();
+    return reader.Ok();
+  }
+  return ReadString(reader, value.emplace());
+}
+
+static bool ReadBase(XMLWireReader &reader, XMLBaseData &data) {
+  return ReadString(reader, data.name) && ReadOptional(reader, data.prefix) &&
+         ReadOptional(reader, data.info);
+}
+
+static bool ReadValues(XMLWireReader &reader,
+                       std::vector<XMLValueData> &values) {
+  uint32_t count = reader.U32();
+  // Every value takes at least 14 bytes (empty name, no prefix or info),
+  // don't trust a corrupt count.
+  if (!reader.Ok() || count > reader.Remaining() / 14)
+    return false;
+  values.resize(count);
+  for (auto &value : values) {
+    if (!ReadBase(reader, value))
+      return false;
+    value.value = reader.U64();
+  }
+  return reader.Ok();
+}
+
+void EncodeJournalEnum(const XMLEnumData &data, std::vector<uint8_t> &out) {
+  XMLWireWriter writer;
+  writer.buffer.swap(out);
+  WriteBase(writer, data);
+  WriteValues(writer, data.values);
+  writer.buffer.swap(out);
+}
+
+static void WriteField(XMLWireWriter &writer, const XMLFieldData &field) {
+  WriteBase(writer, field);
+  writer.U32(field.start);
+  writer.U32(field.end);
+  WriteString(writer, field.type);
+  writer.U8(field.defaultValue ? 1 : 0);
+  if (field.defaultValue)
+    writer.U64(*field.defaultValue);
+  writer.U8(field.choices ? 1 : 0);
+  if (field.choices)
+    WriteValues(writer, *field.choices);
+  writer.U32(field.group);
+}
+
+static bool ReadField(XMLWireReader &reader, XMLFieldData &field) {
+  if (!ReadBase(reader, field))
+    return false;
+  field.start = reader.U32();
+  field.end = reader.U32();
+  if (!ReadString(reader, field.type))
+    return false;
+  if (reader.U8())
+    field.defaultValue = reader.U64();
+  if (reader.U8() && !ReadValues(reader, field.choices.emplace()))
+    return false;
+  field.group = reader.U32();
+  return reader.Ok();
+}
+
+// u8 variant index, then the node.
+static void WriteEditNode(XMLWireWriter &writer, const XMLEditNode &node) {
+  writer.U8(static_cast<uint8_t>(node.index()));
+  if (const auto *header = std::get_if<XMLHeaderData>(&node)) {
+    WriteBase(writer, *header);
+    writer.U32(header->length);
+  } else if (const auto *field = std::get_if<XMLFieldData>(&node)) {
+    WriteField(writer, *field);
+  } else {
+    const auto &value = std::get<XMLValueData>(node);
+    WriteBase(writer, value);
+    writer.U64(value.value);
+  }
+}
+
+// Field and value hashes are recomputed, ApplyChange checks them.
+static bool ReadEditNode(XMLWireReader &reader, XMLEditNode &node) {
+  switch (reader.U8()) {
+  case 0: {
+    auto &header = node.emplace<XMLHeaderData>();
+    if (!ReadBase(reader, header))
+      return false;
+    header.length = reader.U32();
+    return reader.Ok();
+  }
+  case 1: {
+    auto &field = node.emplace<XMLFieldData>();
+    if (!ReadField(reader, field))
+      return false;
+    RehashField(field);
+    return true;
+  }
+  case 2: {
+    auto &value = node.emplace<XMLValueData>();
+    if (!ReadBase(reader, value))
+      return false;
+    value.value = reader.U64();
+    RehashValue(value);
+    return reader.Ok();
+  }
+  }
+  return false;
+}
+
+void EncodeJournalStruct(const XMLStructData &data,
+                         std::vector<uint8_t> &out) {
+  XMLWireWriter writer;
+  writer.buffer.swap(out);
+  WriteBase(writer, data);
+  writer.U32(data.length);
+  writer.U8(static_cast<uint8_t>(data.kind));
+  writer.U8(data.address ? 1 : 0);
+  if (data.address)
+    writer.U64(*data.address);
+  writer.U8(data.bias ? 1 : 0);
+  if (data.bias)
+    writer.U32(*data.bias);
+  WriteOptional(writer, data.engine);
+  writer.U32(static_cast<uint32_t>(data.groups.size()));
+  for (const auto &group : data.groups) {
+    writer.U32(group.start);
+    writer.U32(group.size);
+    writer.U32(group.count);
+    writer.U32(group.parent);
+  }
+  writer.U32(static_cast<uint32_t>(data.fields.size()));
+  for (const auto &field : data.fields)
+    WriteField(writer, field);
+  writer.buffer.swap(out);
+}
+
+void EncodeJournalChanges(const XMLChangeSet &changes,
+                          std::vector<uint8_t> &out) {
+  XMLWireWriter writer;
+  writer.buffer.swap(out);
+  WriteString(writer, changes.label);
+  writer.U32(static_cast<uint32_t>(changes.changes.size()));
+  for (const auto &change : changes.changes) {
+    writer.U8(static_cast<uint8_t>(change.target));
+    writer.U8(static_cast<uint8_t>(change.op));
+    writer.U32(change.parent);
+    writer.U32(change.child);
+    WriteEditNode(writer, change.before);
+    WriteEditNode(writer, change.after);
+  }
+  writer.buffer.swap(out);
+}
+
+bool DecodeJournalEnum(const std::vector<uint8_t> &payload, XMLEnumData &out) {
+  XMLWireReader reader(payload.data(), payload.size());
+  return ReadBase(reader, out) && ReadValues(reader, out.values) &&
+         reader.Remaining() == 0;
+}
+
+bool DecodeJournalStruct(const std::vector<uint8_t> &payload,
+                         XMLStructData &out) {
+  XMLWireReader reader(payload.data(), payload.size());
+  if (!ReadBase(reader, out))
+    return false;
+  out.length = reader.U32();
+  uint8_t kind = reader.U8();
+  if (kind > static_cast<uint8_t>(XMLStructKind::Register))
+    return false;
+  out.kind = static_cast<XMLStructKind>(kind);
+  if (reader.U8())
+    out.address = reader.U64();
+  if (reader.U8())
+    out.bias = reader.U32();
+  if (!ReadOptional(reader, out.engine))
+    return false;
+  uint32_t groupCount = reader.U32();
+  if (!reader.Ok() || groupCount > reader.Remaining() / 16)
+    return false;
+  out.groups.resize(groupCount);
+  for (uint32_t g = 0; g < groupCount; ++g) {
+    XMLGroupData &group = out.groups[g];
+    group.start = reader.U32();
+    group.size = reader.U32();
+    group.count = reader.U32();
+    group.parent = reader.U32();
+    // Parents precede their children, which also rules out cycles.
+    if (group.parent != XMLGroupData::kNoGroup && group.parent >= g)
+      return false;
+  }
+  uint32_t count = reader.U32();
+  // Every field takes at least 24 bytes (empty strings, no optionals).
+  if (!reader.Ok() || count > reader.Remaining() / 24)
+    return false;
+  out.fields.resize(count);
+  for (auto &field : out.fields) {
+    if (!ReadField(reader, field))
+      return false;
+  }
+  return reader.Ok() && reader.Remaining() == 0;
+}
+
+bool DecodeJournalChanges(const std::vector<uint8_t> &payload,
+                          XMLChangeSet &out) {
+  XMLWireReader reader(payload.data(), payload.size());
+  if (!ReadString(reader, out.label))
+    return false;
+  uint32_t count = reader.U32();
+  // Every change takes at least 30 bytes.
+  if (!reader.Ok() || count > reader.Remaining() / 30)
+    return false;
+  out.changes.resize(count);
+  for (auto &change : out.changes) {
+    uint8_t target = reader.U8();
+    uint8_t op = reader.U8();
+    if (target > static_cast<uint8_t>(XMLEditTarget::Value) ||
+        op > static_cast<uint8_t>(XMLEditOp::Remove))
+      return false;
+    change.target = static_cast<XMLEditTarget>(target);
+    change.op = static_cast<XMLEditOp>(op);
+    change.parent = reader.U32();
+    change.child = reader.U32();
+    if (!ReadEditNode(reader, change.before) ||
+        !ReadEditNode(reader, change.after))
+      return false;
+  }
+  return reader.Ok() && reader.Remaining() == 0;
+}
+
+XMLJournal::XMLJournal(const std::string &docFile)
+    : docFile(docFile), path(PathFor(docFile)),
+      flusher(&XMLJournal::RunFlusher, this) {}
+
+XMLJournal::~XMLJournal() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+  }
+  wake.notify_one();
+  flusher.join();
+  CloseFile();
+}
+
+bool XMLJournal::Recover(std::vector<XMLJournalRecord> &records) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in)
+    return true; // nothing to recover
+  std::vector<uint8_t> data(static_cast<size_t>(in.tellg()));
+  in.seekg(0);
+  if (!in.read(reinterpret_cast<char *>(data.data()), data.size())) {
+    std::cerr << "Read journal [" << path << "] failed." << std::endl;
+    return false;
+  }
+  in.close();
+
+  XMLWireReader header(data.data(), data.size());
+  uint32_t magic = header.U32();
+  uint32_t version = header.U32();
+  uint64_t fileSize = header.U64();
+  int64_t fileTime = static_cast<int64_t>(header.U64());
+  uint64_t docSize = 0;
+  int64_t docTime = 0;
+  std::error_code error;
+  if (!header.Ok() || magic != kJournalMagic || version != kJournalVersion ||
+      !StatDocument(docFile, docSize, docTime) || docSize != fileSize ||
+      docTime != fileTime) {
+    std::cerr << "Journal [" << path
+              << "] does not belong to the current file, moved aside."
+              << std::endl;
+    std::filesystem::rename(path, path + ".stale", error);
+    return true;
+  }
+
+  size_t offset = kJournalHeaderBytes;
+  while (offset < data.size()) {
+    XMLWireReader reader(data.data() + offset, data.size() - offset);
+    uint32_t size = reader.U32();
+    uint32_t checksum = reader.U32();
+    if (!reader.Ok() || size == 0 || size > reader.Remaining())
+      break;
+    const uint8_t *body = data.data() + offset + kJournalRecordHeaderBytes;
+    if (JournalChecksum(body, size) != checksum)
+      break;
+    XMLJournalRecord &record = records.emplace_back();
+    record.op = static_cast<XMLJournalOp>(body[0]);
+    record.payload.assign(body + 1, body + size);
+    offset += kJournalRecordHeaderBytes + size;
+  }
+  if (offset < data.size()) {
+    std::cerr << "Journal [" << path << "]: dropping "
+              << data.size() - offset << " torn byte(s) at the end."
+              << std::endl;
+    std::filesystem::resize_file(path, offset, error);
+  }
+  return true;
+}
+
+void XMLJournal::AppendEnum(const XMLEnumData &data) {
+  XMLWireWriter writer;
+  writer.U64(0); // record header
+  writer.U8(static_cast<uint8_t>(XMLJournalOp::AddEnum));
+  EncodeJournalEnum(data, writer.buffer);
+  std::lock_guard<std::mutex> lock(mutex);
+  scratch.swap(writer.buffer);
+  Append(XMLJournalOp::AddEnum);
+}
+
+void XMLJournal::AppendStruct(const XMLStructData &data) {
+  XMLWireWriter writer;
+  writer.U64(0);
+  writer.U8(static_cast<uint8_t>(XMLJournalOp::AddStruct));
+  EncodeJournalStruct(data, writer.buffer);
+  std::lock_guard<std::mutex> lock(mutex);
+  scratch.swap(writer.buffer);
+  Append(XMLJournalOp::AddStruct);
+}
+
+void XMLJournal::AppendChanges(const XMLChangeSet &changes) {
+  XMLWireWriter writer;
+  writer.U64(0);
+  writer.U8(static_cast<uint8_t>(XMLJournalOp::ChangeSet));
+  EncodeJournalChanges(changes, writer.buffer);
+  std::lock_guard<std::mutex> lock(mutex);
+  scratch.swap(writer.buffer);
+  Append(XMLJournalOp::ChangeSet);
+}
+
+// Write the record in 'scratch' (header space, op, payload). Called with
+// 'mutex' held.
+void XMLJournal::Append(XMLJournalOp op) {
+  if (!file && !OpenForAppend())
+    return;
+  uint32_t size =
+      static_cast<uint32_t>(scratch.size() - kJournalRecordHeaderBytes);
+  uint32_t checksum =
+      JournalChecksum(scratch.data() + kJournalRecordHeaderBytes, size);
+  std::memcpy(scratch.data(), &size, sizeof(size));
+  std::memcpy(scratch.data() + sizeof(size), &checksum, sizeof(checksum));
+  if (std::fwrite(scratch.data(), 1, scratch.size(), file) != scratch.size() ||
+      std::fflush(file) != 0) {
+    std::cerr << "Write journal [" << path << "] failed, op "
+              << static_cast<int>(op) << " is not journaled." << std::endl;
+  }
+  isSyncPending = true;
+  wake.notify_one();
+}
+
+// Called with 'mutex' held.
+bool XMLJournal::OpenForAppend() {
+  std::error_code error;
+  if (std::filesystem::exists(path, error)) {
+    file = std::fopen(path.c_str(), "ab");
+  } else {
+    uint64_t docSize = 0;
+    int64_t docTime = 0;
+    if (!StatDocument(docFile, docSize, docTime)) {
+      std::cerr << "Journal: cannot stat [" << docFile << "]." << std::endl;
+      return false;
+    }
+    file = std::fopen(path.c_str(), "wb");
+    if (file) {
+      XMLWireWriter header;
+      header.U32(kJournalMagic);
+      header.U32(kJournalVersion);
+      header.U64(docSize);
+      header.U64(static_cast<uint64_t>(docTime));
+      std::fwrite(header.buffer.data(), 1, header.buffer.size(), file);
+    }
+  }
+  if (!file) {
+    std::cerr << "Open journal [" << path << "] failed." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void XMLJournal::CloseFile() {
+  std::lock_guard<std::mutex> syncLock(syncMutex);
+  std::lock_guard<std::mutex> lock(mutex);
+  if (file) {
+    SyncFile(file);
+    std::fclose(file);
+    file = nullptr;
+  }
+  isSyncPending = false;
+}
+
+void XMLJournal::Reset() {
+  CloseFile();
+  std::error_code error;
+  std::filesystem::remove(path, error);
+}
+
+void XMLJournal::Sync() {
+  std::lock_guard<std::mutex> syncLock(syncMutex);
+  std::FILE *target;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    target = file;
+    isSyncPending = false;
+  }
+  // The fsync runs outside 'mutex', 'syncMutex' keeps the file open.
+  if (target)
+    SyncFile(target);
+}
+
+void XMLJournal::RunFlusher() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    wake.wait(lock, [this] { return isSyncPending || isStopping; });
+    if (isStopping)
+      return;
+    // Let more appends pile up so one fsync covers the whole burst.
+    wake.wait_for(lock, kJournalSyncDelay, [this] { return isStopping; });
+    lock.unlock();
+    Sync();
+    lock.lock();
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef __XML_JOURNAL_H__
+#define __XML_JOURNAL_H__
+
+#include "xml_edit.h"
+#include "xml_types.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Write-ahead journal of committed edits, kept next to the document as
+// "<file>.journal" until the document is saved again.
+//
+//   journal := header, record*
+//   header  := u32 magic, u32 version, u64 fileSize, i64 fileTime
+//   record  := u32 size, u32 checksum, u8 op, payload[size - 1]
+//
+// The header identifies the saved file the records apply to; a journal for
+// a different file version is set aside as "<file>.journal.stale" instead of
+// being replayed. A record costs as much as the edit it describes, never the
+// document. Records are written to the OS immediately, so they survive an
+// editor crash, and fsync'ed in batches by a flusher thread.
+
+enum class XMLJournalOp : uint8_t {
+  AddEnum = 1,
+  AddStruct = 2,
+  // An applied, undone or redone edit (see xml_edit.h); undo is journaled
+  // as the inverse set.
+  ChangeSet = 3,
+};
+
+struct XMLJournalRecord {
+  XMLJournalOp op;
+  std::vector<uint8_t> payload;
+};
+
+// Payload codecs, false for a malformed payload.
+void EncodeJournalEnum(const XMLEnumData &data, std::vector<uint8_t> &out);
+void EncodeJournalStruct(const XMLStructData &data, std::vector<uint8_t> &out);
+bool DecodeJournalEnum(const std::vector<uint8_t> &payload, XMLEnumData &out);
+bool DecodeJournalStruct(const std::vector<uint8_t> &payload,
+                         XMLStructData &out);
+void EncodeJournalChanges(const XMLChangeSet &changes,
+                          std::vector<uint8_t> &out);
+bool DecodeJournalChanges(const std::vector<uint8_t> &payload,
+                          XMLChangeSet &out);
+
+class XMLJournal {
+public:
+  explicit XMLJournal(const std::string &docFile);
+  ~XMLJournal();
+  XMLJournal(const XMLJournal &) = delete;
+  XMLJournal &operator=(const XMLJournal &) = delete;
+
+  static std::string PathFor(const std::string &docFile) {
+    return docFile + ".journal";
+  }
+
+  // Read the records a previous session left for the current version of the
+  // document. A torn record at the end (crash mid-write) ends the journal
+  // and is cut off; later appends continue after the last intact record.
+  bool Recover(std::vector<XMLJournalRecord> &records);
+
+  void AppendEnum(const XMLEnumData &data);
+  void AppendStruct(const XMLStructData &data);
+  void AppendChanges(const XMLChangeSet &changes);
+  // The document was saved, drop the journal. The next append starts a new
+  // one against the saved file.
+  void Reset();
+  // Block until every appended record is on disk.
+  void Sync();
+
+private:
+  std::string docFile;
+  std::string path;
+  // 'mutex' guards the file and the pending state, 'syncMutex' serializes
+  // fsync against closing the file so appends never wait for the disk.
+  std::mutex mutex;
+  std::mutex syncMutex;
+  std::condition_variable wake;
+  std::FILE *file = nullptr;
+  std::vector<uint8_t> scratch; // record being appended
+  bool isSyncPending = false;
+  bool isStopping = false;
+  std::thread flusher;
+
+  void Append(XMLJournalOp op);
+  bool OpenForAppend();
+  void CloseFile();
+  void RunFlusher();
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "xml_label_cache.h"
+#include <cstdarg>
+#include <cstdio>
+
+uint64_t XMLLabelCache::Key(Kind kind, uint32_t parent, uint32_t child) {
+  return (static_cast<uint64_t>(kind) << 62) |
+         (static_cast<uint64_t>(parent) << 30) | (child & 0x3fffffffu);
+}
+
+const char *XMLLabelCache::Find(const XMLDocData &doc, uint64_t key) {
+  if (doc.contentHash != docHash) {
+    Clear();
+    docHash = doc.contentHash;
+    return nullptr;
+  }
+  auto it = offsets.find(key);
+  return it == offsets.end() ? nullptr : text.data() + it->second;
+}
+
+void XMLLabelCache::Append(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  va_list measure;
+  va_copy(measure, args);
+  int length = std::vsnprintf(nullptr, 0, fmt, measure);
+  va_end(measure);
+  if (length < 0)
+    length = 0;
+  size_t offset = text.size();
+  text.resize(offset + length + 1);
+  std::vsnprintf(text.data() + offset, length + 1, fmt, args);
+  va_end(args);
+}
+
+const char *XMLLabelCache::Commit(uint64_t key, uint32_t offset) {
+  offsets.emplace(key, offset);
+  return text.data() + offset;
+}
+
+const char *XMLLabelCache::StructTag(const XMLDocData &doc,
+                                     uint32_t structIndex) {
+  uint64_t key = Key(Kind::StructTag, structIndex, 0);
+  if (const char *cached = Find(doc, key))
+    return cached;
+  const XMLStructData &data = doc.structures[structIndex];
+  uint32_t offset = static_cast<uint32_t>(text.size());
+  if (data.address) {
+    Append("%s 0x%llx", StructKindName(data.kind),
+           static_cast<unsigned long long>(data.address.value()));
+  } else if (data.kind != XMLStructKind::Struct) {
+    Append("%s", StructKindName(data.kind));
+  } else {
+    Append("%s", "");
+  }
+  return Commit(key, offset);
+}
+
+const char *XMLLabelCache::GroupTag(const XMLDocData &doc,
+                                    uint32_t structIndex,
+                                    uint32_t fieldIndex) {
+  const XMLStructData &data = doc.structures[structIndex];
+  uint32_t group = data.fields[fieldIndex].group;
+  if (group >= data.groups.size())
+    return "";
+  uint64_t key = Key(Kind::GroupTag, structIndex, group);
+  if (const char *cached = Find(doc, key))
+    return cached;
+  const XMLGroupData &groupData = data.groups[group];
+  uint32_t offset = static_cast<uint32_t>(text.size());
+  if (groupData.count == 0) {
+    Append("[every %u bits from bit %u]", groupData.size, groupData.start);
+  } else {
+    Append("[%u x %u bits from bit %u]", groupData.count, groupData.size,
+           groupData.start);
+  }
+  return Commit(key, offset);
+}
+
+const char *XMLLabelCache::EnumValues(const XMLDocData &doc,
+                                      uint32_t enumIndex) {
+  uint64_t key = Key(Kind::EnumValues, enumIndex, 0);
+  if (const char *cached = Find(doc, key))
+    return cached;
+  uint32_t offset = static_cast<uint32_t>(text.size());
+  for (const XMLValueData &value : doc.enumerates[enumIndex].values) {
+    Append("%llu", static_cast<unsigned long long>(value.value));
+  }
+  return Commit(key, offset);
+}
+
+const char *XMLLabelCache::ChoiceValues(const XMLDocData &doc,
+                                        uint32_t structIndex,
+                                        uint32_t fieldIndex) {
+  uint64_t key = Key(Kind::ChoiceValues, structIndex, fieldIndex);
+  if (const char *cached = Find(doc, key))
+    return cached;
+  const XMLFieldData &field = doc.structures[structIndex].fields[fieldIndex];
+  uint32_t offset = static_cast<uint32_t>(text.size());
+  if (field.choices) {
+    for (const XMLValueData &value : field.choices.value()) {
+      Append("%llu", static_cast<unsigned long long>(value.value));
+    }
+  }
+  return Commit(key, offset);
+}
+
+void XMLLabelCache::Clear() {
+  offsets.clear();
+  text.clear();
+  docHash = 0;
+}
+
+size_t XMLLabelCache::MemoryBytes() const {
+  return offsets.bucket_count() * sizeof(void *) +
+         offsets.size() * (sizeof(std::pair<uint64_t, uint32_t>) +
+                           sizeof(void *)) +
+         text.capacity();
+}
@@ -0,0 +1,49 @@
+#ifndef __XML_LABEL_CACHE_H__
+#define __XML_LABEL_CACHE_H__
+
+#include "xml_types.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Formatted numbers and tags of the tree view, built the first time a node is
+// drawn and kept for as long as the document keeps its content hash. Redrawing
+// an unchanged document then formats nothing and allocates nothing.
+//
+// Returned text lives in one shared buffer: it is valid until the next call.
+class XMLLabelCache {
+public:
+  // "register 0x2000", "instruction", or "" for a plain struct.
+  const char *StructTag(const XMLDocData &doc, uint32_t structIndex);
+  // "[4 x 32 bits from bit 64]" of the field's group, "" outside of groups.
+  const char *GroupTag(const XMLDocData &doc, uint32_t structIndex,
+                       uint32_t fieldIndex);
+  // The values of an enum, or of a field's choices, in decimal: one
+  // '\0'-terminated string per value, back to back.
+  const char *EnumValues(const XMLDocData &doc, uint32_t enumIndex);
+  const char *ChoiceValues(const XMLDocData &doc, uint32_t structIndex,
+                           uint32_t fieldIndex);
+
+  void Clear();
+  size_t MemoryBytes() const;
+
+private:
+  enum class Kind : uint64_t { StructTag, GroupTag, EnumValues, ChoiceValues };
+
+  std::unordered_map<uint64_t, uint32_t> offsets; // key -> offset in 'text'
+  std::vector<char> text;
+  uint64_t docHash = 0;
+
+  // The cached text of 'key', or nullptr after a miss; the caller then
+  // appends it with Append() and Commit().
+  const char *Find(const XMLDocData &doc, uint64_t key);
+  void Append(const char *fmt, ...)
+#if defined(__GNUC__) || defined(__clang__)
+      __attribute__((format(printf, 2, 3)))
+#endif
+      ;
+  const char *Commit(uint64_t key, uint32_t offset);
+  static uint64_t Key(Kind kind, uint32_t parent, uint32_t child);
+};
+
+#endif
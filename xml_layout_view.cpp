@@ -0,0 +1,344 @@
+#include "xml_layout_view.h"
+#include "imgui.h"
+#include "xml_frame_arena.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+static const ImU32 kFieldColors[] = {
+    IM_COL32(86, 156, 214, 200), IM_COL32(78, 201, 176, 200),
+    IM_COL32(197, 134, 192, 200), IM_COL32(220, 220, 170, 200),
+    IM_COL32(206, 145, 120, 200), IM_COL32(156, 220, 254, 200),
+    IM_COL32(181, 206, 168, 200), IM_COL32(214, 157, 133, 200),
+};
+static constexpr size_t kFieldColorCount =
+    sizeof(kFieldColors) / sizeof(kFieldColors[0]);
+static const ImU32 kGapColor = IM_COL32(90, 90, 90, 120);
+static const ImU32 kGridColor = IM_COL32(140, 140, 140, 255);
+static const ImU32 kOverlapColor = IM_COL32(255, 60, 60, 255);
+static const ImU32 kTextColor = IM_COL32(20, 20, 20, 255);
+static const ImU32 kLabelColor = IM_COL32(200, 200, 200, 255);
+
+struct LayoutMetrics {
+  float fontSize;
+  float labelWidth;
+  float cellWidth;
+  float rowHeight;
+};
+
+static LayoutMetrics ComputeMetrics() {
+  LayoutMetrics metrics;
+  metrics.fontSize = ImGui::GetFontSize();
+  metrics.labelWidth = ImGui::CalcTextSize("DW 0000").x + 8.0f;
+  metrics.cellWidth = std::max(metrics.fontSize * 1.2f,
+                               ImGui::CalcTextSize("00").x + 4.0f);
+  metrics.rowHeight = metrics.fontSize + 6.0f;
+  return metrics;
+}
+
+// Glyph by glyph so nothing is CPU-clipped: rows outside the visible region
+// are recorded too and must still carry their labels when replayed.
+static void DrawUnclippedText(ImDrawList *drawList, ImVec2 pos, ImU32 col,
+                              const char *text, float maxWidth) {
+  ImFont *font = ImGui::GetFont();
+  const float size = ImGui::GetFontSize();
+  float x = pos.x;
+  for (const char *c = text; *c; ++c) {
+    float advance = font->CalcTextSizeA(size, FLT_MAX, 0.0f, c, c + 1).x;
+    if (x + advance > pos.x + maxWidth)
+      break;
+    font->RenderChar(drawList, size, ImVec2(x, pos.y), col,
+                     static_cast<ImWchar>(static_cast<unsigned char>(*c)));
+    x += advance;
+  }
+}
+
+// Left edge of bit 'bit' in its dword row; bit 31 is the leftmost column.
+static float BitLeft(const LayoutMetrics &metrics, float gridX, uint32_t bit) {
+  return gridX + (31 - bit % 32) * metrics.cellWidth;
+}
+
+static void DrawHeaderRow(ImDrawList *drawList, const LayoutMetrics &metrics,
+                          ImVec2 pos) {
+  const float gridX = pos.x + metrics.labelWidth;
+  char text[8];
+  for (uint32_t bit : {31u, 24u, 16u, 8u, 0u}) {
+    std::snprintf(text, sizeof(text), "%u", bit);
+    DrawUnclippedText(drawList, ImVec2(BitLeft(metrics, gridX, bit) + 2.0f,
+                                       pos.y + 3.0f),
+                      kLabelColor, text, metrics.cellWidth * 2);
+  }
+}
+
+// Absolute bits of a field, grouped fields at their first repetition.
+static void FieldBits(const XMLStructData &data, const XMLFieldData &field,
+                      uint32_t &start, uint32_t &end) {
+  uint32_t base = GroupBaseBit(data.groups, field.group);
+  start = base + field.start;
+  end = base + field.end;
+}
+
+static void DrawDwordRow(ImDrawList *drawList, const LayoutMetrics &metrics,
+                         const XMLStructData &data,
+                         const uint8_t *coverage, uint32_t dword,
+                         ImVec2 pos) {
+  const float gridX = pos.x + metrics.labelWidth;
+  const float top = pos.y + 1.0f;
+  const float bottom = pos.y + metrics.rowHeight - 1.0f;
+  const uint32_t firstBit = dword * 32;
+
+  char label[16];
+  std::snprintf(label, sizeof(label), "DW %u", dword);
+  DrawUnclippedText(drawList, ImVec2(pos.x, pos.y + 3.0f), kLabelColor, label,
+                    metrics.labelWidth);
+
+  // Uncovered bits, merged into runs.
+  for (uint32_t bit = 0; bit < 32;) {
+    if (coverage[firstBit + bit] != 0) {
+      ++bit;
+      continue;
+    }
+    uint32_t runEnd = bit;
+    while (runEnd + 1 < 32 && coverage[firstBit + runEnd + 1] == 0)
+      ++runEnd;
+    drawList->AddRectFilled(ImVec2(BitLeft(metrics, gridX, runEnd), top),
+                            ImVec2(BitLeft(metrics, gridX, bit) +
+                                       metrics.cellWidth,
+                                   bottom),
+                            kGapColor);
+    bit = runEnd + 1;
+  }
+
+  for (size_t f = 0; f < data.fields.size(); ++f) {
+    const XMLFieldData &field = data.fields[f];
+    uint32_t start, end;
+    FieldBits(data, field, start, end);
+    uint32_t segStart = std::max(start, firstBit);
+    uint32_t segEnd = std::min(end, firstBit + 31);
+    if (end < start || segStart > segEnd)
+      continue;
+    ImVec2 min(BitLeft(metrics, gridX, segEnd), top);
+    ImVec2 max(BitLeft(metrics, gridX, segStart) + metrics.cellWidth, bottom);
+    drawList->AddRectFilled(min, max, kFieldColors[f % kFieldColorCount]);
+    drawList->AddRect(min, max, kGridColor);
+    float room = max.x - min.x - 4.0f;
+    if (room > metrics.fontSize)
+      DrawUnclippedText(drawList, ImVec2(min.x + 2.0f, pos.y + 3.0f),
+                        kTextColor, field.name.c_str(), room);
+  }
+
+  for (uint32_t bit = 0; bit < 32;) {
+    if (coverage[firstBit + bit] < 2) {
+      ++bit;
+      continue;
+    }
+    uint32_t runEnd = bit;
+    while (runEnd + 1 < 32 && coverage[firstBit + runEnd + 1] >= 2)
+      ++runEnd;
+    drawList->AddRect(ImVec2(BitLeft(metrics, gridX, runEnd), top),
+                      ImVec2(BitLeft(metrics, gridX, bit) + metrics.cellWidth,
+                             bottom),
+                      kOverlapColor, 0.0f, 0, 2.0f);
+    bit = runEnd + 1;
+  }
+
+  drawList->AddRect(ImVec2(gridX, top),
+                    ImVec2(gridX + 32 * metrics.cellWidth, bottom), kGridColor);
+}
+
+static uint32_t DwordCount(const XMLStructData &data) {
+  // Bounds a diagram of a corrupt 'end' attribute, real structs are far
+  // smaller.
+  constexpr uint32_t kMaxDwords = 4096;
+  uint32_t count = std::max(1u, data.length);
+  for (const auto &field : data.fields) {
+    uint32_t start, end;
+    FieldBits(data, field, start, end);
+    if (end >= start)
+      count = std::max(count, end / 32 + 1);
+  }
+  return std::min(count, kMaxDwords);
+}
+
+static ImVec2 LayoutSize(const LayoutMetrics &metrics, uint32_t dwords) {
+  return ImVec2(metrics.labelWidth + 32 * metrics.cellWidth,
+                (dwords + 1) * metrics.rowHeight);
+}
+
+bool XMLLayoutCache::Record(ImDrawList *drawList, const XMLStructData &data,
+                            ImVec2 origin, Geometry &geometry) {
+  const LayoutMetrics metrics = ComputeMetrics();
+  const uint32_t dwords = DwordCount(data);
+  geometry.fontSize = metrics.fontSize;
+  geometry.rowHeight = metrics.rowHeight;
+  geometry.size = LayoutSize(metrics, dwords);
+
+  const uint32_t bitCount = dwords * 32;
+  uint8_t *coverage = GetFrameArena().AllocateArray<uint8_t>(bitCount);
+  for (const auto &field : data.fields) {
+    uint32_t start, end;
+    FieldBits(data, field, start, end);
+    for (uint32_t bit = start; bit <= end && bit < bitCount; ++bit) {
+      if (coverage[bit] < 255)
+        ++coverage[bit];
+    }
+  }
+
+  const unsigned int vtxOffset = drawList->_CmdHeader.VtxOffset;
+  for (uint32_t row = 0; row <= dwords; ++row) {
+    const int vtxStart = drawList->VtxBuffer.Size;
+    const int idxStart = drawList->IdxBuffer.Size;
+    const unsigned int baseIdx = drawList->_VtxCurrentIdx;
+    ImVec2 pos(origin.x, origin.y + row * metrics.rowHeight);
+    if (row == 0)
+      DrawHeaderRow(drawList, metrics, pos);
+    else
+      DrawDwordRow(drawList, metrics, data, coverage, row - 1, pos);
+
+    // A 16-bit index buffer rolled over to a new vertex offset, so the
+    // indices recorded so far are no longer relative to one base.
+    if (drawList->_CmdHeader.VtxOffset != vtxOffset)
+      return false;
+
+    Row cached;
+    cached.vtxOffset = static_cast<uint32_t>(geometry.vertices.size());
+    cached.vtxCount = static_cast<uint32_t>(drawList->VtxBuffer.Size - vtxStart);
+    cached.idxOffset = static_cast<uint32_t>(geometry.indices.size());
+    cached.idxCount = static_cast<uint32_t>(drawList->IdxBuffer.Size - idxStart);
+    for (int i = vtxStart; i < drawList->VtxBuffer.Size; ++i) {
+      ImDrawVert vert = drawList->VtxBuffer[i];
+      vert.pos.x -= origin.x;
+      vert.pos.y -= origin.y;
+      geometry.vertices.push_back(vert);
+    }
+    for (int i = idxStart; i < drawList->IdxBuffer.Size; ++i) {
+      geometry.indices.push_back(
+          static_cast<ImDrawIdx>(drawList->IdxBuffer[i] - baseIdx));
+    }
+    geometry.rows.push_back(cached);
+  }
+  return true;
+}
+
+void XMLLayoutCache::Replay(ImDrawList *drawList, const Geometry &geometry,
+                            ImVec2 origin) {
+  const ImVec2 clipMin = drawList->GetClipRectMin();
+  const ImVec2 clipMax = drawList->GetClipRectMax();
+  const int rowCount = static_cast<int>(geometry.rows.size());
+  int first = static_cast<int>(
+      std::floor((clipMin.y - origin.y) / geometry.rowHeight));
+  int last = static_cast<int>(
+      std::ceil((clipMax.y - origin.y) / geometry.rowHeight));
+  first = std::max(first, 0);
+  last = std::min(last, rowCount - 1);
+
+  for (int r = first; r <= last; ++r) {
+    const Row &row = geometry.rows[r];
+    if (row.idxCount == 0)
+      continue;
+    drawList->PrimReserve(static_cast<int>(row.idxCount),
+                          static_cast<int>(row.vtxCount));
+    // Read after PrimReserve, which may have started a new vertex offset.
+    const unsigned int baseIdx = drawList->_VtxCurrentIdx;
+    const ImDrawIdx *indices = geometry.indices.data() + row.idxOffset;
+    for (uint32_t i = 0; i < row.idxCount; ++i) {
+      drawList->PrimWriteIdx(static_cast<ImDrawIdx>(baseIdx + indices[i]));
+    }
+    const ImDrawVert *vertices = geometry.vertices.data() + row.vtxOffset;
+    for (uint32_t i = 0; i < row.vtxCount; ++i) {
+      drawList->PrimWriteVtx(ImVec2(vertices[i].pos.x + origin.x,
+                                    vertices[i].pos.y + origin.y),
+                             vertices[i].uv, vertices[i].col);
+    }
+  }
+}
+
+void XMLLayoutCache::RenderTooltip(const XMLStructData &data,
+                                   const Geometry &geometry, ImVec2 origin) {
+  const LayoutMetrics metrics = ComputeMetrics();
+  const ImVec2 mouse = ImGui::GetMousePos();
+  const float gridX = origin.x + metrics.labelWidth;
+  const int row = static_cast<int>((mouse.y - origin.y) / geometry.rowHeight);
+  const int column = static_cast<int>((mouse.x - gridX) / metrics.cellWidth);
+  if (row < 1 || column < 0 || column > 31 ||
+      row >= static_cast<int>(geometry.rows.size()))
+    return;
+  const uint32_t bit = (row - 1) * 32 + (31 - column);
+
+  ImGui::BeginTooltip();
+  ImGui::Text("DW %d bit %u (bit %u overall)", row - 1, bit % 32, bit);
+  bool isCovered = false;
+  for (const auto &field : data.fields) {
+    uint32_t start, end;
+    FieldBits(data, field, start, end);
+    if (start <= bit && bit <= end) {
+      ImGui::BulletText("%s [%u..%u] %s", field.name.c_str(), start, end,
+                        field.type.c_str());
+      isCovered = true;
+    }
+  }
+  if (!isCovered)
+    ImGui::TextDisabled("unused");
+  ImGui::EndTooltip();
+}
+
+void XMLLayoutCache::Render(const XMLStructData &data) {
+  ImDrawList *drawList = ImGui::GetWindowDrawList();
+  const ImVec2 origin = ImGui::GetCursorScreenPos();
+  const float fontSize = ImGui::GetFontSize();
+
+  auto it = layouts.find(data.contentHash);
+  if (it != layouts.end() && it->second.fontSize != fontSize) {
+    layouts.erase(it);
+    it = layouts.end();
+  }
+  if (it == layouts.end()) {
+    // Off screen, e.g. with every node expanded: only reserve the space, the
+    // layout is recorded once it scrolls into view.
+    ImVec2 size = LayoutSize(ComputeMetrics(), DwordCount(data));
+    if (!ImGui::IsRectVisible(size)) {
+      ImGui::Dummy(size);
+      return;
+    }
+  }
+  Geometry recorded;
+  const Geometry *geometry = &recorded;
+  if (it != layouts.end()) {
+    Replay(drawList, it->second, origin);
+    geometry = &it->second;
+  } else if (Record(drawList, data, origin, recorded)) {
+    if (layouts.size() >= kMaxCachedLayouts)
+      EvictLeastRecentlyUsed();
+    it = layouts.emplace(data.contentHash, std::move(recorded)).first;
+    geometry = &it->second;
+  }
+  if (it != layouts.end())
+    it->second.lastUsedFrame = ImGui::GetFrameCount();
+
+  ImGui::Dummy(geometry->size);
+  if (ImGui::IsItemHovered())
+    RenderTooltip(data, *geometry, origin);
+}
+
+void XMLLayoutCache::EvictLeastRecentlyUsed() {
+  auto oldest = layouts.begin();
+  for (auto it = layouts.begin(); it != layouts.end(); ++it) {
+    if (it->second.lastUsedFrame < oldest->second.lastUsedFrame)
+      oldest = it;
+  }
+  if (oldest != layouts.end())
+    layouts.erase(oldest);
+}
+
+size_t XMLLayoutCache::MemoryBytes() const {
+  size_t bytes = layouts.bucket_count() * sizeof(void *);
+  for (const auto &entry : layouts) {
+    const Geometry &geometry = entry.second;
+    bytes += sizeof(entry) + sizeof(void *);
+    bytes += geometry.vertices.capacity() * sizeof(ImDrawVert);
+    bytes += geometry.indices.capacity() * sizeof(ImDrawIdx);
+    bytes += geometry.rows.capacity() * sizeof(Row);
+  }
+  return bytes;
+}
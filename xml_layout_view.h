@@ -0,0 +1,57 @@
+#ifndef __XML_LAYOUT_VIEW_H__
+#define __XML_LAYOUT_VIEW_H__
+
+#include "imgui.h"
+#include "xml_types.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Dword-by-bit grid diagram of a struct's fields: one row per dword, bit 31
+// on the left, field spans as labelled boxes, gaps greyed out and overlapping
+// bits outlined in red. Fields of a <group> are drawn at its first repetition.
+//
+// The geometry of a struct is recorded once into plain vertex/index arrays
+// (keyed by the struct's content hash) and replayed into the window draw list
+// on later frames. Only rows inside the clip rect are replayed, so a frame
+// costs a few memcpy-like loops instead of hundreds of ImGui draw calls.
+// Diagrams that are entirely off screen are never recorded, and the least
+// recently drawn layout makes room for a new one, so redrawing the same view
+// records nothing and allocates nothing.
+class XMLLayoutCache {
+public:
+  void Render(const XMLStructData &data);
+  void Clear() { layouts.clear(); }
+  size_t MemoryBytes() const;
+
+private:
+  struct Row {
+    uint32_t vtxOffset;
+    uint32_t vtxCount;
+    uint32_t idxOffset;
+    uint32_t idxCount;
+  };
+  struct Geometry {
+    float fontSize = 0.0f;
+    ImVec2 size;
+    float rowHeight = 0.0f;
+    int lastUsedFrame = 0;
+    std::vector<ImDrawVert> vertices;
+    // Relative to the first vertex of the owning row.
+    std::vector<ImDrawIdx> indices;
+    std::vector<Row> rows;
+  };
+
+  static constexpr size_t kMaxCachedLayouts = 64;
+  std::unordered_map<uint64_t, Geometry> layouts;
+
+  void EvictLeastRecentlyUsed();
+  static bool Record(ImDrawList *drawList, const XMLStructData &data,
+                     ImVec2 origin, Geometry &geometry);
+  static void Replay(ImDrawList *drawList, const Geometry &geometry,
+                     ImVec2 origin);
+  static void RenderTooltip(const XMLStructData &data,
+                            const Geometry &geometry, ImVec2 origin);
+};
+
+#endif
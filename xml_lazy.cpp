@@ -0,0 +1,380 @@
+#include "xml_lazy.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+class GenxmlScanner {
+public:
+  explicit GenxmlScanner(std::string_view source) : src(source) {}
+
+  bool Scan(XMLDocData &out, XMLLazyScan &spans, std::string &error);
+
+private:
+  struct Tag {
+    size_t begin;       // '<'
+    size_t end;         // one past '>'
+    std::string_view name;
+    bool isClose;
+    bool isSelfClosing;
+  };
+
+  std::string_view src;
+  size_t pos = 0;
+  size_t linePos = 0;
+  int line = 1;
+
+  int LineAt(size_t offset);
+  bool SkipPast(std::string_view terminator);
+  bool NextTag(Tag &tag, std::string &error);
+  bool SkipElement(const Tag &start, std::string &error);
+  bool ParseHeader(const Tag &tag, XMLBaseData &out,
+                   XMLStructData *structHeader, std::string &error);
+  bool ScanRoot(XMLDocData &out, XMLLazyScan &spans, std::string &error);
+};
+
+} // namespace
+
+static bool IsNameChar(char c) {
+  return c != '>' && c != '/' && c != '=' && c != '"' && c != '\'' &&
+         c != ' ' && c != '\t' && c != '\r' && c != '\n';
+}
+
+static bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static void AppendUtf8(std::string &out, unsigned long code) {
+  if (code < 0x80) {
+    out += static_cast<char>(code);
+  } else if (code < 0x800) {
+    out += static_cast<char>(0xc0 | (code >> 6));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  } else if (code < 0x10000) {
+    out += static_cast<char>(0xe0 | (code >> 12));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  } else {
+    out += static_cast<char>(0xf0 | (code >> 18));
+    out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  }
+}
+
+// Entity and newline handling as tinyxml2 applies it to attribute values.
+static std::string DecodeAttribute(std::string_view raw) {
+  static const struct {
+    std::string_view entity;
+    char c;
+  } kEntities[] = {{"&quot;", '"'}, {"&amp;", '&'}, {"&apos;", '\''},
+                   {"&lt;", '<'},   {"&gt;", '>'}};
+  std::string out;
+  out.reserve(raw.size());
+  for (size_t i = 0; i < raw.size(); ++i) {
+    char c = raw[i];
+    if (c == '\r') {
+      out += '\n';
+      if (i + 1 < raw.size() && raw[i + 1] == '\n')
+        ++i;
+      continue;
+    }
+    if (c != '&') {
+      out += c;
+      continue;
+    }
+    std::string_view rest = raw.substr(i);
+    if (rest.size() > 3 && rest[1] == '#') {
+      size_t semicolon = rest.find(';');
+      if (semicolon != std::string_view::npos) {
+        bool hex = rest[2] == 'x' || rest[2] == 'X';
+        std::string digits(rest.substr(hex ? 3 : 2, semicolon - (hex ? 3 : 2)));
+        AppendUtf8(out, std::strtoul(digits.c_str(), nullptr, hex ? 16 : 10));
+        i += semicolon;
+        continue;
+      }
+    }
+    bool matched = false;
+    for (const auto &entity : kEntities) {
+      if (rest.substr(0, entity.entity.size()) == entity.entity) {
+        out += entity.c;
+        i += entity.entity.size() - 1;
+        matched = true;
+        break;
+      }
+    }
+    if (!matched)
+      out += c;
+  }
+  return out;
+}
+
+static bool ParseUnsigned(const std::string &text, uint64_t &value) {
+  const char *str = text.c_str();
+  while (IsSpace(*str))
+    ++str;
+  bool hex = str[0] == '0' && (str[1] == 'x' || str[1] == 'X');
+  char *end = nullptr;
+  unsigned long long parsed = std::strtoull(str, &end, hex ? 16 : 10);
+  if (end == str)
+    return false;
+  value = parsed;
+  return true;
+}
+
+static bool ParseUnsigned(const std::string &text, uint32_t &value) {
+  uint64_t parsed;
+  if (!ParseUnsigned(text, parsed))
+    return false;
+  value = static_cast<uint32_t>(parsed);
+  return true;
+}
+
+int GenxmlScanner::LineAt(size_t offset) {
+  // Offsets only move forward, so counting is incremental.
+  line += static_cast<int>(
+      std::count(src.begin() + linePos, src.begin() + offset, '\n'));
+  linePos = offset;
+  return line;
+}
+
+bool GenxmlScanner::SkipPast(std::string_view terminator) {
+  size_t found = src.find(terminator, pos);
+  if (found == std::string_view::npos)
+    return false;
+  pos = found + terminator.size();
+  return true;
+}
+
+// Advance to the next start or end tag, skipping text, comments, CDATA,
+// processing instructions and DOCTYPE.
+bool GenxmlScanner::NextTag(Tag &tag, std::string &error) {
+  for (;;) {
+    const void *lt = pos < src.size()
+                         ? std::memchr(src.data() + pos, '<', src.size() - pos)
+                         : nullptr;
+    if (!lt) {
+      error = "unexpected end of document";
+      return false;
+    }
+    pos = static_cast<const char *>(lt) - src.data();
+    std::string_view rest = src.substr(pos);
+    bool skipped = true;
+    if (rest.substr(0, 4) == "<!--")
+      skipped = SkipPast("-->");
+    else if (rest.substr(0, 9) == "<![CDATA[")
+      skipped = SkipPast("]]>");
+    else if (rest.substr(0, 2) == "<?")
+      skipped = SkipPast("?>");
+    else if (rest.substr(0, 2) == "<!")
+      skipped = SkipPast(">");
+    else
+      break;
+    if (!skipped) {
+      error = "unterminated markup";
+      return false;
+    }
+  }
+
+  tag.begin = pos;
+  size_t i = pos + 1;
+  tag.isClose = i < src.size() && src[i] == '/';
+  if (tag.isClose)
+    ++i;
+  size_t nameBegin = i;
+  while (i < src.size() && IsNameChar(src[i]))
+    ++i;
+  tag.name = src.substr(nameBegin, i - nameBegin);
+  if (tag.name.empty()) {
+    error = "malformed tag";
+    return false;
+  }
+  // Attribute values may contain '>', so respect quoting.
+  char quote = 0;
+  for (; i < src.size(); ++i) {
+    char c = src[i];
+    if (quote) {
+      if (c == quote)
+        quote = 0;
+    } else if (c == '"' || c == '\'') {
+      quote = c;
+    } else if (c == '>') {
+      break;
+    }
+  }
+  if (i >= src.size()) {
+    error = "unterminated tag";
+    return false;
+  }
+  tag.isSelfClosing = !tag.isClose && src[i - 1] == '/';
+  tag.end = i + 1;
+  pos = tag.end;
+  return true;
+}
+
+bool GenxmlScanner::SkipElement(const Tag &start, std::string &error) {
+  if (start.isSelfClosing)
+    return true;
+  int depth = 1;
+  Tag tag;
+  while (depth > 0) {
+    if (!NextTag(tag, error))
+      return false;
+    if (tag.isClose)
+      --depth;
+    else if (!tag.isSelfClosing)
+      ++depth;
+  }
+  if (tag.name != start.name) {
+    error = "mismatched end tag";
+    return false;
+  }
+  return true;
+}
+
+// 'structHeader' is 'out' for the struct kinds, which have more attributes.
+bool GenxmlScanner::ParseHeader(const Tag &tag, XMLBaseData &out,
+                                XMLStructData *structHeader,
+                                std::string &error) {
+  size_t i = tag.begin + 1 + tag.name.size();
+  size_t end = tag.end - (tag.isSelfClosing ? 2 : 1);
+  bool haveName = false, haveLength = false;
+  while (i < end) {
+    while (i < end && IsSpace(src[i]))
+      ++i;
+    size_t nameBegin = i;
+    while (i < end && IsNameChar(src[i]))
+      ++i;
+    std::string_view name = src.substr(nameBegin, i - nameBegin);
+    if (name.empty())
+      break;
+    while (i < end && IsSpace(src[i]))
+      ++i;
+    if (i >= end || src[i] != '=') {
+      error = "malformed attribute";
+      return false;
+    }
+    ++i;
+    while (i < end && IsSpace(src[i]))
+      ++i;
+    if (i >= end || (src[i] != '"' && src[i] != '\'')) {
+      error = "malformed attribute";
+      return false;
+    }
+    char quote = src[i++];
+    size_t valueBegin = i;
+    while (i < end && src[i] != quote)
+      ++i;
+    std::string_view raw = src.substr(valueBegin, i - valueBegin);
+    ++i;
+
+    if (name == "name") {
+      out.name = DecodeAttribute(raw);
+      haveName = true;
+    } else if (name == "prefix") {
+      out.prefix = DecodeAttribute(raw);
+    } else if (name == "info") {
+      out.info = DecodeAttribute(raw);
+    } else if (structHeader) {
+      if (name == "length") {
+        haveLength = ParseUnsigned(DecodeAttribute(raw), structHeader->length);
+      } else if (name == "num") {
+        uint64_t address;
+        if (ParseUnsigned(DecodeAttribute(raw), address))
+          structHeader->address = address;
+      } else if (name == "bias") {
+        uint32_t bias;
+        if (ParseUnsigned(DecodeAttribute(raw), bias))
+          structHeader->bias = bias;
+      } else if (name == "engine") {
+        structHeader->engine = DecodeAttribute(raw);
+      }
+    }
+  }
+  if (!haveName) {
+    error = "no attribute of name";
+    return false;
+  }
+  if (structHeader && !haveLength) {
+    error = "no attribute of length";
+    return false;
+  }
+  return true;
+}
+
+bool GenxmlScanner::Scan(XMLDocData &out, XMLLazyScan &spans,
+                         std::string &error) {
+  if (ScanRoot(out, spans, error))
+    return true;
+  error = "Line " + std::to_string(LineAt(std::min(pos, src.size()))) + ": " +
+          error;
+  return false;
+}
+
+bool GenxmlScanner::ScanRoot(XMLDocData &out, XMLLazyScan &spans,
+                             std::string &error) {
+  Tag tag;
+  do {
+    if (!NextTag(tag, error)) {
+      error = "no genxml root node";
+      return false;
+    }
+  } while (tag.isClose);
+  if (tag.name != "genxml") {
+    error = "no genxml root node";
+    return false;
+  }
+  if (tag.isSelfClosing)
+    return true;
+
+  for (;;) {
+    if (!NextTag(tag, error))
+      return false;
+    if (tag.isClose)
+      return true;
+
+    XMLStructKind kind = XMLStructKind::Struct;
+    bool isStruct = true;
+    if (tag.name == "instruction")
+      kind = XMLStructKind::Instruction;
+    else if (tag.name == "register")
+      kind = XMLStructKind::Register;
+    else
+      isStruct = tag.name == "struct";
+    bool isEnum = tag.name == "enum";
+    XMLLazySpan span{tag.begin, 0, isStruct || isEnum ? LineAt(tag.begin) : 0};
+    if (isStruct) {
+      XMLStructData header;
+      header.length = 0;
+      header.kind = kind;
+      if (!ParseHeader(tag, header, &header, error))
+        return false;
+      out.structures.emplace_back(std::move(header));
+    } else if (isEnum) {
+      XMLEnumData header;
+      if (!ParseHeader(tag, header, nullptr, error))
+        return false;
+      out.enumerates.emplace_back(std::move(header));
+    }
+    if (!SkipElement(tag, error))
+      return false;
+    span.size = pos - span.offset;
+    if (isStruct)
+      spans.structs.push_back(span);
+    else if (isEnum)
+      spans.enums.push_back(span);
+  }
+}
+
+bool ScanGenxmlHeaders(std::string_view source, XMLDocData &out,
+                       XMLLazyScan &spans, std::string &error) {
+  GenxmlScanner scanner(source);
+  XMLDocData headers;
+  XMLLazyScan headerSpans;
+  if (!scanner.Scan(headers, headerSpans, error))
+    return false;
+  std::swap(out, headers);
+  std::swap(spans, headerSpans);
+  return true;
+}
@@ -0,0 +1,33 @@
+#ifndef __XML_LAZY_H__
+#define __XML_LAZY_H__
+
+#include "xml_types.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Byte range of one top level <struct>, <instruction>, <register> or <enum>
+// element in the source text, start tag through end tag.
+struct XMLLazySpan {
+  size_t offset;
+  size_t size;
+  int line;
+};
+
+struct XMLLazyScan {
+  // Parallel to XMLDocData::enumerates and XMLDocData::structures.
+  std::vector<XMLLazySpan> enums;
+  std::vector<XMLLazySpan> structs;
+};
+
+// Header scan of a genxml document without building a DOM. Every direct
+// <enum>, <struct>, <instruction> and <register> child of the <genxml> root
+// gets an entry in 'out' with only its start tag attributes (name, prefix,
+// info, and the length, num, bias and engine of the struct kinds), and its
+// span in 'spans' so the body can be parsed later. The cost is one pass over
+// the bytes looking for tags.
+bool ScanGenxmlHeaders(std::string_view source, XMLDocData &out,
+                       XMLLazyScan &spans, std::string &error);
+
+#endif
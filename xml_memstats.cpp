@@ -0,0 +1,154 @@
+#include "xml_memstats.h"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+static const char *kCategoryNames[] = {
+    "names",  "symbols", "infos", "types",   "values",
+    "fields", "structs", "enums", "dom",     "indexes",
+};
+static_assert(sizeof(kCategoryNames) / sizeof(kCategoryNames[0]) ==
+                  static_cast<size_t>(XMLMemCategory::Count),
+              "missing category name");
+
+const char *MemCategoryName(XMLMemCategory category) {
+  if (category >= XMLMemCategory::Count)
+    return "";
+  return kCategoryNames[static_cast<size_t>(category)];
+}
+
+XMLMemBucket XMLMemReport::Total() const {
+  XMLMemBucket total;
+  for (const XMLMemBucket &bucket : buckets) {
+    total.Add(bucket.bytes, bucket.allocations, bucket.objects);
+  }
+  return total;
+}
+
+static void AccountString(const std::string &str, XMLMemBucket &bucket) {
+  static const size_t kInlineCapacity = std::string().capacity();
+  if (str.capacity() > kInlineCapacity)
+    bucket.Add(str.capacity() + 1, 1, 1);
+  else
+    bucket.Add(0, 0, 1);
+}
+
+static void AccountString(const std::optional<std::string> &str,
+                          XMLMemBucket &bucket) {
+  if (str)
+    AccountString(*str, bucket);
+}
+
+template <typename T>
+static void AccountVector(const std::vector<T> &vec, XMLMemBucket &bucket) {
+  if (vec.capacity() > 0)
+    bucket.Add(vec.capacity() * sizeof(T), 1, vec.size());
+}
+
+static void AccountBase(const XMLBaseData &data, XMLMemReport &report) {
+  AccountString(data.name, report[XMLMemCategory::Names]);
+  AccountString(data.prefix, report[XMLMemCategory::Names]);
+  AccountString(data.info, report[XMLMemCategory::Infos]);
+}
+
+static void AccountValues(const std::vector<XMLValueData> &values,
+                          XMLMemReport &report) {
+  AccountVector(values, report[XMLMemCategory::Values]);
+  for (const XMLValueData &value : values) {
+    AccountBase(value, report);
+  }
+}
+
+// A value table is shared by every field with the same choices and counted
+// once: its make_shared block, its values and its lookup index.
+static void AccountValueTable(const XMLValueTable &table,
+                              XMLMemReport &report) {
+  XMLMemBucket &bucket = report[XMLMemCategory::Values];
+  bucket.Add(sizeof(XMLValueTable) + 2 * sizeof(void *), 1, 1);
+  AccountValues(table.values, report);
+  if (table.byValue.capacity() > 0)
+    bucket.Add(table.byValue.capacity() * sizeof(uint32_t), 1, 0);
+}
+
+void AccountDocData(const XMLDocData &doc, XMLMemReport &report) {
+  std::unordered_set<const XMLValueTable *> tables;
+  AccountVector(doc.structures, report[XMLMemCategory::Structs]);
+  AccountVector(doc.enumerates, report[XMLMemCategory::Enums]);
+
+  for (const XMLStructData &structData : doc.structures) {
+    AccountBase(structData, report);
+    AccountString(structData.engine, report[XMLMemCategory::Names]);
+    AccountVector(structData.groups, report[XMLMemCategory::Structs]);
+    AccountVector(structData.fields, report[XMLMemCategory::Fields]);
+    for (const XMLFieldData &field : structData.fields) {
+      AccountBase(field, report);
+      AccountString(field.type, report[XMLMemCategory::Types]);
+      const XMLValueTable *table = field.choices.Table();
+      if (table && tables.insert(table).second)
+        AccountValueTable(*table, report);
+    }
+  }
+  for (const XMLEnumData &enumData : doc.enumerates) {
+    AccountBase(enumData, report);
+    AccountValues(enumData.values, report);
+  }
+}
+
+void AccountCompactDoc(const XMLCompactDoc &doc, XMLMemReport &report) {
+  // Four blocks: characters, offsets, hashes and slots.
+  report[XMLMemCategory::Symbols].Add(doc.symbols.MemoryBytes(),
+                                      doc.symbols.Size() ? 4 : 0,
+                                      doc.symbols.Size());
+  AccountVector(doc.structures, report[XMLMemCategory::Structs]);
+  AccountVector(doc.enumerates, report[XMLMemCategory::Enums]);
+  AccountVector(doc.fields, report[XMLMemCategory::Fields]);
+  AccountVector(doc.values, report[XMLMemCategory::Values]);
+  AccountVector(doc.groups, report[XMLMemCategory::Structs]);
+}
+
+// tinyxml2 carves nodes out of per-type pools of 4KB blocks and keeps names
+// and text in place inside one copy of the source text.
+static constexpr size_t kDomPoolBlockBytes = 4 * 1024;
+
+static void AccountPool(uint64_t count, size_t itemSize,
+                        XMLMemBucket &bucket) {
+  if (count == 0)
+    return;
+  uint64_t itemsPerBlock = kDomPoolBlockBytes / itemSize;
+  uint64_t blocks = (count + itemsPerBlock - 1) / itemsPerBlock;
+  bucket.Add(blocks * kDomPoolBlockBytes, blocks, count);
+}
+
+void AccountDom(const tinyxml2::XMLDocument &dom, size_t sourceBytes,
+                XMLMemReport &report) {
+  uint64_t elements = 0, attributes = 0, others = 0;
+  std::vector<const tinyxml2::XMLNode *> stack;
+  for (const tinyxml2::XMLNode *node = dom.FirstChild(); node;
+       node = node->NextSibling()) {
+    stack.push_back(node);
+  }
+  while (!stack.empty()) {
+    const tinyxml2::XMLNode *node = stack.back();
+    stack.pop_back();
+    if (const tinyxml2::XMLElement *element = node->ToElement()) {
+      ++elements;
+      for (const tinyxml2::XMLAttribute *attr = element->FirstAttribute();
+           attr; attr = attr->Next()) {
+        ++attributes;
+      }
+    } else {
+      ++others;
+    }
+    for (const tinyxml2::XMLNode *child = node->FirstChild(); child;
+         child = child->NextSibling()) {
+      stack.push_back(child);
+    }
+  }
+
+  XMLMemBucket &bucket = report[XMLMemCategory::Dom];
+  AccountPool(elements, sizeof(tinyxml2::XMLElement), bucket);
+  AccountPool(attributes, sizeof(tinyxml2::XMLAttribute), bucket);
+  AccountPool(others, sizeof(tinyxml2::XMLText), bucket);
+  if (sourceBytes > 0)
+    bucket.Add(sourceBytes + 1, 1, 0);
+}
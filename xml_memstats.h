@@ -0,0 +1,63 @@
+#ifndef __XML_MEMSTATS_H__
+#define __XML_MEMSTATS_H__
+
+#include "thirdparty/tinyxml2/tinyxml2.h"
+#include "xml_alloc_counter.h"
+#include "xml_compact.h"
+#include "xml_types.h"
+#include <cstddef>
+#include <cstdint>
+
+enum class XMLMemCategory : uint8_t {
+  Names,   // name and prefix strings
+  Symbols, // interned strings of a compact document
+  Infos,   // info strings
+  Types,   // field type strings
+  Values,  // enum values, choices and default values
+  Fields,  // XMLFieldData arrays
+  Structs, // XMLStructData array and group descriptors
+  Enums,   // XMLEnumData array
+  Dom,     // tinyxml2 node pools and source buffer
+  Indexes, // query indexes, type graph and render caches
+  Count,
+};
+
+const char *MemCategoryName(XMLMemCategory category);
+
+// Heap bytes owned by one category. 'allocations' is the number of live heap
+// blocks; strings short enough for the small string buffer cost neither.
+struct XMLMemBucket {
+  uint64_t bytes = 0;
+  uint64_t allocations = 0;
+  uint64_t objects = 0;
+
+  void Add(uint64_t blockBytes, uint64_t blockCount, uint64_t objectCount) {
+    bytes += blockBytes;
+    allocations += blockCount;
+    objects += objectCount;
+  }
+};
+
+struct XMLMemReport {
+  XMLMemBucket buckets[static_cast<size_t>(XMLMemCategory::Count)];
+  // Heap traffic measured while loading; all zero unless the counting
+  // allocator is built in.
+  XMLAllocStats loadAllocs;
+
+  XMLMemBucket &operator[](XMLMemCategory category) {
+    return buckets[static_cast<size_t>(category)];
+  }
+  const XMLMemBucket &operator[](XMLMemCategory category) const {
+    return buckets[static_cast<size_t>(category)];
+  }
+  XMLMemBucket Total() const;
+};
+
+// Bytes are computed from container capacities, so they are exact for the
+// document model and a close estimate for tinyxml2 (pool block granularity).
+void AccountDocData(const XMLDocData &doc, XMLMemReport &report);
+void AccountCompactDoc(const XMLCompactDoc &doc, XMLMemReport &report);
+void AccountDom(const tinyxml2::XMLDocument &dom, size_t sourceBytes,
+                XMLMemReport &report);
+
+#endif
@@ -1,35 +1,24 @@
 #include "xml_parser.h"
 #include "thirdparty/tinyxml2/tinyxml2.h"
+#include "xml_compress.h"
+#include "xml_hash.h"
+#include "xml_journal.h"
+#include "xml_lazy.h"
+#include <atomic>
+#include <condition_variable>
 #include <functional>
-#include <iostream>
-#include <sstream>
-
-#define PARSE_ERROR(err_msg) std::cerr << "err_msg" << std::endl;
-
-#define SUCCESS_OR_RETURN(err, err_msg, return_express)                        \
-  if (err != tinyxml2::XMLError::XML_SUCCESS) {                                \
-    PARSE_ERROR(err_msg);                                                      \
-    return return_express;                                                     \
-  }
-
-static std::string ErrorAttributeMsg(tinyxml2::XMLElement *element,
-                                     const std::string &attributeName,
-                                     tinyxml2::XMLError errorCode) {
-  std::stringstream ss;
-  ss << "[ERROR] Line " << element->GetLineNum()
-     << "Parse Failed. No attribute of " << attributeName << "\n";
-  return ss.str();
-}
-
-static std::string ErrorElementMsg(tinyxml2::XMLElement *element,
-                                   const std::string &reason) {
-  std::stringstream ss;
-  ss << "[ERROR] Line " << element->GetLineNum() << "Parse Failed;";
-  if (!reason.empty()) {
-    ss << " Reason: " << reason << ".";
-  }
-  ss << "\n";
-  return ss.str();
+#include <mutex>
+#include <thread>
+
+static bool RequireAttribute(tinyxml2::XMLError error,
+                             tinyxml2::XMLElement *element,
+                             XMLDiagElement kind, const char *attribute,
+                             XMLDiagnostics &diag) {
+  if (error == tinyxml2::XMLError::XML_SUCCESS)
+    return true;
+  diag.Report(XMLDiagSeverity::Error, kind, XMLDiagCode::BadAttribute,
+              element->GetLineNum(), attribute);
+  return false;
 }
 
 static bool
@@ -47,15 +36,56 @@ ForeachChildNode(tinyxml2::XMLElement *element,
   return ret;
 }
 
+// Same as ForeachChildNode() over every child element, in document order.
+static bool
+ForeachChildElement(tinyxml2::XMLElement *element,
+                    std::function<bool(tinyxml2::XMLElement *element)> &&func) {
+  bool ret = true;
+  for (tinyxml2::XMLElement *child = element->FirstChildElement(); child;
+       child = child->NextSiblingElement()) {
+    if (!func(child)) {
+      ret = false;
+    }
+  }
+  return ret;
+}
+
+// <struct>, <instruction> and <register> all define a struct layout.
+static bool StructKindOf(const char *elementName, XMLStructKind &kind) {
+  std::string_view name(elementName ? elementName : "");
+  if (name == "struct")
+    kind = XMLStructKind::Struct;
+  else if (name == "instruction")
+    kind = XMLStructKind::Instruction;
+  else if (name == "register")
+    kind = XMLStructKind::Register;
+  else
+    return false;
+  return true;
+}
+
+static XMLDiagElement StructDiagElement(XMLStructKind kind) {
+  switch (kind) {
+  case XMLStructKind::Instruction:
+    return XMLDiagElement::Instruction;
+  case XMLStructKind::Register:
+    return XMLDiagElement::Register;
+  default:
+    return XMLDiagElement::Struct;
+  }
+}
+
 static bool DoParseXMLBaseData(tinyxml2::XMLElement *element,
-                               XMLBaseData &out) {
+                               XMLDiagElement kind, XMLBaseData &out,
+                               XMLDiagnostics &diag) {
   assert(element);
   const char *strName = nullptr;
   const char *strInfo = nullptr;
   const char *strPrefix = nullptr;
   tinyxml2::XMLError error;
   error = element->QueryAttribute("name", &strName);
-  SUCCESS_OR_RETURN(error, ErrorAttributeMsg(element, "name", error), false);
+  if (!RequireAttribute(error, element, kind, "name", diag))
+    return false;
 
   // optional attributes
   element->QueryAttribute("prefix", &strPrefix);
@@ -63,41 +93,45 @@ static bool DoParseXMLBaseData(tinyxml2::XMLElement *element,
 
   out.name = std::string(strName);
   if (strInfo)
-    out.info->assign(strInfo);
+    out.info = strInfo;
   if (strPrefix)
-    out.prefix->assign(strPrefix);
+    out.prefix = strPrefix;
   return true;
 }
 
 static bool DoParseXMLValueData(tinyxml2::XMLElement *element,
-                                XMLValueData &out) {
-  if (!DoParseXMLBaseData(element, (XMLBaseData &)out)) {
+                                XMLValueData &out, XMLDiagnostics &diag) {
+  if (!DoParseXMLBaseData(element, XMLDiagElement::Value, out, diag)) {
     return false;
   }
   uint64_t value;
   tinyxml2::XMLError error = element->QueryAttribute("value", &value);
-  SUCCESS_OR_RETURN(error, ErrorAttributeMsg(element, "value", error), false);
+  if (!RequireAttribute(error, element, XMLDiagElement::Value, "value", diag))
+    return false;
   out.value = value;
   return true;
 }
 
 static bool DoParseXMLFieldData(tinyxml2::XMLElement *element,
-                                XMLFieldData &out) {
-  if (!DoParseXMLBaseData(element, (XMLBaseData &)out)) {
+                                XMLFieldData &out, XMLDiagnostics &diag) {
+  if (!DoParseXMLBaseData(element, XMLDiagElement::Field, out, diag)) {
     return false;
   }
   uint32_t start;
   uint32_t end;
   uint64_t defaultValue;
-  bool haveDefaultValue;
+  bool haveDefaultValue = false;
   const char *strType;
 
   tinyxml2::XMLError error = element->QueryAttribute("start", &start);
-  SUCCESS_OR_RETURN(error, ErrorAttributeMsg(element, "start", error), false);
+  if (!RequireAttribute(error, element, XMLDiagElement::Field, "start", diag))
+    return false;
   error = element->QueryAttribute("end", &end);
-  SUCCESS_OR_RETURN(error, ErrorAttributeMsg(element, "end", error), false);
+  if (!RequireAttribute(error, element, XMLDiagElement::Field, "end", diag))
+    return false;
   error = element->QueryAttribute("type", &strType);
-  SUCCESS_OR_RETURN(error, ErrorAttributeMsg(element, "end", error), false);
+  if (!RequireAttribute(error, element, XMLDiagElement::Field, "type", diag))
+    return false;
 
   if (tinyxml2::XMLError::XML_SUCCESS ==
       element->QueryAttribute("default", &defaultValue)) {
@@ -106,21 +140,17 @@ static bool DoParseXMLFieldData(tinyxml2::XMLElement *element,
 
   std::optional<std::vector<XMLValueData>> choices;
   if (!ForeachChildNode(
-          element, "value", [&choices](tinyxml2::XMLElement *element) {
+          element, "value", [&choices, &diag](tinyxml2::XMLElement *element) {
             if (!choices.has_value()) {
               choices = std::vector<XMLValueData>();
             }
             XMLValueData data;
-            if (!DoParseXMLValueData(element, data)) {
-              PARSE_ERROR(
-                  ErrorElementMsg(element, "Failed to get valid 'value' data"));
+            if (!DoParseXMLValueData(element, data, diag)) {
               return false;
             }
             choices->emplace_back(data);
             return true;
           })) {
-    PARSE_ERROR(
-        ErrorElementMsg(element, "Traverse child node of 'value' failed"));
     return false;
   }
 
@@ -129,37 +159,37 @@ static bool DoParseXMLFieldData(tinyxml2::XMLElement *element,
   out.type = strType;
   if (haveDefaultValue)
     out.defaultValue = defaultValue;
-  std::swap(out.choices, choices);
+  if (choices)
+    out.choices = std::move(*choices);
+  else
+    out.choices.reset();
 
   return true;
 }
 
 static bool DoParseXMLEnumData(tinyxml2::XMLElement *element,
-                               XMLEnumData &out) {
+                               XMLEnumData &out, XMLDiagnostics &diag) {
   assert(element);
-  if (!DoParseXMLBaseData(element, (XMLBaseData &)out)) {
+  if (!DoParseXMLBaseData(element, XMLDiagElement::Enum, out, diag)) {
     return false;
   }
 
   std::vector<XMLValueData> values;
   if (!ForeachChildNode(element, "value",
-                        [&values](tinyxml2::XMLElement *element) {
-                          // std::cout << "Parse" <<element->GetText() << std::endl;
+                        [&values, &diag](tinyxml2::XMLElement *element) {
                           XMLValueData valueData;
-                          if (!DoParseXMLValueData(element, valueData)) {
+                          if (!DoParseXMLValueData(element, valueData, diag)) {
                             return false;
                           }
                           values.emplace_back(std::move(valueData));
                           return true;
                         })) {
-    PARSE_ERROR(
-        ErrorElementMsg(element, "Traverse child node of 'value' failed"));
     return false;
   }
 
   if (values.empty()) {
-    PARSE_ERROR(
-        ErrorElementMsg(element, "No 'value' belong to this 'enum' node"));
+    diag.Report(XMLDiagSeverity::Error, XMLDiagElement::Enum,
+                XMLDiagCode::NoValues, element->GetLineNum());
     return false;
   }
 
@@ -168,49 +198,115 @@ static bool DoParseXMLEnumData(tinyxml2::XMLElement *element,
   return true;
 }
 
+// Parse the fields and nested groups of a struct or of group 'group', in
+// document order, into 'out'.
+static bool DoParseXMLFieldList(tinyxml2::XMLElement *element, uint32_t group,
+                                XMLStructData &out, XMLDiagnostics &diag);
+
+static bool DoParseXMLGroupData(tinyxml2::XMLElement *element, uint32_t parent,
+                                XMLStructData &out, XMLDiagnostics &diag) {
+  XMLGroupData group;
+  tinyxml2::XMLError error = element->QueryAttribute("count", &group.count);
+  if (!RequireAttribute(error, element, XMLDiagElement::Group, "count", diag))
+    return false;
+  error = element->QueryAttribute("start", &group.start);
+  if (!RequireAttribute(error, element, XMLDiagElement::Group, "start", diag))
+    return false;
+  error = element->QueryAttribute("size", &group.size);
+  if (!RequireAttribute(error, element, XMLDiagElement::Group, "size", diag))
+    return false;
+  group.parent = parent;
+
+  uint32_t groupIndex = static_cast<uint32_t>(out.groups.size());
+  size_t fieldCount = out.fields.size();
+  out.groups.push_back(group);
+  if (!DoParseXMLFieldList(element, groupIndex, out, diag))
+    return false;
+  if (out.fields.size() == fieldCount) {
+    // Nothing to repeat; any nested groups are empty as well.
+    diag.Report(XMLDiagSeverity::Warning, XMLDiagElement::Group,
+                XMLDiagCode::NoFields, element->GetLineNum());
+    out.groups.resize(groupIndex);
+  }
+  return true;
+}
+
+static bool DoParseXMLFieldList(tinyxml2::XMLElement *element, uint32_t group,
+                                XMLStructData &out, XMLDiagnostics &diag) {
+  return ForeachChildElement(
+      element, [group, &out, &diag](tinyxml2::XMLElement *element) {
+        std::string_view name(element->Name());
+        if (name == "group")
+          return DoParseXMLGroupData(element, group, out, diag);
+        if (name != "field")
+          return true;
+        XMLFieldData data;
+        if (!DoParseXMLFieldData(element, data, diag)) {
+          return false;
+        }
+        data.group = group;
+        out.fields.emplace_back(std::move(data));
+        return true;
+      });
+}
+
 static bool DoParseXMLStructData(tinyxml2::XMLElement *element,
-                                 XMLStructData &out) {
+                                 XMLStructData &out, XMLDiagnostics &diag) {
   assert(element);
-  if (!DoParseXMLBaseData(element, (XMLBaseData &)out)) {
+  XMLStructKind kind = XMLStructKind::Struct;
+  StructKindOf(element->Name(), kind);
+  XMLDiagElement diagElement = StructDiagElement(kind);
+  if (!DoParseXMLBaseData(element, diagElement, out, diag)) {
     return false;
   }
   uint32_t length;
-  std::vector<XMLFieldData> fields;
   tinyxml2::XMLError error;
 
   error = element->QueryAttribute("length", &length);
-  SUCCESS_OR_RETURN(error, ErrorAttributeMsg(element, "length", error), false);
+  if (!RequireAttribute(error, element, diagElement, "length", diag))
+    return false;
 
-  if (!ForeachChildNode(
-          element, "field", [&fields](tinyxml2::XMLElement *element) {
-            XMLFieldData data;
-            if (!DoParseXMLFieldData(element, data)) {
-              PARSE_ERROR(ErrorElementMsg(element, "Not a valid 'field'"));
-              return false;
-            }
-            fields.emplace_back(std::move(data));
-            return true;
-          })) {
-    PARSE_ERROR(
-        ErrorElementMsg(element, "Traverse child node of 'field' failed"));
+  // optional attributes
+  uint64_t address;
+  uint32_t bias;
+  const char *strEngine = nullptr;
+  if (tinyxml2::XMLError::XML_SUCCESS ==
+      element->QueryAttribute("num", &address)) {
+    out.address = address;
+  }
+  if (tinyxml2::XMLError::XML_SUCCESS ==
+      element->QueryAttribute("bias", &bias)) {
+    out.bias = bias;
+  }
+  element->QueryAttribute("engine", &strEngine);
+  if (strEngine)
+    out.engine = strEngine;
+
+  XMLStructData body;
+  if (!DoParseXMLFieldList(element, XMLGroupData::kNoGroup, body, diag)) {
     return false;
   }
 
-  if (fields.empty()) {
-    PARSE_ERROR(ErrorElementMsg(element, "Have no 'field' nodes"));
+  if (body.fields.empty()) {
+    diag.Report(XMLDiagSeverity::Error, diagElement, XMLDiagCode::NoFields,
+                element->GetLineNum());
     return false;
   }
 
   out.length = length;
-  std::swap(out.fields, fields);
+  out.kind = kind;
+  std::swap(out.fields, body.fields);
+  std::swap(out.groups, body.groups);
 
   return true;
 }
 
-static bool DoParseXMLDocData(tinyxml2::XMLDocument &xmldoc, XMLDocData &out) {
+static bool DoParseXMLDocData(tinyxml2::XMLDocument &xmldoc, XMLDocData &out,
+                              XMLDiagnostics &diag) {
   tinyxml2::XMLElement *genxmlNode = xmldoc.FirstChildElement("genxml");
   if (!genxmlNode) {
-    PARSE_ERROR("no genxml root node.");
+    diag.Report(XMLDiagSeverity::Error, XMLDiagElement::Document,
+                XMLDiagCode::NoRootElement, 0);
     return false;
   }
 
@@ -218,34 +314,36 @@ static bool DoParseXMLDocData(tinyxml2::XMLDocument &xmldoc, XMLDocData &out) {
 
   // Parse the 'enum's
   if (!ForeachChildNode(
-          genxmlNode, "enum", [&docData](tinyxml2::XMLElement *element) {
+          genxmlNode, "enum", [&docData, &diag](tinyxml2::XMLElement *element) {
             XMLEnumData enumData;
-            if (!DoParseXMLEnumData(element, enumData)) {
-              PARSE_ERROR(
-                  ErrorElementMsg(element, "Invalid 'enum' definition"));
+            if (!DoParseXMLEnumData(element, enumData, diag)) {
+              diag.Report(XMLDiagSeverity::Error, XMLDiagElement::Enum,
+                          XMLDiagCode::InvalidDefinition,
+                          element->GetLineNum());
               return false;
             }
             docData.enumerates.emplace_back(std::move(enumData));
             return true;
           })) {
-    PARSE_ERROR("Error happends when parse 'enum' definitions");
     return false;
   }
 
-  // parse the 'struct's
-  if (!ForeachChildNode(
-          genxmlNode, "struct", [&docData](tinyxml2::XMLElement *element) {
-            std::cout << "Parse " << element->Attribute("name") << std::endl;
+  // parse the 'struct's, 'instruction's and 'register's, in document order
+  if (!ForeachChildElement(
+          genxmlNode, [&docData, &diag](tinyxml2::XMLElement *element) {
+            XMLStructKind kind;
+            if (!StructKindOf(element->Name(), kind))
+              return true;
             XMLStructData Data;
-            if (!DoParseXMLStructData(element, Data)) {
-              PARSE_ERROR(
-                  ErrorElementMsg(element, "Invalid 'struct' definition"));
+            if (!DoParseXMLStructData(element, Data, diag)) {
+              diag.Report(XMLDiagSeverity::Error, StructDiagElement(kind),
+                          XMLDiagCode::InvalidDefinition,
+                          element->GetLineNum());
               return false;
             }
             docData.structures.emplace_back(std::move(Data));
             return true;
           })) {
-    PARSE_ERROR("Error happends when parse 'struct' definitions");
     return false;
   }
 
@@ -253,21 +351,469 @@ static bool DoParseXMLDocData(tinyxml2::XMLDocument &xmldoc, XMLDocData &out) {
   return true;
 }
 
-bool XMLParserContext::init() {
+struct XMLParserContext::LazyLoad {
+  // Failed is a committed item whose body did not parse; it stays a header.
+  enum State : uint8_t { Pending, Parsing, Parsed, Committed, Failed };
+  struct Body {
+    bool ok = false;
+    XMLStructData structData;
+    XMLEnumData enumData;
+    XMLDiagnostics diag;
+  };
+
+  std::string source;
+  XMLLazyScan spans;
+  // Items [0, enumCount) are the enums, the rest the structs.
+  size_t enumCount = 0;
+  std::unique_ptr<std::atomic<uint8_t>[]> states;
+  // Written by whoever claimed the item, read once it is Parsed.
+  std::vector<Body> bodies;
+  // Items not committed yet, owner thread only.
+  size_t remaining = 0;
+
+  static constexpr size_t kNoHint = SIZE_MAX;
+  std::atomic<size_t> hint{kNoHint};
+  std::atomic<bool> stop{false};
+  std::mutex mutex;
+  std::condition_variable parsed;
+  std::thread worker;
+
+  ~LazyLoad() {
+    stop = true;
+    if (worker.joinable())
+      worker.join();
+  }
+
+  size_t ItemCount() const { return bodies.size(); }
+  const XMLLazySpan &Span(size_t item) const {
+    return item < enumCount ? spans.enums[item]
+                            : spans.structs[item - enumCount];
+  }
+  bool Claim(size_t item) {
+    uint8_t expected = Pending;
+    return states[item].compare_exchange_strong(expected, Parsing,
+                                                std::memory_order_acq_rel);
+  }
+  void Parse(size_t item);
+  void Run();
+};
+
+// Parse one claimed body from its span of the source text.
+void XMLParserContext::LazyLoad::Parse(size_t item) {
+  const XMLLazySpan &span = Span(item);
+  Body &body = bodies[item];
+  XMLDiagElement kind =
+      item < enumCount ? XMLDiagElement::Enum : XMLDiagElement::Struct;
+  // Fragment lines count from the start of the definition.
+  body.diag.SetLineBase(span.line - 1);
+  tinyxml2::XMLDocument fragment;
+  if (fragment.Parse(source.data() + span.offset, span.size) ==
+      tinyxml2::XMLError::XML_SUCCESS) {
+    tinyxml2::XMLElement *element = fragment.RootElement();
+    if (element) {
+      body.ok = item < enumCount
+                    ? DoParseXMLEnumData(element, body.enumData, body.diag)
+                    : DoParseXMLStructData(element, body.structData, body.diag);
+    }
+  } else {
+    body.diag.ReportText(XMLDiagSeverity::Error, kind, fragment.ErrorLineNum(),
+                         fragment.ErrorStr());
+  }
+  if (!body.ok) {
+    body.diag.Report(XMLDiagSeverity::Error, kind, XMLDiagCode::BodyNotLoaded,
+                     1);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    states[item].store(Parsed, std::memory_order_release);
+  }
+  parsed.notify_all();
+}
+
+// Worker thread: parse every pending body, in document order unless a hint
+// moves the cursor.
+void XMLParserContext::LazyLoad::Run() {
+  size_t count = ItemCount();
+  size_t next = 0;
+  while (!stop.load(std::memory_order_relaxed)) {
+    size_t hinted = hint.exchange(kNoHint, std::memory_order_relaxed);
+    if (hinted != kNoHint)
+      next = hinted;
+    size_t item = count;
+    for (size_t i = 0; i < count; ++i) {
+      size_t candidate = (next + i) % count;
+      if (states[candidate].load(std::memory_order_acquire) == Pending &&
+          Claim(candidate)) {
+        item = candidate;
+        break;
+      }
+    }
+    if (item == count)
+      return;
+    Parse(item);
+    next = item + 1;
+  }
+}
+
+XMLParserContext::XMLParserContext(const std::string &filename)
+    : filename(filename), validContext(false) {}
+
+XMLParserContext::~XMLParserContext() = default;
+
+bool XMLParserContext::init(XMLLoadMode mode) {
+  // Loading again is a no-op, not worth a diagnostic.
   if (validContext) {
-    std::cout << "Already Inited. Skit." << std::endl;
     return true;
   }
-  tinyxml2::XMLError error = doc.LoadFile(filename.c_str());
+  XMLAllocStats allocsBefore = GetAllocStats();
+  bool loaded = mode == XMLLoadMode::Full
+                    ? InitFull()
+                    : InitLazy(mode == XMLLoadMode::LazyBackground);
+  if (!loaded) {
+    return false;
+  }
+  loadAllocs = AllocStatsDelta(allocsBefore, GetAllocStats());
+
+  validContext = true;
+  return true;
+}
+
+bool XMLParserContext::InitFull() {
+  // tinyxml2 parses whole buffers; ReadSourceFile decompresses whatever the
+  // magic bytes say, so a compressed file needs no particular name.
+  std::string source, readError;
+  if (!ReadSourceFile(filename, source, readError)) {
+    diagnostics.ReportText(XMLDiagSeverity::Error, XMLDiagElement::Document, 0,
+                           readError);
+    return false;
+  }
+  tinyxml2::XMLError error = doc.Parse(source.data(), source.size());
+  sourceBytes = source.size();
   if (error != tinyxml2::XMLError::XML_SUCCESS) {
+    diagnostics.ReportText(XMLDiagSeverity::Error, XMLDiagElement::Document,
+                           doc.ErrorLineNum(), doc.ErrorStr());
     return false;
   }
 
-  if (!DoParseXMLDocData(doc, parsedDoc)) {
-    std::cerr << "Parse XML doc [" << filename << "] failed." << std::endl;
+  if (!DoParseXMLDocData(doc, parsedDoc, diagnostics)) {
     return false;
   }
+  valueTables.InternDoc(parsedDoc);
+  savedHash = RehashDoc(parsedDoc);
+  docIndex.Build(parsedDoc);
+  typeGraph.Build(parsedDoc);
+  return true;
+}
 
-  validContext = true;
+bool XMLParserContext::InitLazy(bool background) {
+  auto lazy = std::make_unique<LazyLoad>();
+  std::string error;
+  if (!ReadSourceFile(filename, lazy->source, error)) {
+    diagnostics.ReportText(XMLDiagSeverity::Error, XMLDiagElement::Document, 0,
+                           error);
+    return false;
+  }
+
+  if (!ScanGenxmlHeaders(lazy->source, parsedDoc, lazy->spans, error)) {
+    diagnostics.ReportText(XMLDiagSeverity::Error, XMLDiagElement::Document, 0,
+                           error);
+    return false;
+  }
+  sourceBytes = lazy->source.size();
+  // Header-only hashes; each body commit folds its delta into both hashes.
+  savedHash = RehashDoc(parsedDoc);
+  typeGraph.Build(parsedDoc);
+
+  lazy->enumCount = lazy->spans.enums.size();
+  size_t count = lazy->enumCount + lazy->spans.structs.size();
+  if (count == 0) {
+    docIndex.Build(parsedDoc);
+    return true;
+  }
+  lazy->states = std::make_unique<std::atomic<uint8_t>[]>(count);
+  for (size_t i = 0; i < count; ++i)
+    lazy->states[i].store(LazyLoad::Pending, std::memory_order_relaxed);
+  lazy->bodies.resize(count);
+  lazy->remaining = count;
+  lazyLoad = std::move(lazy);
+  if (background)
+    lazyLoad->worker = std::thread(&LazyLoad::Run, lazyLoad.get());
+  return true;
+}
+
+void XMLParserContext::CommitLazyItem(size_t item) {
+  LazyLoad &lazy = *lazyLoad;
+  LazyLoad::Body &body = lazy.bodies[item];
+  if (item < lazy.enumCount) {
+    size_t index = item;
+    XMLEnumData &target = parsedDoc.enumerates[index];
+    uint64_t oldHash = target.contentHash;
+    if (body.ok)
+      target.values = std::move(body.enumData.values);
+    uint64_t newHash = RehashEnum(target);
+    UpdateChildHash(parsedDoc.contentHash, XMLHashSlot::Enum, index, oldHash,
+                    newHash);
+    UpdateChildHash(savedHash, XMLHashSlot::Enum, index, oldHash, newHash);
+  } else {
+    size_t index = item - lazy.enumCount;
+    XMLStructData &target = parsedDoc.structures[index];
+    uint64_t oldHash = target.contentHash;
+    if (body.ok) {
+      target.fields = std::move(body.structData.fields);
+      target.groups = std::move(body.structData.groups);
+      valueTables.InternStruct(target);
+    }
+    uint64_t newHash = RehashStruct(target);
+    UpdateChildHash(parsedDoc.contentHash, XMLHashSlot::Struct, index, oldHash,
+                    newHash);
+    UpdateChildHash(savedHash, XMLHashSlot::Struct, index, oldHash, newHash);
+    typeGraph.UpdateStructFields(parsedDoc, index);
+  }
+  diagnostics.Append(body.diag);
+  if (!body.ok)
+    ++failedBodies;
+  lazy.states[item].store(body.ok ? LazyLoad::Committed : LazyLoad::Failed,
+                          std::memory_order_relaxed);
+  body = LazyLoad::Body();
+
+  if (--lazy.remaining == 0) {
+    // The index is built in one pass instead of per body.
+    docIndex.Build(parsedDoc);
+    lazyLoad.reset();
+  }
+}
+
+bool XMLParserContext::EnsureLazyItem(size_t item) {
+  LazyLoad &lazy = *lazyLoad;
+  uint8_t state = lazy.states[item].load(std::memory_order_acquire);
+  if (state == LazyLoad::Committed || state == LazyLoad::Failed)
+    return state == LazyLoad::Committed;
+
+  if (state == LazyLoad::Pending && lazy.Claim(item)) {
+    lazy.Parse(item);
+  } else {
+    // The worker is on it.
+    std::unique_lock<std::mutex> lock(lazy.mutex);
+    lazy.parsed.wait(lock, [&lazy, item]() {
+      return lazy.states[item].load(std::memory_order_acquire) !=
+             LazyLoad::Parsing;
+    });
+  }
+  bool ok = lazy.bodies[item].ok;
+  CommitLazyItem(item);
+  return ok;
+}
+
+bool XMLParserContext::EnsureStruct(uint32_t structIndex) {
+  // Structs added after loading are always materialized.
+  if (!lazyLoad || structIndex >= lazyLoad->spans.structs.size())
+    return true;
+  return EnsureLazyItem(lazyLoad->enumCount + structIndex);
+}
+
+bool XMLParserContext::EnsureEnum(uint32_t enumIndex) {
+  if (!lazyLoad || enumIndex >= lazyLoad->enumCount)
+    return true;
+  return EnsureLazyItem(enumIndex);
+}
+
+void XMLParserContext::EnsureAllLoaded() {
+  for (size_t item = 0; lazyLoad && item < lazyLoad->ItemCount(); ++item) {
+    EnsureLazyItem(item);
+  }
+}
+
+size_t XMLParserContext::PumpLazyLoads() {
+  for (size_t item = 0; lazyLoad && item < lazyLoad->ItemCount(); ++item) {
+    if (lazyLoad->states[item].load(std::memory_order_acquire) ==
+        LazyLoad::Parsed)
+      CommitLazyItem(item);
+  }
+  return lazyLoad ? lazyLoad->remaining : 0;
+}
+
+void XMLParserContext::PrefetchStructsFrom(uint32_t structIndex) {
+  if (lazyLoad && structIndex < lazyLoad->spans.structs.size())
+    lazyLoad->hint.store(lazyLoad->enumCount + structIndex,
+                         std::memory_order_relaxed);
+}
+
+void XMLParserContext::AddEnum(XMLEnumData enumData) {
+  if (journal)
+    journal->AppendEnum(enumData);
+  size_t index = parsedDoc.enumerates.size();
+  AddChildHash(parsedDoc.contentHash, XMLHashSlot::Enum, index,
+               RehashEnum(enumData));
+  parsedDoc.enumerates.emplace_back(std::move(enumData));
+  docIndex.AddEnum(parsedDoc, index);
+  typeGraph.AddEnum(parsedDoc, index);
+}
+
+void XMLParserContext::AddStruct(XMLStructData structData) {
+  if (journal)
+    journal->AppendStruct(structData);
+  size_t index = parsedDoc.structures.size();
+  valueTables.InternStruct(structData);
+  AddChildHash(parsedDoc.contentHash, XMLHashSlot::Struct, index,
+               RehashStruct(structData));
+  parsedDoc.structures.emplace_back(std::move(structData));
+  docIndex.AddStruct(parsedDoc, index);
+  typeGraph.AddStruct(parsedDoc, index);
+}
+
+// Change sets larger than this skip the incremental index updates.
+constexpr size_t kBulkEditChanges = 1024;
+
+// Apply every change or, if one does not fit, roll back the ones before it.
+bool XMLParserContext::ApplyChangeSet(const XMLChangeSet &changes) {
+  if (compactDoc)
+    return false;
+  for (const auto &change : changes.changes) {
+    bool loaded = change.target == XMLEditTarget::Struct ||
+                          change.target == XMLEditTarget::Field
+                      ? EnsureStruct(change.parent)
+                      : EnsureEnum(change.parent);
+    if (!loaded)
+      return false;
+  }
+  // Bulk edits rebuild the index and the type graph in one pass instead of
+  // patching them per change. The index is built from scratch anyway once
+  // the last lazy body is in.
+  bool isBulk = changes.changes.size() > kBulkEditChanges;
+  XMLDocIndex *index = lazyLoad || isBulk ? nullptr : &docIndex;
+  XMLTypeGraph *graph = isBulk ? nullptr : &typeGraph;
+  for (size_t i = 0; i < changes.changes.size(); ++i) {
+    if (ApplyChange(parsedDoc, index, graph, changes.changes[i]))
+      continue;
+    // The index and the graph are back in sync once all are undone.
+    while (i-- > 0)
+      ApplyChange(parsedDoc, index, graph, changes.changes[i].Inverse());
+    return false;
+  }
+  if (isBulk) {
+    typeGraph.Build(parsedDoc);
+    if (!lazyLoad)
+      docIndex.Build(parsedDoc);
+  }
+  // Edited choices are copies owned by their field, share them again.
+  // Interning keeps the content and so the hashes.
+  uint32_t lastStruct = UINT32_MAX;
+  for (const auto &change : changes.changes) {
+    if (change.target != XMLEditTarget::Field || change.parent == lastStruct)
+      continue;
+    lastStruct = change.parent;
+    valueTables.InternStruct(parsedDoc.structures[change.parent]);
+  }
+  if (journal)
+    journal->AppendChanges(changes);
+  return true;
+}
+
+bool XMLParserContext::ApplyChanges(XMLChangeSet changes) {
+  if (changes.changes.empty() || !ApplyChangeSet(changes))
+    return false;
+  history.Push(std::move(changes));
+  return true;
+}
+
+bool XMLParserContext::Undo() {
+  if (!history.CanUndo() || !ApplyChangeSet(history.NextUndo().Inverse()))
+    return false;
+  history.OnUndone();
+  return true;
+}
+
+bool XMLParserContext::Redo() {
+  if (!history.CanRedo() || !ApplyChangeSet(history.NextRedo()))
+    return false;
+  history.OnRedone();
   return true;
 }
+
+size_t XMLParserContext::EnableJournal() {
+  if (journal)
+    return 0;
+  auto newJournal = std::make_unique<XMLJournal>(filename);
+  std::vector<XMLJournalRecord> records;
+  newJournal->Recover(records);
+  // Replay before attaching, the records are in the journal already.
+  size_t replayed = 0;
+  for (const auto &record : records) {
+    bool ok = false;
+    switch (record.op) {
+    case XMLJournalOp::AddEnum: {
+      XMLEnumData enumData;
+      ok = DecodeJournalEnum(record.payload, enumData);
+      if (ok)
+        AddEnum(std::move(enumData));
+      break;
+    }
+    case XMLJournalOp::AddStruct: {
+      XMLStructData structData;
+      ok = DecodeJournalStruct(record.payload, structData);
+      if (ok)
+        AddStruct(std::move(structData));
+      break;
+    }
+    case XMLJournalOp::ChangeSet: {
+      XMLChangeSet changes;
+      // Replayed edits stay undoable.
+      ok = DecodeJournalChanges(record.payload, changes) &&
+           ApplyChanges(std::move(changes));
+      break;
+    }
+    }
+    if (ok) {
+      ++replayed;
+    } else {
+      XMLDiagElement element = XMLDiagElement::Document;
+      if (record.op == XMLJournalOp::AddEnum)
+        element = XMLDiagElement::Enum;
+      else if (record.op == XMLJournalOp::AddStruct)
+        element = XMLDiagElement::Struct;
+      diagnostics.Report(XMLDiagSeverity::Warning, element,
+                         XMLDiagCode::MalformedJournalRecord, 0);
+    }
+  }
+  journal = std::move(newJournal);
+  return replayed;
+}
+
+void XMLParserContext::ResetJournal() {
+  if (journal)
+    journal->Reset();
+}
+
+void XMLParserContext::Compact() {
+  if (compactDoc)
+    return;
+  EnsureAllLoaded();
+  compactDoc = std::make_unique<XMLCompactDoc>();
+  CompactDoc(parsedDoc, *compactDoc);
+  // Nothing reads the DOM after parsing.
+  doc.Clear();
+  sourceBytes = 0;
+  parsedDoc = XMLDocData();
+  valueTables.Clear();
+}
+
+void XMLParserContext::Expand() {
+  if (!compactDoc)
+    return;
+  ExpandDoc(*compactDoc, parsedDoc);
+  valueTables.InternDoc(parsedDoc);
+  compactDoc.reset();
+}
+
+void XMLParserContext::BuildMemoryReport(XMLMemReport &report) const {
+  AccountDom(doc, sourceBytes, report);
+  if (compactDoc)
+    AccountCompactDoc(*compactDoc, report);
+  else
+    AccountDocData(parsedDoc, report);
+  XMLMemBucket &indexes = report[XMLMemCategory::Indexes];
+  indexes.Add(docIndex.MemoryBytes(), 0, 1);
+  indexes.Add(typeGraph.MemoryBytes(), 0, 1);
+  indexes.Add(valueTables.MemoryBytes(), 0, 1);
+  report.loadAllocs = loadAllocs;
+}
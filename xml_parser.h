@@ -1,13 +1,33 @@
 #ifndef __XML_PARSER_H__
 #define __XML_PARSER_H__
 
+#include "xml_alloc_counter.h"
+#include "xml_compact.h"
+#include "xml_diagnostics.h"
+#include "xml_edit.h"
+#include "xml_memstats.h"
+#include "xml_query.h"
+#include "xml_typegraph.h"
 #include "xml_types.h"
+#include "xml_value_tables.h"
 #include "thirdparty/tinyxml2/tinyxml2.h"
 #include <fstream>
+#include <memory>
 #include <optional>
 #include <string>
 
 
+class XMLJournal;
+
+enum class XMLLoadMode {
+  // Parse the whole document up front.
+  Full,
+  // Scan only the struct/enum start tags (see xml_lazy.h) and parse bodies on
+  // first use.
+  Lazy,
+  // Lazy, plus a worker thread parsing the remaining bodies ahead of use.
+  LazyBackground,
+};
 
 class XMLParserContext {
 public:
@@ -17,15 +37,104 @@ public:
   XMLParserContext(const XMLParserContext&) = delete;
   XMLParserContext& operator=(const XMLParserContext&) = delete;
 
-  explicit XMLParserContext(const std::string& filename):
-    filename(filename), validContext(false) {}
-  bool init();
-  ~XMLParserContext() = default;
+  // 'filename' may be gzip or zstd compressed (.xml.gz, .xml.zst), see
+  // xml_compress.h.
+  explicit XMLParserContext(const std::string& filename);
+  bool init(XMLLoadMode mode = XMLLoadMode::Full);
+  ~XMLParserContext();
+
+  const XMLDocData &GetDoc() const { return parsedDoc; }
+  const XMLDocIndex &GetIndex() const { return docIndex; }
+  const XMLTypeGraph &GetTypeGraph() const { return typeGraph; }
+  // Problems found while loading, including lazily parsed bodies once they
+  // are committed.
+  const XMLDiagnostics &GetDiagnostics() const { return diagnostics; }
+
+  // Lazy loading. A struct or enum that was not materialized yet has only its
+  // header (name, prefix, info, and for the struct kinds length, num, bias
+  // and engine); these parse its body first. The
+  // query index is built once every body is in, so queries, saving and
+  // decoding all call EnsureAllLoaded() first. All of them are no-ops for a
+  // fully loaded document and must be called from the thread using GetDoc().
+  bool EnsureStruct(uint32_t structIndex);
+  bool EnsureEnum(uint32_t enumIndex);
+  void EnsureAllLoaded();
+  // Lazily parsed bodies that failed; each stays a bare header and has a
+  // BodyNotLoaded diagnostic. Saving such a document would drop their
+  // fields and values, so the viewer refuses to.
+  size_t FailedBodyCount() const { return failedBodies; }
+  // Move bodies finished by the worker thread into the document; called once
+  // per frame. Returns the number of bodies still missing.
+  size_t PumpLazyLoads();
+  // Let the worker thread continue from this struct, e.g. the first one
+  // scrolled into view.
+  void PrefetchStructsFrom(uint32_t structIndex);
+  bool IsFullyLoaded() const { return !lazyLoad; }
+
+  // Commit edited objects into the document, keeping the content hashes, the
+  // query indexes and the type graph up to date incrementally.
+  void AddEnum(XMLEnumData enumData);
+  void AddStruct(XMLStructData structData);
+
+  // Edit existing structs, fields and enum values in place (see xml_edit.h).
+  // The set is applied as a whole or not at all and becomes one undo step.
+  // Fails for a compact document or when a change does not match it.
+  bool ApplyChanges(XMLChangeSet changes);
+  bool CanUndo() const { return history.CanUndo(); }
+  bool CanRedo() const { return history.CanRedo(); }
+  bool Undo();
+  bool Redo();
+
+  // Journal every edit to "<file>.journal" for crash recovery (see
+  // xml_journal.h), first replaying the edits a previous session left there.
+  // Returns the number of replayed edits.
+  size_t EnableJournal();
+  // The document was saved over its own file, the journal is obsolete.
+  void ResetJournal();
+
+  // Compact mode keeps only the symbol id model (see xml_compact.h) and
+  // releases the DOM and the string model, for documents that stay open but
+  // are not being looked at. GetDoc() is empty until Expand() restores it;
+  // the indexes and the type graph are kept as they are. The live model is
+  // always the string one; this only shrinks documents nobody is using.
+  void Compact();
+  void Expand();
+  bool IsCompact() const { return compactDoc != nullptr; }
+  const XMLCompactDoc *GetCompactDoc() const { return compactDoc.get(); }
+
+  uint64_t ContentHash() const {
+    return compactDoc ? compactDoc->contentHash : parsedDoc.contentHash;
+  }
+  // Whether the document differs from what was last loaded or saved.
+  bool IsDirty() const { return ContentHash() != savedHash; }
+  void MarkSaved(uint64_t docHash) { savedHash = docHash; }
+
+  // Heap usage of the DOM, the document model and its indexes by category.
+  void BuildMemoryReport(XMLMemReport &report) const;
 
 private:
   bool validContext;
+  uint64_t savedHash = 0;
+  size_t sourceBytes = 0;
+  size_t failedBodies = 0;
+  XMLAllocStats loadAllocs;
   tinyxml2::XMLDocument doc;
   XMLDocData parsedDoc;
+  std::unique_ptr<XMLCompactDoc> compactDoc;
+  struct LazyLoad;
+  std::unique_ptr<LazyLoad> lazyLoad;
+  std::unique_ptr<XMLJournal> journal;
+  XMLDocIndex docIndex;
+  XMLTypeGraph typeGraph;
+  XMLValueTablePool valueTables;
+  XMLDiagnostics diagnostics;
+  XMLEditHistory history;
+
+  bool InitFull();
+  bool InitLazy(bool background);
+  bool EnsureLazyItem(size_t item);
+  void CommitLazyItem(size_t item);
+  bool ApplyChangeSet(const XMLChangeSet &changes);
 };
 
 #endif
\ No newline at end of file
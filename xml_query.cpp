@@ -0,0 +1,860 @@
+#include "xml_query.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+struct QueryToken {
+  enum Type { Word, Number, String, Op } type;
+  std::string text;
+  uint64_t number = 0;
+};
+
+static bool IsWordChar(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.';
+}
+
+static bool Tokenize(const std::string &text, std::vector<QueryToken> &tokens,
+                     std::string &error) {
+  static const char *const kOps[] = {"&&", "==", "!=", "<=", ">=",
+                                     "=",  "<",  ">",  "~",  "!"};
+  size_t pos = 0;
+  while (pos < text.size()) {
+    char c = text[pos];
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      ++pos;
+      continue;
+    }
+    if (c == '"' || c == '\'') {
+      size_t end = text.find(c, pos + 1);
+      if (end == std::string::npos) {
+        error = "Unterminated string";
+        return false;
+      }
+      tokens.push_back({QueryToken::String, text.substr(pos + 1, end - pos - 1)});
+      pos = end + 1;
+      continue;
+    }
+    if (IsWordChar(c)) {
+      size_t end = pos;
+      while (end < text.size() && IsWordChar(text[end]))
+        ++end;
+      QueryToken token{QueryToken::Word, text.substr(pos, end - pos)};
+      if (std::isdigit(static_cast<unsigned char>(c))) {
+        char *parsedEnd = nullptr;
+        uint64_t number = std::strtoull(token.text.c_str(), &parsedEnd, 0);
+        if (*parsedEnd == '\0') {
+          token.type = QueryToken::Number;
+          token.number = number;
+        }
+      }
+      tokens.push_back(std::move(token));
+      pos = end;
+      continue;
+    }
+    bool matched = false;
+    for (const char *op : kOps) {
+      size_t len = std::strlen(op);
+      if (text.compare(pos, len, op) == 0) {
+        tokens.push_back({QueryToken::Op, op});
+        pos += len;
+        matched = true;
+        break;
+      }
+    }
+    if (!matched) {
+      error = std::string("Unexpected character '") + c + "'";
+      return false;
+    }
+  }
+  return true;
+}
+
+struct QueryAttrInfo {
+  const char *name;
+  XMLQueryAttr attr;
+  bool numeric;
+  bool flag;
+};
+
+static const QueryAttrInfo kQueryAttrs[] = {
+    {"name", XMLQueryAttr::Name, false, false},
+    {"info", XMLQueryAttr::Info, false, false},
+    {"parent", XMLQueryAttr::Parent, false, false},
+    {"type", XMLQueryAttr::Type, false, false},
+    {"start", XMLQueryAttr::Start, true, false},
+    {"end", XMLQueryAttr::End, true, false},
+    {"width", XMLQueryAttr::Width, true, false},
+    {"dword", XMLQueryAttr::Dword, true, false},
+    {"length", XMLQueryAttr::Length, true, false},
+    {"fields", XMLQueryAttr::Fields, true, false},
+    {"value", XMLQueryAttr::Value, true, false},
+    {"values", XMLQueryAttr::Values, true, false},
+    {"kind", XMLQueryAttr::Kind, false, false},
+    {"address", XMLQueryAttr::Address, true, false},
+    {"straddle", XMLQueryAttr::Straddle, false, true},
+    {"choices", XMLQueryAttr::Choices, false, true},
+    {"default", XMLQueryAttr::Default, false, true},
+};
+
+static bool AttrAppliesTo(XMLQueryAttr attr, XMLQueryKind kind) {
+  switch (attr) {
+  case XMLQueryAttr::Name:
+  case XMLQueryAttr::Info:
+    return true;
+  case XMLQueryAttr::Parent:
+    return kind == XMLQueryKind::Field || kind == XMLQueryKind::Value;
+  case XMLQueryAttr::Type:
+  case XMLQueryAttr::Start:
+  case XMLQueryAttr::End:
+  case XMLQueryAttr::Width:
+  case XMLQueryAttr::Dword:
+  case XMLQueryAttr::Straddle:
+  case XMLQueryAttr::Choices:
+  case XMLQueryAttr::Default:
+    return kind == XMLQueryKind::Field;
+  case XMLQueryAttr::Length:
+  case XMLQueryAttr::Fields:
+  case XMLQueryAttr::Kind:
+  case XMLQueryAttr::Address:
+    return kind == XMLQueryKind::Struct;
+  case XMLQueryAttr::Value:
+    return kind == XMLQueryKind::Enum || kind == XMLQueryKind::Value;
+  case XMLQueryAttr::Values:
+    return kind == XMLQueryKind::Enum;
+  }
+  return false;
+}
+
+const char *QueryKindName(XMLQueryKind kind) {
+  switch (kind) {
+  case XMLQueryKind::Struct:
+    return "struct";
+  case XMLQueryKind::Field:
+    return "field";
+  case XMLQueryKind::Enum:
+    return "enum";
+  case XMLQueryKind::Value:
+    return "value";
+  }
+  return "";
+}
+
+bool XMLQuery::Compile(const std::string &text, std::string &error) {
+  static const std::pair<const char *, XMLQueryOp> kOps[] = {
+      {"=", XMLQueryOp::Eq},  {"==", XMLQueryOp::Eq}, {"!=", XMLQueryOp::Ne},
+      {"<", XMLQueryOp::Lt},  {"<=", XMLQueryOp::Le}, {">", XMLQueryOp::Gt},
+      {">=", XMLQueryOp::Ge}, {"~", XMLQueryOp::Contains}};
+
+  std::vector<QueryToken> tokens;
+  if (!Tokenize(text, tokens, error))
+    return false;
+
+  kind = XMLQueryKind::Field;
+  predicates.clear();
+  size_t pos = 0;
+  // "value" is both a kind and an attribute; it is the kind unless an
+  // operator follows.
+  bool kindFirst = !tokens.empty() && tokens[0].type == QueryToken::Word &&
+                   (tokens.size() == 1 || tokens[1].type != QueryToken::Op);
+  if (kindFirst) {
+    for (XMLQueryKind k : {XMLQueryKind::Struct, XMLQueryKind::Field,
+                           XMLQueryKind::Enum, XMLQueryKind::Value}) {
+      if (tokens[pos].text == QueryKindName(k)) {
+        kind = k;
+        ++pos;
+        break;
+      }
+    }
+  }
+
+  while (pos < tokens.size()) {
+    const QueryToken *token = &tokens[pos];
+    if ((token->type == QueryToken::Word && token->text == "and") ||
+        (token->type == QueryToken::Op && token->text == "&&")) {
+      ++pos;
+      continue;
+    }
+    XMLQueryPredicate pred;
+    if ((token->type == QueryToken::Word && token->text == "not") ||
+        (token->type == QueryToken::Op && token->text == "!")) {
+      pred.negate = true;
+      if (++pos >= tokens.size()) {
+        error = "Expected an attribute after 'not'";
+        return false;
+      }
+      token = &tokens[pos];
+    }
+    if (token->type != QueryToken::Word) {
+      error = "Expected an attribute, got '" + token->text + "'";
+      return false;
+    }
+    const QueryAttrInfo *info = nullptr;
+    for (const auto &candidate : kQueryAttrs) {
+      if (token->text == candidate.name) {
+        info = &candidate;
+        break;
+      }
+    }
+    if (!info) {
+      error = "Unknown attribute '" + token->text + "'";
+      return false;
+    }
+    if (!AttrAppliesTo(info->attr, kind)) {
+      error = "Attribute '" + token->text + "' does not apply to " +
+              QueryKindName(kind);
+      return false;
+    }
+    pred.attr = info->attr;
+    ++pos;
+
+    if (info->flag) {
+      pred.op = XMLQueryOp::Flag;
+      predicates.push_back(std::move(pred));
+      continue;
+    }
+
+    if (pos >= tokens.size() || tokens[pos].type != QueryToken::Op) {
+      error = std::string("Expected an operator after '") + info->name + "'";
+      return false;
+    }
+    bool knownOp = false;
+    for (const auto &op : kOps) {
+      if (tokens[pos].text == op.first) {
+        pred.op = op.second;
+        knownOp = true;
+      }
+    }
+    if (!knownOp) {
+      error = "Unexpected operator '" + tokens[pos].text + "'";
+      return false;
+    }
+    if (++pos >= tokens.size() || tokens[pos].type == QueryToken::Op) {
+      error = std::string("Expected a value after '") + info->name + "'";
+      return false;
+    }
+    const QueryToken &literal = tokens[pos++];
+    if (info->numeric) {
+      if (literal.type != QueryToken::Number) {
+        error = std::string("'") + info->name + "' expects a number";
+        return false;
+      }
+      if (pred.op == XMLQueryOp::Contains) {
+        error = std::string("'~' does not apply to '") + info->name + "'";
+        return false;
+      }
+      pred.isNumber = true;
+      pred.number = literal.number;
+    } else {
+      if (pred.op != XMLQueryOp::Eq && pred.op != XMLQueryOp::Ne &&
+          pred.op != XMLQueryOp::Contains) {
+        error = std::string("'") + info->name + "' supports = != ~ only";
+        return false;
+      }
+      pred.text = literal.text;
+    }
+    predicates.push_back(std::move(pred));
+  }
+  return true;
+}
+
+static bool CompareNumber(uint64_t lhs, XMLQueryOp op, uint64_t rhs) {
+  switch (op) {
+  case XMLQueryOp::Eq:
+    return lhs == rhs;
+  case XMLQueryOp::Ne:
+    return lhs != rhs;
+  case XMLQueryOp::Lt:
+    return lhs < rhs;
+  case XMLQueryOp::Le:
+    return lhs <= rhs;
+  case XMLQueryOp::Gt:
+    return lhs > rhs;
+  case XMLQueryOp::Ge:
+    return lhs >= rhs;
+  default:
+    return false;
+  }
+}
+
+static bool ContainsNoCase(const std::string &haystack,
+                           const std::string &needle) {
+  auto it = std::search(haystack.begin(), haystack.end(), needle.begin(),
+                        needle.end(), [](char a, char b) {
+                          return std::tolower(static_cast<unsigned char>(a)) ==
+                                 std::tolower(static_cast<unsigned char>(b));
+                        });
+  return it != haystack.end();
+}
+
+static bool CompareText(const std::string &lhs, const XMLQueryPredicate &pred) {
+  switch (pred.op) {
+  case XMLQueryOp::Eq:
+    return lhs == pred.text;
+  case XMLQueryOp::Ne:
+    return lhs != pred.text;
+  case XMLQueryOp::Contains:
+    return ContainsNoCase(lhs, pred.text);
+  default:
+    return false;
+  }
+}
+
+static const std::string kEmptyString;
+
+static const std::string &InfoOf(const XMLBaseData &data) {
+  return data.info ? data.info.value() : kEmptyString;
+}
+
+const std::string &QueryHitName(const XMLDocData &doc, const XMLQueryHit &hit) {
+  switch (hit.kind) {
+  case XMLQueryKind::Struct:
+    return doc.structures[hit.parent].name;
+  case XMLQueryKind::Field:
+    return doc.structures[hit.parent].fields[hit.child].name;
+  case XMLQueryKind::Enum:
+    return doc.enumerates[hit.parent].name;
+  case XMLQueryKind::Value:
+    return doc.enumerates[hit.parent].values[hit.child].name;
+  }
+  return kEmptyString;
+}
+
+const std::string &QueryHitParentName(const XMLDocData &doc,
+                                      const XMLQueryHit &hit) {
+  if (hit.child == XMLQueryHit::kNoChild)
+    return kEmptyString;
+  return hit.kind == XMLQueryKind::Field ? doc.structures[hit.parent].name
+                                         : doc.enumerates[hit.parent].name;
+}
+
+void QueryHitDetail(const XMLDocData &doc, const XMLQueryHit &hit, char *buf,
+                    size_t bufSize) {
+  switch (hit.kind) {
+  case XMLQueryKind::Struct: {
+    const XMLStructData &data = doc.structures[hit.parent];
+    std::snprintf(buf, bufSize, "length %u, %zu fields", data.length,
+                  data.fields.size());
+    break;
+  }
+  case XMLQueryKind::Field: {
+    const XMLStructData &parent = doc.structures[hit.parent];
+    const XMLFieldData &data = parent.fields[hit.child];
+    uint32_t base = GroupBaseBit(parent.groups, data.group);
+    std::snprintf(buf, bufSize, "bits %u..%u %s", base + data.start,
+                  base + data.end, data.type.c_str());
+    break;
+  }
+  case XMLQueryKind::Enum:
+    std::snprintf(buf, bufSize, "%zu values",
+                  doc.enumerates[hit.parent].values.size());
+    break;
+  case XMLQueryKind::Value:
+    std::snprintf(buf, bufSize, "= %llu",
+                  (unsigned long long)doc.enumerates[hit.parent]
+                      .values[hit.child]
+                      .value);
+    break;
+  }
+}
+
+static bool MatchStruct(const XMLStructData &data,
+                        const XMLQueryPredicate &pred) {
+  switch (pred.attr) {
+  case XMLQueryAttr::Name:
+    return CompareText(data.name, pred);
+  case XMLQueryAttr::Info:
+    return CompareText(InfoOf(data), pred);
+  case XMLQueryAttr::Length:
+    return CompareNumber(data.length, pred.op, pred.number);
+  case XMLQueryAttr::Fields:
+    return CompareNumber(data.fields.size(), pred.op, pred.number);
+  case XMLQueryAttr::Kind:
+    return CompareText(StructKindName(data.kind), pred);
+  case XMLQueryAttr::Address:
+    return data.address && CompareNumber(*data.address, pred.op, pred.number);
+  default:
+    return false;
+  }
+}
+
+// Whether a field starting at absolute bit 'start' crosses a dword boundary.
+static bool IsStraddling(uint32_t start, const XMLFieldData &field) {
+  return start / 32 != (start + FieldWidth(field) - 1) / 32;
+}
+
+// Positions are matched from the start of the struct, group fields included.
+static bool MatchField(const XMLStructData &parent, const XMLFieldData &data,
+                       const XMLQueryPredicate &pred) {
+  uint32_t base = GroupBaseBit(parent.groups, data.group);
+  switch (pred.attr) {
+  case XMLQueryAttr::Name:
+    return CompareText(data.name, pred);
+  case XMLQueryAttr::Info:
+    return CompareText(InfoOf(data), pred);
+  case XMLQueryAttr::Parent:
+    return CompareText(parent.name, pred);
+  case XMLQueryAttr::Type:
+    return CompareText(data.type, pred);
+  case XMLQueryAttr::Start:
+    return CompareNumber(base + data.start, pred.op, pred.number);
+  case XMLQueryAttr::End:
+    return CompareNumber(base + data.end, pred.op, pred.number);
+  case XMLQueryAttr::Width:
+    return CompareNumber(FieldWidth(data), pred.op, pred.number);
+  case XMLQueryAttr::Dword:
+    return CompareNumber((base + data.start) / 32, pred.op, pred.number);
+  case XMLQueryAttr::Straddle:
+    return IsStraddling(base + data.start, data);
+  case XMLQueryAttr::Choices:
+    return data.choices.has_value();
+  case XMLQueryAttr::Default:
+    return data.defaultValue.has_value();
+  default:
+    return false;
+  }
+}
+
+static bool MatchEnum(const XMLEnumData &data, const XMLQueryPredicate &pred) {
+  switch (pred.attr) {
+  case XMLQueryAttr::Name:
+    return CompareText(data.name, pred);
+  case XMLQueryAttr::Info:
+    return CompareText(InfoOf(data), pred);
+  case XMLQueryAttr::Value:
+    return std::any_of(data.values.begin(), data.values.end(),
+                       [&pred](const XMLValueData &value) {
+                         return CompareNumber(value.value, pred.op,
+                                              pred.number);
+                       });
+  case XMLQueryAttr::Values:
+    return CompareNumber(data.values.size(), pred.op, pred.number);
+  default:
+    return false;
+  }
+}
+
+static bool MatchValue(const XMLEnumData &parent, const XMLValueData &data,
+                       const XMLQueryPredicate &pred) {
+  switch (pred.attr) {
+  case XMLQueryAttr::Name:
+    return CompareText(data.name, pred);
+  case XMLQueryAttr::Info:
+    return CompareText(InfoOf(data), pred);
+  case XMLQueryAttr::Parent:
+    return CompareText(parent.name, pred);
+  case XMLQueryAttr::Value:
+    return CompareNumber(data.value, pred.op, pred.number);
+  default:
+    return false;
+  }
+}
+
+bool XMLQuery::Matches(const XMLDocData &doc, const XMLQueryHit &hit) const {
+  for (const auto &pred : predicates) {
+    bool matched = false;
+    switch (hit.kind) {
+    case XMLQueryKind::Struct:
+      matched = MatchStruct(doc.structures[hit.parent], pred);
+      break;
+    case XMLQueryKind::Field: {
+      const XMLStructData &parent = doc.structures[hit.parent];
+      matched = MatchField(parent, parent.fields[hit.child], pred);
+      break;
+    }
+    case XMLQueryKind::Enum:
+      matched = MatchEnum(doc.enumerates[hit.parent], pred);
+      break;
+    case XMLQueryKind::Value: {
+      const XMLEnumData &parent = doc.enumerates[hit.parent];
+      matched = MatchValue(parent, parent.values[hit.child], pred);
+      break;
+    }
+    }
+    if (matched == pred.negate)
+      return false;
+  }
+  return true;
+}
+
+static bool IsRangeOp(XMLQueryOp op) {
+  return op == XMLQueryOp::Eq || op == XMLQueryOp::Lt ||
+         op == XMLQueryOp::Le || op == XMLQueryOp::Gt || op == XMLQueryOp::Ge;
+}
+
+// Slice of a key-sorted index satisfying 'key op number'.
+template <typename Ref>
+static std::pair<typename std::vector<std::pair<uint64_t, Ref>>::const_iterator,
+                 typename std::vector<std::pair<uint64_t, Ref>>::const_iterator>
+KeyRange(const std::vector<std::pair<uint64_t, Ref>> &keys, XMLQueryOp op,
+         uint64_t number) {
+  auto keyLess = [](const std::pair<uint64_t, Ref> &entry, uint64_t key) {
+    return entry.first < key;
+  };
+  auto keyGreater = [](uint64_t key, const std::pair<uint64_t, Ref> &entry) {
+    return key < entry.first;
+  };
+  auto lower = std::lower_bound(keys.begin(), keys.end(), number, keyLess);
+  auto upper = std::upper_bound(keys.begin(), keys.end(), number, keyGreater);
+  switch (op) {
+  case XMLQueryOp::Eq:
+    return {lower, upper};
+  case XMLQueryOp::Lt:
+    return {keys.begin(), lower};
+  case XMLQueryOp::Le:
+    return {keys.begin(), upper};
+  case XMLQueryOp::Gt:
+    return {upper, keys.end()};
+  case XMLQueryOp::Ge:
+    return {lower, keys.end()};
+  default:
+    return {keys.end(), keys.end()};
+  }
+}
+
+bool XMLQuery::CollectFromIndex(const XMLDocIndex &index,
+                                std::vector<XMLQueryHit> &hits) const {
+  auto addField = [&hits](const XMLFieldRef &ref) {
+    hits.push_back({XMLQueryKind::Field, ref.structIndex, ref.fieldIndex});
+  };
+  for (const auto &pred : predicates) {
+    if (pred.negate)
+      continue;
+    switch (kind) {
+    case XMLQueryKind::Field:
+      if (pred.attr == XMLQueryAttr::Type && pred.op == XMLQueryOp::Eq) {
+        auto it = index.fieldsByType.find(pred.text);
+        if (it != index.fieldsByType.end())
+          std::for_each(it->second.begin(), it->second.end(), addField);
+        return true;
+      }
+      if (pred.attr == XMLQueryAttr::Straddle) {
+        std::for_each(index.straddlingFields.begin(),
+                      index.straddlingFields.end(), addField);
+        return true;
+      }
+      if ((pred.attr == XMLQueryAttr::Start ||
+           pred.attr == XMLQueryAttr::Width) &&
+          IsRangeOp(pred.op)) {
+        auto range = KeyRange(pred.attr == XMLQueryAttr::Start
+                                  ? index.fieldsByStart
+                                  : index.fieldsByWidth,
+                              pred.op, pred.number);
+        for (auto it = range.first; it != range.second; ++it)
+          addField(it->second);
+        return true;
+      }
+      break;
+    case XMLQueryKind::Struct:
+      if (pred.attr == XMLQueryAttr::Length && IsRangeOp(pred.op)) {
+        auto range = KeyRange(index.structsByLength, pred.op, pred.number);
+        for (auto it = range.first; it != range.second; ++it)
+          hits.push_back(
+              {XMLQueryKind::Struct, it->second, XMLQueryHit::kNoChild});
+        return true;
+      }
+      if (pred.attr == XMLQueryAttr::Address && IsRangeOp(pred.op)) {
+        auto range = KeyRange(index.registersByAddress, pred.op, pred.number);
+        for (auto it = range.first; it != range.second; ++it)
+          hits.push_back(
+              {XMLQueryKind::Struct, it->second, XMLQueryHit::kNoChild});
+        return true;
+      }
+      break;
+    case XMLQueryKind::Enum:
+    case XMLQueryKind::Value:
+      if (pred.attr == XMLQueryAttr::Value && IsRangeOp(pred.op)) {
+        auto range = KeyRange(index.valuesByValue, pred.op, pred.number);
+        for (auto it = range.first; it != range.second; ++it) {
+          if (kind == XMLQueryKind::Enum)
+            hits.push_back({XMLQueryKind::Enum, it->second.enumIndex,
+                            XMLQueryHit::kNoChild});
+          else
+            hits.push_back({XMLQueryKind::Value, it->second.enumIndex,
+                            it->second.valueIndex});
+        }
+        return true;
+      }
+      break;
+    }
+  }
+  return false;
+}
+
+void XMLQuery::CollectAll(const XMLDocData &doc,
+                          std::vector<XMLQueryHit> &hits) const {
+  switch (kind) {
+  case XMLQueryKind::Struct:
+    for (uint32_t s = 0; s < doc.structures.size(); ++s)
+      hits.push_back({kind, s, XMLQueryHit::kNoChild});
+    break;
+  case XMLQueryKind::Field:
+    for (uint32_t s = 0; s < doc.structures.size(); ++s)
+      for (uint32_t f = 0; f < doc.structures[s].fields.size(); ++f)
+        hits.push_back({kind, s, f});
+    break;
+  case XMLQueryKind::Enum:
+    for (uint32_t e = 0; e < doc.enumerates.size(); ++e)
+      hits.push_back({kind, e, XMLQueryHit::kNoChild});
+    break;
+  case XMLQueryKind::Value:
+    for (uint32_t e = 0; e < doc.enumerates.size(); ++e)
+      for (uint32_t v = 0; v < doc.enumerates[e].values.size(); ++v)
+        hits.push_back({kind, e, v});
+    break;
+  }
+}
+
+void XMLQuery::Evaluate(const XMLDocData &doc, const XMLDocIndex &index,
+                        std::vector<XMLQueryHit> &hits) const {
+  hits.clear();
+  if (!CollectFromIndex(index, hits))
+    CollectAll(doc, hits);
+
+  auto hitLess = [](const XMLQueryHit &a, const XMLQueryHit &b) {
+    return a.parent != b.parent ? a.parent < b.parent : a.child < b.child;
+  };
+  auto hitEqual = [](const XMLQueryHit &a, const XMLQueryHit &b) {
+    return a.parent == b.parent && a.child == b.child;
+  };
+  std::sort(hits.begin(), hits.end(), hitLess);
+  hits.erase(std::unique(hits.begin(), hits.end(), hitEqual), hits.end());
+  hits.erase(std::remove_if(hits.begin(), hits.end(),
+                            [this, &doc](const XMLQueryHit &hit) {
+                              return !Matches(doc, hit);
+                            }),
+             hits.end());
+}
+
+template <typename Ref>
+static void InsertSorted(std::vector<std::pair<uint64_t, Ref>> &keys,
+                         uint64_t key, const Ref &ref) {
+  auto pos = std::upper_bound(
+      keys.begin(), keys.end(), key,
+      [](uint64_t k, const std::pair<uint64_t, Ref> &entry) {
+        return k < entry.first;
+      });
+  keys.insert(pos, {key, ref});
+}
+
+template <typename Ref, typename Pred>
+static void EraseKeys(std::vector<std::pair<uint64_t, Ref>> &keys, Pred pred) {
+  keys.erase(std::remove_if(keys.begin(), keys.end(),
+                            [&pred](const std::pair<uint64_t, Ref> &entry) {
+                              return pred(entry.second);
+                            }),
+             keys.end());
+}
+
+void XMLDocIndex::Build(const XMLDocData &doc) {
+  fieldsByType.clear();
+  fieldsByStart.clear();
+  fieldsByWidth.clear();
+  straddlingFields.clear();
+  structsByLength.clear();
+  registersByAddress.clear();
+  valuesByValue.clear();
+
+  // Append everything in document order, then sort each index once.
+  for (uint32_t s = 0; s < doc.structures.size(); ++s) {
+    const XMLStructData &structData = doc.structures[s];
+    structsByLength.push_back({structData.length, s});
+    if (structData.address)
+      registersByAddress.push_back({*structData.address, s});
+    for (uint32_t f = 0; f < structData.fields.size(); ++f) {
+      const XMLFieldData &field = structData.fields[f];
+      XMLFieldRef ref{s, f};
+      uint32_t start = GroupBaseBit(structData.groups, field.group) +
+                       field.start;
+      fieldsByType[field.type].push_back(ref);
+      fieldsByStart.push_back({start, ref});
+      fieldsByWidth.push_back({FieldWidth(field), ref});
+      if (IsStraddling(start, field))
+        straddlingFields.push_back(ref);
+    }
+  }
+  for (uint32_t e = 0; e < doc.enumerates.size(); ++e) {
+    const auto &values = doc.enumerates[e].values;
+    for (uint32_t v = 0; v < values.size(); ++v)
+      valuesByValue.push_back({values[v].value, ValueRef{e, v}});
+  }
+
+  auto byKey = [](const auto &a, const auto &b) { return a.first < b.first; };
+  std::stable_sort(fieldsByStart.begin(), fieldsByStart.end(), byKey);
+  std::stable_sort(fieldsByWidth.begin(), fieldsByWidth.end(), byKey);
+  std::stable_sort(structsByLength.begin(), structsByLength.end(), byKey);
+  std::stable_sort(registersByAddress.begin(), registersByAddress.end(),
+                   byKey);
+  std::stable_sort(valuesByValue.begin(), valuesByValue.end(), byKey);
+}
+
+void XMLDocIndex::AddStruct(const XMLDocData &doc, uint32_t structIndex) {
+  const XMLStructData &structData = doc.structures[structIndex];
+  InsertSorted(structsByLength, structData.length, structIndex);
+  if (structData.address)
+    InsertSorted(registersByAddress, *structData.address, structIndex);
+  for (uint32_t f = 0; f < structData.fields.size(); ++f) {
+    const XMLFieldData &field = structData.fields[f];
+    XMLFieldRef ref{structIndex, f};
+    uint32_t start = GroupBaseBit(structData.groups, field.group) +
+                     field.start;
+    fieldsByType[field.type].push_back(ref);
+    InsertSorted(fieldsByStart, start, ref);
+    InsertSorted(fieldsByWidth, FieldWidth(field), ref);
+    if (IsStraddling(start, field))
+      straddlingFields.push_back(ref);
+  }
+}
+
+void XMLDocIndex::RemoveStruct(uint32_t structIndex) {
+  auto inStruct = [structIndex](const XMLFieldRef &ref) {
+    return ref.structIndex == structIndex;
+  };
+  for (auto it = fieldsByType.begin(); it != fieldsByType.end();) {
+    auto &refs = it->second;
+    refs.erase(std::remove_if(refs.begin(), refs.end(), inStruct), refs.end());
+    it = refs.empty() ? fieldsByType.erase(it) : std::next(it);
+  }
+  EraseKeys(fieldsByStart, inStruct);
+  EraseKeys(fieldsByWidth, inStruct);
+  straddlingFields.erase(std::remove_if(straddlingFields.begin(),
+                                        straddlingFields.end(), inStruct),
+                         straddlingFields.end());
+  auto isStruct = [structIndex](uint32_t index) {
+    return index == structIndex;
+  };
+  EraseKeys(structsByLength, isStruct);
+  EraseKeys(registersByAddress, isStruct);
+}
+
+void XMLDocIndex::AddEnum(const XMLDocData &doc, uint32_t enumIndex) {
+  const auto &values = doc.enumerates[enumIndex].values;
+  for (uint32_t v = 0; v < values.size(); ++v)
+    InsertSorted(valuesByValue, values[v].value, ValueRef{enumIndex, v});
+}
+
+void XMLDocIndex::RemoveEnum(uint32_t enumIndex) {
+  EraseKeys(valuesByValue, [enumIndex](const ValueRef &ref) {
+    return ref.enumIndex == enumIndex;
+  });
+}
+
+// Erase the entry of 'key' whose ref matches 'pred', found by binary search.
+template <typename Ref, typename Pred>
+static void EraseKey(std::vector<std::pair<uint64_t, Ref>> &keys, uint64_t key,
+                     Pred pred) {
+  auto first = std::lower_bound(
+      keys.begin(), keys.end(), key,
+      [](const std::pair<uint64_t, Ref> &entry, uint64_t k) {
+        return entry.first < k;
+      });
+  for (auto it = first; it != keys.end() && it->first == key; ++it) {
+    if (pred(it->second)) {
+      keys.erase(it);
+      return;
+    }
+  }
+}
+
+void XMLDocIndex::UpdateField(const XMLDocData &doc, XMLFieldRef ref,
+                              const XMLFieldData &before) {
+  const XMLStructData &structData = doc.structures[ref.structIndex];
+  const XMLFieldData &field = structData.fields[ref.fieldIndex];
+  auto isRef = [&ref](const XMLFieldRef &other) {
+    return other.structIndex == ref.structIndex &&
+           other.fieldIndex == ref.fieldIndex;
+  };
+  if (field.type != before.type) {
+    auto it = fieldsByType.find(before.type);
+    if (it != fieldsByType.end()) {
+      auto &refs = it->second;
+      refs.erase(std::remove_if(refs.begin(), refs.end(), isRef), refs.end());
+      if (refs.empty())
+        fieldsByType.erase(it);
+    }
+    fieldsByType[field.type].push_back(ref);
+  }
+  uint32_t oldStart = GroupBaseBit(structData.groups, before.group) +
+                      before.start;
+  uint32_t newStart = GroupBaseBit(structData.groups, field.group) +
+                      field.start;
+  if (newStart != oldStart) {
+    EraseKey(fieldsByStart, oldStart, isRef);
+    InsertSorted(fieldsByStart, newStart, ref);
+  }
+  uint64_t oldWidth = FieldWidth(before);
+  uint64_t newWidth = FieldWidth(field);
+  if (newWidth != oldWidth) {
+    EraseKey(fieldsByWidth, oldWidth, isRef);
+    InsertSorted(fieldsByWidth, newWidth, ref);
+  }
+  bool wasStraddling = IsStraddling(oldStart, before);
+  bool isStraddling = IsStraddling(newStart, field);
+  if (wasStraddling && !isStraddling) {
+    straddlingFields.erase(std::remove_if(straddlingFields.begin(),
+                                          straddlingFields.end(), isRef),
+                           straddlingFields.end());
+  } else if (!wasStraddling && isStraddling) {
+    straddlingFields.push_back(ref);
+  }
+}
+
+void XMLDocIndex::UpdateStructLength(uint32_t structIndex, uint32_t oldLength,
+                                     uint32_t newLength) {
+  if (oldLength == newLength)
+    return;
+  EraseKey(structsByLength, oldLength,
+           [structIndex](uint32_t index) { return index == structIndex; });
+  InsertSorted(structsByLength, newLength, structIndex);
+}
+
+void XMLDocIndex::UpdateValue(const XMLDocData &doc, uint32_t enumIndex,
+                              uint32_t valueIndex, uint64_t oldValue) {
+  uint64_t value = doc.enumerates[enumIndex].values[valueIndex].value;
+  if (value == oldValue)
+    return;
+  EraseKey(valuesByValue, oldValue,
+           [enumIndex, valueIndex](const ValueRef &ref) {
+             return ref.enumIndex == enumIndex && ref.valueIndex == valueIndex;
+           });
+  InsertSorted(valuesByValue, value, ValueRef{enumIndex, valueIndex});
+}
+
+bool XMLDocIndex::FindRegister(const XMLDocData &doc, uint64_t address,
+                               uint32_t &structIndex) const {
+  // Last register starting at or below 'address', then the first entry of
+  // that start address.
+  auto it = std::upper_bound(
+      registersByAddress.begin(), registersByAddress.end(), address,
+      [](uint64_t key, const std::pair<uint64_t, uint32_t> &entry) {
+        return key < entry.first;
+      });
+  if (it == registersByAddress.begin())
+    return false;
+  uint64_t start = (--it)->first;
+  while (it != registersByAddress.begin() && std::prev(it)->first == start)
+    --it;
+  const XMLStructData &reg = doc.structures[it->second];
+  uint64_t bytes = uint64_t(std::max(reg.length, 1u)) * 4;
+  if (address - start >= bytes)
+    return false;
+  structIndex = it->second;
+  return true;
+}
+
+size_t XMLDocIndex::MemoryBytes() const {
+  size_t bytes = sizeof(*this);
+  for (const auto &entry : fieldsByType) {
+    bytes += sizeof(entry) + entry.first.capacity() +
+             entry.second.capacity() * sizeof(XMLFieldRef);
+  }
+  bytes += fieldsByType.bucket_count() * sizeof(void *);
+  bytes += fieldsByStart.capacity() * sizeof(fieldsByStart[0]);
+  bytes += fieldsByWidth.capacity() * sizeof(fieldsByWidth[0]);
+  bytes += straddlingFields.capacity() * sizeof(XMLFieldRef);
+  bytes += structsByLength.capacity() * sizeof(structsByLength[0]);
+  bytes += registersByAddress.capacity() * sizeof(registersByAddress[0]);
+  bytes += valuesByValue.capacity() * sizeof(valuesByValue[0]);
+  return bytes;
+}
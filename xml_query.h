@@ -0,0 +1,148 @@
+#ifndef __XML_QUERY_H__
+#define __XML_QUERY_H__
+
+#include "xml_types.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A small filter language over XMLDocData.
+//
+//   query     := [kind] term { ["and" | "&&"] term }
+//   kind      := "struct" | "field" | "enum" | "value"      (default: field)
+//   term      := ["not" | "!"] (flag | attribute op literal)
+//   flag      := "straddle" | "choices" | "default"
+//   attribute := "name" | "info" | "parent" | "type" | "start" | "end"
+//              | "width" | "dword" | "length" | "fields" | "value" | "values"
+//              | "kind" | "address"
+//   op        := "=" | "==" | "!=" | "<" | "<=" | ">" | ">=" | "~"
+//
+// "~" is a case-insensitive substring match. "parent" is the owning struct
+// or enum name. A struct's "kind" is struct, instruction or register; only
+// registers have an "address". A field's "start", "end" and "dword" count
+// from the start of its struct, for a field in a group that is its first
+// repetition. Examples:
+//
+//   field type=uint
+//   field straddle                  fields crossing a dword boundary
+//   struct length>16
+//   enum value>255                  enums having a value above 255
+//   field width>=32 and name~address
+//   struct address>=0x2000 and address<0x3000
+
+enum class XMLQueryKind : uint8_t { Struct, Field, Enum, Value };
+
+enum class XMLQueryAttr : uint8_t {
+  Name,
+  Info,
+  Parent,
+  Type,
+  Start,
+  End,
+  Width,
+  Dword,
+  Length,
+  Fields,
+  Value,
+  Values,
+  Kind,
+  Address,
+  Straddle,
+  Choices,
+  Default,
+};
+
+enum class XMLQueryOp : uint8_t { Eq, Ne, Lt, Le, Gt, Ge, Contains, Flag };
+
+struct XMLQueryPredicate {
+  XMLQueryAttr attr;
+  XMLQueryOp op;
+  bool negate = false;
+  bool isNumber = false;
+  uint64_t number = 0;
+  std::string text;
+};
+
+// One query result. 'child' is the field or value index, kNoChild for a
+// struct or enum hit.
+struct XMLQueryHit {
+  static constexpr uint32_t kNoChild = UINT32_MAX;
+  XMLQueryKind kind;
+  uint32_t parent;
+  uint32_t child;
+};
+
+// Secondary indexes used to answer queries without scanning the document.
+// They are built once at load and patched per struct/enum on edits.
+class XMLDocIndex {
+public:
+  friend class XMLQuery;
+
+  void Build(const XMLDocData &doc);
+  void AddStruct(const XMLDocData &doc, uint32_t structIndex);
+  void RemoveStruct(uint32_t structIndex);
+  void AddEnum(const XMLDocData &doc, uint32_t enumIndex);
+  void RemoveEnum(uint32_t enumIndex);
+  // Patch the entries of a single node after an in-place edit, given its
+  // previous state.
+  void UpdateField(const XMLDocData &doc, XMLFieldRef ref,
+                   const XMLFieldData &before);
+  void UpdateStructLength(uint32_t structIndex, uint32_t oldLength,
+                          uint32_t newLength);
+  void UpdateValue(const XMLDocData &doc, uint32_t enumIndex,
+                   uint32_t valueIndex, uint64_t oldValue);
+  // The register whose dwords cover MMIO 'address', by binary search over
+  // the register addresses. Of several registers at one address the first
+  // in document order wins.
+  bool FindRegister(const XMLDocData &doc, uint64_t address,
+                    uint32_t &structIndex) const;
+  size_t MemoryBytes() const;
+
+private:
+  template <typename Ref>
+  using SortedKeys = std::vector<std::pair<uint64_t, Ref>>;
+  struct ValueRef {
+    uint32_t enumIndex;
+    uint32_t valueIndex;
+  };
+
+  std::unordered_map<std::string, std::vector<XMLFieldRef>> fieldsByType;
+  SortedKeys<XMLFieldRef> fieldsByStart;
+  SortedKeys<XMLFieldRef> fieldsByWidth;
+  std::vector<XMLFieldRef> straddlingFields;
+  SortedKeys<uint32_t> structsByLength;
+  SortedKeys<uint32_t> registersByAddress;
+  SortedKeys<ValueRef> valuesByValue;
+};
+
+class XMLQuery {
+public:
+  // Returns false and fills 'error' when 'text' is not a valid query.
+  bool Compile(const std::string &text, std::string &error);
+  void Evaluate(const XMLDocData &doc, const XMLDocIndex &index,
+                std::vector<XMLQueryHit> &hits) const;
+
+  XMLQueryKind GetKind() const { return kind; }
+
+private:
+  XMLQueryKind kind = XMLQueryKind::Field;
+  std::vector<XMLQueryPredicate> predicates;
+
+  bool Matches(const XMLDocData &doc, const XMLQueryHit &hit) const;
+  bool CollectFromIndex(const XMLDocIndex &index,
+                        std::vector<XMLQueryHit> &hits) const;
+  void CollectAll(const XMLDocData &doc, std::vector<XMLQueryHit> &hits) const;
+};
+
+// Display name of the node a hit refers to, and of its struct/enum parent.
+const std::string &QueryHitName(const XMLDocData &doc, const XMLQueryHit &hit);
+const std::string &QueryHitParentName(const XMLDocData &doc,
+                                      const XMLQueryHit &hit);
+// One line summary of the hit ("bits 0..31 uint", "length 4", ...).
+void QueryHitDetail(const XMLDocData &doc, const XMLQueryHit &hit, char *buf,
+                    size_t bufSize);
+const char *QueryKindName(XMLQueryKind kind);
+
+#endif
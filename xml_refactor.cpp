@@ -0,0 +1,291 @@
+#include "xml_refactor.h"
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Structs or enums planned by one worker at a time.
+constexpr size_t kRefactorBlockSize = 256;
+
+const char *RefactorKindName(XMLRefactorKind kind) {
+  switch (kind) {
+  case XMLRefactorKind::ShiftFields:
+    return "Shift fields";
+  case XMLRefactorKind::Retype:
+    return "Retype fields";
+  case XMLRefactorKind::RenamePrefix:
+    return "Rename prefix";
+  case XMLRefactorKind::RenumberValues:
+    return "Renumber values";
+  }
+  return "";
+}
+
+bool MatchNamePattern(std::string_view pattern, std::string_view name) {
+  if (pattern.empty())
+    return true;
+  // Iterative glob match, backtracking to the last '*' only.
+  size_t p = 0, n = 0;
+  size_t starP = std::string_view::npos, starN = 0;
+  while (n < name.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+      ++p;
+      ++n;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      starP = p++;
+      starN = n;
+    } else if (starP != std::string_view::npos) {
+      p = starP + 1;
+      n = ++starN;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*')
+    ++p;
+  return p == pattern.size();
+}
+
+struct RefactorBlock {
+  std::vector<XMLChange> changes;
+  std::string error;
+};
+
+static bool RangesOverlap(uint32_t start, uint32_t end, uint32_t otherStart,
+                          uint32_t otherEnd) {
+  return start <= otherEnd && otherStart <= end;
+}
+
+// Fields below 'fromBit' stay put, so a shifted field must neither land on
+// one of them or on any repetition of a group (unless the two overlapped
+// already) nor leave the struct. Fields inside groups keep their group
+// relative positions; groups cannot be moved by a change, so a group at or
+// after 'fromBit' refuses the shift.
+static bool PlanShiftFields(const XMLDocData &doc, uint32_t s,
+                            const XMLRefactor &refactor,
+                            RefactorBlock &block) {
+  const XMLStructData &structData = doc.structures[s];
+  const auto &fields = structData.fields;
+  if (refactor.shift != 0) {
+    for (const XMLGroupData &group : structData.groups) {
+      if (group.parent != XMLGroupData::kNoGroup ||
+          group.start < refactor.fromBit)
+        continue;
+      block.error = structData.name + " has a group at bit " +
+                    std::to_string(group.start) +
+                    ", groups cannot be shifted";
+      return false;
+    }
+  }
+  int64_t lengthBits = int64_t(structData.length) * 32;
+  for (uint32_t f = 0; f < fields.size(); ++f) {
+    const XMLFieldData &field = fields[f];
+    if (field.group != XMLGroupData::kNoGroup ||
+        field.start < refactor.fromBit)
+      continue;
+    int64_t start = int64_t(field.start) + refactor.shift;
+    int64_t end = int64_t(field.end) + refactor.shift;
+    if (start < 0 || end > int64_t(UINT32_MAX)) {
+      block.error = structData.name + "::" + field.name +
+                    " would move out of range";
+      return false;
+    }
+    if (end >= lengthBits) {
+      block.error = structData.name + "::" + field.name +
+                    " would end past the struct's " +
+                    std::to_string(structData.length) + " dword(s)";
+      return false;
+    }
+    XMLFieldData shifted = field;
+    shifted.start = static_cast<uint32_t>(start);
+    shifted.end = static_cast<uint32_t>(end);
+    for (const XMLFieldData &other : fields) {
+      if (other.group != XMLGroupData::kNoGroup ||
+          other.start >= refactor.fromBit ||
+          !RangesOverlap(shifted.start, shifted.end, other.start, other.end) ||
+          RangesOverlap(field.start, field.end, other.start, other.end))
+        continue;
+      block.error = structData.name + "::" + field.name +
+                    " would overlap " + other.name;
+      return false;
+    }
+    for (const XMLGroupData &group : structData.groups) {
+      if (group.parent != XMLGroupData::kNoGroup)
+        continue;
+      uint32_t groupEnd = group.start + GroupWidth(structData, group) - 1;
+      if (!RangesOverlap(shifted.start, shifted.end, group.start, groupEnd) ||
+          RangesOverlap(field.start, field.end, group.start, groupEnd))
+        continue;
+      block.error = structData.name + "::" + field.name +
+                    " would overlap the group at bit " +
+                    std::to_string(group.start);
+      return false;
+    }
+    block.changes.push_back(SetFieldChange(doc, s, f, std::move(shifted)));
+  }
+  return true;
+}
+
+static void PlanRetype(const XMLDocData &doc, uint32_t s,
+                       const XMLRefactor &refactor, RefactorBlock &block) {
+  const auto &fields = doc.structures[s].fields;
+  for (uint32_t f = 0; f < fields.size(); ++f) {
+    if (fields[f].type != refactor.from)
+      continue;
+    XMLFieldData retyped = fields[f];
+    retyped.type = refactor.to;
+    block.changes.push_back(SetFieldChange(doc, s, f, std::move(retyped)));
+  }
+}
+
+// An empty 'from' matches enums without a prefix, an empty 'to' removes it.
+static bool PrefixMatches(const std::optional<std::string> &prefix,
+                          const std::string &from) {
+  return from.empty() ? !prefix || prefix->empty() : prefix == from;
+}
+
+static std::optional<std::string> NewPrefix(const std::string &to) {
+  return to.empty() ? std::nullopt : std::optional<std::string>(to);
+}
+
+static void PlanRenamePrefix(const XMLDocData &doc, uint32_t e,
+                             const XMLRefactor &refactor,
+                             RefactorBlock &block) {
+  const XMLEnumData &enumData = doc.enumerates[e];
+  if (PrefixMatches(enumData.prefix, refactor.from)) {
+    XMLHeaderData header = EnumHeader(enumData);
+    header.prefix = NewPrefix(refactor.to);
+    block.changes.push_back(SetEnumHeaderChange(doc, e, std::move(header)));
+  }
+  for (uint32_t v = 0; v < enumData.values.size(); ++v) {
+    if (!PrefixMatches(enumData.values[v].prefix, refactor.from))
+      continue;
+    XMLValueData renamed = enumData.values[v];
+    renamed.prefix = NewPrefix(refactor.to);
+    block.changes.push_back(SetValueChange(doc, e, v, std::move(renamed)));
+  }
+}
+
+static void PlanRenumberValues(const XMLDocData &doc, uint32_t e,
+                               const XMLRefactor &refactor,
+                               RefactorBlock &block) {
+  const auto &values = doc.enumerates[e].values;
+  uint64_t next = refactor.first;
+  for (uint32_t v = 0; v < values.size(); ++v, next += refactor.step) {
+    if (values[v].value == next)
+      continue;
+    XMLValueData renumbered = values[v];
+    renumbered.value = next;
+    block.changes.push_back(SetValueChange(doc, e, v, std::move(renumbered)));
+  }
+}
+
+static bool IsStructRefactor(XMLRefactorKind kind) {
+  return kind == XMLRefactorKind::ShiftFields ||
+         kind == XMLRefactorKind::Retype;
+}
+
+static bool PlanItem(const XMLDocData &doc, uint32_t item,
+                     const XMLRefactor &refactor, RefactorBlock &block) {
+  const XMLBaseData &target =
+      IsStructRefactor(refactor.kind)
+          ? static_cast<const XMLBaseData &>(doc.structures[item])
+          : static_cast<const XMLBaseData &>(doc.enumerates[item]);
+  if (!MatchNamePattern(refactor.scope, target.name))
+    return true;
+  switch (refactor.kind) {
+  case XMLRefactorKind::ShiftFields:
+    return PlanShiftFields(doc, item, refactor, block);
+  case XMLRefactorKind::Retype:
+    PlanRetype(doc, item, refactor, block);
+    break;
+  case XMLRefactorKind::RenamePrefix:
+    PlanRenamePrefix(doc, item, refactor, block);
+    break;
+  case XMLRefactorKind::RenumberValues:
+    PlanRenumberValues(doc, item, refactor, block);
+    break;
+  }
+  return true;
+}
+
+bool PlanRefactor(const XMLDocData &doc, const XMLRefactor &refactor,
+                  XMLChangeSet &changes, std::string &error,
+                  unsigned threadCount) {
+  changes.label = RefactorKindName(refactor.kind);
+  changes.changes.clear();
+  if (refactor.kind == XMLRefactorKind::Retype && refactor.from.empty()) {
+    error = "no type to replace";
+    return false;
+  }
+  // Nothing would change.
+  if ((refactor.kind == XMLRefactorKind::ShiftFields && refactor.shift == 0) ||
+      (refactor.kind != XMLRefactorKind::RenumberValues &&
+       refactor.kind != XMLRefactorKind::ShiftFields &&
+       refactor.from == refactor.to))
+    return true;
+  size_t itemCount = IsStructRefactor(refactor.kind) ? doc.structures.size()
+                                                     : doc.enumerates.size();
+  std::vector<RefactorBlock> blocks(
+      (itemCount + kRefactorBlockSize - 1) / kRefactorBlockSize);
+  if (threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  threadCount = std::min<unsigned>(threadCount, blocks.size());
+
+  std::atomic<size_t> next{0};
+  std::atomic<bool> failed{false};
+  auto work = [&]() {
+    for (size_t b; !failed && (b = next.fetch_add(1)) < blocks.size();) {
+      size_t end = std::min(itemCount, (b + 1) * kRefactorBlockSize);
+      for (size_t item = b * kRefactorBlockSize; item < end; ++item) {
+        if (!PlanItem(doc, static_cast<uint32_t>(item), refactor,
+                      blocks[b])) {
+          failed = true;
+          break;
+        }
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < threadCount; ++t)
+    threads.emplace_back(work);
+  work();
+  for (auto &thread : threads)
+    thread.join();
+
+  // Blocks are concatenated in document order, the plan is deterministic.
+  size_t total = 0;
+  for (const auto &block : blocks) {
+    if (!block.error.empty()) {
+      error = block.error;
+      return false;
+    }
+    total += block.changes.size();
+  }
+  changes.changes.reserve(total);
+  for (auto &block : blocks) {
+    std::move(block.changes.begin(), block.changes.end(),
+              std::back_inserter(changes.changes));
+  }
+  return true;
+}
+
+void EditNodeDetail(const XMLEditNode &node, char *buf, size_t size) {
+  if (const auto *header = std::get_if<XMLHeaderData>(&node)) {
+    std::snprintf(buf, size, "%s%s%s length %u",
+                  header->prefix ? header->prefix->c_str() : "",
+                  header->prefix ? " " : "", header->name.c_str(),
+                  header->length);
+  } else if (const auto *field = std::get_if<XMLFieldData>(&node)) {
+    std::snprintf(buf, size, "%s [%u, %u]", field->type.c_str(), field->start,
+                  field->end);
+  } else {
+    const auto &value = std::get<XMLValueData>(node);
+    std::snprintf(buf, size, "%s%s%s = %" PRIu64,
+                  value.prefix ? value.prefix->c_str() : "",
+                  value.prefix ? " " : "", value.name.c_str(), value.value);
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef __XML_REFACTOR_H__
+#define __XML_REFACTOR_H__
+
+#include "xml_edit.h"
+#include "xml_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Bulk transformations over a whole document.
+//
+// A refactor is planned into an XMLChangeSet of Set changes (see
+// xml_edit.h), one per node it modifies, by workers splitting the structs or
+// enums between them. The set doubles as the preview and is committed with
+// XMLParserContext::ApplyChanges(), so it lands as one atomic undo step.
+
+enum class XMLRefactorKind : uint8_t {
+  // Move the top level fields starting at or after 'fromBit' by 'shift'
+  // bits. Fields inside groups are not moved, and structs with a group at
+  // or after 'fromBit' refuse the shift.
+  ShiftFields,
+  // Change the type of every field of type 'from' to 'to'.
+  Retype,
+  // Replace the prefix 'from' by 'to' on enums and their values. An empty
+  // 'from' stands for no prefix, an empty 'to' removes it.
+  RenamePrefix,
+  // Number the values of each enum 'first', 'first + step', ...
+  RenumberValues,
+};
+
+struct XMLRefactor {
+  XMLRefactorKind kind = XMLRefactorKind::ShiftFields;
+  // Structs (ShiftFields, Retype) or enums (RenamePrefix, RenumberValues)
+  // whose name matches, with '*' and '?' wildcards. Empty matches all.
+  std::string scope;
+  uint32_t fromBit = 0;
+  int32_t shift = 0;
+  std::string from;
+  std::string to;
+  uint64_t first = 0;
+  uint64_t step = 1;
+};
+
+const char *RefactorKindName(XMLRefactorKind kind);
+bool MatchNamePattern(std::string_view pattern, std::string_view name);
+
+// Plan 'refactor' against 'doc' into 'changes'; nodes it leaves as they are
+// get no change. Returns false with 'error' set when the result would be
+// invalid, e.g. a field shifted below bit 0, past the struct's length or onto
+// a field that is not shifted. 0 threads means one per core.
+bool PlanRefactor(const XMLDocData &doc, const XMLRefactor &refactor,
+                  XMLChangeSet &changes, std::string &error,
+                  unsigned threadCount = 0);
+
+// One line summary of a node for previews, e.g. "uint [8, 15]".
+void EditNodeDetail(const XMLEditNode &node, char *buf, size_t size);
+
+#endif
@@ -1,8 +1,13 @@
 #include "xml_saver.h"
 #include "tinyxml2.h"
+#include "xml_compress.h"
 #include "xml_types.h"
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <iostream>
+#include <utility>
+#include <vector>
 
 static void ToXml(tinyxml2::XMLElement *element, const XMLBaseData &data) {
   assert(element);
@@ -45,12 +50,55 @@ static void ToXml(tinyxml2::XMLElement *element, const XMLEnumData &enumData) {
   }
 }
 
+static void ToXml(tinyxml2::XMLElement *element, const XMLGroupData &group) {
+  element->SetAttribute("count", group.count);
+  element->SetAttribute("start", group.start);
+  element->SetAttribute("size", group.size);
+}
+
 static void ToXml(tinyxml2::XMLElement *element,
                   const XMLStructData &structData) {
   ToXml(element, dynamic_cast<const XMLBaseData &>(structData));
   element->SetAttribute("length", structData.length);
+  if (structData.address.has_value()) {
+    char num[24];
+    std::snprintf(num, sizeof(num), "0x%llx",
+                  static_cast<unsigned long long>(structData.address.value()));
+    element->SetAttribute("num", num);
+  }
+  if (structData.bias.has_value()) {
+    element->SetAttribute("bias", structData.bias.value());
+  }
+  if (structData.engine.has_value()) {
+    element->SetAttribute("engine", structData.engine->c_str());
+  }
+
+  // Groups are rebuilt from runs of fields: 'open' is the chain of <group>
+  // elements the previous field was written into, outermost first.
+  const auto &groups = structData.groups;
+  std::vector<std::pair<uint32_t, tinyxml2::XMLElement *>> open;
+  std::vector<uint32_t> chain;
   for (const XMLFieldData &fieldData : structData.fields) {
-    tinyxml2::XMLElement *pChild = element->InsertNewChildElement("field");
+    chain.clear();
+    for (uint32_t g = fieldData.group; g < groups.size();
+         g = groups[g].parent) {
+      chain.push_back(g);
+    }
+    std::reverse(chain.begin(), chain.end());
+    size_t common = 0;
+    while (common < open.size() && common < chain.size() &&
+           open[common].first == chain[common]) {
+      ++common;
+    }
+    open.resize(common);
+    for (size_t i = common; i < chain.size(); ++i) {
+      tinyxml2::XMLElement *parent = open.empty() ? element : open.back().second;
+      tinyxml2::XMLElement *pGroup = parent->InsertNewChildElement("group");
+      ToXml(pGroup, groups[chain[i]]);
+      open.emplace_back(chain[i], pGroup);
+    }
+    tinyxml2::XMLElement *parent = open.empty() ? element : open.back().second;
+    tinyxml2::XMLElement *pChild = parent->InsertNewChildElement("field");
     ToXml(pChild, fieldData);
   }
 }
@@ -63,7 +111,8 @@ static void ToXml(tinyxml2::XMLElement *element, const XMLDocData &docData) {
   }
 
   for (const XMLStructData &structData : docData.structures) {
-    auto *pChild = element->InsertNewChildElement("struct");
+    auto *pChild =
+        element->InsertNewChildElement(StructKindName(structData.kind));
     ToXml(pChild, structData);
   }
 }
@@ -72,11 +121,26 @@ bool SaveToFile(const XMLDocData &data, const char* file) {
   tinyxml2::XMLDocument doc;
   doc.InsertFirstChild(doc.NewElement("genxml"));
   ToXml(doc.RootElement(), data);
+  XMLCompression compression = CompressionOfPath(file);
+  if (compression != XMLCompression::None) {
+    // Print to memory, then compress into the file.
+    tinyxml2::XMLPrinter printer;
+    doc.Print(&printer);
+    std::string error;
+    if (!WriteCompressedFile(file, compression, printer.CStr(),
+                             printer.CStrSize() - 1, error)) {
+      std::cerr << "Error: Save xml to '" << file << "' failed: " << error
+                << std::endl;
+      return false;
+    }
+    std::cout << "Save to '" << file << "' success." << std::endl;
+    return true;
+  }
   tinyxml2::XMLError result = doc.SaveFile(file);
   if (result != tinyxml2::XMLError::XML_SUCCESS) {
     std::cerr << "Error: Save xml to '" << file << "' failed." << std::endl;
   } else {
     std::cout << "Save to '" << file << "' success." << std::endl;
   }
-  return result;
+  return result == tinyxml2::XMLError::XML_SUCCESS;
 }
\ No newline at end of file
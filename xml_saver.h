@@ -1,4 +1,6 @@
 #pragma once
 #include "xml_types.h"
 
+// A file name ending in ".gz" or ".zst" is written compressed, see
+// xml_compress.h.
 bool SaveToFile(const XMLDocData& data, const char* file);
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "xml_search.h"
+#include <algorithm>
+#include <cstring>
+#include <regex>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define XML_SEARCH_SSE2 1
+#endif
+
+// Entries scanned between two cancellation checks, each batch of hits is
+// published to the UI once its chunk is done.
+static constexpr size_t kSearchChunkEntries = 4096;
+
+static char FoldAscii(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static std::string FoldString(std::string_view text) {
+  std::string folded(text);
+  for (char &c : folded)
+    c = FoldAscii(c);
+  return folded;
+}
+
+void XMLSearchCorpus::Add(std::string_view text, XMLQueryHit target,
+                          XMLSearchField field, bool isChoice) {
+  if (text.empty())
+    return;
+  Entry entry;
+  entry.offset = static_cast<uint32_t>(blob.size());
+  entry.size = static_cast<uint32_t>(text.size());
+  entry.target = target;
+  entry.field = field;
+  entry.isChoice = isChoice;
+  entries.push_back(entry);
+  // The NUL separator keeps a match from spanning two entries.
+  blob.append(text);
+  blob.push_back('\0');
+}
+
+void XMLSearchCorpus::AddBase(const XMLBaseData &data, XMLQueryHit target,
+                              bool isChoice) {
+  Add(data.name, target, XMLSearchField::Name, isChoice);
+  if (data.info)
+    Add(*data.info, target, XMLSearchField::Info, isChoice);
+}
+
+void XMLSearchCorpus::Build(const XMLDocData &doc) {
+  blob.clear();
+  entries.clear();
+  for (uint32_t s = 0; s < doc.structures.size(); ++s) {
+    const auto &structData = doc.structures[s];
+    AddBase(structData, {XMLQueryKind::Struct, s, XMLQueryHit::kNoChild},
+            false);
+    for (uint32_t f = 0; f < structData.fields.size(); ++f) {
+      const auto &field = structData.fields[f];
+      XMLQueryHit target{XMLQueryKind::Field, s, f};
+      AddBase(field, target, false);
+      if (!field.choices)
+        continue;
+      for (const auto &choice : *field.choices) {
+        AddBase(choice, target, true);
+      }
+    }
+  }
+  for (uint32_t e = 0; e < doc.enumerates.size(); ++e) {
+    const auto &enumData = doc.enumerates[e];
+    AddBase(enumData, {XMLQueryKind::Enum, e, XMLQueryHit::kNoChild}, false);
+    for (uint32_t v = 0; v < enumData.values.size(); ++v) {
+      AddBase(enumData.values[v], {XMLQueryKind::Value, e, v}, false);
+    }
+  }
+  foldedBlob.resize(blob.size());
+  std::transform(blob.begin(), blob.end(), foldedBlob.begin(), FoldAscii);
+}
+
+#ifdef XML_SEARCH_SSE2
+static unsigned CountTrailingZeros(unsigned mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+size_t FindSubstring(std::string_view haystack, std::string_view needle) {
+  const size_t n = needle.size();
+  if (n == 0)
+    return 0;
+  if (n > haystack.size())
+    return std::string_view::npos;
+  const char *data = haystack.data();
+  const size_t last = haystack.size() - n; // last valid start position
+  size_t i = 0;
+#ifdef XML_SEARCH_SSE2
+  // Compare the first and last needle byte against 16 candidate positions at
+  // once, only candidates matching both are verified with memcmp.
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i lastByte = _mm_set1_epi8(needle[n - 1]);
+  for (; i + 16 <= last + 1; i += 16) {
+    __m128i blockFirst =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    __m128i blockLast =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + n - 1));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, lastByte))));
+    while (mask) {
+      unsigned bit = CountTrailingZeros(mask);
+      if (n <= 2 || !std::memcmp(data + i + bit + 1, needle.data() + 1, n - 2))
+        return i + bit;
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i <= last; ++i) {
+    const void *hit = std::memchr(data + i, needle[0], last - i + 1);
+    if (!hit)
+      break;
+    i = static_cast<const char *>(hit) - data;
+    if (!std::memcmp(data + i, needle.data(), n))
+      return i;
+  }
+  return std::string_view::npos;
+}
+
+struct XMLTextSearch::Job {
+  uint64_t generation;
+  std::shared_ptr<const XMLSearchCorpus> corpus;
+  std::string needle; // folded unless case sensitive
+  XMLSearchOptions options;
+  std::regex regex;
+};
+
+XMLTextSearch::XMLTextSearch() : worker(&XMLTextSearch::Run, this) {}
+
+XMLTextSearch::~XMLTextSearch() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+    ++generation;
+  }
+  wake.notify_one();
+  worker.join();
+}
+
+bool XMLTextSearch::Start(std::shared_ptr<const XMLSearchCorpus> corpus,
+                          const std::string &pattern,
+                          const XMLSearchOptions &options,
+                          std::string &error) {
+  auto job = std::make_shared<Job>();
+  job->corpus = std::move(corpus);
+  job->options = options;
+  if (options.regex) {
+    auto flags = std::regex::ECMAScript | std::regex::optimize;
+    if (!options.caseSensitive)
+      flags |= std::regex::icase;
+    try {
+      job->regex = std::regex(pattern, flags);
+    } catch (const std::regex_error &e) {
+      error = e.what();
+      Cancel();
+      return false;
+    }
+  } else {
+    job->needle = options.caseSensitive ? pattern : FoldString(pattern);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job->generation = ++generation;
+    pending = std::move(job);
+    published.clear();
+  }
+  wake.notify_one();
+  return true;
+}
+
+void XMLTextSearch::Cancel() {
+  std::lock_guard<std::mutex> lock(mutex);
+  ++generation;
+  pending.reset();
+  published.clear();
+}
+
+bool XMLTextSearch::Poll(std::vector<XMLSearchHit> &hits) {
+  std::lock_guard<std::mutex> lock(mutex);
+  hits.insert(hits.end(), published.begin(), published.end());
+  published.clear();
+  return isRunning || pending;
+}
+
+void XMLTextSearch::Run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    wake.wait(lock, [this] { return isStopping || pending; });
+    if (isStopping)
+      return;
+    std::shared_ptr<Job> job = std::move(pending);
+    isRunning = true;
+    lock.unlock();
+    Execute(*job);
+    lock.lock();
+    isRunning = false;
+  }
+}
+
+void XMLTextSearch::Publish(const Job &job, std::vector<XMLSearchHit> &hits) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (job.generation == generation)
+    published.insert(published.end(), hits.begin(), hits.end());
+  hits.clear();
+}
+
+void XMLTextSearch::Execute(const Job &job) {
+  const XMLSearchCorpus &corpus = *job.corpus;
+  const auto &entries = corpus.Entries();
+  const std::string &blob = corpus.Blob(!job.options.caseSensitive);
+  auto isWanted = [&job](const XMLSearchCorpus::Entry &entry) {
+    return entry.field == XMLSearchField::Name ? job.options.names
+                                               : job.options.infos;
+  };
+
+  std::vector<XMLSearchHit> hits;
+  std::cmatch match;
+  for (size_t begin = 0; begin < entries.size();
+       begin += kSearchChunkEntries) {
+    if (job.generation != generation.load(std::memory_order_relaxed))
+      return;
+    size_t end = std::min(entries.size(), begin + kSearchChunkEntries);
+    if (job.options.regex) {
+      for (size_t e = begin; e < end; ++e) {
+        const auto &entry = entries[e];
+        if (!isWanted(entry))
+          continue;
+        const char *text = corpus.Blob(false).data() + entry.offset;
+        if (std::regex_search(text, text + entry.size, match, job.regex)) {
+          hits.push_back({static_cast<uint32_t>(e),
+                          static_cast<uint32_t>(match.position(0)),
+                          static_cast<uint32_t>(match.length(0))});
+        }
+      }
+    } else {
+      // Scan the whole chunk as one string, then map each match back to its
+      // entry and resume after it so every entry is reported at most once.
+      size_t chunkBegin = entries[begin].offset;
+      size_t chunkEnd = entries[end - 1].offset + entries[end - 1].size;
+      size_t e = begin;
+      size_t pos = chunkBegin;
+      while (pos < chunkEnd) {
+        std::string_view haystack(blob.data() + pos, chunkEnd - pos);
+        size_t found = FindSubstring(haystack, job.needle);
+        if (found == std::string_view::npos)
+          break;
+        size_t at = pos + found;
+        while (entries[e].offset + entries[e].size <= at)
+          ++e;
+        const auto &entry = entries[e];
+        if (isWanted(entry)) {
+          hits.push_back({static_cast<uint32_t>(e),
+                          static_cast<uint32_t>(at - entry.offset),
+                          static_cast<uint32_t>(job.needle.size())});
+        }
+        pos = entry.offset + entry.size + 1;
+      }
+    }
+    if (!hits.empty())
+      Publish(job, hits);
+  }
+}
@@ -0,0 +1,108 @@
+#ifndef __XML_SEARCH_H__
+#define __XML_SEARCH_H__
+
+#include "xml_query.h"
+#include "xml_types.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class XMLSearchField : uint8_t { Name, Info };
+
+// All searchable text of a document in one NUL separated blob, plus a case
+// folded copy, so a search is a single linear scan instead of a walk over
+// thousands of small strings.
+class XMLSearchCorpus {
+public:
+  struct Entry {
+    uint32_t offset;
+    uint32_t size;
+    XMLQueryHit target;
+    XMLSearchField field;
+    // Text of one of a field's choice values, reported on the field.
+    bool isChoice;
+  };
+
+  void Build(const XMLDocData &doc);
+
+  std::string_view Text(const Entry &entry) const {
+    return std::string_view(blob.data() + entry.offset, entry.size);
+  }
+  const std::vector<Entry> &Entries() const { return entries; }
+  const std::string &Blob(bool folded) const { return folded ? foldedBlob : blob; }
+  size_t MemoryBytes() const {
+    return blob.capacity() + foldedBlob.capacity() +
+           entries.capacity() * sizeof(Entry);
+  }
+
+private:
+  std::string blob;
+  std::string foldedBlob;
+  std::vector<Entry> entries;
+
+  void Add(std::string_view text, XMLQueryHit target, XMLSearchField field,
+           bool isChoice);
+  void AddBase(const XMLBaseData &data, XMLQueryHit target, bool isChoice);
+};
+
+struct XMLSearchOptions {
+  bool caseSensitive = false;
+  bool regex = false;
+  bool names = true;
+  bool infos = true;
+};
+
+struct XMLSearchHit {
+  uint32_t entry; // index into XMLSearchCorpus::Entries()
+  uint32_t matchOffset;
+  uint32_t matchSize;
+};
+
+// First occurrence of 'needle' in 'haystack', SSE2 accelerated where
+// available; npos when there is none.
+size_t FindSubstring(std::string_view haystack, std::string_view needle);
+
+// Runs searches on a worker thread. Hits are published in chunks while the
+// scan proceeds and collected with Poll(); starting a new search cancels the
+// running one at the next chunk boundary.
+class XMLTextSearch {
+public:
+  XMLTextSearch();
+  ~XMLTextSearch();
+  XMLTextSearch(const XMLTextSearch &) = delete;
+  XMLTextSearch &operator=(const XMLTextSearch &) = delete;
+
+  // Returns false and fills 'error' for an invalid regex.
+  bool Start(std::shared_ptr<const XMLSearchCorpus> corpus,
+             const std::string &pattern, const XMLSearchOptions &options,
+             std::string &error);
+  void Cancel();
+  // Append the hits found since the last call, returns whether the search is
+  // still running.
+  bool Poll(std::vector<XMLSearchHit> &hits);
+
+private:
+  struct Job;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::shared_ptr<Job> pending;
+  std::vector<XMLSearchHit> published;
+  std::atomic<uint64_t> generation{0};
+  bool isRunning = false;
+  bool isStopping = false;
+  // Last, so it starts after the state it uses is constructed.
+  std::thread worker;
+
+  void Run();
+  void Execute(const Job &job);
+  void Publish(const Job &job, std::vector<XMLSearchHit> &hits);
+};
+
+#endif
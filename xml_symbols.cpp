@@ -0,0 +1,69 @@
+#include "xml_symbols.h"
+#include <cstring>
+
+static uint64_t HashString(std::string_view str) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (unsigned char c : str) {
+    h ^= c;
+    h *= 0x100000001b3ull;
+  }
+  return h ^ (h >> 32);
+}
+
+size_t XMLSymbolTable::FindSlot(std::string_view str, uint64_t hash) const {
+  size_t mask = slots.size() - 1;
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    XMLSymbol symbol = slots[slot];
+    if (symbol == kNoSymbol ||
+        (hashes[symbol] == hash && View(symbol) == str))
+      return slot;
+  }
+}
+
+void XMLSymbolTable::Grow() {
+  slots.assign(slots.empty() ? 256 : slots.size() * 2, kNoSymbol);
+  size_t mask = slots.size() - 1;
+  for (XMLSymbol symbol = 0; symbol < hashes.size(); ++symbol) {
+    size_t slot = hashes[symbol] & mask;
+    while (slots[slot] != kNoSymbol)
+      slot = (slot + 1) & mask;
+    slots[slot] = symbol;
+  }
+}
+
+XMLSymbol XMLSymbolTable::Intern(std::string_view str) {
+  // Keep the load factor at or below 1/2.
+  if ((hashes.size() + 1) * 2 > slots.size())
+    Grow();
+  uint64_t hash = HashString(str);
+  size_t slot = FindSlot(str, hash);
+  if (slots[slot] != kNoSymbol)
+    return slots[slot];
+
+  XMLSymbol symbol = static_cast<XMLSymbol>(hashes.size());
+  chars.insert(chars.end(), str.begin(), str.end());
+  chars.push_back('\0');
+  offsets.push_back(static_cast<uint32_t>(chars.size()));
+  hashes.push_back(hash);
+  slots[slot] = symbol;
+  return symbol;
+}
+
+XMLSymbol XMLSymbolTable::Find(std::string_view str) const {
+  if (slots.empty())
+    return kNoSymbol;
+  return slots[FindSlot(str, HashString(str))];
+}
+
+void XMLSymbolTable::Clear() {
+  chars.clear();
+  offsets.assign(1, 0);
+  hashes.clear();
+  slots.clear();
+}
+
+size_t XMLSymbolTable::MemoryBytes() const {
+  return chars.capacity() + offsets.capacity() * sizeof(uint32_t) +
+         hashes.capacity() * sizeof(uint64_t) +
+         slots.capacity() * sizeof(XMLSymbol);
+}
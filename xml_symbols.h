@@ -0,0 +1,50 @@
+#ifndef __XML_SYMBOLS_H__
+#define __XML_SYMBOLS_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Dense id of an interned string, stable for the lifetime of its table.
+using XMLSymbol = uint32_t;
+constexpr XMLSymbol kNoSymbol = ~0u;
+
+// Document level string interning. Every distinct string is stored once, NUL
+// terminated, in one contiguous buffer; equal strings get equal ids, so
+// comparing two symbols is an integer compare and Hash() is a table lookup.
+class XMLSymbolTable {
+public:
+  XMLSymbol Intern(std::string_view str);
+  // kNoSymbol when 'str' was never interned.
+  XMLSymbol Find(std::string_view str) const;
+
+  // Views and pointers stay valid until the next Intern().
+  std::string_view View(XMLSymbol symbol) const {
+    return std::string_view(chars.data() + offsets[symbol],
+                            offsets[symbol + 1] - offsets[symbol] - 1);
+  }
+  const char *CStr(XMLSymbol symbol) const {
+    return chars.data() + offsets[symbol];
+  }
+  std::string Str(XMLSymbol symbol) const { return std::string(View(symbol)); }
+  uint64_t Hash(XMLSymbol symbol) const { return hashes[symbol]; }
+
+  size_t Size() const { return hashes.size(); }
+  void Clear();
+  size_t MemoryBytes() const;
+
+private:
+  std::vector<char> chars;
+  // Start of every symbol in 'chars', plus one past the last.
+  std::vector<uint32_t> offsets{0};
+  std::vector<uint64_t> hashes;
+  // Open addressing, power of two sized, kNoSymbol marks an empty slot.
+  std::vector<XMLSymbol> slots;
+
+  size_t FindSlot(std::string_view str, uint64_t hash) const;
+  void Grow();
+};
+
+#endif
@@ -0,0 +1,204 @@
+#include "xml_typegraph.h"
+#include <algorithm>
+#include <cctype>
+
+static bool IsFixedPointType(const std::string &type) {
+  // u4.8 / s3.8
+  size_t dot = type.find('.');
+  if (type.size() < 4 || dot == std::string::npos || dot < 2 ||
+      dot + 1 == type.size())
+    return false;
+  for (size_t i = 1; i < type.size(); ++i) {
+    if (i != dot && !std::isdigit(static_cast<unsigned char>(type[i])))
+      return false;
+  }
+  return true;
+}
+
+static const struct {
+  const char *name;
+  XMLBuiltinType type;
+} kBuiltinTypes[] = {
+    {"uint", XMLBuiltinType::Uint},       {"int", XMLBuiltinType::Int},
+    {"bool", XMLBuiltinType::Bool},       {"float", XMLBuiltinType::Float},
+    {"address", XMLBuiltinType::Address}, {"offset", XMLBuiltinType::Offset},
+    {"mbo", XMLBuiltinType::Mbo},         {"mbz", XMLBuiltinType::Mbz},
+};
+
+XMLBuiltinType ParseBuiltinType(const std::string &type) {
+  for (const auto &builtin : kBuiltinTypes) {
+    if (type == builtin.name)
+      return builtin.type;
+  }
+  if (IsFixedPointType(type)) {
+    if (type[0] == 'u')
+      return XMLBuiltinType::UFixed;
+    if (type[0] == 's')
+      return XMLBuiltinType::SFixed;
+  }
+  return XMLBuiltinType::None;
+}
+
+const char *BuiltinTypeName(XMLBuiltinType type) {
+  for (const auto &builtin : kBuiltinTypes) {
+    if (type == builtin.type)
+      return builtin.name;
+  }
+  switch (type) {
+  case XMLBuiltinType::UFixed:
+    return "ufixed";
+  case XMLBuiltinType::SFixed:
+    return "sfixed";
+  default:
+    return "";
+  }
+}
+
+static void EraseRef(std::vector<XMLFieldRef> &refs, XMLFieldRef field) {
+  refs.erase(std::remove_if(refs.begin(), refs.end(),
+                            [field](const XMLFieldRef &ref) {
+                              return ref.structIndex == field.structIndex &&
+                                     ref.fieldIndex == field.fieldIndex;
+                            }),
+             refs.end());
+}
+
+void XMLTypeGraph::Define(const std::string &name, XMLTypeRef ref) {
+  // The first definition of a name wins, like a lookup in document order.
+  definitions.emplace(name, ref);
+}
+
+void XMLTypeGraph::ResolveField(const XMLDocData &doc, XMLFieldRef field) {
+  const std::string &type =
+      doc.structures[field.structIndex].fields[field.fieldIndex].type;
+  XMLTypeRef &ref = fieldTypes[field.structIndex][field.fieldIndex];
+  ref = XMLTypeRef();
+
+  XMLBuiltinType builtin = ParseBuiltinType(type);
+  if (builtin != XMLBuiltinType::None) {
+    ref.kind = XMLTypeKind::Builtin;
+    ref.builtin = builtin;
+    return;
+  }
+  auto it = definitions.find(type);
+  if (it == definitions.end()) {
+    dangling.push_back(field);
+    return;
+  }
+  ref = it->second;
+  if (ref.kind == XMLTypeKind::Enum)
+    enumUsages[ref.index].push_back(field);
+  else
+    structUsages[ref.index].push_back(field);
+}
+
+void XMLTypeGraph::UnlinkField(XMLFieldRef field) {
+  const XMLTypeRef &ref = fieldTypes[field.structIndex][field.fieldIndex];
+  switch (ref.kind) {
+  case XMLTypeKind::Enum:
+    EraseRef(enumUsages[ref.index], field);
+    break;
+  case XMLTypeKind::Struct:
+    EraseRef(structUsages[ref.index], field);
+    break;
+  case XMLTypeKind::Unresolved:
+    EraseRef(dangling, field);
+    break;
+  case XMLTypeKind::Builtin:
+    break;
+  }
+}
+
+void XMLTypeGraph::ResolveDangling(const XMLDocData &doc,
+                                   const std::string &name) {
+  std::vector<XMLFieldRef> pending;
+  pending.swap(dangling);
+  for (const XMLFieldRef &field : pending) {
+    const XMLFieldData &data =
+        doc.structures[field.structIndex].fields[field.fieldIndex];
+    if (data.type == name)
+      ResolveField(doc, field);
+    else
+      dangling.push_back(field);
+  }
+}
+
+void XMLTypeGraph::Build(const XMLDocData &doc) {
+  definitions.clear();
+  dangling.clear();
+  enumUsages.assign(doc.enumerates.size(), {});
+  structUsages.assign(doc.structures.size(), {});
+  fieldTypes.resize(doc.structures.size());
+
+  for (uint32_t e = 0; e < doc.enumerates.size(); ++e) {
+    Define(doc.enumerates[e].name,
+           XMLTypeRef{XMLTypeKind::Enum, XMLBuiltinType::None, e});
+  }
+  for (uint32_t s = 0; s < doc.structures.size(); ++s) {
+    Define(doc.structures[s].name,
+           XMLTypeRef{XMLTypeKind::Struct, XMLBuiltinType::None, s});
+  }
+  for (uint32_t s = 0; s < doc.structures.size(); ++s) {
+    fieldTypes[s].assign(doc.structures[s].fields.size(), XMLTypeRef());
+    for (uint32_t f = 0; f < doc.structures[s].fields.size(); ++f) {
+      ResolveField(doc, XMLFieldRef{s, f});
+    }
+  }
+}
+
+void XMLTypeGraph::AddEnum(const XMLDocData &doc, uint32_t enumIndex) {
+  enumUsages.resize(doc.enumerates.size());
+  const std::string &name = doc.enumerates[enumIndex].name;
+  Define(name, XMLTypeRef{XMLTypeKind::Enum, XMLBuiltinType::None, enumIndex});
+  ResolveDangling(doc, name);
+}
+
+void XMLTypeGraph::AddStruct(const XMLDocData &doc, uint32_t structIndex) {
+  structUsages.resize(doc.structures.size());
+  fieldTypes.resize(doc.structures.size());
+  const std::string &name = doc.structures[structIndex].name;
+  Define(name,
+         XMLTypeRef{XMLTypeKind::Struct, XMLBuiltinType::None, structIndex});
+  ResolveDangling(doc, name);
+  UpdateStructFields(doc, structIndex);
+}
+
+void XMLTypeGraph::UpdateStructFields(const XMLDocData &doc,
+                                      uint32_t structIndex) {
+  auto &types = fieldTypes[structIndex];
+  for (uint32_t f = 0; f < types.size(); ++f) {
+    UnlinkField(XMLFieldRef{structIndex, f});
+  }
+  const auto &fields = doc.structures[structIndex].fields;
+  types.assign(fields.size(), XMLTypeRef());
+  for (uint32_t f = 0; f < fields.size(); ++f) {
+    ResolveField(doc, XMLFieldRef{structIndex, f});
+  }
+}
+
+void XMLTypeGraph::UpdateField(const XMLDocData &doc, uint32_t structIndex,
+                               uint32_t fieldIndex) {
+  XMLFieldRef field{structIndex, fieldIndex};
+  UnlinkField(field);
+  ResolveField(doc, field);
+}
+
+size_t XMLTypeGraph::MemoryBytes() const {
+  size_t bytes = sizeof(*this);
+  for (const auto &entry : definitions) {
+    bytes += sizeof(entry) + entry.first.capacity() + sizeof(void *);
+  }
+  bytes += definitions.bucket_count() * sizeof(void *);
+  bytes += fieldTypes.capacity() * sizeof(fieldTypes[0]);
+  for (const auto &types : fieldTypes) {
+    bytes += types.capacity() * sizeof(XMLTypeRef);
+  }
+  for (const auto *usages : {&enumUsages, &structUsages}) {
+    bytes += usages->capacity() * sizeof((*usages)[0]);
+    for (const auto &refs : *usages) {
+      bytes += refs.capacity() * sizeof(XMLFieldRef);
+    }
+  }
+  bytes += dangling.capacity() * sizeof(XMLFieldRef);
+  return bytes;
+}
@@ -0,0 +1,78 @@
+#ifndef __XML_TYPEGRAPH_H__
+#define __XML_TYPEGRAPH_H__
+
+#include "xml_types.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class XMLTypeKind : uint8_t { Unresolved, Builtin, Enum, Struct };
+
+enum class XMLBuiltinType : uint8_t {
+  None,
+  Uint,
+  Int,
+  Bool,
+  Float,
+  Address,
+  Offset,
+  Mbo,
+  Mbz,
+  UFixed, // "u<int>.<frac>"
+  SFixed, // "s<int>.<frac>"
+};
+
+// What an XMLFieldData::type string refers to. 'index' is the position in
+// XMLDocData::enumerates or XMLDocData::structures.
+struct XMLTypeRef {
+  XMLTypeKind kind = XMLTypeKind::Unresolved;
+  XMLBuiltinType builtin = XMLBuiltinType::None;
+  uint32_t index = 0;
+};
+
+XMLBuiltinType ParseBuiltinType(const std::string &type);
+const char *BuiltinTypeName(XMLBuiltinType type);
+
+// Field type strings resolved once into direct references, plus the reverse
+// usage index. Resolution happens at load and is patched incrementally when
+// enums or structs are committed, so rendering and decoding never compare
+// type strings.
+class XMLTypeGraph {
+public:
+  void Build(const XMLDocData &doc);
+  void AddEnum(const XMLDocData &doc, uint32_t enumIndex);
+  void AddStruct(const XMLDocData &doc, uint32_t structIndex);
+  // Re-resolve the fields of one struct after they were edited.
+  void UpdateStructFields(const XMLDocData &doc, uint32_t structIndex);
+  // Re-resolve a single field whose type was edited.
+  void UpdateField(const XMLDocData &doc, uint32_t structIndex,
+                   uint32_t fieldIndex);
+
+  const XMLTypeRef &FieldType(uint32_t structIndex, uint32_t fieldIndex) const {
+    return fieldTypes[structIndex][fieldIndex];
+  }
+  const std::vector<XMLFieldRef> &EnumUsages(uint32_t enumIndex) const {
+    return enumUsages[enumIndex];
+  }
+  const std::vector<XMLFieldRef> &StructUsages(uint32_t structIndex) const {
+    return structUsages[structIndex];
+  }
+  // Fields whose type names neither a builtin nor a definition.
+  const std::vector<XMLFieldRef> &DanglingFields() const { return dangling; }
+  size_t MemoryBytes() const;
+
+private:
+  std::unordered_map<std::string, XMLTypeRef> definitions;
+  std::vector<std::vector<XMLTypeRef>> fieldTypes;
+  std::vector<std::vector<XMLFieldRef>> enumUsages;
+  std::vector<std::vector<XMLFieldRef>> structUsages;
+  std::vector<XMLFieldRef> dangling;
+
+  void Define(const std::string &name, XMLTypeRef ref);
+  void ResolveField(const XMLDocData &doc, XMLFieldRef field);
+  void UnlinkField(XMLFieldRef field);
+  void ResolveDangling(const XMLDocData &doc, const std::string &name);
+};
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef __XML_TYPES_H__
 #define __XML_TYPES_H__
 
+#include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <optional>
 #include <vector>
@@ -9,18 +12,119 @@ struct XMLBaseData {
   std::string name;
   std::optional<std::string> prefix;
   std::optional<std::string> info;
+  // Merkle hash of this node and its children, see xml_hash.h
+  uint64_t contentHash = 0;
 };
 
 struct XMLValueData : public XMLBaseData {
   uint64_t value;
 };
 
+// A repeated <group count=... start=... size=...> of fields. Stored once, not
+// per repetition: repetition i of the group sits at 'start + i * size' bits
+// from the base of its parent group (or of the struct).
+struct XMLGroupData {
+  static constexpr uint32_t kNoGroup = UINT32_MAX;
+  uint32_t start;
+  uint32_t size;
+  // 0 repeats until the end of the struct's data.
+  uint32_t count;
+  // Index of the enclosing group in XMLStructData::groups.
+  uint32_t parent = kNoGroup;
+};
+
+// A list of <value> children. Many fields carry the same list (booleans,
+// tiling modes, format subsets), so lists are hash-consed per document by
+// XMLValueTablePool and shared by every field that has them; see
+// xml_value_tables.h. A table is immutable once interned or shared.
+struct XMLValueTable {
+  std::vector<XMLValueData> values;
+  // Positions in 'values' ordered by value, built when the table is interned.
+  std::vector<uint32_t> byValue;
+  // Sum of the hash terms of 'values' as children of a field, see
+  // xml_hash.h; valid once interned.
+  uint64_t valuesHash = 0;
+  bool isInterned = false;
+};
+
+// The choices of a field: absent, or a reference to a value table. Reads
+// like std::optional<std::vector<XMLValueData>>; writes go through emplace()
+// or Mutable(), which copy a shared table first.
+class XMLChoices {
+public:
+  XMLChoices() = default;
+  XMLChoices(std::nullopt_t) {}
+  XMLChoices(std::vector<XMLValueData> values)
+      : table(std::make_shared<XMLValueTable>()) {
+    Writable().values = std::move(values);
+  }
+
+  explicit operator bool() const { return table != nullptr; }
+  bool has_value() const { return table != nullptr; }
+  const std::vector<XMLValueData> &value() const { return table->values; }
+  const std::vector<XMLValueData> &operator*() const { return table->values; }
+  const std::vector<XMLValueData> *operator->() const {
+    return &table->values;
+  }
+  const XMLValueTable *Table() const { return table.get(); }
+
+  void reset() { table.reset(); }
+  // A new empty list owned by this field alone.
+  std::vector<XMLValueData> &emplace() {
+    table = std::make_shared<XMLValueTable>();
+    return Writable().values;
+  }
+  // The list for editing; a table that is interned or shared with another
+  // field is copied first, so the other users never see the edit.
+  std::vector<XMLValueData> &Mutable() {
+    if (!table)
+      return emplace();
+    if (table->isInterned || table.use_count() > 1) {
+      auto copy = std::make_shared<XMLValueTable>();
+      copy->values = table->values;
+      table = std::move(copy);
+    }
+    return Writable().values;
+  }
+
+  // The first value equal to 'raw', or nullptr. Binary search through the
+  // shared index of an interned table, a scan otherwise.
+  const XMLValueData *Find(uint64_t raw) const {
+    if (!table)
+      return nullptr;
+    const std::vector<XMLValueData> &values = table->values;
+    if (table->byValue.size() != values.size()) {
+      for (const XMLValueData &value : values) {
+        if (value.value == raw)
+          return &value;
+      }
+      return nullptr;
+    }
+    auto it = std::lower_bound(
+        table->byValue.begin(), table->byValue.end(), raw,
+        [&values](uint32_t pos, uint64_t v) { return values[pos].value < v; });
+    if (it == table->byValue.end() || values[*it].value != raw)
+      return nullptr;
+    return &values[*it];
+  }
+
+private:
+  friend class XMLValueTablePool;
+  // Tables are always created non-const, so writing through a table that
+  // nobody else references is well defined.
+  XMLValueTable &Writable() { return const_cast<XMLValueTable &>(*table); }
+
+  std::shared_ptr<const XMLValueTable> table;
+};
+
 struct XMLFieldData : public XMLBaseData {
+  // Relative to the base of 'group' when the field belongs to one.
   uint32_t start;
   uint32_t end;
   std::string type;
   std::optional<uint64_t>defaultValue;
-  std::optional<std::vector<XMLValueData> > choices;
+  XMLChoices choices;
+  uint32_t group = XMLGroupData::kNoGroup;
 };
 
 // support 'enum' and 'structure'
@@ -28,9 +132,62 @@ struct XMLEnumData : public XMLBaseData {
   std::vector<XMLValueData> values;
 };
 
+// The element a struct was defined by; all share the struct layout.
+enum class XMLStructKind : uint8_t { Struct, Instruction, Register };
+
+// Element name of a struct kind.
+inline const char *StructKindName(XMLStructKind kind) {
+  switch (kind) {
+  case XMLStructKind::Instruction:
+    return "instruction";
+  case XMLStructKind::Register:
+    return "register";
+  default:
+    return "struct";
+  }
+}
+
 struct XMLStructData : public XMLBaseData {
   uint32_t length;
+  XMLStructKind kind = XMLStructKind::Struct;
+  // <register num=...>, the MMIO offset.
+  std::optional<uint64_t> address;
+  // <instruction bias=... engine=...>
+  std::optional<uint32_t> bias;
+  std::optional<std::string> engine;
   std::vector<XMLFieldData> fields;
+  // Parents precede their children.
+  std::vector<XMLGroupData> groups;
+};
+
+// Bit offset of the first repetition of 'group' from the start of its
+// struct, 0 for kNoGroup.
+inline uint32_t GroupBaseBit(const std::vector<XMLGroupData> &groups,
+                             uint32_t group) {
+  uint32_t base = 0;
+  for (; group < groups.size(); group = groups[group].parent)
+    base += groups[group].start;
+  return base;
+}
+
+// Bits a top level group covers, all repetitions; one without a count
+// repeats until the end of the struct.
+inline uint32_t GroupWidth(const XMLStructData &data,
+                           const XMLGroupData &group) {
+  if (group.count != 0)
+    return group.count * group.size;
+  return std::max(data.length * 32, group.start + group.size) - group.start;
+}
+
+// Bits a field covers; a field with end < start counts as one bit wide.
+inline uint32_t FieldWidth(const XMLFieldData &field) {
+  return field.end >= field.start ? field.end - field.start + 1 : 1;
+}
+
+// Position of a field inside XMLDocData::structures
+struct XMLFieldRef {
+  uint32_t structIndex;
+  uint32_t fieldIndex;
 };
 
 struct XMLDocData: public XMLBaseData {
@@ -5,15 +5,18 @@
 #include "xml_types.h"
 #include <functional>
 
-inline bool ModalOKButton() {
+bool ModalOKButton() {
   return ImGui::Button("Ok") ||  ImGui::Shortcut(ImGuiKey_Enter);
 }
 
-inline bool ModalCancelButton() {
+bool ModalCancelButton() {
   return ImGui::Button("Cancel") || ImGui::Shortcut(ImGuiKey_Escape);
 }
 
-static void RenderEditingValueTable(std::vector<XMLValueData> &data) {
+// Returns the row whose "edit" button was clicked, -1 for none. The caller
+// opens its editor popup, outside of the table's ID scope.
+static int RenderEditingValueTable(std::vector<XMLValueData> &data) {
+  int editRow = -1;
   if (ImGui::BeginTable("Value Table", 4,
                         ImGuiTableFlags_Resizable)) {
     ImGui::TableSetupColumn("Name", 0);
@@ -39,22 +42,29 @@ static void RenderEditingValueTable(std::vector<XMLValueData> &data) {
       }
       ImGui::SameLine();
       if (ImGui::Button("edit")) {
-        // todo
+        editRow = id;
       }
       ImGui::PopID();
     }
     ImGui::EndTable();
   }
+  return editRow;
 }
 
-static void RenderEditingFieldTable(std::vector<XMLFieldData> &data) {
-  if (ImGui::BeginTable("Field Table", 6,
+// Same as RenderEditingValueTable(). With 'pinned' (parallel to 'data')
+// there is a column of pin checkboxes for the auto layout.
+static int RenderEditingFieldTable(std::vector<XMLFieldData> &data,
+                                   std::vector<uint8_t> *pinned) {
+  int editRow = -1;
+  if (ImGui::BeginTable("Field Table", pinned ? 7 : 6,
                         ImGuiTableFlags_Resizable)) {
     ImGui::TableSetupColumn("Name", 0);
     ImGui::TableSetupColumn("Start", 0);
     ImGui::TableSetupColumn("End", 0);
     ImGui::TableSetupColumn("Info", 0);
     ImGui::TableSetupColumn("Choices", 0);
+    if (pinned)
+      ImGui::TableSetupColumn("Pinned", 0);
     ImGui::TableSetupColumn("Operations", 0);
     ImGui::TableHeadersRow();
     for (int id = 0; id < data.size(); ++id) {
@@ -79,19 +89,28 @@ static void RenderEditingFieldTable(std::vector<XMLFieldData> &data) {
       }
       ImGui::TableNextColumn();
       ImGui::PushID(id);
+      if (pinned) {
+        bool isPinned = (*pinned)[id] != 0;
+        if (ImGui::Checkbox("##pinned", &isPinned))
+          (*pinned)[id] = isPinned;
+        ImGui::TableNextColumn();
+      }
       if (ImGui::Button("delete")) {
         data.erase(data.begin() + id);
+        if (pinned)
+          pinned->erase(pinned->begin() + id);
         ImGui::PopID();
         break;
       }
       ImGui::SameLine();
       if (ImGui::Button("edit")) {
-        // todo
+        editRow = id;
       }
       ImGui::PopID();
     }
     ImGui::EndTable();
   }
+  return editRow;
 }
 
 static void RenderOptionalText(const char *strCheckBoxLabel,
@@ -99,7 +118,9 @@ static void RenderOptionalText(const char *strCheckBoxLabel,
                                std::optional<std::string> &optionalStr) {
 
   if (ImGui::Checkbox(strCheckBoxLabel, bNeeded)) {
-    if (!optionalStr)
+    if (!*bNeeded)
+      optionalStr.reset();
+    else if (!optionalStr)
       optionalStr = "";
   }
   if (*bNeeded) {
@@ -123,6 +144,7 @@ void XMLEditEnumUI::Render() {
     ImGui::TableSetupColumn("Operations", 0);
     ImGui::TableHeadersRow();
     int id = 0;
+    int editRow = -1;
     for (auto it = currentEditing.values.begin();
          it != currentEditing.values.end(); ++it) {
       auto &valueData = *it;
@@ -142,26 +164,38 @@ void XMLEditEnumUI::Render() {
       }
       ImGui::SameLine();
       if (ImGui::Button("edit")) {
-        // todo
+        editRow = id;
       }
       ImGui::PopID();
       ++id;
     }
     ImGui::EndTable();
+    if (editRow >= 0) {
+      valueEdiotr.SetEditing(currentEditing.values[editRow]);
+      editingValue = editRow;
+      ImGui::OpenPopup("Edit Value");
+    }
   }
 
   if (ImGui::Button("Add value")) {
+    editingValue = -1;
     ImGui::OpenPopup("Edit Value");
   }
   if (ImGui::BeginPopupModal("Edit Value", NULL, ImGuiWindowFlags_Modal | ImGuiWindowFlags_AlwaysAutoResize)) {
     valueEdiotr.Render();
     if (ModalOKButton()) {
-      currentEditing.values.push_back(valueEdiotr.currentEditing);
+      if (editingValue < 0)
+        currentEditing.values.push_back(valueEdiotr.currentEditing);
+      else
+        currentEditing.values[editingValue] = valueEdiotr.currentEditing;
       valueEdiotr = XMLEditValueUI();
       ImGui::CloseCurrentPopup();
     }
     ImGui::SameLine();
     if (ModalCancelButton()) {
+      // Keep a draft new value, drop an edited copy.
+      if (editingValue >= 0)
+        valueEdiotr = XMLEditValueUI();
       ImGui::CloseCurrentPopup();
     }
     ImGui::EndPopup();
@@ -172,53 +206,131 @@ void XMLEditEnumUI::Render() {
 void XMLEditStructUI::Render() {
   ImGui::Text("Struct:");
   ImGui::InputText("Name", &currentEditing.name);
+  // The auto layout sets the length unless it is asked to keep it.
+  ImGui::BeginDisabled(bAutoLayout && !bKeepLength);
   ImGui::InputScalar("Length", ImGuiDataType_U32, &currentEditing.length);
+  ImGui::EndDisabled();
   RenderOptionalText("Have info?", "Info", &bHaveInfo, currentEditing.info);
-  RenderEditingFieldTable(currentEditing.fields);
+  RenderLayout();
+  // Pins only mean something to the auto layout.
+  if (!bAutoLayout)
+    pinnedFields.clear();
+  pinnedFields.resize(currentEditing.fields.size());
+  int editRow = RenderEditingFieldTable(currentEditing.fields,
+                                        bAutoLayout ? &pinnedFields : nullptr);
+  if (editRow >= 0) {
+	fieldEditor.SetEditing(currentEditing.fields[editRow]);
+	editingField = editRow;
+	ImGui::OpenPopup("Edit Field");
+  }
 
   if (ImGui::Button("Add Field")) {
+	editingField = -1;
 	ImGui::OpenPopup("Edit Field");
   }
   if (ImGui::BeginPopupModal("Edit Field")) {
+	// A pinned field keeps the position typed in.
+	fieldEditor.SetPlacedByLayout(
+	    bAutoLayout && (editingField < 0 || !pinnedFields[editingField]));
 	fieldEditor.Render();
 	if (ModalOKButton()) {
-		currentEditing.fields.emplace_back(fieldEditor.currentEditing);
+		if (editingField < 0)
+			currentEditing.fields.emplace_back(fieldEditor.currentEditing);
+		else
+			currentEditing.fields[editingField] = fieldEditor.currentEditing;
 		fieldEditor = XMLEditFieldUI();
 		ImGui::CloseCurrentPopup();
 	}
 	ImGui::SameLine();
 	if (ModalCancelButton()) {
+		if (editingField >= 0)
+			fieldEditor = XMLEditFieldUI();
 		ImGui::CloseCurrentPopup();
 	}
 	ImGui::EndPopup();
   }
 }
 
+void XMLEditStructUI::RenderLayout() {
+  ImGui::Checkbox("Auto layout", &bAutoLayout);
+  if (!bAutoLayout)
+    return;
+  static const char *const kGoalNames[] = {"Compact", "Dword boundaries"};
+  static const char *const kAlignNames[] = {"Any bit", "Bytes", "Natural"};
+  int goal = static_cast<int>(layoutOptions.goal);
+  if (ImGui::Combo("Goal", &goal, kGoalNames, IM_ARRAYSIZE(kGoalNames)))
+    layoutOptions.goal = static_cast<XMLLayoutGoal>(goal);
+  int align = static_cast<int>(layoutOptions.align);
+  if (ImGui::Combo("Alignment", &align, kAlignNames,
+                   IM_ARRAYSIZE(kAlignNames)))
+    layoutOptions.align = static_cast<XMLLayoutAlign>(align);
+  ImGui::Checkbox("Keep field order", &layoutOptions.keepOrder);
+  ImGui::SameLine();
+  ImGui::Checkbox("Keep length", &bKeepLength);
+
+  layoutOptions.maxBits = bKeepLength ? currentEditing.length * 32 : 0;
+  if (layoutSolver.SolveStruct(currentEditing, pinnedFields, layoutOptions)) {
+    ImGui::TextDisabled("%u bits used", layoutSolver.LengthBits());
+    return;
+  }
+  uint32_t failed = layoutSolver.FailedField();
+  const char *name = failed < currentEditing.fields.size()
+                         ? currentEditing.fields[failed].name.c_str()
+                         : "a group";
+  if (layoutSolver.Error() == XMLLayoutError::PinnedOverlap)
+    ImGui::Text("Pinned field '%s' overlaps another one.", name);
+  else
+    ImGui::Text("'%s' does not fit in %u dwords.", name,
+                currentEditing.length);
+}
+
 void XMLEditFieldUI::Render() {
   ImGui::Text("Feild:");
   ImGui::InputText("Name", &currentEditing.name);
+  ImGui::BeginDisabled(bPlacedByLayout);
   ImGui::InputScalar("Start bit", ImGuiDataType_U32, &currentEditing.start);
   ImGui::InputScalar("End bit", ImGuiDataType_U32, &currentEditing.end);
+  ImGui::EndDisabled();
+  uint32_t width = currentEditing.end >= currentEditing.start
+                       ? currentEditing.end - currentEditing.start + 1
+                       : 1;
+  if (ImGui::InputScalar("Width", ImGuiDataType_U32, &width) && width > 0)
+    currentEditing.end = currentEditing.start + width - 1;
+  ImGui::InputText("Type", &currentEditing.type);
   RenderOptionalText("Have info?", "Info", &bHaveInfo, currentEditing.info);
   RenderOptionalText("Have prefix?", "Prefix", &bHavePrefix,
                      currentEditing.prefix);
 
   if (currentEditing.choices) {
-    RenderEditingValueTable(currentEditing.choices.value());
+    // The editor works on its own copy of a shared table; applying the
+    // edit shares it again.
+    int editRow = RenderEditingValueTable(currentEditing.choices.Mutable());
+    if (editRow >= 0) {
+      valueEditor.SetEditing((*currentEditing.choices)[editRow]);
+      editingChoice = editRow;
+      ImGui::OpenPopup("Edit Choice");
+    }
   }
   if (ImGui::Button("Add choise")) {
-	if (!currentEditing.choices) currentEditing.choices = std::vector<XMLValueData>();
+	if (!currentEditing.choices) currentEditing.choices.emplace();
+    editingChoice = -1;
     ImGui::OpenPopup("Edit Choice");
   }
   if (ImGui::BeginPopupModal("Edit Choice")) {
     valueEditor.Render();
     if (ModalOKButton()) {
-      currentEditing.choices->push_back(valueEditor.currentEditing);
+      if (editingChoice < 0)
+        currentEditing.choices.Mutable().push_back(valueEditor.currentEditing);
+      else
+        currentEditing.choices.Mutable()[editingChoice] =
+            valueEditor.currentEditing;
       valueEditor = XMLEditValueUI();
       ImGui::CloseCurrentPopup();
     }
     ImGui::SameLine();
     if (ModalCancelButton()) {
+      if (editingChoice >= 0)
+        valueEditor = XMLEditValueUI();
       ImGui::CloseCurrentPopup();
     }
 	ImGui::EndPopup();
@@ -231,3 +343,31 @@ void XMLEditValueUI::Render() {
   ImGui::InputScalar("Value", ImGuiDataType_U64, &currentEditing.value);
   RenderOptionalText("Have info?", "Info", &bHaveInfo, currentEditing.info);
 }
+
+void XMLEditValueUI::SetEditing(const XMLValueData &data) {
+  currentEditing = data;
+  bHaveInfo = data.info.has_value();
+}
+
+void XMLEditFieldUI::SetEditing(const XMLFieldData &data) {
+  currentEditing = data;
+  bHaveInfo = data.info.has_value();
+  bHavePrefix = data.prefix.has_value();
+  editingChoice = -1;
+}
+
+void XMLEditHeaderUI::SetEditing(const XMLHeaderData &data, bool hasLength) {
+  currentEditing = data;
+  bHasLength = hasLength;
+  bHaveInfo = data.info.has_value();
+  bHavePrefix = data.prefix.has_value();
+}
+
+void XMLEditHeaderUI::Render() {
+  ImGui::InputText("Name", &currentEditing.name);
+  if (bHasLength)
+    ImGui::InputScalar("Length", ImGuiDataType_U32, &currentEditing.length);
+  RenderOptionalText("Have prefix?", "Prefix", &bHavePrefix,
+                     currentEditing.prefix);
+  RenderOptionalText("Have info?", "Info", &bHaveInfo, currentEditing.info);
+}
@@ -1,13 +1,20 @@
+#ifndef __XML_UI_H__
+#define __XML_UI_H__
+#include "xml_bit_layout.h"
+#include "xml_edit.h"
 #include "xml_types.h"
 #include <memory>
 
 bool ModalOKButton();
 bool ModalCancelButton();
 
+// Each editor works on its own copy of one node; SetEditing() loads an
+// existing node, a default constructed editor creates a new one.
 class XMLEditValueUI
 {
 public:
 	void Render();
+	void SetEditing(const XMLValueData& data);
 	XMLValueData currentEditing;
 private:
 	bool bHaveInfo = false;
@@ -22,17 +29,24 @@ private:
 	bool bHavePrefix = false;
 	bool bHaveInfo = false;
 	XMLEditValueUI valueEdiotr;
+	// Row of currentEditing.values in the value editor, -1 when adding.
+	int editingValue = -1;
 };
 
 class XMLEditFieldUI
 {
 public:
 	void Render();
+	void SetEditing(const XMLFieldData& data);
+	// Only the width is edited while the struct's auto layout places fields.
+	void SetPlacedByLayout(bool placed) { bPlacedByLayout = placed; }
 	XMLFieldData currentEditing;
 	XMLEditValueUI valueEditor;
 private:
-	bool bHaveInfo;
-	bool bHavePrefix;
+	bool bHaveInfo = false;
+	bool bHavePrefix = false;
+	bool bPlacedByLayout = false;
+	int editingChoice = -1;
 };
 
 class XMLEditStructUI
@@ -41,6 +55,33 @@ public:
 	void Render();
 	XMLStructData currentEditing;
 private:
-	bool bHaveInfo;
+	bool bHaveInfo = false;
 	XMLEditFieldUI fieldEditor;
+	int editingField = -1;
+
+	// Auto layout, re-solved every frame while enabled (see xml_bit_layout.h).
+	// Pinned fields keep the start bit they were given.
+	bool bAutoLayout = false;
+	bool bKeepLength = false;
+	XMLLayoutOptions layoutOptions;
+	std::vector<uint8_t> pinnedFields; // parallel to currentEditing.fields
+	XMLBitLayoutSolver layoutSolver;
+
+	void RenderLayout();
+};
+
+// Name, prefix, info and length of an existing struct or enum, without its
+// children. 'hasLength' is false for enums.
+class XMLEditHeaderUI
+{
+public:
+	void Render();
+	void SetEditing(const XMLHeaderData& data, bool hasLength);
+	XMLHeaderData currentEditing;
+private:
+	bool bHasLength = false;
+	bool bHavePrefix = false;
+	bool bHaveInfo = false;
 };
+
+#endif
@@ -0,0 +1,98 @@
+#include "xml_value_tables.h"
+#include "xml_hash.h"
+#include <algorithm>
+
+static bool SameValues(const std::vector<XMLValueData> &a,
+                       const std::vector<XMLValueData> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].value != b[i].value || a[i].name != b[i].name ||
+        a[i].prefix != b[i].prefix || a[i].info != b[i].info)
+      return false;
+  }
+  return true;
+}
+
+void XMLValueTablePool::Intern(XMLChoices &choices) {
+  if (!choices.table || choices.table->isInterned)
+    return;
+  const std::vector<XMLValueData> &values = choices.table->values;
+  uint64_t hash = ValuesHash(values);
+  auto range = tables.equal_range(hash);
+  for (auto it = range.first; it != range.second;) {
+    std::shared_ptr<const XMLValueTable> pooled = it->second.lock();
+    if (!pooled) {
+      it = tables.erase(it);
+      continue;
+    }
+    if (SameValues(pooled->values, values)) {
+      choices.table = std::move(pooled);
+      return;
+    }
+    ++it;
+  }
+
+  // First of its kind: finish it and freeze it. Other references (an edit
+  // record) only ever read it, so this is done in place.
+  XMLValueTable &table = choices.Writable();
+  for (XMLValueData &value : table.values) {
+    RehashValue(value);
+  }
+  table.byValue.resize(table.values.size());
+  for (uint32_t i = 0; i < table.byValue.size(); ++i) {
+    table.byValue[i] = i;
+  }
+  // Stable, so Find() returns the first of equal values like a scan would.
+  std::stable_sort(table.byValue.begin(), table.byValue.end(),
+                   [&table](uint32_t a, uint32_t b) {
+                     return table.values[a].value < table.values[b].value;
+                   });
+  table.valuesHash = hash;
+  table.isInterned = true;
+  tables.emplace(hash, choices.table);
+  if (++insertsSinceSweep > tables.size() / 2 + 64)
+    Sweep();
+}
+
+void XMLValueTablePool::InternStruct(XMLStructData &data) {
+  for (XMLFieldData &field : data.fields) {
+    Intern(field.choices);
+  }
+}
+
+void XMLValueTablePool::InternDoc(XMLDocData &doc) {
+  for (XMLStructData &structData : doc.structures) {
+    InternStruct(structData);
+  }
+}
+
+void XMLValueTablePool::Sweep() {
+  for (auto it = tables.begin(); it != tables.end();) {
+    if (it->second.expired())
+      it = tables.erase(it);
+    else
+      ++it;
+  }
+  insertsSinceSweep = 0;
+}
+
+size_t XMLValueTablePool::TableCount() const {
+  size_t count = 0;
+  for (const auto &entry : tables) {
+    count += entry.second.expired() ? 0 : 1;
+  }
+  return count;
+}
+
+size_t XMLValueTablePool::MemoryBytes() const {
+  return tables.bucket_count() * sizeof(void *) +
+         tables.size() *
+             (sizeof(std::pair<uint64_t, std::weak_ptr<const XMLValueTable>>) +
+              sizeof(void *));
+}
+
+void XMLValueTablePool::Clear() {
+  tables.clear();
+  insertsSinceSweep = 0;
+}
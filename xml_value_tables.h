@@ -0,0 +1,45 @@
+#ifndef __XML_VALUE_TABLES_H__
+#define __XML_VALUE_TABLES_H__
+
+#include "xml_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+// Hash-consing of field value tables (XMLChoices).
+//
+// Generated headers repeat the same few <value> lists on thousands of fields.
+// The pool keeps one immutable table per distinct list and points every
+// field with that list at it, so a list is stored, hashed and indexed for
+// lookups once. Tables are looked up by the Merkle sum of their values
+// (xml_hash.h) and compared by content on a hit.
+//
+// The pool only holds weak references: a table lives as long as a field, an
+// edit record or a copy refers to it. Edits never write to an interned
+// table, XMLChoices::Mutable() copies it first, and the copy is interned
+// again once the edit is applied.
+class XMLValueTablePool {
+public:
+  // Point 'choices' at the pooled table with the same values, adding it to
+  // the pool (and freezing it) when it is the first of its kind.
+  void Intern(XMLChoices &choices);
+  void InternStruct(XMLStructData &data);
+  void InternDoc(XMLDocData &doc);
+
+  // Distinct live tables.
+  size_t TableCount() const;
+  // Bytes of the pool itself, the tables are accounted with their fields.
+  size_t MemoryBytes() const;
+  void Clear();
+
+private:
+  std::unordered_multimap<uint64_t, std::weak_ptr<const XMLValueTable>>
+      tables;
+  // Entries of dropped tables are swept once they may make up half the pool.
+  size_t insertsSinceSweep = 0;
+
+  void Sweep();
+};
+
+#endif
@@ -0,0 +1,1201 @@
+#include "xml_viewer.h"
+#include "imgui.h"
+#include "imgui_internal.h"
+#include "imgui_stdlib.h"
+#include "xml_parser.h"
+#include "xml_exporter.h"
+#include "xml_frame_arena.h"
+#include "xml_types.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <vector>
+
+constexpr size_t MAX_PATH_SIZE = 4096;
+
+XMLViewer::XMLViewer() : XMLViewer("../gen4.xml") {}
+
+XMLViewer::XMLViewer(const std::string &initialFile) {
+  filename.reserve(MAX_PATH_SIZE);
+  filename = initialFile;
+  if (!filename.empty())
+    OnFileLoading();
+}
+
+XMLViewer::~XMLViewer() {
+  if (savingResult)
+    savingResult->wait();
+  if (loadingResult)
+    loadingResult->wait();
+}
+
+bool XMLViewer::WaitForLoading() {
+  if (loadingResult)
+    loadingResult->wait();
+  return isFileOpened;
+}
+
+void XMLViewer::EnsureAllLoaded() {
+  if (isFileOpened && xmlParserContext)
+    xmlParserContext->EnsureAllLoaded();
+}
+
+// Open the next tree node when every node is forced open
+static void ExpandNextNode(bool expandAll) {
+  if (expandAll)
+    ImGui::SetNextItemOpen(true);
+}
+
+static int PathInputChangeCallback(ImGuiInputTextCallbackData *data) {
+  *(bool *)(data->UserData) = false;
+  return 1;
+}
+
+static void XMLValueDataDrawWidget(const XMLValueData &valueData) {
+  ImGui::Text("%llu\t%s %s", valueData.value, valueData.name.c_str(),
+              (valueData.info ? valueData.info->c_str() : ""));
+}
+
+// Row operation picked in an editable table, 'row' is -1 for none.
+struct XMLRowAction {
+  int row = -1;
+  bool isRemove = false;
+};
+
+// Remove button of a field or value row. The last one of a struct or enum
+// cannot go, genxml does not load empty bodies.
+static bool RemoveChildButton(bool isLastChild) {
+  ImGui::BeginDisabled(isLastChild);
+  bool isPressed = ImGui::SmallButton("remove");
+  ImGui::EndDisabled();
+  if (isLastChild &&
+      ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) {
+    ImGui::SetTooltip("The last entry cannot be removed, an empty body does "
+                      "not load");
+  }
+  return isPressed;
+}
+
+// 'numbers' are the formatted values, see XMLLabelCache::EnumValues().
+static XMLRowAction
+XMLVecValueDataTable(const std::vector<XMLValueData> &vecValueData,
+                     const char *numbers, const char *strTableName,
+                     bool isEditable = false) {
+  XMLRowAction action;
+  if (ImGui::BeginTable(strTableName, isEditable ? 4 : 3,
+                        ImGuiTableFlags_Resizable |
+                            ImGuiTableFlags_SizingFixedFit)) {
+    ImGui::TableSetupColumn("Name", 0);
+    ImGui::TableSetupColumn("Value", 0);
+    ImGui::TableSetupColumn("Info", 0);
+    if (isEditable)
+      ImGui::TableSetupColumn("Operations", 0);
+    ImGui::TableHeadersRow();
+    for (int id = 0; id < static_cast<int>(vecValueData.size()); ++id) {
+      const auto &valueData = vecValueData[id];
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(valueData.name.c_str());
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(numbers);
+      numbers += std::strlen(numbers) + 1;
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(valueData.info ? valueData.info->c_str() : "NA");
+      if (!isEditable)
+        continue;
+      ImGui::TableNextColumn();
+      ImGui::PushID(id);
+      if (ImGui::SmallButton("edit"))
+        action.row = id;
+      ImGui::SameLine();
+      if (RemoveChildButton(vecValueData.size() == 1))
+        action = XMLRowAction{id, true};
+      ImGui::PopID();
+    }
+    ImGui::EndTable();
+  }
+  return action;
+}
+
+static void RenderDiagnosticsTable(const XMLDiagnostics &diagnostics) {
+  const auto &records = diagnostics.Records();
+  if (!ImGui::BeginTable("Diagnostics", 3,
+                         ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY |
+                             ImGuiTableFlags_RowBg,
+                         ImVec2(0.0f,
+                                ImGui::GetTextLineHeightWithSpacing() *
+                                    std::min<size_t>(records.size() + 1, 10)))) {
+    return;
+  }
+  ImGui::TableSetupScrollFreeze(0, 1);
+  ImGui::TableSetupColumn("Severity", 0);
+  ImGui::TableSetupColumn("Line", 0);
+  ImGui::TableSetupColumn("Message", 0);
+  ImGui::TableHeadersRow();
+  ImGuiListClipper clipper;
+  clipper.Begin(static_cast<int>(records.size()));
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+      const XMLDiagnostic &diagnostic = records[row];
+      char message[256];
+      diagnostics.Format(diagnostic, message, sizeof(message));
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(DiagSeverityName(diagnostic.severity));
+      ImGui::TableNextColumn();
+      if (diagnostic.line) {
+        ImGui::Text("%u", diagnostic.line);
+      }
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(message);
+    }
+  }
+  ImGui::EndTable();
+}
+
+void XMLViewer::Render() {
+  if (residency != Residency::Resident) {
+    Restore();
+  }
+  if (!isFileOpened) {
+    if (isFileLoading && !isShowFileDialog) {
+      ImGui::Text("Loading file of %s ...", filename.c_str());
+      return;
+    }
+    ImGui::Text("No file opened.");
+    if (ImGui::Button("Open")) {
+      isShowFileDialog = true;
+      ImGui::OpenPopup("File Selector");
+    }
+
+    if (isShowFileDialog) {
+      ImGui::BeginPopupModal("File Selector", NULL,
+                             ImGuiWindowFlags_AlwaysAutoResize);
+      if (isFileLoading) {
+        if (filename.empty()) {
+          ImGui::Text("Unknow error");
+        }
+        ImGui::Text("Loading file of %s ...", filename.c_str());
+      } else {
+        ImGui::InputText(
+            "Please input the absolute path of the target xml file", &filename,
+            ImGuiInputTextFlags_CallbackEdit, &PathInputChangeCallback,
+            &isShowFileLoadError);
+        if (ImGui::Button("Load")) {
+          OnFileLoading();
+        }
+        if (isShowFileLoadError) {
+          ImGui::Text("Load '%s' failed.", filename.c_str());
+          if (!loadDiagnostics.Records().empty()) {
+            RenderDiagnosticsTable(loadDiagnostics);
+          }
+        }
+      }
+      ImGui::EndPopup();
+    }
+  } else {
+    ImGui::Text("Opened file %s%s", filename.c_str(),
+                xmlParserContext->IsDirty() ? " (modified)" : "");
+    size_t pendingBodies = xmlParserContext->PumpLazyLoads();
+    if (pendingBodies > 0) {
+      ImGui::SameLine();
+      ImGui::TextDisabled("(loading %zu definitions)", pendingBodies);
+    }
+    if (recoveredEdits > 0) {
+      ImGui::SameLine();
+      ImGui::TextDisabled("(recovered %zu unsaved edit(s) from the journal)",
+                          recoveredEdits);
+    }
+    const XMLDocData &docData = xmlParserContext->parsedDoc;
+    const XMLTypeGraph &typeGraph = xmlParserContext->GetTypeGraph();
+    ExpandNextNode(isExpandAll ||
+                   (isRevealPending && revealTarget.kind == XMLTypeKind::Enum));
+    if (ImGui::TreeNode("enum(s)")) {
+      for (uint32_t e = 0; e < docData.enumerates.size(); ++e) {
+        const auto &enumData = docData.enumerates[e];
+        bool isReveal = IsRevealTarget(XMLTypeKind::Enum, e);
+        ExpandNextNode(isExpandAll || isReveal);
+        bool isOpen = ImGui::TreeNode(enumData.name.c_str());
+        if (isReveal) {
+          ImGui::SetScrollHereY();
+          isRevealPending = false;
+        }
+        ImGui::PushID(static_cast<int>(e));
+        ImGui::SameLine();
+        if (ImGui::SmallButton("edit"))
+          BeginEdit(XMLEditTarget::Enum, e, XMLQueryHit::kNoChild);
+        ImGui::PopID();
+        if (isOpen) {
+          xmlParserContext->EnsureEnum(e);
+          XMLRowAction action =
+              XMLVecValueDataTable(enumData.values,
+                                   labelCache.EnumValues(docData, e), "Values",
+                                   true);
+          if (action.isRemove) {
+            CommitChange("Remove value",
+                         RemoveValueChange(docData, e, action.row));
+          } else if (action.row >= 0) {
+            BeginEdit(XMLEditTarget::Value, e, action.row);
+          }
+          RenderUsages(typeGraph.EnumUsages(e));
+          ImGui::TreePop();
+        }
+      }
+      ImGui::TreePop();
+    }
+    ExpandNextNode(isExpandAll || (isRevealPending &&
+                                   revealTarget.kind == XMLTypeKind::Struct));
+    if (ImGui::TreeNode("struct(s)")) {
+      uint32_t firstVisible = UINT32_MAX;
+      for (uint32_t s = 0; s < docData.structures.size(); ++s) {
+        const auto &structData = docData.structures[s];
+        bool isReveal = IsRevealTarget(XMLTypeKind::Struct, s);
+        ExpandNextNode(isExpandAll || isReveal);
+        bool isOpen = ImGui::TreeNode(structData.name.c_str());
+        if (firstVisible == UINT32_MAX && ImGui::IsItemVisible())
+          firstVisible = s;
+        if (isReveal) {
+          ImGui::SetScrollHereY();
+          isRevealPending = false;
+        }
+        const char *tag = labelCache.StructTag(docData, s);
+        if (tag[0] != '\0') {
+          ImGui::SameLine();
+          ImGui::TextDisabled("%s", tag);
+        }
+        ImGui::PushID(static_cast<int>(s));
+        ImGui::SameLine();
+        if (ImGui::SmallButton("edit"))
+          BeginEdit(XMLEditTarget::Struct, s, XMLQueryHit::kNoChild);
+        ImGui::PopID();
+        if (isOpen) {
+          xmlParserContext->EnsureStruct(s);
+          uint32_t removeField = UINT32_MAX;
+          for (uint32_t f = 0; f < structData.fields.size(); ++f) {
+            const auto &fields = structData.fields[f];
+            ImGui::PushID(f);
+            bool isFieldOpen = false;
+            if (!fields.choices) {
+              ImGui::BulletText("%s", fields.name.c_str());
+              RenderFieldType(typeGraph.FieldType(s, f), fields.type);
+            } else {
+              ExpandNextNode(isExpandAll);
+              isFieldOpen = ImGui::TreeNode(fields.name.c_str());
+              RenderFieldType(typeGraph.FieldType(s, f), fields.type);
+            }
+            // Repetition of a grouped field, after its name.
+            if (fields.group < structData.groups.size()) {
+              ImGui::SameLine();
+              ImGui::TextDisabled("%s", labelCache.GroupTag(docData, s, f));
+            }
+            ImGui::SameLine();
+            if (ImGui::SmallButton("edit"))
+              BeginEdit(XMLEditTarget::Field, s, f);
+            ImGui::SameLine();
+            if (RemoveChildButton(structData.fields.size() == 1))
+              removeField = f;
+            if (isFieldOpen) {
+              XMLVecValueDataTable(fields.choices.value(),
+                                   labelCache.ChoiceValues(docData, s, f),
+                                   "Choices");
+              ImGui::TreePop();
+            }
+            ImGui::PopID();
+          }
+          if (removeField != UINT32_MAX) {
+            CommitChange("Remove field",
+                         RemoveFieldChange(docData, s, removeField));
+          }
+          if (ImGui::TreeNode("Bit layout")) {
+            layoutCache.Render(structData);
+            ImGui::TreePop();
+          }
+          RenderUsages(typeGraph.StructUsages(s));
+          ImGui::TreePop();
+        }
+      }
+      // Keep the loader working right where the user is looking.
+      if (pendingBodies > 0 && firstVisible != UINT32_MAX)
+        xmlParserContext->PrefetchStructsFrom(firstVisible);
+      ImGui::TreePop();
+    }
+
+    const auto &dangling = typeGraph.DanglingFields();
+    if (!dangling.empty() &&
+        ImGui::CollapsingHeader("Type diagnostics")) {
+      ImGui::Text("%zu field(s) with an unresolved type:", dangling.size());
+      for (const XMLFieldRef &ref : dangling) {
+        const XMLStructData &structData = docData.structures[ref.structIndex];
+        const XMLFieldData &field = structData.fields[ref.fieldIndex];
+        ImGui::BulletText("%s::%s : '%s'", structData.name.c_str(),
+                          field.name.c_str(), field.type.c_str());
+      }
+    }
+
+    const XMLDiagnostics &diagnostics = xmlParserContext->GetDiagnostics();
+    if (!diagnostics.Records().empty() &&
+        ImGui::CollapsingHeader("Load diagnostics")) {
+      RenderDiagnosticsTable(diagnostics);
+    }
+
+    RenderQueryPanel();
+    RenderSearchPanel();
+    RenderRefactorPanel();
+    RenderRegisterPanel();
+    RenderMemoryPanel();
+
+    if (ImGui::Button("Close")) {
+      OnFileClose();
+    }
+
+    ImGui::BeginDisabled(!xmlParserContext->CanUndo());
+    if (ImGui::Button("Undo") ||
+        ImGui::Shortcut(ImGuiMod_Ctrl | ImGuiKey_Z)) {
+      xmlParserContext->Undo();
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    ImGui::BeginDisabled(!xmlParserContext->CanRedo());
+    if (ImGui::Button("Redo") ||
+        ImGui::Shortcut(ImGuiMod_Ctrl | ImGuiKey_Y)) {
+      xmlParserContext->Redo();
+    }
+    ImGui::EndDisabled();
+    RenderEditPopup();
+
+    if (ImGui::Button("Save")) {
+      if (toSaveFilename.empty() && !filename.empty()) {
+        toSaveFilename = filename;
+      }
+      savingMsg.clear();
+      ImGui::OpenPopup("Save");
+    }
+    if (ImGui::BeginPopupModal("Save", NULL,
+                               ImGuiWindowFlags_AlwaysAutoResize)) {
+
+      if (!savingResult) {
+        ImGui::InputText("File", &toSaveFilename);
+        static const char *const kFormatNames[] = {"XML", "JSON",
+                                                   "Binary schema"};
+        int format = static_cast<int>(saveFormat);
+        if (ImGui::Combo("Format", &format, kFormatNames,
+                         IM_ARRAYSIZE(kFormatNames))) {
+          saveFormat = static_cast<XMLExportFormat>(format);
+          toSaveFilename = std::filesystem::path(toSaveFilename)
+                               .replace_extension(
+                                   ExportFormatExtension(saveFormat))
+                               .string();
+        }
+        if (ImGui::Button("Save")) {
+          OnFileSave();
+        }
+      } else if (savingResult->wait_for(std::chrono::seconds(0)) ==
+                 std::future_status::ready) {
+        bool isSaved = savingResult->get();
+        savingResult.reset();
+        if (isSaved)
+          OnSaved(saveFormat, toSaveFilename, savingDocHash);
+        savingMsg = isSaved ? "Saved" : "Save failed";
+      }
+      if (!savingMsg.empty()) {
+        ImGui::Text("%s.", savingMsg.c_str());
+      }
+      // no begin save or finished save
+      if (!savingResult) {
+        if (ImGui::Button("Cancel")) {
+          savingResult.reset();
+          ImGui::CloseCurrentPopup();
+        }
+      }
+      ImGui::EndPopup();
+    }
+    if (ImGui::Button("Add enum")) {
+      if (!xmlEditEnumUI) {
+        xmlEditEnumUI = std::make_unique<XMLEditEnumUI>();
+      }
+      ImGui::OpenPopup("Edit enum" );
+    }
+    if (ImGui::BeginPopupModal("Edit enum")) {
+
+      xmlEditEnumUI->Render();
+      ImGui::NewLine();
+      if (ModalOKButton()) {
+        xmlParserContext->AddEnum(xmlEditEnumUI->currentEditing);
+        xmlEditEnumUI.reset();
+        ImGui::CloseCurrentPopup();
+      }
+      ImGui::SameLine();
+
+      if (ModalCancelButton()) {
+        ImGui::CloseCurrentPopup();
+      }
+      ImGui::EndPopup();
+    }
+
+    if (ImGui::Button("Add Struct")) {
+      if (!xmlEditStructUI) xmlEditStructUI = std::make_unique<XMLEditStructUI>();
+      ImGui::OpenPopup("Edit Struct");
+    }
+    if (ImGui::BeginPopupModal("Edit Struct")) {
+      xmlEditStructUI->Render();
+      if (ModalOKButton()) {
+        xmlParserContext->AddStruct(xmlEditStructUI->currentEditing);
+        xmlEditStructUI.reset();
+        ImGui::CloseCurrentPopup();
+      }
+      ImGui::SameLine();
+      if (ModalCancelButton()) {
+        ImGui::CloseCurrentPopup();
+      }
+      ImGui::EndPopup();
+    }
+
+  }
+}
+
+bool XMLViewer::IsRevealTarget(XMLTypeKind kind, uint32_t index) const {
+  return isRevealPending && revealTarget.kind == kind &&
+         revealTarget.index == index;
+}
+
+void XMLViewer::RequestReveal(const XMLTypeRef &target) {
+  revealTarget = target;
+  isRevealPending = true;
+}
+
+void XMLViewer::BeginEdit(XMLEditTarget target, uint32_t parent,
+                          uint32_t child) {
+  const XMLDocData &docData = xmlParserContext->GetDoc();
+  switch (target) {
+  case XMLEditTarget::Struct:
+    headerEditor.SetEditing(StructHeader(docData.structures[parent]), true);
+    break;
+  case XMLEditTarget::Enum:
+    headerEditor.SetEditing(EnumHeader(docData.enumerates[parent]), false);
+    break;
+  case XMLEditTarget::Field:
+    fieldEditor.SetEditing(docData.structures[parent].fields[child]);
+    break;
+  case XMLEditTarget::Value:
+    valueEditor.SetEditing(docData.enumerates[parent].values[child]);
+    break;
+  }
+  editTarget = target;
+  editParent = parent;
+  editChild = child;
+  // Opened from RenderEditPopup(), at the popup's ID scope.
+  isEditPending = true;
+}
+
+void XMLViewer::CommitChange(const char *label, XMLChange change) {
+  XMLChangeSet changes;
+  changes.label = label;
+  changes.changes.push_back(std::move(change));
+  xmlParserContext->ApplyChanges(std::move(changes));
+}
+
+void XMLViewer::RenderEditPopup() {
+  if (isEditPending) {
+    ImGui::OpenPopup("Edit in place");
+    isEditPending = false;
+  }
+  if (!ImGui::BeginPopupModal("Edit in place", NULL,
+                              ImGuiWindowFlags_AlwaysAutoResize)) {
+    return;
+  }
+  switch (editTarget) {
+  case XMLEditTarget::Struct:
+  case XMLEditTarget::Enum:
+    headerEditor.Render();
+    break;
+  case XMLEditTarget::Field:
+    fieldEditor.Render();
+    // Positions inside a group are relative to it, nothing to search there.
+    ImGui::BeginDisabled(fieldEditor.currentEditing.group !=
+                         XMLGroupData::kNoGroup);
+    if (ImGui::Button("Find free bits"))
+      PlaceEditedField();
+    ImGui::EndDisabled();
+    break;
+  case XMLEditTarget::Value:
+    valueEditor.Render();
+    break;
+  }
+  ImGui::NewLine();
+  if (ModalOKButton()) {
+    const XMLDocData &docData = xmlParserContext->GetDoc();
+    switch (editTarget) {
+    case XMLEditTarget::Struct:
+      CommitChange("Edit struct",
+                   SetStructHeaderChange(docData, editParent,
+                                         headerEditor.currentEditing));
+      break;
+    case XMLEditTarget::Enum:
+      CommitChange("Edit enum", SetEnumHeaderChange(
+                                    docData, editParent,
+                                    headerEditor.currentEditing));
+      break;
+    case XMLEditTarget::Field:
+      CommitChange("Edit field",
+                   SetFieldChange(docData, editParent, editChild,
+                                  fieldEditor.currentEditing));
+      break;
+    case XMLEditTarget::Value:
+      CommitChange("Edit value",
+                   SetValueChange(docData, editParent, editChild,
+                                  valueEditor.currentEditing));
+      break;
+    }
+    ImGui::CloseCurrentPopup();
+  }
+  ImGui::SameLine();
+  if (ModalCancelButton()) {
+    ImGui::CloseCurrentPopup();
+  }
+  ImGui::EndPopup();
+}
+
+// Move the edited field to the first bits no other field of its struct
+// uses, within the struct's length if possible and past its end otherwise.
+void XMLViewer::PlaceEditedField() {
+  const XMLStructData &structData =
+      xmlParserContext->GetDoc().structures[editParent];
+  XMLLayoutOptions options;
+  options.goal = XMLLayoutGoal::Dwords;
+  options.maxBits = structData.length * 32;
+  if (!layoutSolver.PlaceField(structData, editChild,
+                               fieldEditor.currentEditing, options)) {
+    options.maxBits = 0;
+    layoutSolver.PlaceField(structData, editChild, fieldEditor.currentEditing,
+                            options);
+  }
+}
+
+void XMLViewer::RenderFieldType(const XMLTypeRef &ref,
+                                const std::string &type) {
+  ImGui::SameLine();
+  switch (ref.kind) {
+  case XMLTypeKind::Builtin:
+    ImGui::TextDisabled("%s", type.c_str());
+    break;
+  case XMLTypeKind::Enum:
+  case XMLTypeKind::Struct:
+    if (ImGui::SmallButton(type.c_str())) {
+      RequestReveal(ref);
+    }
+    if (ImGui::IsItemHovered()) {
+      ImGui::SetTooltip("Go to %s definition",
+                        ref.kind == XMLTypeKind::Enum ? "enum" : "struct");
+    }
+    break;
+  case XMLTypeKind::Unresolved:
+    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s (unresolved)",
+                       type.c_str());
+    break;
+  }
+}
+
+void XMLViewer::RenderUsages(const std::vector<XMLFieldRef> &usages) {
+  if (usages.empty()) {
+    return;
+  }
+  if (!ImGui::TreeNode("Usages", "Used by %zu field(s)", usages.size())) {
+    return;
+  }
+  const XMLDocData &docData = xmlParserContext->GetDoc();
+  XMLFrameArena &arena = GetFrameArena();
+  for (size_t i = 0; i < usages.size(); ++i) {
+    const XMLStructData &structData = docData.structures[usages[i].structIndex];
+    const char *label =
+        arena.Format("%s::%s", structData.name.c_str(),
+                     structData.fields[usages[i].fieldIndex].name.c_str());
+    ImGui::PushID(static_cast<int>(i));
+    if (ImGui::Selectable(label)) {
+      RequestReveal(XMLTypeRef{XMLTypeKind::Struct, XMLBuiltinType::None,
+                               usages[i].structIndex});
+    }
+    ImGui::PopID();
+  }
+  ImGui::TreePop();
+}
+
+void XMLViewer::RenderQueryPanel() {
+  if (!ImGui::CollapsingHeader("Query")) {
+    return;
+  }
+  const XMLDocData &docData = xmlParserContext->GetDoc();
+  if (ImGui::InputText("Query", &queryText)) {
+    isQueryDirty = true;
+  }
+  if (ImGui::IsItemHovered()) {
+    ImGui::SetTooltip("e.g. 'field type=uint', 'field straddle', "
+                      "'struct length>16', 'enum value>255'");
+  }
+  if (ImGui::InputText("Filter results", &queryFilter)) {
+    isQueryFilterDirty = true;
+  }
+
+  if (isQueryDirty || queryDocHash != docData.contentHash) {
+    queryHits.clear();
+    queryError.clear();
+    if (!queryText.empty() && query.Compile(queryText, queryError)) {
+      xmlParserContext->EnsureAllLoaded();
+      query.Evaluate(docData, xmlParserContext->GetIndex(), queryHits);
+    }
+    queryDocHash = docData.contentHash;
+    isQueryDirty = false;
+    isQueryFilterDirty = true;
+  }
+  if (isQueryFilterDirty) {
+    queryVisibleHits.clear();
+    for (uint32_t i = 0; i < queryHits.size(); ++i) {
+      const std::string &name = QueryHitName(docData, queryHits[i]);
+      if (queryFilter.empty() || name.find(queryFilter) != std::string::npos) {
+        queryVisibleHits.push_back(i);
+      }
+    }
+    isQueryFilterDirty = false;
+  }
+
+  if (!queryError.empty()) {
+    ImGui::Text("Error: %s", queryError.c_str());
+    return;
+  }
+  ImGui::Text("%zu result(s)", queryVisibleHits.size());
+  if (ImGui::BeginTable("Query Results", 4,
+                        ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY |
+                            ImGuiTableFlags_RowBg,
+                        ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 12))) {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Kind", 0);
+    ImGui::TableSetupColumn("Name", 0);
+    ImGui::TableSetupColumn("Parent", 0);
+    ImGui::TableSetupColumn("Detail", 0);
+    ImGui::TableHeadersRow();
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(queryVisibleHits.size()));
+    while (clipper.Step()) {
+      for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+        const XMLQueryHit &hit = queryHits[queryVisibleHits[row]];
+        char detail[128];
+        QueryHitDetail(docData, hit, detail, sizeof(detail));
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(QueryKindName(hit.kind));
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(QueryHitName(docData, hit).c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(QueryHitParentName(docData, hit).c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(detail);
+      }
+    }
+    ImGui::EndTable();
+  }
+}
+
+void XMLViewer::RenderSearchPanel() {
+  if (!ImGui::CollapsingHeader("Search")) {
+    return;
+  }
+  const XMLDocData &docData = xmlParserContext->GetDoc();
+  if (ImGui::InputText("Search", &searchText)) {
+    isSearchDirty = true;
+  }
+  if (ImGui::IsItemHovered()) {
+    ImGui::SetTooltip("Substring of any name or info text");
+  }
+  isSearchDirty |= ImGui::Checkbox("Case sensitive", &searchOptions.caseSensitive);
+  ImGui::SameLine();
+  isSearchDirty |= ImGui::Checkbox("Regex", &searchOptions.regex);
+  ImGui::SameLine();
+  isSearchDirty |= ImGui::Checkbox("Names", &searchOptions.names);
+  ImGui::SameLine();
+  isSearchDirty |= ImGui::Checkbox("Info", &searchOptions.infos);
+
+  if (!searchCorpus || searchDocHash != docData.contentHash) {
+    xmlParserContext->EnsureAllLoaded();
+    auto corpus = std::make_shared<XMLSearchCorpus>();
+    corpus->Build(docData);
+    searchCorpus = std::move(corpus);
+    searchDocHash = docData.contentHash;
+    isSearchDirty = true;
+  }
+  if (isSearchDirty) {
+    if (!textSearch) {
+      textSearch = std::make_unique<XMLTextSearch>();
+    }
+    searchHits.clear();
+    searchError.clear();
+    isSearching = false;
+    if (searchText.empty()) {
+      textSearch->Cancel();
+    } else {
+      isSearching = textSearch->Start(searchCorpus, searchText, searchOptions,
+                                      searchError);
+    }
+    isSearchDirty = false;
+  }
+  if (isSearching) {
+    isSearching = textSearch->Poll(searchHits);
+  }
+
+  if (!searchError.empty()) {
+    ImGui::Text("Error: %s", searchError.c_str());
+    return;
+  }
+  ImGui::Text("%zu hit(s)%s", searchHits.size(),
+              isSearching ? " (searching...)" : "");
+  if (ImGui::BeginTable("Search Results", 4,
+                        ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY |
+                            ImGuiTableFlags_RowBg,
+                        ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 12))) {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Kind", 0);
+    ImGui::TableSetupColumn("Name", 0);
+    ImGui::TableSetupColumn("Parent", 0);
+    ImGui::TableSetupColumn("Match", 0);
+    ImGui::TableHeadersRow();
+    const auto &entries = searchCorpus->Entries();
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(searchHits.size()));
+    while (clipper.Step()) {
+      for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+        const XMLSearchHit &hit = searchHits[row];
+        const XMLSearchCorpus::Entry &entry = entries[hit.entry];
+        std::string_view text = searchCorpus->Text(entry);
+        // Show the match with a little leading context.
+        size_t from = hit.matchOffset > 24 ? hit.matchOffset - 24 : 0;
+        std::string_view excerpt = text.substr(from, 96);
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(QueryKindName(entry.target.kind));
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(QueryHitName(docData, entry.target).c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(QueryHitParentName(docData, entry.target).c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(from > 0 ? "..." : "");
+        ImGui::SameLine(0.0f, 0.0f);
+        ImGui::TextUnformatted(excerpt.data(), excerpt.data() + excerpt.size());
+      }
+    }
+    ImGui::EndTable();
+  }
+}
+
+// The node a change applies to, as a query hit for the naming helpers.
+static XMLQueryHit ChangeTargetHit(const XMLChange &change) {
+  XMLQueryKind kind = XMLQueryKind::Field;
+  switch (change.target) {
+  case XMLEditTarget::Struct:
+    kind = XMLQueryKind::Struct;
+    break;
+  case XMLEditTarget::Enum:
+    kind = XMLQueryKind::Enum;
+    break;
+  case XMLEditTarget::Field:
+    kind = XMLQueryKind::Field;
+    break;
+  case XMLEditTarget::Value:
+    kind = XMLQueryKind::Value;
+    break;
+  }
+  return XMLQueryHit{kind, change.parent, change.child};
+}
+
+void XMLViewer::RenderRefactorPanel() {
+  if (!ImGui::CollapsingHeader("Refactor")) {
+    return;
+  }
+  static const char *const kKindNames[] = {
+      RefactorKindName(XMLRefactorKind::ShiftFields),
+      RefactorKindName(XMLRefactorKind::Retype),
+      RefactorKindName(XMLRefactorKind::RenamePrefix),
+      RefactorKindName(XMLRefactorKind::RenumberValues)};
+  bool isEdited = false;
+  int kind = static_cast<int>(refactor.kind);
+  if (ImGui::Combo("Operation", &kind, kKindNames, IM_ARRAYSIZE(kKindNames))) {
+    refactor.kind = static_cast<XMLRefactorKind>(kind);
+    isEdited = true;
+  }
+  isEdited |= ImGui::InputText("Scope", &refactor.scope);
+  if (ImGui::IsItemHovered()) {
+    ImGui::SetTooltip("Struct or enum names, '*' and '?' match any text or "
+                      "character; empty for all");
+  }
+  switch (refactor.kind) {
+  case XMLRefactorKind::ShiftFields:
+    isEdited |= ImGui::InputScalar("From bit", ImGuiDataType_U32,
+                                   &refactor.fromBit);
+    isEdited |= ImGui::InputScalar("Shift by", ImGuiDataType_S32,
+                                   &refactor.shift);
+    break;
+  case XMLRefactorKind::Retype:
+  case XMLRefactorKind::RenamePrefix:
+    isEdited |= ImGui::InputText("From", &refactor.from);
+    isEdited |= ImGui::InputText("To", &refactor.to);
+    break;
+  case XMLRefactorKind::RenumberValues:
+    isEdited |= ImGui::InputScalar("First", ImGuiDataType_U64,
+                                   &refactor.first);
+    isEdited |= ImGui::InputScalar("Step", ImGuiDataType_U64, &refactor.step);
+    break;
+  }
+
+  const XMLDocData &docData = xmlParserContext->GetDoc();
+  if (isEdited || (hasRefactorPreview && refactorDocHash != docData.contentHash)) {
+    hasRefactorPreview = false;
+    refactorPreview = XMLChangeSet();
+  }
+  if (ImGui::Button("Preview")) {
+    xmlParserContext->EnsureAllLoaded();
+    refactorError.clear();
+    hasRefactorPreview =
+        PlanRefactor(docData, refactor, refactorPreview, refactorError);
+    refactorDocHash = docData.contentHash;
+  }
+  if (!refactorError.empty()) {
+    ImGui::Text("Error: %s", refactorError.c_str());
+  }
+  if (!hasRefactorPreview) {
+    return;
+  }
+  const auto &changes = refactorPreview.changes;
+  ImGui::SameLine();
+  ImGui::BeginDisabled(changes.empty());
+  if (ImGui::Button("Apply")) {
+    if (!xmlParserContext->ApplyChanges(std::move(refactorPreview))) {
+      refactorError = "the document no longer matches the preview";
+    }
+    hasRefactorPreview = false;
+    refactorPreview = XMLChangeSet();
+    ImGui::EndDisabled();
+    return;
+  }
+  ImGui::EndDisabled();
+  ImGui::Text("%zu change(s)", changes.size());
+  if (ImGui::BeginTable("Refactor Preview", 4,
+                        ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY |
+                            ImGuiTableFlags_RowBg,
+                        ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 12))) {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Parent", 0);
+    ImGui::TableSetupColumn("Name", 0);
+    ImGui::TableSetupColumn("Before", 0);
+    ImGui::TableSetupColumn("After", 0);
+    ImGui::TableHeadersRow();
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(changes.size()));
+    while (clipper.Step()) {
+      for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+        const XMLChange &change = changes[row];
+        XMLQueryHit hit = ChangeTargetHit(change);
+        char detail[128];
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(QueryHitParentName(docData, hit).c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(QueryHitName(docData, hit).c_str());
+        ImGui::TableNextColumn();
+        EditNodeDetail(change.before, detail, sizeof(detail));
+        ImGui::TextUnformatted(detail);
+        ImGui::TableNextColumn();
+        EditNodeDetail(change.after, detail, sizeof(detail));
+        ImGui::TextUnformatted(detail);
+      }
+    }
+    ImGui::EndTable();
+  }
+}
+
+void XMLViewer::RenderRegisterPanel() {
+  if (!ImGui::CollapsingHeader("Registers")) {
+    return;
+  }
+  // The address index is built with the query index.
+  if (!xmlParserContext->IsFullyLoaded()) {
+    ImGui::TextDisabled("Available once every definition is loaded.");
+    return;
+  }
+  const XMLDocData &docData = xmlParserContext->GetDoc();
+  isRegisterDirty |= ImGui::InputScalar("Address", ImGuiDataType_U64,
+                                        &registerAddress, nullptr, nullptr,
+                                        "%llX");
+  isRegisterDirty |= ImGui::InputScalar("Value", ImGuiDataType_U32,
+                                        &registerValue, nullptr, nullptr,
+                                        "%08X");
+  if (isRegisterDirty || registerDocHash != docData.contentHash) {
+    registerIndex = UINT32_MAX;
+    registerFields.clear();
+    uint32_t structIndex;
+    if (xmlParserContext->GetIndex().FindRegister(docData, registerAddress,
+                                                  structIndex)) {
+      // The value is the dword at the address, other dwords of a wider
+      // register read as zero.
+      const XMLStructData &reg = docData.structures[structIndex];
+      const size_t dwordCount = std::max(reg.length, 1u);
+      uint32_t *dwords = GetFrameArena().AllocateArray<uint32_t>(dwordCount);
+      dwords[(registerAddress - reg.address.value()) / 4] = registerValue;
+      XMLDecoder decoder(docData, xmlParserContext->GetTypeGraph());
+      decoder.DecodeStruct(structIndex, dwords, dwordCount, registerFields);
+      registerIndex = structIndex;
+    }
+    registerDocHash = docData.contentHash;
+    isRegisterDirty = false;
+  }
+
+  if (registerIndex == UINT32_MAX) {
+    ImGui::TextDisabled("No register covers this address.");
+    return;
+  }
+  const XMLStructData &reg = docData.structures[registerIndex];
+  if (ImGui::SmallButton(reg.name.c_str())) {
+    RequestReveal(
+        XMLTypeRef{XMLTypeKind::Struct, XMLBuiltinType::None, registerIndex});
+  }
+  ImGui::SameLine();
+  ImGui::TextDisabled("at 0x%llx, %u dword(s)",
+                      static_cast<unsigned long long>(reg.address.value()),
+                      reg.length);
+  if (ImGui::BeginTable("Register fields", 3,
+                        ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable)) {
+    ImGui::TableSetupColumn("Field", 0);
+    ImGui::TableSetupColumn("Bits", 0);
+    ImGui::TableSetupColumn("Value", 0);
+    ImGui::TableHeadersRow();
+    for (const XMLDecodedField &decoded : registerFields) {
+      const XMLFieldData &field = reg.fields[decoded.fieldIndex];
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(field.name.c_str());
+      ImGui::TableNextColumn();
+      ImGui::Text("%u..%u", decoded.start,
+                  decoded.start + (field.end - field.start));
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(decoded.text.c_str());
+    }
+    ImGui::EndTable();
+  }
+}
+
+void XMLViewer::RenderMemoryPanel() {
+  if (!ImGui::CollapsingHeader("Memory")) {
+    return;
+  }
+  const XMLDocData &docData = xmlParserContext->GetDoc();
+  bool refresh = ImGui::SmallButton("Refresh");
+  if (refresh || !isMemReportValid || memDocHash != docData.contentHash) {
+    memReport = XMLMemReport();
+    xmlParserContext->BuildMemoryReport(memReport);
+    // The caches only know their bytes, not their block counts.
+    memReport[XMLMemCategory::Indexes].Add(layoutCache.MemoryBytes(), 0, 1);
+    memReport[XMLMemCategory::Indexes].Add(labelCache.MemoryBytes(), 0, 1);
+    if (searchCorpus) {
+      memReport[XMLMemCategory::Indexes].Add(searchCorpus->MemoryBytes(), 0, 1);
+    }
+    memDocHash = docData.contentHash;
+    isMemReportValid = true;
+  }
+
+  if (ImGui::BeginTable("Memory", 4,
+                        ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+    ImGui::TableSetupColumn("Category", 0);
+    ImGui::TableSetupColumn("Bytes", 0);
+    ImGui::TableSetupColumn("Allocations", 0);
+    ImGui::TableSetupColumn("Objects", 0);
+    ImGui::TableHeadersRow();
+    auto row = [](const char *name, const XMLMemBucket &bucket) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(name);
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", static_cast<unsigned long long>(bucket.bytes));
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", static_cast<unsigned long long>(bucket.allocations));
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", static_cast<unsigned long long>(bucket.objects));
+    };
+    for (size_t c = 0; c < static_cast<size_t>(XMLMemCategory::Count); ++c) {
+      row(MemCategoryName(static_cast<XMLMemCategory>(c)),
+          memReport.buckets[c]);
+    }
+    row("total", memReport.Total());
+    ImGui::EndTable();
+  }
+
+  if (IsAllocCounterEnabled()) {
+    const XMLAllocStats &load = memReport.loadAllocs;
+    XMLAllocStats now = GetAllocStats();
+    ImGui::Text("Load: %llu allocations, %llu bytes",
+                static_cast<unsigned long long>(load.allocations),
+                static_cast<unsigned long long>(load.bytesAllocated));
+    ImGui::Text("Process: %llu live bytes, %llu allocations so far",
+                static_cast<unsigned long long>(now.liveBytes),
+                static_cast<unsigned long long>(now.allocations));
+  } else {
+    ImGui::TextDisabled("Build with GENXML_COUNTING_ALLOCATOR for heap "
+                        "counters.");
+  }
+}
+
+bool XMLViewer::IsDirty() const {
+  return isFileOpened && !isFileLoading && xmlParserContext &&
+         xmlParserContext->IsDirty();
+}
+
+size_t XMLViewer::MemoryBytes() const {
+  if (!isFileOpened || isFileLoading || !xmlParserContext) {
+    return 0;
+  }
+  XMLMemReport report;
+  xmlParserContext->BuildMemoryReport(report);
+  return report.Total().bytes + layoutCache.MemoryBytes() +
+         labelCache.MemoryBytes() +
+         (searchCorpus ? searchCorpus->MemoryBytes() : 0);
+}
+
+void XMLViewer::ReleaseCaches() {
+  hasRefactorPreview = false;
+  refactorPreview = XMLChangeSet();
+  layoutCache.Clear();
+  labelCache.Clear();
+  std::vector<XMLQueryHit>().swap(queryHits);
+  std::vector<uint32_t>().swap(queryVisibleHits);
+  isQueryDirty = true;
+  if (textSearch) {
+    textSearch->Cancel();
+  }
+  searchCorpus.reset();
+  std::vector<XMLSearchHit>().swap(searchHits);
+  isSearching = false;
+  isMemReportValid = false;
+}
+
+void XMLViewer::Compact() {
+  if (residency != Residency::Resident || !isFileOpened || isFileLoading) {
+    return;
+  }
+  xmlParserContext->Compact();
+  ReleaseCaches();
+  residency = Residency::Compact;
+}
+
+bool XMLViewer::Drop() {
+  if (residency == Residency::Dropped || !isFileOpened || isFileLoading ||
+      xmlParserContext->IsDirty()) {
+    return false;
+  }
+  xmlParserContext.reset();
+  ReleaseCaches();
+  isFileOpened = false;
+  residency = Residency::Dropped;
+  return true;
+}
+
+void XMLViewer::Restore() {
+  switch (residency) {
+  case Residency::Resident:
+    return;
+  case Residency::Compact:
+    xmlParserContext->Expand();
+    break;
+  case Residency::Dropped:
+    OnFileLoading();
+    break;
+  }
+  residency = Residency::Resident;
+}
+
+void XMLViewer::OnFileLoading() {
+  isFileLoading = true;
+  isShowFileLoadError = false;
+  if (loadingResult)
+    loadingResult->wait();
+  auto newLoadingResult = std::make_unique<std::future<bool>>(
+      std::async(std::launch::async, [this]() {
+        auto parserContextPtr =
+            std::make_unique<XMLParserContext>(this->filename);
+        bool parseResult =
+            parserContextPtr->init(XMLLoadMode::LazyBackground);
+        if (parseResult) {
+          recoveredEdits = parserContextPtr->EnableJournal();
+          this->xmlParserContext.swap(parserContextPtr);
+          isFileOpened = true;
+          isShowFileDialog = false;
+        } else {
+          loadDiagnostics = parserContextPtr->GetDiagnostics();
+          isShowFileLoadError = true;
+        }
+
+        isFileLoading = false;
+        return parseResult;
+      }));
+  loadingResult.swap(newLoadingResult);
+}
+
+void XMLViewer::OnFileClose() {
+  if (isFileLoading) {
+    loadingResult->wait();
+  }
+  xmlParserContext.reset();
+  ReleaseCaches();
+  isFileLoading = false;
+  isFileOpened = false;
+}
+
+// Only the export itself runs on the saving thread; the checks before and
+// the bookkeeping after it happen here on the UI thread.
+void XMLViewer::OnFileSave() {
+  xmlParserContext->EnsureAllLoaded();
+  if (!CanSave())
+    return;
+  savingMsg = "Saving ...";
+  savingDocHash = xmlParserContext->parsedDoc.contentHash;
+  const XMLDocData *docData = &xmlParserContext->parsedDoc;
+  savingResult = std::make_unique<std::future<bool>>(
+      std::async(std::launch::async,
+                 [docData, format = saveFormat, file = toSaveFilename]() {
+                   return ExportDoc(*docData, format, file.c_str());
+                 }));
+}
+
+bool XMLViewer::SaveAs(const std::string &file) {
+  if (!isFileOpened || savingResult)
+    return false;
+  xmlParserContext->EnsureAllLoaded();
+  if (!CanSave())
+    return false;
+  uint64_t docHash = xmlParserContext->parsedDoc.contentHash;
+  if (!ExportDoc(xmlParserContext->parsedDoc, XMLExportFormat::Xml,
+                 file.c_str()))
+    return false;
+  OnSaved(XMLExportFormat::Xml, file, docHash);
+  return true;
+}
+
+bool XMLViewer::CanSave() {
+  size_t failedBodies = xmlParserContext->FailedBodyCount();
+  if (failedBodies == 0)
+    return true;
+  // Their BodyNotLoaded diagnostics are under "Load diagnostics".
+  savingMsg = "Not saved: " + std::to_string(failedBodies) +
+              " definition(s) failed to load, see the load diagnostics";
+  std::fprintf(stderr, "Error: %s.\n", savingMsg.c_str());
+  return false;
+}
+
+void XMLViewer::OnSaved(XMLExportFormat format, const std::string &file,
+                        uint64_t docHash) {
+  // Only XML can be loaded back, the other formats are exports.
+  if (format != XMLExportFormat::Xml)
+    return;
+  xmlParserContext->MarkSaved(docHash);
+  if (file == filename)
+    xmlParserContext->ResetJournal();
+}
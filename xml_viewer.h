@@ -0,0 +1,160 @@
+#ifndef __XML_VIEWER_H__
+#define __XML_VIEWER_H__
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "xml_decoder.h"
+#include "xml_exporter.h"
+#include "xml_label_cache.h"
+#include "xml_layout_view.h"
+#include "xml_parser.h"
+#include "xml_refactor.h"
+#include "xml_search.h"
+#include "xml_types.h"
+#include "xml_ui.h"
+
+class XMLViewer
+{
+public:
+	XMLViewer();
+	explicit XMLViewer(const std::string& initialFile);
+	// Waits for a running load or save, both use the parser context.
+	~XMLViewer();
+	void Render();
+
+	// Block until the pending load finished, returns whether a file is open.
+	bool WaitForLoading();
+	// Commit every lazily loaded definition now instead of in later frames.
+	void EnsureAllLoaded();
+	// Force every tree node open, used to stress the full per-frame UI build.
+	void SetExpandAll(bool expandAll) { isExpandAll = expandAll; }
+	// Save the open document as XML and block until it is written, false
+	// while nothing is open or a save from the UI is still running.
+	bool SaveAs(const std::string& file);
+
+	// How much of the document is kept while its tab is in the background,
+	// see XMLWorkspace. Render() always restores it first.
+	enum class Residency { Resident, Compact, Dropped };
+	Residency GetResidency() const { return residency; }
+	bool IsDocumentOpen() const { return isFileOpened; }
+	// A load or save is running; the tab cannot be closed meanwhile.
+	bool IsBusy() const { return isFileLoading || savingResult != nullptr; }
+	bool IsDirty() const;
+	const std::string& GetFilename() const { return filename; }
+	// Heap bytes of the document and its caches, 0 while nothing is loaded.
+	size_t MemoryBytes() const;
+	// Keep only the compact symbol id form of the document.
+	void Compact();
+	// Release the document entirely, it is reloaded from its file on Restore().
+	// Refused for modified documents.
+	bool Drop();
+	void Restore();
+private:
+	std::string filename;
+	std::string toSaveFilename;
+	std::string loadingErrorMsg;
+	// Diagnostics of the last failed load, the open document has its own.
+	XMLDiagnostics loadDiagnostics;
+	std::string savingMsg;
+	uint64_t savingDocHash = 0; // content hash the running save writes
+	XMLExportFormat saveFormat = XMLExportFormat::Xml;
+	bool isFileOpened = false;
+	bool isShowFileDialog = false;
+	bool isShowFileLoadError = false;
+	bool isFileLoading = false;
+	bool isExpandAll = false;
+	Residency residency = Residency::Resident;
+	// Unsaved edits replayed from the journal when the file was opened.
+	size_t recoveredEdits = 0;
+
+	// Query panel state, re-evaluated when the text or the document changes.
+	std::string queryText;
+	std::string queryFilter;
+	std::string queryError;
+	XMLQuery query;
+	std::vector<XMLQueryHit> queryHits;
+	std::vector<uint32_t> queryVisibleHits;
+	uint64_t queryDocHash = 0;
+	bool isQueryDirty = false;
+	bool isQueryFilterDirty = false;
+
+	// Search panel state, the corpus is rebuilt when the document changes and
+	// hits stream in from the search worker.
+	std::string searchText;
+	std::string searchError;
+	XMLSearchOptions searchOptions;
+	std::shared_ptr<const XMLSearchCorpus> searchCorpus;
+	std::vector<XMLSearchHit> searchHits;
+	std::unique_ptr<XMLTextSearch> textSearch;
+	uint64_t searchDocHash = 0;
+	bool isSearchDirty = false;
+	bool isSearching = false;
+
+	// Refactor panel, the planned change set is the preview and is dropped
+	// when the document changes under it.
+	XMLRefactor refactor;
+	XMLChangeSet refactorPreview;
+	std::string refactorError;
+	uint64_t refactorDocHash = 0;
+	bool hasRefactorPreview = false;
+
+	// Register panel: the register covering an MMIO address, decoded with
+	// one dword value, redone when either or the document changes.
+	uint64_t registerAddress = 0;
+	uint32_t registerValue = 0;
+	uint32_t registerIndex = UINT32_MAX;
+	std::vector<XMLDecodedField> registerFields;
+	uint64_t registerDocHash = 0;
+	bool isRegisterDirty = true;
+
+	XMLLayoutCache layoutCache;
+	XMLLabelCache labelCache;
+
+	// Memory panel, rebuilt when the document changes or on request.
+	XMLMemReport memReport;
+	uint64_t memDocHash = 0;
+	bool isMemReportValid = false;
+
+	// In-place edit of one node of the open document (see xml_edit.h); the
+	// editors hold a copy of just that node, committed as one change set.
+	XMLEditTarget editTarget = XMLEditTarget::Field;
+	uint32_t editParent = 0;
+	uint32_t editChild = 0;
+	bool isEditPending = false;
+	XMLEditHeaderUI headerEditor;
+	XMLEditFieldUI fieldEditor;
+	XMLEditValueUI valueEditor;
+	XMLBitLayoutSolver layoutSolver; // "Find free bits" of the field editor
+
+	// "Go to definition" target, opened and scrolled to on the next frame.
+	XMLTypeRef revealTarget;
+	bool isRevealPending = false;
+
+	bool IsRevealTarget(XMLTypeKind kind, uint32_t index) const;
+	void RequestReveal(const XMLTypeRef& target);
+	void RenderFieldType(const XMLTypeRef& ref, const std::string& type);
+	void RenderUsages(const std::vector<XMLFieldRef>& usages);
+	void BeginEdit(XMLEditTarget target, uint32_t parent, uint32_t child);
+	void RenderEditPopup();
+	void PlaceEditedField();
+	void CommitChange(const char* label, XMLChange change);
+	void RenderQueryPanel();
+	void RenderSearchPanel();
+	void RenderRefactorPanel();
+	void RenderRegisterPanel();
+	void RenderMemoryPanel();
+	void ReleaseCaches();
+	void OnFileLoading();
+	void OnFileClose();
+	void OnFileSave();
+	bool CanSave();
+	void OnSaved(XMLExportFormat format, const std::string& file, uint64_t docHash);
+	std::unique_ptr<std::future<bool>> loadingResult;
+	std::unique_ptr<std::future<bool>> savingResult;
+	std::unique_ptr<XMLParserContext> xmlParserContext;
+	std::unique_ptr<XMLEditEnumUI> xmlEditEnumUI;
+	std::unique_ptr<XMLEditStructUI> xmlEditStructUI;
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "xml_workspace.h"
+#include "imgui.h"
+#include "xml_frame_arena.h"
+#include <algorithm>
+
+XMLWorkspace::XMLWorkspace(size_t memoryBudget) : memoryBudget(memoryBudget) {}
+
+void XMLWorkspace::Open(const std::string &file) {
+  Tab tab;
+  tab.id = nextTabId++;
+  tab.viewer = std::make_unique<XMLViewer>(file);
+  tab.viewer->SetExpandAll(isExpandAll);
+  tab.lastUsed = ++useClock;
+  tabs.emplace_back(std::move(tab));
+  isBudgetDirty = true;
+}
+
+void XMLWorkspace::SetMemoryBudget(size_t bytes) {
+  memoryBudget = bytes;
+  isBudgetDirty = true;
+}
+
+bool XMLWorkspace::WaitForLoading() {
+  bool isAllOpen = true;
+  for (Tab &tab : tabs) {
+    // Empty tabs show a file selector and dropped ones reload when selected,
+    // neither has a load to wait for.
+    if (tab.viewer->GetFilename().empty() ||
+        tab.viewer->GetResidency() == XMLViewer::Residency::Dropped)
+      continue;
+    if (!tab.viewer->WaitForLoading())
+      isAllOpen = false;
+  }
+  return isAllOpen;
+}
+
+void XMLWorkspace::SetExpandAll(bool expandAll) {
+  isExpandAll = expandAll;
+  for (Tab &tab : tabs)
+    tab.viewer->SetExpandAll(expandAll);
+}
+
+bool XMLWorkspace::SaveActive(const std::string &file) {
+  for (Tab &tab : tabs) {
+    if (tab.id == activeTab)
+      return tab.viewer->SaveAs(file);
+  }
+  return false;
+}
+
+void XMLWorkspace::EnforceBudget() {
+  std::vector<Tab *> background;
+  totalBytes = 0;
+  for (Tab &tab : tabs) {
+    tab.memoryBytes = tab.viewer->MemoryBytes();
+    totalBytes += tab.memoryBytes;
+    if (tab.id != activeTab)
+      background.push_back(&tab);
+  }
+  std::sort(background.begin(), background.end(),
+            [](const Tab *a, const Tab *b) { return a->lastUsed < b->lastUsed; });
+
+  for (Tab *tab : background) {
+    if (totalBytes <= memoryBudget)
+      return;
+    if (tab->viewer->GetResidency() != XMLViewer::Residency::Resident)
+      continue;
+    tab->viewer->Compact();
+    size_t bytes = tab->viewer->MemoryBytes();
+    totalBytes = totalBytes - tab->memoryBytes + bytes;
+    tab->memoryBytes = bytes;
+  }
+  for (Tab *tab : background) {
+    if (totalBytes <= memoryBudget)
+      return;
+    if (tab->viewer->Drop()) {
+      totalBytes -= tab->memoryBytes;
+      tab->memoryBytes = 0;
+    }
+  }
+}
+
+// File name part of 'file', pointing into it so that no frame allocates.
+static const char *TabTitle(const std::string &file) {
+  if (file.empty())
+    return "Untitled";
+  size_t slash = file.find_last_of("/\\");
+  return file.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+void XMLWorkspace::Render() {
+  if (ImGui::Button("New tab")) {
+    Open(std::string());
+  }
+  ImGui::SameLine();
+  ImGui::TextDisabled("%zu document(s), %.1f / %.1f MB", tabs.size(),
+                      totalBytes / (1024.0 * 1024.0),
+                      memoryBudget / (1024.0 * 1024.0));
+
+  if (!ImGui::BeginTabBar("Documents", ImGuiTabBarFlags_Reorderable |
+                                           ImGuiTabBarFlags_AutoSelectNewTabs |
+                                           ImGuiTabBarFlags_FittingPolicyScroll)) {
+    return;
+  }
+  size_t closedTab = tabs.size();
+  for (size_t i = 0; i < tabs.size(); ++i) {
+    Tab &tab = tabs[i];
+    const char *label = GetFrameArena().Format(
+        "%s%s###doc%u", TabTitle(tab.viewer->GetFilename()),
+        tab.viewer->IsDirty() ? " *" : "", tab.id);
+    bool isOpen = true;
+    // No close button while the viewer's load or save thread is running.
+    if (ImGui::BeginTabItem(label,
+                            tab.viewer->IsBusy() ? nullptr : &isOpen)) {
+      if (activeTab != tab.id) {
+        activeTab = tab.id;
+        isBudgetDirty = true;
+      }
+      tab.lastUsed = ++useClock;
+      ImGui::PushID(static_cast<int>(tab.id));
+      tab.viewer->Render();
+      ImGui::PopID();
+      ImGui::EndTabItem();
+    }
+    if (!isOpen)
+      closedTab = i;
+    // Re-measure once a load finished.
+    bool isDocumentOpen = tab.viewer->IsDocumentOpen();
+    if (isDocumentOpen && !tab.wasOpen)
+      isBudgetDirty = true;
+    tab.wasOpen = isDocumentOpen;
+  }
+  ImGui::EndTabBar();
+
+  if (closedTab < tabs.size()) {
+    if (tabs[closedTab].id == activeTab)
+      activeTab = kNoTab;
+    tabs.erase(tabs.begin() + closedTab);
+    isBudgetDirty = true;
+  }
+  if (isBudgetDirty) {
+    EnforceBudget();
+    isBudgetDirty = false;
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef __XML_WORKSPACE_H__
+#define __XML_WORKSPACE_H__
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "xml_viewer.h"
+
+// Several documents open at once, one XMLViewer per tab.
+//
+// Background tabs are kept within a memory budget, least recently used
+// first: a tab is first compacted to its symbol id form (switching back only
+// re-expands it, no parsing), and if that is not enough, unmodified
+// documents are dropped and reloaded from their file when selected again.
+class XMLWorkspace
+{
+public:
+	static constexpr size_t kDefaultMemoryBudget = size_t(512) << 20;
+
+	explicit XMLWorkspace(size_t memoryBudget = kDefaultMemoryBudget);
+	// Open a tab for 'file', or an empty one with a file selector.
+	void Open(const std::string& file);
+	void Render();
+	void SetMemoryBudget(size_t bytes);
+
+	// Used by the editor's scripted test mode (see main_ui_script.h).
+	// Block until every tab finished loading, false if any load failed.
+	bool WaitForLoading();
+	void SetExpandAll(bool expandAll);
+	// Save the selected tab as XML to 'file'.
+	bool SaveActive(const std::string& file);
+private:
+	struct Tab {
+		uint32_t id;
+		std::unique_ptr<XMLViewer> viewer;
+		uint64_t lastUsed = 0;
+		size_t memoryBytes = 0;
+		bool wasOpen = false;
+	};
+	static constexpr uint32_t kNoTab = UINT32_MAX;
+
+	std::vector<Tab> tabs;
+	uint32_t nextTabId = 0;
+	uint32_t activeTab = kNoTab;
+	uint64_t useClock = 0;
+	size_t memoryBudget;
+	size_t totalBytes = 0;
+	bool isBudgetDirty = false;
+	bool isExpandAll = false;
+
+	void EnforceBudget();
+};
+
+#endif